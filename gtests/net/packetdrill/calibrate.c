@@ -0,0 +1,297 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for calibrating timing tolerances to the host's
+ * measured timing noise.
+ */
+
+#include "calibrate.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+#include "config.h"
+#include "logging.h"
+#include "netdev.h"
+#include "packet_checksum.h"
+#include "run.h"
+#include "socket.h"
+#include "system.h"
+#include "tcp_packet.h"
+
+struct calibrator {
+	const struct config *config;
+	pthread_t thread;		/* measures sleep overshoot */
+	s64 sleep_usecs[CALIBRATE_SLEEP_PROBES];	/* overshoot samples */
+};
+
+/* The flow of the kernel's RSTs to our probes. */
+struct probe_flow {
+	struct ip_address local_ip;
+	__be16 local_port;
+	struct ip_address remote_ip;
+	__be16 remote_port;
+};
+
+static int compare_s64(const void *a, const void *b)
+{
+	const s64 x = *(const s64 *)a, y = *(const s64 *)b;
+
+	return (x < y) ? -1 : (x > y);
+}
+
+/* Sort the given samples and return the CALIBRATE_PERCENTILE one. */
+static s64 percentile(s64 *samples, int num_samples)
+{
+	int index = num_samples * CALIBRATE_PERCENTILE / 100;
+
+	qsort(samples, num_samples, sizeof(*samples), compare_s64);
+	if (index >= num_samples)
+		index = num_samples - 1;
+	return samples[index];
+}
+
+static void *calibrator_thread(void *arg)
+{
+	struct calibrator *calibrator = arg;
+	int i;
+
+	for (i = 0; i < CALIBRATE_SLEEP_PROBES; ++i) {
+		const s64 wake_usecs = now_usecs() + CALIBRATE_SLEEP_USECS;
+
+		wait_until_usecs(wake_usecs);
+		calibrator->sleep_usecs[i] = now_usecs() - wake_usecs;
+	}
+	return NULL;
+}
+
+struct calibrator *calibrator_start(const struct config *config)
+{
+	struct calibrator *calibrator = calloc(1, sizeof(*calibrator));
+	int err;
+
+	calibrator->config = config;
+	if ((err = create_thread(&calibrator->thread,
+				 calibrator_thread, calibrator)) != 0)
+		die_strerror("pthread_create", err);
+	return calibrator;
+}
+
+static bool is_probe_reply(void *arg, const struct packet_flow *flow)
+{
+	const struct probe_flow *probe = arg;
+
+	return (flow->protocol == IPPROTO_TCP) &&
+	       is_equal_ip(&flow->src_ip, &probe->local_ip) &&
+	       is_equal_port(flow->src_port, probe->local_port) &&
+	       is_equal_ip(&flow->dst_ip, &probe->remote_ip) &&
+	       is_equal_port(flow->dst_port, probe->remote_port);
+}
+
+/* Inject SYNs from the remote address to the local port scripts bind,
+ * which no socket can have bound yet, and time the RSTs that come
+ * back.
+ */
+static int measure_loopback(const struct config *config,
+			    struct netdev *netdev,
+			    struct calibration *calibration, char **error)
+{
+	s64 loopback_usecs[CALIBRATE_LOOPBACK_PROBES];
+	s64 sniff_delay_usecs[CALIBRATE_LOOPBACK_PROBES];
+	struct probe_flow probe;
+	const struct packet_filter filter = {
+		.match = is_probe_reply,
+		.arg = &probe,
+	};
+	struct packet *syn = NULL, *rst = NULL;
+	struct tuple tuple;
+	int i;
+
+	memset(&probe, 0, sizeof(probe));
+	probe.local_ip = config->live_local_ip;
+	probe.local_port = htons(config->live_bind_port);
+	probe.remote_ip = config->live_remote_ip;
+	probe.remote_port = htons(config->live_connect_port);
+
+	memset(&tuple, 0, sizeof(tuple));
+	tuple.src.ip = probe.remote_ip;
+	tuple.src.port = probe.remote_port;
+	tuple.dst.ip = probe.local_ip;
+	tuple.dst.port = probe.local_port;
+
+	for (i = 0; i < CALIBRATE_LOOPBACK_PROBES; ++i) {
+		s64 sent_usecs, read_usecs, sniffed_usecs;
+
+		syn = new_tcp_packet(config->wire_protocol, DIRECTION_INBOUND,
+				     ECN_NONE, "S", i, 0, 0, 65535, 0, NULL,
+				     false, false, false, false, 0, 0, error);
+		if (syn == NULL)
+			return STATUS_ERR;
+		set_packet_tuple(syn, &tuple, false);
+		checksum_packet(syn);
+
+		sent_usecs = now_usecs();
+		if (netdev_send(netdev, syn)) {
+			asprintf(error, "error injecting calibration probe");
+			packet_free(syn);
+			return STATUS_ERR;
+		}
+		packet_free(syn);
+		if (netdev_receive(netdev, 0, &filter, &rst, error))
+			return STATUS_ERR;
+		read_usecs = now_usecs();
+
+		/* Without a receive timestamp, all we know is when we
+		 * read the packet.
+		 */
+		sniffed_usecs = rst->time_usecs ? rst->time_usecs : read_usecs;
+		loopback_usecs[i] = sniffed_usecs - sent_usecs;
+		sniff_delay_usecs[i] = read_usecs - sniffed_usecs;
+		packet_free(rst);
+		rst = NULL;
+	}
+	calibration->loopback_usecs =
+		percentile(loopback_usecs, CALIBRATE_LOOPBACK_PROBES);
+	calibration->sniff_delay_usecs =
+		percentile(sniff_delay_usecs, CALIBRATE_LOOPBACK_PROBES);
+	return STATUS_OK;
+}
+
+/* The tolerance for events with the given noise, and no less than the
+ * given floor.
+ */
+static int noise_to_tolerance(const struct config *config, s64 noise_usecs,
+			      int min_tolerance_usecs)
+{
+	s64 tolerance_usecs = CALIBRATE_NOISE_MULTIPLIER * noise_usecs;
+
+	/* Perturbed runs delay inbound events on purpose. */
+	if (config->perturb)
+		tolerance_usecs += config->perturb_jitter_usecs;
+	if (tolerance_usecs < min_tolerance_usecs)
+		tolerance_usecs = min_tolerance_usecs;
+	return tolerance_usecs;
+}
+
+int calibrator_finish(struct calibrator *calibrator,
+		      struct netdev *netdev,
+		      struct calibration *calibration, char **error)
+{
+	const struct config *config = calibrator->config;
+	s64 overshoot_usecs;
+	int result = STATUS_ERR;
+	int err, i;
+
+	if ((err = pthread_join(calibrator->thread, NULL)) != 0)
+		die_strerror("pthread_join", err);
+
+	memset(calibration, 0, sizeof(*calibration));
+	overshoot_usecs = percentile(calibrator->sleep_usecs,
+				     CALIBRATE_SLEEP_PROBES);
+	calibration->sleep_overshoot_usecs = overshoot_usecs;
+	if (measure_loopback(config, netdev, calibration, error))
+		goto out;
+
+	/* Every event may start late. An outbound packet is also late
+	 * by however long the kernel's reply takes to reach our sniffer.
+	 * Our probes cannot see the jiffies of the kernel timers that
+	 * send packets and wake blocked calls, so those keep at least
+	 * --tolerance_usecs.
+	 */
+	calibration->tolerance_usecs[TIMING_INBOUND] =
+		noise_to_tolerance(config, overshoot_usecs,
+				   CALIBRATE_MIN_TOLERANCE_USECS);
+	calibration->tolerance_usecs[TIMING_OUTBOUND] =
+		noise_to_tolerance(config, overshoot_usecs +
+				   calibration->loopback_usecs +
+				   calibration->sniff_delay_usecs,
+				   config->tolerance_usecs);
+	calibration->tolerance_usecs[TIMING_SYSCALL] =
+		noise_to_tolerance(config, overshoot_usecs,
+				   config->tolerance_usecs);
+	calibration->tolerance_usecs[TIMING_OTHER] =
+		noise_to_tolerance(config, overshoot_usecs,
+				   CALIBRATE_MIN_TOLERANCE_USECS);
+	for (i = 0; i < NUM_TIMING_CLASSES; ++i) {
+		if (calibration->tolerance_usecs[i] > config->tolerance_usecs)
+			calibration->too_noisy = true;
+	}
+	result = STATUS_OK;
+
+out:
+	memset(calibrator, 0, sizeof(*calibrator));  /* paranoia */
+	free(calibrator);
+	return result;
+}
+
+const char *timing_class_name(enum timing_class timing)
+{
+	switch (timing) {
+	case TIMING_INBOUND:	return "inbound";
+	case TIMING_OUTBOUND:	return "outbound";
+	case TIMING_SYSCALL:	return "syscall";
+	case TIMING_OTHER:	return "other";
+	case NUM_TIMING_CLASSES:
+		break;
+	/* omitting default so compiler catches missing cases */
+	}
+	assert(!"bad timing class");
+	return NULL;
+}
+
+char *calibration_to_string(const struct calibration *calibration)
+{
+	char *string = NULL;
+
+	asprintf(&string,
+		 "sleep overshoot %lld usecs, loopback %lld usecs, "
+		 "sniff delay %lld usecs; tolerance usecs: "
+		 "inbound %d, outbound %d, syscall %d, other %d",
+		 calibration->sleep_overshoot_usecs,
+		 calibration->loopback_usecs,
+		 calibration->sniff_delay_usecs,
+		 calibration->tolerance_usecs[TIMING_INBOUND],
+		 calibration->tolerance_usecs[TIMING_OUTBOUND],
+		 calibration->tolerance_usecs[TIMING_SYSCALL],
+		 calibration->tolerance_usecs[TIMING_OTHER]);
+	return string;
+}
+
+char *calibration_noise_error(const struct calibration *calibration,
+			      const struct config *config)
+{
+	char *error = NULL;
+	int i;
+
+	for (i = 0; i < NUM_TIMING_CLASSES; ++i) {
+		if (calibration->tolerance_usecs[i] <=
+		    config->tolerance_usecs)
+			continue;
+		asprintf(&error,
+			 "host timing noise needs a tolerance of %d usecs "
+			 "for %s events, over --tolerance_usecs=%d",
+			 calibration->tolerance_usecs[i],
+			 timing_class_name(i), config->tolerance_usecs);
+		return error;
+	}
+	return NULL;
+}
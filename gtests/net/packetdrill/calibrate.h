@@ -0,0 +1,116 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Interface for calibrating timing tolerances to the host's measured
+ * timing noise, for --calibrate.
+ *
+ * A single --tolerance_usecs is too loose to catch regressions on a
+ * quiet machine and too tight for a busy CI machine. So before a script
+ * runs we measure how late we wake up for an event, using the same
+ * sleep-then-spin wait that events use, on a thread of its own while
+ * the test device is being set up. Then, once the device is up, we
+ * inject TCP SYNs for a closed port and time the kernel's RSTs: how
+ * long a reply takes to come back out of the device, and how long the
+ * sniffed packet waits between its receive timestamp and our read.
+ *
+ * From these we derive a tolerance for each kind of timed event, which
+ * replaces --tolerance_usecs for the run, unless the script sets its own
+ * tolerance_usecs in its options, and goes in the --results record. A
+ * host whose noise needs more than --tolerance_usecs for any kind of
+ * event is flagged, since scripts written for that tolerance may flake
+ * there; with --calibrate_strict the script fails instead.
+ */
+
+#ifndef __CALIBRATE_H__
+#define __CALIBRATE_H__
+
+#include "types.h"
+
+/* How many times we measure each kind of noise. */
+#define CALIBRATE_SLEEP_PROBES		100
+#define CALIBRATE_LOOPBACK_PROBES	32
+
+/* How long each sleep probe sleeps. */
+#define CALIBRATE_SLEEP_USECS		500
+
+/* Which percentile of the samples we take as the noise. */
+#define CALIBRATE_PERCENTILE		99
+
+/* A tolerance is this many times the noise of its kind of event... */
+#define CALIBRATE_NOISE_MULTIPLIER	2
+
+/* ...but no less than this. Outbound packets and blocking system calls
+ * are also timed by kernel timers, which tick in jiffies of up to 10ms
+ * on HZ=100 kernels, so for those the floor is --tolerance_usecs itself.
+ */
+#define CALIBRATE_MIN_TOLERANCE_USECS	1000
+
+struct config;
+struct netdev;
+
+/* The kinds of timed events, each with a tolerance of its own. */
+enum timing_class {
+	TIMING_INBOUND,		/* injecting an inbound packet */
+	TIMING_OUTBOUND,	/* the kernel sending an outbound packet */
+	TIMING_SYSCALL,		/* starting and returning from system calls */
+	TIMING_OTHER,		/* commands, code, and sysctls */
+	NUM_TIMING_CLASSES,
+};
+
+/* What we measured, and the tolerances we derived from it. */
+struct calibration {
+	s64 sleep_overshoot_usecs;	/* lateness waking up for an event */
+	s64 loopback_usecs;		/* SYN injected to RST sniffed */
+	s64 sniff_delay_usecs;		/* RST timestamped to RST read */
+	int tolerance_usecs[NUM_TIMING_CLASSES];	/* derived tolerances */
+	bool too_noisy;			/* any over --tolerance_usecs? */
+};
+
+struct calibrator;
+
+/* Start measuring sleep overshoot on a thread of our own, so that it
+ * runs while the caller sets up the test device.
+ */
+extern struct calibrator *calibrator_start(const struct config *config);
+
+/* Wait for the sleep measurements, measure the loopback through the
+ * given device, fill in the calibration, and free the calibrator. On
+ * success, returns STATUS_OK. On error returns STATUS_ERR and fills in
+ * *error.
+ */
+extern int calibrator_finish(struct calibrator *calibrator,
+			     struct netdev *netdev,
+			     struct calibration *calibration, char **error);
+
+/* Return a human-readable name for the given kind of event. */
+extern const char *timing_class_name(enum timing_class timing);
+
+/* Return the tolerances of the calibration as a malloc-ed
+ * human-readable string.
+ */
+extern char *calibration_to_string(const struct calibration *calibration);
+
+/* Describe the first kind of event whose tolerance exceeds what the
+ * config allows, in a malloc-ed string, or return NULL if the host is
+ * quiet enough.
+ */
+extern char *calibration_noise_error(const struct calibration *calibration,
+				     const struct config *config);
+
+#endif /* __CALIBRATE_H__ */
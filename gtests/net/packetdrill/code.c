@@ -37,6 +37,8 @@
 #include <unistd.h>
 #include "assert.h"
 #include "run.h"
+#include "socket_diag.h"
+#include "system.h"
 #include "tcp.h"
 
 /* We emit the following Python preamble at the top of the output
@@ -88,7 +90,8 @@ static void emit_var(struct code_state *code, const char *name, u64 value)
 	case FORMAT_NUM_TYPES:
 		assert(!"bad code format type");
 	case FORMAT_PYTHON:
-		fprintf(code->file, "%s = %llu\n", name, value);
+		fprintf(code->file, "%s%s%s = %llu\n",
+			code->var_prefix, name, code->var_suffix, value);
 		break;
 	/* omitting default so compiler catches missing cases */
 	}
@@ -176,16 +179,10 @@ static void write_symbols(struct code_state *code)
 
 #ifdef linux
 
-/* Write out a formatted representation of the given tcp_info buffer. */
-static void write_tcp_info(struct code_state *code,
-				   const struct _tcp_info *info,
-				   int len)
+/* Emit the recorded values of tcpi_foo values. */
+static void emit_tcp_info(struct code_state *code,
+			  const struct _tcp_info *info)
 {
-	assert(len >= sizeof(struct _tcp_info));
-
-	write_symbols(code);
-
-	/* Emit the recorded values of tcpi_foo values. */
 	emit_var(code, "tcpi_state",		info->tcpi_state);
 	emit_var(code, "tcpi_ca_state",		info->tcpi_ca_state);
 	emit_var(code, "tcpi_retransmits",	info->tcpi_retransmits);
@@ -219,12 +216,125 @@ static void write_tcp_info(struct code_state *code,
 
 	emit_var(code, "tcpi_rcv_rtt",		info->tcpi_rcv_rtt);
 	emit_var(code, "tcpi_rcv_space",	info->tcpi_rcv_space);
+}
 
+/* Write out a formatted representation of the given tcp_info buffer. */
+static void write_tcp_info(struct code_state *code,
+				   const struct _tcp_info *info,
+				   int len)
+{
+	assert(len >= sizeof(struct _tcp_info));
+
+	write_symbols(code);
+	emit_tcp_info(code, info);
 	emit_var_end(code);
 }
 
 #endif  /* linux */
 
+#if HAVE_SOCK_DIAG
+
+/* Emit the SK_MEMINFO_* values of a socket as skmem_foo values. */
+static void emit_sk_meminfo(struct code_state *code, const u32 *meminfo)
+{
+	char *name = NULL;
+	int i;
+
+	for (i = 0; i < SK_MEMINFO_VARS; ++i) {
+		asprintf(&name, "skmem_%s", sk_meminfo_names[i]);
+		emit_var(code, name, meminfo[i]);
+		free(name);
+	}
+}
+
+/* Write out the SO_MEMINFO values of the socket under test, which we
+ * grab alongside its tcp_info.
+ */
+static void write_so_meminfo(struct code_state *code, const u32 *meminfo,
+			     int len)
+{
+	assert(len == SK_MEMINFO_VARS * sizeof(u32));
+
+	emit_sk_meminfo(code, meminfo);
+	emit_var_end(code);
+}
+
+/* Write out a formatted representation of the given sock_diag entry as
+ * a Python dict of the socket's fields.
+ */
+static void write_sock_diag_entry(struct code_state *code,
+				  const struct sock_diag_entry *entry)
+{
+	char *prefix = NULL;
+
+	asprintf(&prefix, "sockets[%d]['", entry->script_fd);
+	fprintf(code->file, "sockets[%d] = {}\n", entry->script_fd);
+	code->var_prefix = prefix;
+	code->var_suffix = "']";
+
+	emit_var(code, "state",			entry->state);
+	emit_var(code, "rqueue",		entry->rqueue);
+	emit_var(code, "wqueue",		entry->wqueue);
+	if (entry->has_info)
+		emit_tcp_info(code, &entry->info);
+	if (entry->has_meminfo)
+		emit_sk_meminfo(code, entry->meminfo);
+	if (entry->has_dctcp) {
+		emit_var(code, "dctcp_enabled",	entry->dctcp.dctcp_enabled);
+		emit_var(code, "dctcp_ce_state", entry->dctcp.dctcp_ce_state);
+		emit_var(code, "dctcp_alpha",	entry->dctcp.dctcp_alpha);
+		emit_var(code, "dctcp_ab_ecn",	entry->dctcp.dctcp_ab_ecn);
+		emit_var(code, "dctcp_ab_tot",	entry->dctcp.dctcp_ab_tot);
+	}
+	if (entry->has_bbr) {
+		emit_var(code, "bbr_bw",
+			 ((u64)entry->bbr.bbr_bw_hi << 32) |
+			 entry->bbr.bbr_bw_lo);
+		emit_var(code, "bbr_min_rtt",	entry->bbr.bbr_min_rtt);
+		emit_var(code, "bbr_pacing_gain", entry->bbr.bbr_pacing_gain);
+		emit_var(code, "bbr_cwnd_gain",	entry->bbr.bbr_cwnd_gain);
+	}
+	/* The kernel reports the name as a plain identifier. */
+	fprintf(code->file, "%scong%s = '%s'\n",
+		prefix, code->var_suffix, entry->cong);
+
+	code->var_prefix = "";
+	code->var_suffix = "";
+	free(prefix);
+}
+
+/* Write out a formatted representation of a sock_diag snapshot: the
+ * usual tcpi_foo and skmem_foo values for the socket under test, if
+ * any, plus a "sockets" dict mapping each script fd to a dict of its
+ * fields.
+ */
+static void write_sock_diag(struct code_state *code,
+			    const struct sock_diag_entry *entries,
+			    int len)
+{
+	const int num_entries = len / sizeof(struct sock_diag_entry);
+	int i;
+
+	write_symbols(code);
+
+	for (i = 0; i < num_entries; ++i) {
+		if (!entries[i].is_socket_under_test)
+			continue;
+		if (entries[i].has_info)
+			emit_tcp_info(code, &entries[i].info);
+		if (entries[i].has_meminfo)
+			emit_sk_meminfo(code, entries[i].meminfo);
+	}
+
+	fprintf(code->file, "sockets = {}\n");
+	for (i = 0; i < num_entries; ++i)
+		write_sock_diag_entry(code, &entries[i]);
+
+	emit_var_end(code);
+}
+
+#endif  /* HAVE_SOCK_DIAG */
+
 #if defined(__FreeBSD__)
 
 /* Write out a formatted representation of the given tcp_info buffer. */
@@ -464,6 +574,14 @@ static void write_data(struct code_state *code, struct code_data *data)
 		write_tcp_info(code, data->buffer, data->len);
 		break;
 #endif  /* HAVE_TCP_INFO */
+#if HAVE_SOCK_DIAG
+	case DATA_SOCK_DIAG:
+		write_sock_diag(code, data->buffer, data->len);
+		break;
+	case DATA_SO_MEMINFO:
+		write_so_meminfo(code, data->buffer, data->len);
+		break;
+#endif  /* HAVE_SOCK_DIAG */
 	/* omitting default so compiler catches missing cases */
 	}
 }
@@ -561,6 +679,10 @@ struct code_state *code_new(struct config *config)
 #if HAVE_TCP_INFO
 	} else if (strcmp(config->code_sockopt, "TCP_INFO") == 0) {
 		code->data_type = DATA_TCP_INFO;
+#endif
+#if HAVE_SOCK_DIAG
+	} else if (strcmp(config->code_sockopt, "SOCK_DIAG") == 0) {
+		code->data_type = DATA_SOCK_DIAG;
 #endif
 	} else {
 		die("unsupported --code_sockopt '%s'\n", config->code_sockopt);
@@ -568,6 +690,9 @@ struct code_state *code_new(struct config *config)
 
 	code->command_line = strdup(config->code_command_line);
 	code->verbose = config->verbose;
+	code->var_prefix = "";
+	code->var_suffix = "";
+	code->sock_diag_fd = -1;
 
 	return code;
 }
@@ -578,6 +703,8 @@ void code_free(struct code_state *code)
 		free(code->command_line);
 	if (code->path != NULL)
 		free(code->path);
+	if (code->sock_diag_fd >= 0)
+		close(code->sock_diag_fd);
 
 	/* Free all the code fragments. */
 	struct code_fragment *fragment = code->list_head;
@@ -635,14 +762,15 @@ static int execute_code_command_line(struct code_state *code, char **error)
 	if (code->verbose) {
 		char *verbose_command_line = NULL;
 		asprintf(&verbose_command_line, "cat %s", code->path);
-		system(verbose_command_line);
+		spawn_system(verbose_command_line);
 		free(verbose_command_line);
 		printf("running: '%s'\n", full_command_line);
 	}
 
-	int status = system(full_command_line);
+	int status = spawn_system(full_command_line);
 	if (status == -1) {
-		asprintf(error, "error running '%s' with system(3): %s",
+		asprintf(error, "error running '%s': posix_spawn(3) or "
+			 "waitpid(2) failed: %s",
 			 code->command_line, strerror(errno));
 		goto out;
 	}
@@ -712,6 +840,12 @@ static void *get_data(int fd, enum code_data_t data_type, int *len)
 		min_data_len = data_len;
 		break;
 #endif  /* HAVE_TCP_INFO */
+#if HAVE_SOCK_DIAG
+	case DATA_SOCK_DIAG:
+	case DATA_SO_MEMINFO:
+		assert(!"sock_diag data does not come from getsockopt");
+		break;
+#endif  /* HAVE_SOCK_DIAG */
 	/* omitting default so compiler catches missing cases */
 	}
 	assert(opt_name != 0);
@@ -733,6 +867,65 @@ static void *get_data(int fd, enum code_data_t data_type, int *len)
 	return data;
 }
 
+#if HAVE_SOCK_DIAG
+
+/* Take a sock_diag snapshot of all the sockets of the test with one
+ * netlink dump and stash it for the code. On success, returns
+ * STATUS_OK; on error returns STATUS_ERR and fills in *error.
+ */
+static int get_sock_diag_data(struct state *state, char **error)
+{
+	struct code_state *code = state->code;
+	struct sock_diag_entry *entries = NULL;
+	int num_entries = 0;
+
+	if (code->sock_diag_fd < 0) {
+		code->sock_diag_fd = socket(AF_NETLINK, SOCK_DGRAM,
+					    NETLINK_SOCK_DIAG);
+		if (code->sock_diag_fd < 0) {
+			asprintf(error, "can't open sock_diag socket: %s",
+				 strerror(errno));
+			return STATUS_ERR;
+		}
+	}
+	if (sock_diag_snapshot(code->sock_diag_fd, &code->sock_diag_seq,
+			       state->sockets,
+			       state->socket_under_test,
+			       &entries, &num_entries, error))
+		return STATUS_ERR;
+
+	if (state->recording != NULL) {
+		record_code_data(state->recording, DATA_SOCK_DIAG, entries,
+				 num_entries * sizeof(struct sock_diag_entry));
+	}
+	append_data(code, DATA_SOCK_DIAG, entries,
+		    num_entries * sizeof(struct sock_diag_entry));
+	return STATUS_OK;
+}
+
+/* Stash the SO_MEMINFO values of the socket under test for the code,
+ * if the kernel supports SO_MEMINFO (Linux 4.6 and later).
+ */
+static void get_so_meminfo_data(struct state *state, int fd)
+{
+	const int len = SK_MEMINFO_VARS * sizeof(u32);
+	u32 *meminfo = malloc(len);
+	char *error = NULL;
+
+	if (sk_meminfo_get(fd, meminfo, &error)) {
+		DEBUGP("no skmem for code: %s\n", error);
+		free(error);
+		free(meminfo);
+		return;
+	}
+	if (state->recording != NULL)
+		record_code_data(state->recording, DATA_SO_MEMINFO,
+				 meminfo, len);
+	append_data(state->code, DATA_SO_MEMINFO, meminfo, len);
+}
+
+#endif  /* HAVE_SOCK_DIAG */
+
 void run_code_event(struct state *state, struct event *event,
 			    const char *text)
 {
@@ -743,12 +936,48 @@ void run_code_event(struct state *state, struct event *event,
 	/* Wait for the right time before firing off this event. */
 	wait_for_event(state);
 
+	struct code_state *code = state->code;
+
+	if (is_reverifying(state)) {
+		int recorded_type = DATA_NONE, recorded_len = 0;
+		void *recorded_data = NULL;
+
+		if (replay_code_data(state->recording, &recorded_type,
+				     &recorded_data, &recorded_len, &error))
+			goto error_out;
+		code->data_type = recorded_type;
+		append_data(code, code->data_type, recorded_data, recorded_len);
+#if HAVE_SOCK_DIAG
+		if (recording_next_code_data_type(state->recording) ==
+		    DATA_SO_MEMINFO) {
+			if (replay_code_data(state->recording, &recorded_type,
+					     &recorded_data, &recorded_len,
+					     &error))
+				goto error_out;
+			append_data(code, DATA_SO_MEMINFO, recorded_data,
+				    recorded_len);
+		}
+#endif  /* HAVE_SOCK_DIAG */
+		append_text(code, state->config->script_path,
+			    event->line_number, strdup(text));
+		return;
+	}
+
+#if HAVE_SOCK_DIAG
+	if (code->data_type == DATA_SOCK_DIAG) {
+		if (get_sock_diag_data(state, &error))
+			goto error_out;
+		append_text(code, state->config->script_path,
+			    event->line_number, strdup(text));
+		return;
+	}
+#endif  /* HAVE_SOCK_DIAG */
+
 	if (state->socket_under_test == NULL) {
 		asprintf(&error, "no socket to use for code");
 		goto error_out;
 	}
 	int fd = state->socket_under_test->live.fd;
-	struct code_state *code = state->code;
 
 	void *data = NULL;
 	int  data_len = 0;
@@ -776,7 +1005,13 @@ void run_code_event(struct state *state, struct event *event,
 	assert(code->data_type != DATA_NONE);
 	assert(data != NULL);
 
+	if (state->recording != NULL)
+		record_code_data(state->recording, code->data_type,
+				 data, data_len);
 	append_data(code, code->data_type, data, data_len);
+#if HAVE_SOCK_DIAG
+	get_so_meminfo_data(state, fd);
+#endif  /* HAVE_SOCK_DIAG */
 	append_text(code, state->config->script_path, event->line_number,
 		    strdup(text));
 
@@ -52,6 +52,10 @@ enum code_data_t {
 #if HAVE_TCP_INFO
 	DATA_TCP_INFO,			/* binary tcp_info */
 #endif  /* HAVE_TCP_INFO */
+#if HAVE_SOCK_DIAG
+	DATA_SOCK_DIAG,			/* array of struct sock_diag_entry */
+	DATA_SO_MEMINFO,		/* SK_MEMINFO_* values from SO_MEMINFO */
+#endif  /* HAVE_SOCK_DIAG */
 	DATA_NUM_TYPES,			/* number of types of fragments */
 };
 
@@ -87,6 +91,10 @@ struct code_state {
 	char *command_line;			/* system(3) command to run */
 	char *path;				/* path where we write code */
 	FILE *file;				/* output file we're writing */
+	const char *var_prefix;			/* emitted before var names */
+	const char *var_suffix;			/* emitted after var names */
+	int sock_diag_fd;			/* NETLINK_SOCK_DIAG socket */
+	u32 sock_diag_seq;			/* last request seq on it */
 	struct code_fragment *list_head;	/* linked list head */
 	struct code_fragment **list_tail;	/* pointer to tail */
 };
@@ -97,10 +105,11 @@ extern struct code_state *code_new(struct config *config);
 /* Tear down a code executor and free up the resources it has allocated. */
 extern void code_free(struct code_state *code);
 
-/* Run the TCP_INFO getsockopt on the current socket under test to
- * get a snapshot of socket state, and stash the resulting data and
- * code snippet so that at the end of the test we can emit the data
- * and the code snippet, and then execute both.
+/* Run the TCP_INFO getsockopt on the current socket under test (or,
+ * with --code_sockopt=SOCK_DIAG, a sock_diag dump of all the sockets of
+ * the test) to get a snapshot of socket state, and stash the resulting
+ * data and code snippet so that at the end of the test we can emit the
+ * data and the code snippet, and then execute both.
  */
 struct state;
 extern void run_code_event(struct state *state,
@@ -47,19 +47,48 @@ enum option_codes {
 	OPT_NETMASK_IP,
 	OPT_SPEED,
 	OPT_MTU,
+	OPT_REMOTE_TUPLES,
+	OPT_ECN_MARKING,
+	OPT_ECN_DRAIN_USECS,
+	OPT_REASSEMBLY_DATAGRAMS,
+	OPT_REASSEMBLY_TIMEOUT_USECS,
 	OPT_INIT_SCRIPTS,
 	OPT_TOLERANCE_USECS,
+	OPT_CALIBRATE,
+	OPT_CALIBRATE_STRICT,
 	OPT_WIRE_CLIENT,
 	OPT_WIRE_SERVER,
 	OPT_WIRE_SERVER_IP,
 	OPT_WIRE_SERVER_PORT,
 	OPT_WIRE_CLIENT_DEV,
 	OPT_WIRE_SERVER_DEV,
+	OPT_VETH,
+	OPT_VETH_FEATURES,
 	OPT_TCP_TS_TICK_USECS,
 	OPT_NON_FATAL,
 	OPT_DRY_RUN,
+	OPT_PARALLEL,
+	OPT_SWEEP,
+	OPT_PERTURB,
+	OPT_PERTURB_SEED,
+	OPT_PERTURB_SEEDS,
+	OPT_PERF_COUNTERS,
+	OPT_KERNEL_TRACE,
+	OPT_KERNEL_TRACE_FILE,
+	OPT_SKMEM_TRACE,
+	OPT_RECORD,
+	OPT_REVERIFY,
+	OPT_LEARN,
+	OPT_RESULTS,
+	OPT_JUNIT,
+	OPT_WIRE_SESSION,
 	OPT_DEBUG,
 	OPT_UDP_ENCAPS,
+#ifdef linux
+	OPT_TUN_NAPI,
+	OPT_TUN_CAPTURE,
+	OPT_TUN_CAPTURE_COMPARE,
+#endif
 #if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
 	OPT_TUN_DEV,
 	OPT_PERSISTENT_TUN_DEV,
@@ -83,21 +112,53 @@ struct option options[] = {
 	{ "netmask_ip",		.has_arg = true,  NULL, OPT_NETMASK_IP },
 	{ "speed",		.has_arg = true,  NULL, OPT_SPEED },
 	{ "mtu",		.has_arg = true,  NULL, OPT_MTU },
+	{ "remote_tuples",	.has_arg = true,  NULL, OPT_REMOTE_TUPLES },
+	{ "ecn_marking",	.has_arg = true,  NULL, OPT_ECN_MARKING },
+	{ "ecn_drain_usecs",	.has_arg = true,  NULL, OPT_ECN_DRAIN_USECS },
+	{ "reassembly_datagrams", .has_arg = true, NULL,
+	  OPT_REASSEMBLY_DATAGRAMS },
+	{ "reassembly_timeout_usecs", .has_arg = true, NULL,
+	  OPT_REASSEMBLY_TIMEOUT_USECS },
 	{ "init_scripts",	.has_arg = true,  NULL, OPT_INIT_SCRIPTS },
 	{ "tolerance_usecs",	.has_arg = true,  NULL, OPT_TOLERANCE_USECS },
+	{ "calibrate",		.has_arg = false, NULL, OPT_CALIBRATE },
+	{ "calibrate_strict",	.has_arg = false, NULL, OPT_CALIBRATE_STRICT },
 	{ "wire_client",	.has_arg = false, NULL, OPT_WIRE_CLIENT },
 	{ "wire_server",	.has_arg = false, NULL, OPT_WIRE_SERVER },
 	{ "wire_server_ip",	.has_arg = true,  NULL, OPT_WIRE_SERVER_IP },
 	{ "wire_server_port",	.has_arg = true,  NULL, OPT_WIRE_SERVER_PORT },
 	{ "wire_client_dev",	.has_arg = true,  NULL, OPT_WIRE_CLIENT_DEV },
 	{ "wire_server_dev",	.has_arg = true,  NULL, OPT_WIRE_SERVER_DEV },
+	{ "wire_session",	.has_arg = false, NULL, OPT_WIRE_SESSION },
+	{ "veth",		.has_arg = false, NULL, OPT_VETH },
+	{ "veth_features",	.has_arg = true,  NULL, OPT_VETH_FEATURES },
 	{ "tcp_ts_tick_usecs",	.has_arg = true,  NULL, OPT_TCP_TS_TICK_USECS },
 	{ "non_fatal",		.has_arg = true,  NULL, OPT_NON_FATAL },
 	{ "dry_run",		.has_arg = false, NULL, OPT_DRY_RUN },
+	{ "parallel",		.has_arg = true,  NULL, OPT_PARALLEL },
+	{ "sweep",		.has_arg = true,  NULL, OPT_SWEEP },
+	{ "perturb",		.has_arg = true,  NULL, OPT_PERTURB },
+	{ "perturb_seed",	.has_arg = true,  NULL, OPT_PERTURB_SEED },
+	{ "perturb_seeds",	.has_arg = true,  NULL, OPT_PERTURB_SEEDS },
+	{ "perf_counters",	.has_arg = false, NULL, OPT_PERF_COUNTERS },
+	{ "kernel_trace",	.has_arg = true,  NULL, OPT_KERNEL_TRACE },
+	{ "kernel_trace_file",	.has_arg = true,  NULL, OPT_KERNEL_TRACE_FILE },
+	{ "skmem_trace",	.has_arg = false, NULL, OPT_SKMEM_TRACE },
+	{ "record",		.has_arg = true,  NULL, OPT_RECORD },
+	{ "reverify",		.has_arg = true,  NULL, OPT_REVERIFY },
+	{ "learn",		.has_arg = true,  NULL, OPT_LEARN },
+	{ "results",		.has_arg = true,  NULL, OPT_RESULTS },
+	{ "junit",		.has_arg = true,  NULL, OPT_JUNIT },
 	{ "define",		.has_arg = true,  NULL, OPT_DEFINE },
 	{ "verbose",		.has_arg = false, NULL, OPT_VERBOSE },
 	{ "debug",		.has_arg = false, NULL, OPT_DEBUG },
 	{ "udp_encapsulation",	.has_arg = true,  NULL, OPT_UDP_ENCAPS },
+#ifdef linux
+	{ "tun_napi",		.has_arg = false, NULL, OPT_TUN_NAPI },
+	{ "tun_capture",	.has_arg = false, NULL, OPT_TUN_CAPTURE },
+	{ "tun_capture_compare", .has_arg = false, NULL,
+	  OPT_TUN_CAPTURE_COMPARE },
+#endif
 #if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
 	{ "tun_dev",		.has_arg = true,  NULL, OPT_TUN_DEV },
 	{ "persistent_tun_dev",	.has_arg = false, NULL, OPT_PERSISTENT_TUN_DEV },
@@ -113,7 +174,7 @@ void show_usage(void)
 		"\t[--bind_port=bind_port]\n"
 		"\t[--code_command=code_command]\n"
 		"\t[--code_format=code_format]\n"
-		"\t[--code_sockopt=TCP_INFO]\n"
+		"\t[--code_sockopt=[TCP_INFO,SOCK_DIAG]]\n"
 		"\t[--connect_port=connect_port]\n"
 		"\t[--remote_ip=remote_ip]\n"
 		"\t[--local_ip=local_ip]\n"
@@ -122,7 +183,14 @@ void show_usage(void)
 		"\t[--init_scripts=<comma separated filenames>]\n"
 		"\t[--speed=<speed in Mbps>]\n"
 		"\t[--mtu=<MTU in bytes>]\n"
+		"\t[--remote_tuples=<number of remote address/port tuples>]\n"
+		"\t[--ecn_marking=[step:<packets>,ramp:<min>:<max>]]\n"
+		"\t[--ecn_drain_usecs=<microseconds to serve one packet>]\n"
+		"\t[--reassembly_datagrams=<max datagrams being reassembled>]\n"
+		"\t[--reassembly_timeout_usecs=<microseconds to reassemble>]\n"
 		"\t[--tolerance_usecs=tolerance_usecs]\n"
+		"\t[--calibrate]\n"
+		"\t[--calibrate_strict]\n"
 		"\t[--tcp_ts_tick_usecs=<microseconds per TCP TS val tick>]\n"
 		"\t[--non_fatal=<comma separated types: packet,syscall>]\n"
 		"\t[--wire_client]\n"
@@ -131,11 +199,35 @@ void show_usage(void)
 		"\t[--wire_server_port=<server_port>]\n"
 		"\t[--wire_client_dev=<eth_dev_name>]\n"
 		"\t[--wire_server_dev=<eth_dev_name>]\n"
+		"\t[--wire_session]\n"
+		"\t[--veth]\n"
+		"\t[--veth_features=<comma separated: gro,xdp,threaded_napi>]\n"
 		"\t[--dry_run]\n"
+		"\t[--parallel=<scripts to run at once>]\n"
+		"\t[--sweep symbol1=val1,val2,... --sweep symbol2=... ...]\n"
+		"\t[--perturb=<comma separated jitter=<usecs>,drop=<percent>,\n"
+		"\t            dup=<percent>,reorder=<percent>,"
+		"timeout=<secs>>]\n"
+		"\t[--perturb_seed=<seed, default 1>]\n"
+		"\t[--perturb_seeds=<seeds to run, from perturb_seed on>]\n"
+		"\t[--perf_counters]\n"
+		"\t[--kernel_trace=[default,<comma separated system:event>]]\n"
+		"\t[--kernel_trace_file=<file for the kernel trace>]\n"
+		"\t[--skmem_trace]\n"
+		"\t[--record=<file to record the live run in>]\n"
+		"\t[--reverify=<recording to check the script against>]\n"
+		"\t[--learn=<file for the script with the packets sent>]\n"
+		"\t[--results=<JSON lines file to append results to>]\n"
+		"\t[--junit=<JUnit XML file to render the results as>]\n"
 		"\t[--define symbol1=val1 --define symbol2=val2 ...]\n"
 		"\t[--verbose|-v]\n"
 		"\t[--debug] * requires compilation with DEBUG *\n"
 		"\t[--udp_encapsulation=[sctp,tcp]]\n"
+#ifdef linux
+		"\t[--tun_napi]\n"
+		"\t[--tun_capture]\n"
+		"\t[--tun_capture_compare]\n"
+#endif
 #if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
 		"\t[--tun_dev=<tun_dev_name>]\n"
 		"\t[--persistent_tun_dev]\n"
@@ -227,6 +319,9 @@ void set_default_config(struct config *config)
 	config->tolerance_usecs		= 4000;
 	config->speed			= TUN_DRIVER_SPEED_CUR;
 	config->mtu			= TUN_DRIVER_DEFAULT_MTU;
+	config->remote_tuples		= 1;
+	config->reassembly_datagrams	= 16;
+	config->reassembly_timeout_usecs = 1000000;
 
 	/* For now, by default we disable checks of outbound TS val
 	 * values, since there are timestamp val bugs in the tests and
@@ -243,6 +338,12 @@ void set_default_config(struct config *config)
 
 	config->init_scripts = NULL;
 
+	config->parallel = 1;
+
+	config->perturb_seed = 1;
+	config->perturb_seeds = 1;
+	config->perturb_timeout_secs = 60;
+
 	config->wire_server_port	= 8081;
 #ifdef linux
 	config->wire_client_device	= "eth0";
@@ -374,6 +475,125 @@ void finalize_config(struct config *config)
 			die("wire_server_ip not specified\n");
 		}
 	}
+	if (config->wire_session &&
+	    !config->is_wire_client && !config->is_wire_server) {
+		die("--wire_session requires --wire_client\n");
+	}
+	if ((config->ecn_marking.type != ECN_MARKING_NONE) &&
+	    (config->ecn_marking.drain_usecs == 0)) {
+		die("--ecn_marking requires --ecn_drain_usecs\n");
+	}
+	if (config->parallel > 1) {
+#ifdef linux
+		if (config->is_wire_client || config->is_wire_server)
+			die("--parallel is only supported in local mode\n");
+#else
+		die("--parallel requires Linux network namespaces\n");
+#endif
+	}
+#ifndef linux
+	if (config->perf_counters)
+		die("--perf_counters requires Linux\n");
+	if (config->kernel_trace != NULL)
+		die("--kernel_trace requires Linux\n");
+#endif
+	if ((config->kernel_trace_file != NULL) &&
+	    (config->kernel_trace == NULL)) {
+		die("--kernel_trace_file requires --kernel_trace\n");
+	}
+	if (config->skmem_trace && (config->kernel_trace == NULL))
+		die("--skmem_trace requires --kernel_trace\n");
+	/* Tracepoints see every network namespace at once. */
+	if ((config->kernel_trace != NULL) && (config->parallel > 1))
+		die("--kernel_trace cannot be used with --parallel\n");
+	if ((config->record_path != NULL) || (config->reverify_path != NULL)) {
+		if ((config->record_path != NULL) &&
+		    (config->reverify_path != NULL))
+			die("--record and --reverify cannot be used together\n");
+		if (config->is_wire_client || config->is_wire_server)
+			die("--record and --reverify are only supported "
+			    "in local mode\n");
+		/* Each script would need a recording of its own. */
+		if (config->parallel > 1)
+			die("--record and --reverify cannot be used with "
+			    "--parallel\n");
+	}
+	if (config->perturb) {
+		/* The wire server injects the inbound packets. */
+		if (config->is_wire_client || config->is_wire_server)
+			die("--perturb is only supported in local mode\n");
+		/* Our timeout is a process-wide alarm(2), so each script
+		 * needs a process of its own, as --perturb_seeds and
+		 * --sweep give it, rather than a --parallel thread.
+		 */
+		if ((config->parallel > 1) && (config->sweeps == NULL) &&
+		    (config->perturb_seeds <= 1))
+			die("--perturb cannot be used with --parallel "
+			    "except with --perturb_seeds or --sweep\n");
+		/* The kernel will not send exactly what the script says. */
+		config->non_fatal_packet = true;
+		/* Jitter may push later events back by as much. */
+		config->tolerance_usecs += config->perturb_jitter_usecs;
+	} else if (config->perturb_seeds > 1) {
+		die("--perturb_seeds requires --perturb\n");
+	}
+	if (config->sweeps != NULL) {
+		if (config->is_wire_client || config->is_wire_server)
+			die("--sweep is only supported in local mode\n");
+		/* Each point would need a file of its own. */
+		if ((config->record_path != NULL) ||
+		    (config->reverify_path != NULL) ||
+		    (config->learn_path != NULL))
+			die("--sweep cannot be used with --record, --reverify "
+			    "or --learn\n");
+	}
+	if ((config->reverify_path != NULL) &&
+	    (config->perf_counters || (config->kernel_trace != NULL)))
+		die("--reverify does not run the kernel, so it cannot "
+		    "measure or trace it\n");
+	if ((config->junit_path != NULL) && (config->results_path == NULL))
+		die("--junit requires --results\n");
+	if (config->calibrate) {
+		/* We time the kernel's replies through our own device. */
+		if (config->is_wire_client || config->is_wire_server)
+			die("--calibrate is only supported in local mode\n");
+		if (config->reverify_path != NULL)
+			die("--reverify does not run the kernel, so it cannot "
+			    "calibrate against it\n");
+	}
+	if (config->learn_path != NULL) {
+		/* In wire mode the server sees the outbound packets. */
+		if (config->is_wire_client || config->is_wire_server)
+			die("--learn is only supported in local mode\n");
+		if (config->parallel > 1)
+			die("--learn cannot be used with --parallel\n");
+	}
+	if (config->is_veth) {
+#ifdef linux
+		if (config->is_wire_client || config->is_wire_server)
+			die("--veth is only supported in local mode\n");
+#else
+		die("--veth requires Linux\n");
+#endif
+	}
+#ifdef linux
+	if (config->tun_napi &&
+	    (config->is_wire_client || config->is_wire_server ||
+	     config->is_veth)) {
+		die("--tun_napi is only supported with a local tun device\n");
+	}
+	if (config->tun_capture_compare)
+		config->tun_capture = true;
+	if (config->tun_capture &&
+	    (config->is_wire_client || config->is_wire_server ||
+	     config->is_veth)) {
+		die("--tun_capture is only supported with a local tun device\n");
+	}
+#endif
+	if ((config->veth_gro || config->veth_xdp ||
+	     config->veth_threaded_napi) && !config->is_veth) {
+		die("--veth_features requires --veth\n");
+	}
 #if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
 	if ((config->tun_device == NULL) &&
 	    (config->persistent_tun_device == true)) {
@@ -390,9 +610,22 @@ void finalize_config(struct config *config)
 #endif
 }
 
+/* Free a list of definitions. */
+static void definitions_free(struct definition *defs)
+{
+	struct definition *cur_def = defs, *next_def;
+
+	while (cur_def != NULL) {
+		next_def = cur_def->next;
+		free(cur_def->symbol);
+		free(cur_def->value);
+		free(cur_def);
+		cur_def = next_def;
+	}
+}
+
 void cleanup_config(struct config *config)
 {
-	struct definition *cur_def, *next_def;
 	int i;
 
 	if (config->argv != NULL) {
@@ -405,14 +638,8 @@ void cleanup_config(struct config *config)
 #if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
 	free(config->tun_device);
 #endif
-	cur_def = config->defines;
-	while (cur_def != NULL) {
-		next_def = cur_def->next;
-		free(cur_def->symbol);
-		free(cur_def->value);
-		free(cur_def);
-		cur_def = next_def;
-	}
+	definitions_free(config->defines);
+	definitions_free(config->sweeps);
 	memset(config, 0, sizeof(struct config));
 }
 
@@ -437,6 +664,78 @@ void parse_non_fatal_arg(char *arg, struct config *config)
 	free(argdup);
 }
 
+/* Parse the comma-separated list of receive features to turn on for
+ * the kernel's end of a veth pair.
+ */
+static int parse_veth_features(const char *arg, struct config *config)
+{
+	char *argdup, *saveptr, *token;
+	int result = STATUS_OK;
+
+	config->veth_gro = false;
+	config->veth_xdp = false;
+	config->veth_threaded_napi = false;
+
+	argdup = strdup(arg);
+	token = strtok_r(argdup, ", ", &saveptr);
+	while (token != NULL) {
+		if (strcmp(token, "gro") == 0)
+			config->veth_gro = true;
+		else if (strcmp(token, "xdp") == 0)
+			config->veth_xdp = true;
+		else if (strcmp(token, "threaded_napi") == 0)
+			config->veth_threaded_napi = true;
+		else
+			result = STATUS_ERR;
+		token = strtok_r(NULL, ", ", &saveptr);
+	}
+
+	free(argdup);
+	return result;
+}
+
+/* Parse the comma-separated list of perturbations for --perturb, each
+ * a name=value pair.
+ */
+static int parse_perturb_spec(const char *arg, struct config *config)
+{
+	char *argdup, *saveptr, *token, *end;
+	int result = STATUS_OK;
+	long value;
+
+	argdup = strdup(arg);
+	token = strtok_r(argdup, ", ", &saveptr);
+	while (token != NULL) {
+		char *equals = strchr(token, '=');
+
+		if (equals == NULL) {
+			result = STATUS_ERR;
+			break;
+		}
+		*equals = '\0';
+		value = strtol(equals + 1, &end, 10);
+		if ((*end != '\0') || (end == equals + 1) || (value < 0)) {
+			result = STATUS_ERR;
+			break;
+		}
+		if (strcmp(token, "jitter") == 0)
+			config->perturb_jitter_usecs = value;
+		else if ((strcmp(token, "drop") == 0) && (value <= 100))
+			config->perturb_drop_percent = value;
+		else if ((strcmp(token, "dup") == 0) && (value <= 100))
+			config->perturb_dup_percent = value;
+		else if ((strcmp(token, "reorder") == 0) && (value <= 100))
+			config->perturb_reorder_percent = value;
+		else if (strcmp(token, "timeout") == 0)
+			config->perturb_timeout_secs = value;
+		else
+			result = STATUS_ERR;
+		token = strtok_r(NULL, ", ", &saveptr);
+	}
+
+	free(argdup);
+	return result;
+}
 
 /* Process a command line option */
 static void process_option(int opt, char *optarg, struct config *config,
@@ -444,6 +743,7 @@ static void process_option(int opt, char *optarg, struct config *config,
 {
 	int port = 0;
 	char *end = NULL, *equals = NULL, *symbol = NULL, *value = NULL;
+	char *error = NULL;
 	unsigned long speed = 0;
 
 	DEBUGP("process_option %d = %s\n", opt, optarg);
@@ -505,6 +805,38 @@ static void process_option(int opt, char *optarg, struct config *config,
 		if (config->mtu < 0)
 			die("%s: bad --mtu: %s\n", where, optarg);
 		break;
+	case OPT_REMOTE_TUPLES:
+		assert(optarg != NULL);
+		config->remote_tuples = atoi(optarg);
+		if (config->remote_tuples <= 0)
+			die("%s: bad --remote_tuples: %s\n", where, optarg);
+		break;
+	case OPT_ECN_MARKING:
+		assert(optarg != NULL);
+		if (parse_ecn_marking(optarg, &config->ecn_marking, &error))
+			die("%s: bad --ecn_marking: %s: %s\n",
+			    where, optarg, error);
+		break;
+	case OPT_ECN_DRAIN_USECS:
+		assert(optarg != NULL);
+		config->ecn_marking.drain_usecs = atoi(optarg);
+		if (config->ecn_marking.drain_usecs <= 0)
+			die("%s: bad --ecn_drain_usecs: %s\n", where, optarg);
+		break;
+	case OPT_REASSEMBLY_DATAGRAMS:
+		assert(optarg != NULL);
+		config->reassembly_datagrams = atoi(optarg);
+		if (config->reassembly_datagrams < 0)
+			die("%s: bad --reassembly_datagrams: %s\n",
+			    where, optarg);
+		break;
+	case OPT_REASSEMBLY_TIMEOUT_USECS:
+		assert(optarg != NULL);
+		config->reassembly_timeout_usecs = atoi(optarg);
+		if (config->reassembly_timeout_usecs <= 0)
+			die("%s: bad --reassembly_timeout_usecs: %s\n",
+			    where, optarg);
+		break;
 	case OPT_NETMASK_IP:
 		assert(optarg != NULL);
 		strncpy(config->live_netmask_ip_string, optarg,	ADDR_STR_LEN-1);
@@ -530,6 +862,13 @@ static void process_option(int opt, char *optarg, struct config *config,
 		if (config->tolerance_usecs <= 0)
 			die("%s: bad --tolerance_usecs: %s\n", where, optarg);
 		break;
+	case OPT_CALIBRATE:
+		config->calibrate = true;
+		break;
+	case OPT_CALIBRATE_STRICT:
+		config->calibrate = true;
+		config->calibrate_strict = true;
+		break;
 	case OPT_TCP_TS_TICK_USECS:
 		assert(optarg != NULL);
 		config->tcp_ts_tick_usecs = atoi(optarg);
@@ -564,9 +903,71 @@ static void process_option(int opt, char *optarg, struct config *config,
 		assert(optarg != NULL);
 		config->wire_server_device = strdup(optarg);
 		break;
+	case OPT_WIRE_SESSION:
+		config->wire_session = true;
+		break;
+#ifdef linux
+	case OPT_TUN_NAPI:
+		config->tun_napi = true;
+		break;
+	case OPT_TUN_CAPTURE:
+		config->tun_capture = true;
+		break;
+	case OPT_TUN_CAPTURE_COMPARE:
+		config->tun_capture_compare = true;
+		break;
+#endif
+	case OPT_VETH:
+		config->is_veth = true;
+		break;
+	case OPT_VETH_FEATURES:
+		assert(optarg != NULL);
+		if (parse_veth_features(optarg, config))
+			die("%s: bad --veth_features: %s\n", where, optarg);
+		break;
 	case OPT_DRY_RUN:
 		config->dry_run = true;
 		break;
+	case OPT_PERF_COUNTERS:
+		config->perf_counters = true;
+		break;
+	case OPT_KERNEL_TRACE:
+		assert(optarg != NULL);
+		config->kernel_trace = strdup(optarg);
+		break;
+	case OPT_KERNEL_TRACE_FILE:
+		assert(optarg != NULL);
+		config->kernel_trace_file = strdup(optarg);
+		break;
+	case OPT_SKMEM_TRACE:
+		config->skmem_trace = true;
+		break;
+	case OPT_RECORD:
+		assert(optarg != NULL);
+		config->record_path = strdup(optarg);
+		break;
+	case OPT_REVERIFY:
+		assert(optarg != NULL);
+		config->reverify_path = strdup(optarg);
+		break;
+	case OPT_LEARN:
+		assert(optarg != NULL);
+		config->learn_path = strdup(optarg);
+		break;
+	case OPT_RESULTS:
+		assert(optarg != NULL);
+		config->results_path = strdup(optarg);
+		break;
+	case OPT_JUNIT:
+		assert(optarg != NULL);
+		config->junit_path = strdup(optarg);
+		break;
+	case OPT_PARALLEL:
+		assert(optarg != NULL);
+		config->parallel = atoi(optarg);
+		if (config->parallel <= 0)
+			die("%s: bad --parallel: %s\n", where, optarg);
+		break;
 	case OPT_DEFINE:
 		assert(optarg != NULL);
 		equals = strstr(optarg, "=");
@@ -576,6 +977,33 @@ static void process_option(int opt, char *optarg, struct config *config,
 		value = strdup(equals + 1);
 		definition_set(&config->defines, symbol, value);
 		break;
+	case OPT_PERTURB:
+		assert(optarg != NULL);
+		config->perturb = true;
+		if (parse_perturb_spec(optarg, config))
+			die("%s: bad --perturb: %s\n", where, optarg);
+		break;
+	case OPT_PERTURB_SEED:
+		assert(optarg != NULL);
+		config->perturb_seed = strtoull(optarg, &end, 10);
+		if (*end != '\0' || end == optarg)
+			die("%s: bad --perturb_seed: %s\n", where, optarg);
+		break;
+	case OPT_PERTURB_SEEDS:
+		assert(optarg != NULL);
+		config->perturb_seeds = atoi(optarg);
+		if (config->perturb_seeds <= 0)
+			die("%s: bad --perturb_seeds: %s\n", where, optarg);
+		break;
+	case OPT_SWEEP:
+		assert(optarg != NULL);
+		equals = strstr(optarg, "=");
+		if (equals == optarg || equals == NULL || equals[1] == '\0')
+			die("%s: bad sweep: %s\n", where, optarg);
+		symbol = strndup(optarg, equals - optarg);
+		value = strdup(equals + 1);
+		definition_set(&config->sweeps, symbol, value);
+		break;
 	case OPT_VERBOSE:
 		config->verbose = true;
 		break;
@@ -669,6 +1097,8 @@ static void parse_script_options(struct config *config,
 		process_option(options[i].val,
 			       opt->value, config,
 			       config->script_path);
+		if (c == OPT_TOLERANCE_USECS)
+			config->script_tolerance = true;
 
 		opt = opt->next;
 	}
@@ -31,6 +31,7 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include <getopt.h>
+#include "ecn_marking.h"
 #include "ip_address.h"
 #include "ip_prefix.h"
 #include "script.h"
@@ -114,7 +115,27 @@ struct config {
 
 	int live_prefix_len;		/* IPv4/IPv6 interface prefix len */
 
+	int remote_tuples;		/* remote (IP, port) tuples to reserve
+					 * in live_remote_prefix at start
+					 */
+
+	struct ecn_marking ecn_marking;	/* emulated ECN bottleneck queue */
+
+	int reassembly_datagrams;	/* max sniffed datagrams to reassemble
+					 * at once; 0 to not reassemble
+					 */
+	int reassembly_timeout_usecs;	/* time for all fragments to come */
+
 	int tolerance_usecs;		/* tolerance for time divergence */
+	bool script_tolerance;		/* did the script's options set
+					 * tolerance_usecs?
+					 */
+	bool calibrate;			/* derive tolerances from measured
+					 * host timing noise?
+					 */
+	bool calibrate_strict;		/* ...and fail on a host too noisy
+					 * for tolerance_usecs?
+					 */
 	int tcp_ts_tick_usecs;		/* microseconds per TS val tick */
 
 	u32 speed;			/* speed reported by tun driver;
@@ -127,6 +148,29 @@ struct config {
 
 	bool dry_run;			/* parse script but don't execute? */
 
+	int parallel;			/* scripts to run at once, each in its
+					 * own network namespace
+					 */
+
+	bool perf_counters;		/* report kernel cost of each line? */
+
+	char *kernel_trace;		/* tracepoints to capture, or NULL */
+	char *kernel_trace_file;	/* where to write them, or NULL */
+	bool skmem_trace;		/* add socket memory after each packet
+					 * event to the kernel trace?
+					 */
+
+	char *record_path;		/* file to record the run in, or NULL */
+	char *reverify_path;		/* recording to check against, or NULL */
+	char *learn_path;		/* where to write the script with the
+					 * packets the kernel sent, or NULL
+					 */
+	char *results_path;		/* JSON lines results file, or NULL */
+	char *junit_path;		/* JUnit XML results file, or NULL */
+	bool wire_session;		/* keep the wire connection and server
+					 * netdev across scripts
+					 */
+
 	bool verbose;			/* print detailed debug info? */
 
 	u8 udp_encaps;			/* Protocol encapsulated in UDP */
@@ -157,7 +201,26 @@ struct config {
 					    * connections when exiting
 					    */
 
+	/* For local testing using a veth pair instead of a tun device,
+	 * so that injected packets take the NAPI/GRO receive path.
+	 */
+	bool is_veth;			/* inject and sniff on a veth pair? */
+	bool veth_gro;			/* enable GRO on the kernel's end? */
+	bool veth_xdp;			/* attach an XDP_PASS program there? */
+	bool veth_threaded_napi;	/* use a NAPI kthread there? */
+
 	/* For local testing using a tun interface. */
+#ifdef linux
+	bool tun_napi;			/* receive injected packets via NAPI,
+					 * and so through GRO and busy polling
+					 */
+	bool tun_capture;		/* read sent packets from the tun fd
+					 * instead of a packet socket
+					 */
+	bool tun_capture_compare;	/* ...and measure that against a
+					 * packet socket
+					 */
+#endif
 #if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
 	char *tun_device;
 	bool persistent_tun_device;
@@ -165,6 +228,19 @@ struct config {
 
 	/* List of FOO=bar definitions from command line. */
 	struct definition *defines;
+
+	/* List of FOO=1,2,3 values to run the scripts with, from --sweep. */
+	struct definition *sweeps;
+
+	/* Seeded random perturbation of inbound packets, from --perturb. */
+	bool perturb;
+	int perturb_jitter_usecs;	/* most we delay an inbound event by */
+	int perturb_drop_percent;	/* chance of dropping a packet */
+	int perturb_dup_percent;	/* chance of sending a packet twice */
+	int perturb_reorder_percent;	/* chance of moving a packet */
+	int perturb_timeout_secs;	/* fail a stuck run after this, or 0 */
+	u64 perturb_seed;		/* seed of the first run */
+	int perturb_seeds;		/* how many seeds to run */
 };
 
 /* Top-level info about the invocation of a test script */
@@ -0,0 +1,226 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for the ECN marking engine.
+ */
+
+#include "ecn_marking.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ip.h"
+#include "ipv6.h"
+#include "tcp.h"
+#include "tcp_options.h"
+#include "tcp_options_iterator.h"
+
+int parse_ecn_marking(const char *spec, struct ecn_marking *marking,
+		      char **error)
+{
+	int min_packets = 0, max_packets = 0;
+	char extra;
+
+	if (sscanf(spec, "step:%d%c", &min_packets, &extra) == 1) {
+		if (min_packets < 0)
+			goto bad;
+		marking->type = ECN_MARKING_STEP;
+		marking->min_packets = min_packets;
+		marking->max_packets = min_packets;
+		return STATUS_OK;
+	}
+	if (sscanf(spec, "ramp:%d:%d%c",
+		   &min_packets, &max_packets, &extra) == 2) {
+		if ((min_packets < 0) || (max_packets <= min_packets))
+			goto bad;
+		marking->type = ECN_MARKING_RAMP;
+		marking->min_packets = min_packets;
+		marking->max_packets = max_packets;
+		return STATUS_OK;
+	}
+
+bad:
+	asprintf(error, "expected step:<packets> or ramp:<min>:<max>");
+	return STATUS_ERR;
+}
+
+void ecn_queue_init(struct ecn_queue *queue, const struct ecn_marking *marking)
+{
+	memset(queue, 0, sizeof(*queue));
+	queue->marking = marking;
+}
+
+bool ecn_queue_enqueue(struct ecn_queue *queue, s64 time_usecs)
+{
+	const struct ecn_marking *marking = queue->marking;
+	s64 served;
+	int ahead, span;
+
+	if (marking->type == ECN_MARKING_NONE)
+		return false;
+	assert(marking->drain_usecs > 0);
+
+	/* Serve what the bottleneck could send since the last drain. */
+	if ((queue->depth == 0) || (time_usecs < queue->last_drain_usecs))
+		queue->last_drain_usecs = time_usecs;
+	served = (time_usecs - queue->last_drain_usecs) /
+		 marking->drain_usecs;
+	if (served >= queue->depth) {
+		queue->depth = 0;
+		queue->last_drain_usecs = time_usecs;
+	} else {
+		queue->depth -= served;
+		queue->last_drain_usecs += served * marking->drain_usecs;
+	}
+
+	ahead = queue->depth++;
+
+	switch (marking->type) {
+	case ECN_MARKING_NONE:
+		return false;
+	case ECN_MARKING_STEP:
+		return ahead >= marking->min_packets;
+	case ECN_MARKING_RAMP:
+		if (ahead < marking->min_packets) {
+			queue->ramp_credit = 0;
+			return false;
+		}
+		if (ahead >= marking->max_packets)
+			return true;
+		/* Mark a (ahead - min) / (max - min) fraction of packets,
+		 * spread out evenly rather than drawn at random, so that
+		 * a script always sees the same marks.
+		 */
+		span = marking->max_packets - marking->min_packets;
+		queue->ramp_credit += ahead - marking->min_packets;
+		if (queue->ramp_credit >= span) {
+			queue->ramp_credit -= span;
+			return true;
+		}
+		return false;
+	}
+	assert(!"bad ECN marking type");
+	return false;
+}
+
+/* Return the ECN codepoint of the given packet's innermost IP header. */
+static u8 packet_ecn_bits(const struct packet *packet)
+{
+	if (packet->ipv4 != NULL)
+		return ipv4_ecn_bits(packet->ipv4);
+	if (packet->ipv6 != NULL)
+		return ipv6_ecn_bits(packet->ipv6);
+	return IP_ECN_NONE;
+}
+
+/* Should the given packet go through the emulated queue? Only TCP data
+ * counts, since that is what ECN-capable transports mark as ECT.
+ */
+static bool is_ecn_capable_data(struct packet *packet)
+{
+	const u8 ecn = packet_ecn_bits(packet);
+
+	return (packet->tcp != NULL) &&
+	       ((ecn == IP_ECN_ECT0) || (ecn == IP_ECN_ECT1)) &&
+	       (packet_payload_len(packet) > 0);
+}
+
+void ecn_mark_inbound_packet(struct ecn_queue *queue,
+			     struct packet *live_packet, s64 time_usecs)
+{
+	if (!is_ecn_capable_data(live_packet) ||
+	    !ecn_queue_enqueue(queue, time_usecs))
+		return;
+
+	if (live_packet->ipv4 != NULL)
+		live_packet->ipv4->tos |= IP_ECN_CE;
+	else
+		live_packet->ipv6->traffic_class_lo |= IP_ECN_CE;
+}
+
+void ecn_mark_outbound_packet(struct ecn_queue *queue,
+			      struct ecn_marks *marks,
+			      struct packet *live_packet, s64 time_usecs)
+{
+	u8 ecn;
+
+	if (!is_ecn_capable_data(live_packet) ||
+	    !ecn_queue_enqueue(queue, time_usecs))
+		return;
+
+	ecn = packet_ecn_bits(live_packet);
+	marks->ce_packets++;
+	if (ecn == IP_ECN_ECT0)
+		marks->ect0_ce_bytes += packet_payload_len(live_packet);
+	else
+		marks->ect1_ce_bytes += packet_payload_len(live_packet);
+	marks->ece_pending = true;
+}
+
+/* Add delta to the given counter of an AccECN option, if present. The
+ * counters wrap at 24 bits, like the ones the receiver keeps.
+ */
+static void add_accecn_counter(struct tcp_option *option,
+			       enum accecn_counter_t counter, u32 delta)
+{
+	const int num_counters = (option->length - TCPOLEN_ACCECN_BASE) /
+				 TCPOLEN_ACCECN_COUNTER;
+	const int index = accecn_counter_index(option->kind, counter);
+
+	if (index < num_counters)
+		set_accecn_option_counter(option, index,
+			accecn_option_counter(option, index) + delta);
+}
+
+void ecn_marks_to_inbound_ack(struct ecn_marks *marks,
+			      struct packet *live_packet)
+{
+	struct tcp_options_iterator iter;
+	struct tcp_option *option = NULL;
+	char *error = NULL;
+	struct tcp *tcp = live_packet->tcp;
+	int ace;
+
+	if ((tcp == NULL) || !tcp->ack || tcp->syn)
+		return;
+
+	if (live_packet->flags & FLAG_PARSE_ACE) {
+		ace = ((tcp->ae ? 4 : 0) | (tcp->cwr ? 2 : 0) |
+		       (tcp->ece ? 1 : 0)) + marks->ce_packets;
+		tcp->ece = (ace & 1) != 0;
+		tcp->cwr = (ace & 2) != 0;
+		tcp->ae  = (ace & 4) != 0;
+	} else if (marks->ece_pending) {
+		tcp->ece = 1;
+	}
+	marks->ece_pending = false;
+
+	for (option = tcp_options_begin(live_packet, &iter);
+	     option != NULL; option = tcp_options_next(&iter, &error)) {
+		if ((option->kind != TCPOPT_ACCECN0) &&
+		    (option->kind != TCPOPT_ACCECN1))
+			continue;
+		add_accecn_counter(option, ACCECN_E0B, -marks->ect0_ce_bytes);
+		add_accecn_counter(option, ACCECN_E1B, -marks->ect1_ce_bytes);
+		add_accecn_counter(option, ACCECN_CEB,
+				   marks->ect0_ce_bytes + marks->ect1_ce_bytes);
+	}
+	/* The script's own options were already checked when parsed. */
+	free(error);
+}
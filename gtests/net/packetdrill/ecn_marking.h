@@ -0,0 +1,120 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Interface for an ECN marking engine that emulates an L4S/DCTCP-style
+ * bottleneck queue. Each direction has its own queue, which is fed by
+ * the script's packet schedule and drained at a fixed rate. ECN-capable
+ * data packets are marked CE when the queue is long enough:
+ *
+ *   o inbound data packets are injected with CE set, so the kernel's
+ *     receive-side ECN/AccECN feedback can be tested;
+ *   o outbound data packets are only marked "virtually", and the
+ *     resulting feedback is added to the scripted inbound ACKs, so the
+ *     kernel's congestion control sees the marks as a real sender would.
+ */
+
+#ifndef __ECN_MARKING_H__
+#define __ECN_MARKING_H__
+
+#include "types.h"
+
+#include "packet.h"
+
+/* How the emulated queue decides to mark a packet. */
+enum ecn_marking_t {
+	ECN_MARKING_NONE = 0,	/* no marking engine (default) */
+	ECN_MARKING_STEP,	/* mark iff queue >= min_packets (DCTCP) */
+	ECN_MARKING_RAMP,	/* mark a fraction rising from 0 at min_packets
+				 * to 1 at max_packets (L4S/Prague style)
+				 */
+};
+
+/* Configuration of the marking engine, from --ecn_marking and
+ * --ecn_drain_usecs.
+ */
+struct ecn_marking {
+	enum ecn_marking_t type;
+	int min_packets;	/* step threshold, or start of the ramp */
+	int max_packets;	/* end of the ramp */
+	int drain_usecs;	/* time to serve one packet of the queue */
+};
+
+/* An emulated bottleneck queue for one direction. */
+struct ecn_queue {
+	const struct ecn_marking *marking;
+	int depth;			/* packets currently queued */
+	s64 last_drain_usecs;		/* script time of last drain */
+	int ramp_credit;		/* accumulated ramp mark fraction */
+};
+
+/* The CE marks the engine applied to the outbound data of one
+ * connection, which the scripted inbound ACKs have to reflect.
+ */
+struct ecn_marks {
+	u32 ce_packets;			/* packets marked CE */
+	u32 ect0_ce_bytes;		/* payload bytes marked from ECT(0) */
+	u32 ect1_ce_bytes;		/* payload bytes marked from ECT(1) */
+	bool ece_pending;		/* marked since the last inbound ACK? */
+};
+
+/* Parse an --ecn_marking spec of the form "step:<K>" or
+ * "ramp:<min>:<max>", with thresholds in packets. Returns STATUS_OK on
+ * success; on failure returns STATUS_ERR and sets error message.
+ */
+extern int parse_ecn_marking(const char *spec, struct ecn_marking *marking,
+			     char **error);
+
+/* Set up an empty queue using the given marking configuration. */
+extern void ecn_queue_init(struct ecn_queue *queue,
+			   const struct ecn_marking *marking);
+
+/* Enqueue a packet arriving at the given script time, after draining
+ * whatever the bottleneck could serve since the previous arrival.
+ * Return true iff the packet should be marked CE.
+ */
+extern bool ecn_queue_enqueue(struct ecn_queue *queue, s64 time_usecs);
+
+/* Run an inbound packet about to be injected through the queue, and set
+ * CE in its IP header if it is an ECN-capable data packet that the queue
+ * marks. The caller recomputes checksums before sending.
+ */
+extern void ecn_mark_inbound_packet(struct ecn_queue *queue,
+				    struct packet *live_packet,
+				    s64 time_usecs);
+
+/* Run an outbound packet sniffed from the kernel through the queue, and
+ * record in marks if it is an ECN-capable data packet that the queue
+ * marks.
+ */
+extern void ecn_mark_outbound_packet(struct ecn_queue *queue,
+				     struct ecn_marks *marks,
+				     struct packet *live_packet,
+				     s64 time_usecs);
+
+/* Add the feedback for the given marks to an inbound ACK the script is
+ * about to inject. The script describes the ACK as it would be without
+ * any marks: if it gives an ACE count, the number of CE packets is
+ * added to it; otherwise ECE is set on the first ACK after new marks,
+ * as a DCTCP receiver would. The counters of any AccECN option move the
+ * marked bytes from the ECT(0)/ECT(1) counters to the CE counter.
+ */
+extern void ecn_marks_to_inbound_ack(struct ecn_marks *marks,
+				     struct packet *live_packet);
+
+#endif /* __ECN_MARKING_H__ */
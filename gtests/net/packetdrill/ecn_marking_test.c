@@ -0,0 +1,218 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Unit test for ecn_marking.c.
+ */
+
+#include "ecn_marking.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+#include "tcp.h"
+#include "tcp_options.h"
+#include "tcp_options_iterator.h"
+#include "tcp_packet.h"
+
+int debug_logging=0;
+
+static void test_parse_ecn_marking(void)
+{
+	struct ecn_marking marking;
+	char *error = NULL;
+
+	memset(&marking, 0, sizeof(marking));
+	assert(parse_ecn_marking("step:5", &marking, &error) == STATUS_OK);
+	assert(marking.type == ECN_MARKING_STEP);
+	assert(marking.min_packets == 5);
+	assert(marking.max_packets == 5);
+
+	assert(parse_ecn_marking("ramp:2:6", &marking, &error) ==
+	       STATUS_OK);
+	assert(marking.type == ECN_MARKING_RAMP);
+	assert(marking.min_packets == 2);
+	assert(marking.max_packets == 6);
+
+	assert(parse_ecn_marking("ramp:6:2", &marking, &error) ==
+	       STATUS_ERR);
+	free(error);
+	error = NULL;
+	assert(parse_ecn_marking("step:-1", &marking, &error) == STATUS_ERR);
+	free(error);
+	error = NULL;
+	assert(parse_ecn_marking("step:5x", &marking, &error) == STATUS_ERR);
+	free(error);
+	error = NULL;
+	assert(parse_ecn_marking("red", &marking, &error) == STATUS_ERR);
+	free(error);
+}
+
+/* A step queue marks packets with at least K packets queued ahead of
+ * them, after serving one packet per drain interval.
+ */
+static void test_step_queue(void)
+{
+	struct ecn_marking marking = {
+		.type = ECN_MARKING_STEP,
+		.min_packets = 1,
+		.max_packets = 1,
+		.drain_usecs = 100,
+	};
+	struct ecn_queue queue;
+
+	ecn_queue_init(&queue, &marking);
+	assert(!ecn_queue_enqueue(&queue, 0));		/* 0 ahead */
+	assert(ecn_queue_enqueue(&queue, 0));		/* 1 ahead */
+	assert(ecn_queue_enqueue(&queue, 0));		/* 2 ahead */
+	assert(queue.depth == 3);
+
+	/* Two packets served by 250us; the partial one still counts. */
+	assert(ecn_queue_enqueue(&queue, 250));		/* 1 ahead */
+	assert(queue.depth == 2);
+	assert(queue.last_drain_usecs == 200);
+
+	/* An idle bottleneck empties the queue. */
+	assert(!ecn_queue_enqueue(&queue, 1000));	/* 0 ahead */
+	assert(queue.depth == 1);
+}
+
+/* A ramp queue marks an evenly spread fraction of the packets that rises
+ * from 0 at min packets queued to 1 at max packets.
+ */
+static void test_ramp_queue(void)
+{
+	struct ecn_marking marking = {
+		.type = ECN_MARKING_RAMP,
+		.min_packets = 2,
+		.max_packets = 6,
+		.drain_usecs = 1000000,
+	};
+	const bool expected[] = {
+		false, false,			/* below the ramp */
+		false, false, false, true,	/* 0+1+2+3 quarters */
+		true, true,			/* at or over the top */
+	};
+	struct ecn_queue queue;
+	int i;
+
+	ecn_queue_init(&queue, &marking);
+	for (i = 0; i < ARRAY_SIZE(expected); ++i)
+		assert(ecn_queue_enqueue(&queue, 0) == expected[i]);
+
+	/* No marking engine, no marks. */
+	marking.type = ECN_MARKING_NONE;
+	assert(!ecn_queue_enqueue(&queue, 0));
+}
+
+/* Return an inbound ACK with an accecn0 option carrying the given
+ * counters, padded with a NOP.
+ */
+static struct packet *new_accecn_ack(u32 e0b, u32 ceb, u32 e1b)
+{
+	struct tcp_options *options = tcp_options_new();
+	struct tcp_option *option =
+		tcp_option_new(TCPOPT_ACCECN0, TCPOLEN_ACCECN_BASE +
+			       MAX_ACCECN_COUNTERS * TCPOLEN_ACCECN_COUNTER);
+	struct packet *packet = NULL;
+	char *error = NULL;
+
+	set_accecn_option_counter(option, ACCECN_E0B, e0b);
+	set_accecn_option_counter(option, ACCECN_CEB, ceb);
+	set_accecn_option_counter(option, ACCECN_E1B, e1b);
+	assert(tcp_options_append(options,
+				  tcp_option_new(TCPOPT_NOP, 1)) == STATUS_OK);
+	assert(tcp_options_append(options, option) == STATUS_OK);
+	packet = new_tcp_packet(AF_INET, DIRECTION_INBOUND, ECN_NONE, ".",
+				1, 0, 1, 257, 0, options,
+				false, false, false, false, 0, 0, &error);
+	assert(packet != NULL);
+	free(options);
+	return packet;
+}
+
+/* Return the given counter of the first AccECN option of the packet. */
+static u32 packet_accecn_counter(struct packet *packet,
+				 enum accecn_counter_t counter)
+{
+	struct tcp_options_iterator iter;
+	struct tcp_option *option = NULL;
+	char *error = NULL;
+
+	for (option = tcp_options_begin(packet, &iter); option != NULL;
+	     option = tcp_options_next(&iter, &error)) {
+		if (option->kind == TCPOPT_ACCECN0)
+			break;
+	}
+	assert(option != NULL);
+	return accecn_option_counter(option,
+				     accecn_counter_index(option->kind,
+							  counter));
+}
+
+static void test_marks_to_inbound_ack(void)
+{
+	struct ecn_marks marks = {
+		.ce_packets = 3,
+		.ect0_ce_bytes = 3000,
+		.ect1_ce_bytes = 0,
+		.ece_pending = true,
+	};
+	struct packet *packet = NULL;
+
+	/* Without an ACE count, ECE goes on the first ACK after marks,
+	 * and the marked bytes move from EE0B to ECEB.
+	 */
+	packet = new_accecn_ack(10000, 5, 0);
+	ecn_marks_to_inbound_ack(&marks, packet);
+	assert(packet->tcp->ece);
+	assert(!marks.ece_pending);
+	assert(packet_accecn_counter(packet, ACCECN_E0B) == 7000);
+	assert(packet_accecn_counter(packet, ACCECN_CEB) == 3005);
+	assert(packet_accecn_counter(packet, ACCECN_E1B) == 0);
+	packet_free(packet);
+
+	packet = new_accecn_ack(10000, 5, 0);
+	ecn_marks_to_inbound_ack(&marks, packet);
+	assert(!packet->tcp->ece);
+	packet_free(packet);
+
+	/* An ACE count of 2 in the script becomes 2 + 3 = 5. */
+	packet = new_accecn_ack(10000, 5, 0);
+	packet->flags |= FLAG_PARSE_ACE;
+	packet->tcp->cwr = 1;
+	ecn_marks_to_inbound_ack(&marks, packet);
+	assert(packet->tcp->ae && !packet->tcp->cwr && packet->tcp->ece);
+	packet_free(packet);
+
+	/* The counters wrap at 24 bits. */
+	packet = new_accecn_ack(1000, 0xffffff, 0);
+	ecn_marks_to_inbound_ack(&marks, packet);
+	assert(packet_accecn_counter(packet, ACCECN_E0B) == 0xffffff - 1999);
+	assert(packet_accecn_counter(packet, ACCECN_CEB) == 2999);
+	packet_free(packet);
+}
+
+int main(void)
+{
+	test_parse_ecn_marking();
+	test_step_queue();
+	test_ramp_queue();
+	test_marks_to_inbound_ack();
+	return 0;
+}
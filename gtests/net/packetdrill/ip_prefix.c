@@ -62,6 +62,44 @@ void ip_prefix_normalize(struct ip_prefix *prefix)
 	memset(prefix->ip.ip.bytes + bytes, 0, max_prefix_bytes - bytes);
 }
 
+int ip_prefix_offset_ip(const struct ip_prefix *prefix,
+			const struct ip_address *base, u32 offset,
+			struct ip_address *ip)
+{
+	int num_bytes = ip_address_length(base->address_family);
+	struct ip_prefix result_prefix;
+	int i;
+
+	assert(base->address_family == prefix->ip.address_family);
+
+	/* Add the offset to the address, big-endian byte by byte. */
+	*ip = *base;
+	for (i = num_bytes - 1; i >= 0 && offset != 0; --i) {
+		u32 sum = ip->ip.bytes[i] + (offset & 0xff);
+
+		ip->ip.bytes[i] = sum & 0xff;
+		offset = (offset >> 8) + (sum >> 8);
+	}
+	if (offset != 0)
+		return STATUS_ERR;	/* wrapped around the address space */
+
+	/* Make sure we did not carry into the network part. */
+	result_prefix = ip_to_prefix(ip, prefix->prefix_len);
+	ip_prefix_normalize(&result_prefix);
+	if (!is_equal_ip(&result_prefix.ip, &prefix->ip))
+		return STATUS_ERR;
+
+	/* Avoid the IPv4 subnet-directed broadcast address. */
+	if (ip->address_family == AF_INET && prefix->prefix_len < 31) {
+		u32 host_mask = 0xffffffffU >> prefix->prefix_len;
+
+		if ((ntohl(ip->ip.v4.s_addr) & host_mask) == host_mask)
+			return STATUS_ERR;
+	}
+
+	return STATUS_OK;
+}
+
 /* Parse and return a prefix length (in bits) like /16 or /64 from the
  * end of a string, and die if the prefix is bigger than the given max
  * length. Use the maximum length if there is no prefix in the string.
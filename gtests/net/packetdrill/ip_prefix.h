@@ -59,6 +59,15 @@ extern struct ip_prefix ip_to_prefix(const struct ip_address *ip,
 /* Zero the bits beyond the prefix length. */
 void ip_prefix_normalize(struct ip_prefix *prefix);
 
+/* Fill in *ip with the address that is 'offset' addresses beyond the
+ * given base address, which must lie inside the prefix. Returns
+ * STATUS_OK on success, or STATUS_ERR if the resulting address falls
+ * outside the prefix or is the IPv4 broadcast address of the prefix.
+ */
+extern int ip_prefix_offset_ip(const struct ip_prefix *prefix,
+			       const struct ip_address *base, u32 offset,
+			       struct ip_address *ip);
+
 /* Print a human-readable representation of the given IP prefix in the
  * given buffer, which must be at least ADDR_STR_LEN bytes long.
  * Returns a pointer to the given buffer.
@@ -0,0 +1,347 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for reassembling sniffed IPv4 and IPv6 fragments.
+ */
+
+#include "ip_reassembly.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "checksum.h"
+#include "ethernet.h"
+#include "ip.h"
+#include "ipv6.h"
+#include "logging.h"
+
+struct ip_reassembly *ip_reassembly_new(int max_datagrams,
+					s64 timeout_usecs)
+{
+	struct ip_reassembly *reassembly = calloc(1, sizeof(*reassembly));
+
+	assert(max_datagrams > 0);
+	reassembly->slots = calloc(max_datagrams,
+				   sizeof(struct ip_reassembly_slot));
+	reassembly->num_slots = max_datagrams;
+	reassembly->timeout_usecs = timeout_usecs;
+	return reassembly;
+}
+
+void ip_reassembly_free(struct ip_reassembly *reassembly)
+{
+	int i;
+
+	if (reassembly == NULL)
+		return;
+	for (i = 0; i < reassembly->num_slots; ++i)
+		free(reassembly->slots[i].payload);
+	free(reassembly->slots);
+	free(reassembly);
+}
+
+/* Drop the datagrams that have been waiting too long for fragments. */
+static void expire_slots(struct ip_reassembly *reassembly, s64 now_usecs)
+{
+	int i;
+
+	for (i = 0; i < reassembly->num_slots; ++i) {
+		struct ip_reassembly_slot *slot = &reassembly->slots[i];
+
+		if (slot->in_use &&
+		    (now_usecs - slot->first_usecs >
+		     reassembly->timeout_usecs)) {
+			DEBUGP("IP reassembly timed out for ID %u\n",
+			       slot->id);
+			reassembly->num_timeouts++;
+			slot->in_use = false;
+		}
+	}
+}
+
+/* Return the slot for the datagram with the given addresses, ID and
+ * protocol, claiming a free one (or else the oldest) if it is new.
+ */
+static struct ip_reassembly_slot *find_slot(
+	struct ip_reassembly *reassembly,
+	const struct ip_address *src_ip, const struct ip_address *dst_ip,
+	u32 id, u8 protocol, s64 now_usecs)
+{
+	struct ip_reassembly_slot *slot = NULL, *free_slot = NULL;
+	struct ip_reassembly_slot *oldest = NULL;
+	int i;
+
+	expire_slots(reassembly, now_usecs);
+
+	for (i = 0; i < reassembly->num_slots; ++i) {
+		slot = &reassembly->slots[i];
+		if (!slot->in_use) {
+			if (free_slot == NULL)
+				free_slot = slot;
+			continue;
+		}
+		if ((slot->id == id) && (slot->protocol == protocol) &&
+		    is_equal_ip(&slot->src_ip, src_ip) &&
+		    is_equal_ip(&slot->dst_ip, dst_ip))
+			return slot;
+		if ((oldest == NULL) ||
+		    (slot->first_usecs < oldest->first_usecs))
+			oldest = slot;
+	}
+
+	if (free_slot == NULL) {
+		DEBUGP("IP reassembly evicting ID %u\n", oldest->id);
+		reassembly->num_evictions++;
+		free_slot = oldest;
+	}
+
+	slot = free_slot;
+	if (slot->payload == NULL)
+		slot->payload = malloc(IP_REASSEMBLY_MAX_BYTES);
+	slot->in_use		= true;
+	slot->src_ip		= *src_ip;
+	slot->dst_ip		= *dst_ip;
+	slot->id		= id;
+	slot->protocol		= protocol;
+	slot->first_usecs	= now_usecs;
+	slot->header_bytes	= 0;
+	slot->have_first	= false;
+	slot->payload_bytes	= -1;
+	slot->received_bytes	= 0;
+	slot->end_bytes		= 0;
+	slot->num_fragments	= 0;
+	memset(slot->units, 0, sizeof(slot->units));
+	return slot;
+}
+
+/* Mark the 8-byte units first through last as received. Return false,
+ * marking nothing, if any of them was already received.
+ */
+static bool mark_units(struct ip_reassembly_slot *slot, int first, int last)
+{
+	int i;
+
+	for (i = first; i <= last; ++i) {
+		if (slot->units[i / 8] & (1 << (i % 8)))
+			return false;
+	}
+	for (i = first; i <= last; ++i)
+		slot->units[i / 8] |= 1 << (i % 8);
+	return true;
+}
+
+/* Add a fragment carrying the given payload bytes at the given offset
+ * to its datagram. The header is that of the fragment, minus its
+ * fragmentation info. Return true iff the datagram is now complete.
+ */
+static bool add_fragment(struct ip_reassembly *reassembly,
+			 struct ip_reassembly_slot *slot,
+			 const void *header, int header_bytes,
+			 const u8 *payload, int offset, int bytes, bool more)
+{
+	const int end = offset + bytes;
+
+	if ((end > IP_REASSEMBLY_MAX_BYTES) ||
+	    (header_bytes > IP_REASSEMBLY_HEADER_BYTES) ||
+	    (slot->num_fragments == PACKET_MAX_FRAGMENTS) ||
+	    (more && ((bytes == 0) || (bytes % 8 != 0))) ||
+	    (!more && (slot->payload_bytes >= 0)) ||
+	    (!more && (end < slot->end_bytes)) ||
+	    ((slot->payload_bytes >= 0) && (end > slot->payload_bytes)) ||
+	    ((bytes > 0) && !mark_units(slot, offset / 8, (end - 1) / 8))) {
+		DEBUGP("IP reassembly dropping ID %u\n", slot->id);
+		reassembly->num_drops++;
+		slot->in_use = false;
+		return false;
+	}
+
+	memcpy(slot->payload + offset, payload, bytes);
+	slot->received_bytes += bytes;
+	slot->end_bytes = max(slot->end_bytes, end);
+	slot->fragment_bytes[slot->num_fragments++] = bytes;
+	if (!more)
+		slot->payload_bytes = end;
+
+	/* Use the header of the first fragment, which has all options. */
+	if (!slot->have_first) {
+		memcpy(slot->header, header, header_bytes);
+		slot->header_bytes = header_bytes;
+		slot->have_first = (offset == 0);
+	}
+
+	return (slot->payload_bytes >= 0) &&
+	       (slot->received_bytes == slot->payload_bytes);
+}
+
+/* Write the complete datagram of the given slot into the packet. */
+static bool finish_datagram(struct ip_reassembly *reassembly,
+			    struct ip_reassembly_slot *slot,
+			    struct packet *packet, int *in_bytes)
+{
+	const int bytes = slot->header_bytes + slot->payload_bytes;
+
+	slot->in_use = false;
+	if ((bytes > packet->buffer_bytes) ||
+	    (bytes > IP_REASSEMBLY_MAX_BYTES)) {
+		DEBUGP("IP reassembly: datagram ID %u too big\n", slot->id);
+		reassembly->num_drops++;
+		return false;
+	}
+
+	memcpy(packet->buffer, slot->header, slot->header_bytes);
+	memcpy(packet->buffer + slot->header_bytes, slot->payload,
+	       slot->payload_bytes);
+	if (slot->src_ip.address_family == AF_INET) {
+		struct ipv4 *ipv4 = (struct ipv4 *)packet->buffer;
+
+		ipv4->tot_len = htons(bytes);
+		ipv4->check = 0;
+		ipv4->check = ipv4_checksum(ipv4, slot->header_bytes);
+	} else {
+		struct ipv6 *ipv6 = (struct ipv6 *)packet->buffer;
+
+		ipv6->payload_len = htons(slot->payload_bytes);
+	}
+	*in_bytes = bytes;
+
+	packet->num_fragments = slot->num_fragments;
+	memcpy(packet->fragment_bytes, slot->fragment_bytes,
+	       slot->num_fragments * sizeof(slot->fragment_bytes[0]));
+
+	DEBUGP("IP reassembly: datagram ID %u of %d bytes "
+	       "from %d fragments\n", slot->id, bytes, slot->num_fragments);
+	return true;
+}
+
+/* Feed an IPv4 packet to the pool. Fragments with bad headers are left
+ * for parse_packet() to report.
+ */
+static bool add_ipv4(struct ip_reassembly *reassembly,
+		     struct packet *packet, int *in_bytes)
+{
+	struct ipv4 *ipv4 = (struct ipv4 *)packet->buffer;
+	u8 header[IP_REASSEMBLY_HEADER_BYTES];
+	struct ip_address src_ip, dst_ip;
+	struct ip_reassembly_slot *slot = NULL;
+	int header_bytes, total_bytes;
+	u16 frag_off;
+
+	if ((*in_bytes < sizeof(*ipv4)) || (ipv4->version != 4))
+		return true;
+	frag_off = ntohs(ipv4->frag_off);
+	if ((frag_off & (IP_MF | IP_OFFMASK)) == 0)
+		return true;
+	header_bytes = ipv4_header_len(ipv4);
+	total_bytes = ntohs(ipv4->tot_len);
+	if ((header_bytes < sizeof(*ipv4)) ||
+	    (header_bytes > total_bytes) ||
+	    (total_bytes > *in_bytes) ||
+	    (ipv4_checksum(ipv4, header_bytes) != 0))
+		return true;
+
+	memcpy(header, ipv4, header_bytes);
+	((struct ipv4 *)header)->frag_off = htons(frag_off & IP_DF);
+
+	ip_from_ipv4(&ipv4->src_ip, &src_ip);
+	ip_from_ipv4(&ipv4->dst_ip, &dst_ip);
+	slot = find_slot(reassembly, &src_ip, &dst_ip, ntohs(ipv4->id),
+			 ipv4->protocol, packet->time_usecs);
+	if (!add_fragment(reassembly, slot, header, header_bytes,
+			  packet->buffer + header_bytes,
+			  (frag_off & IP_OFFMASK) * 8,
+			  total_bytes - header_bytes,
+			  (frag_off & IP_MF) != 0))
+		return false;
+	return finish_datagram(reassembly, slot, packet, in_bytes);
+}
+
+/* Feed an IPv6 packet to the pool, removing any hop-by-hop and
+ * destination options headers in front of the fragment or layer 4
+ * header.
+ */
+static bool add_ipv6(struct ip_reassembly *reassembly,
+		     struct packet *packet, int *in_bytes)
+{
+	struct ipv6 *ipv6 = (struct ipv6 *)packet->buffer;
+	u8 *const first = packet->buffer + sizeof(*ipv6);
+	const struct ipv6_frag_header *frag = NULL;
+	struct ipv6 header;
+	struct ip_address src_ip, dst_ip;
+	struct ip_reassembly_slot *slot = NULL;
+	u8 *end = NULL, *p = first;
+	u8 next_header;
+	u16 frag_off;
+
+	if ((*in_bytes < sizeof(*ipv6)) || (ipv6->version != 6))
+		return true;
+	end = first + ntohs(ipv6->payload_len);
+	if (end > packet->buffer + *in_bytes)
+		return true;
+
+	next_header = ipv6->next_header;
+	while ((next_header == IPPROTO_HOPOPTS) ||
+	       (next_header == IPPROTO_DSTOPTS)) {
+		const struct ipv6_ext_header *ext =
+			(const struct ipv6_ext_header *)p;
+
+		if ((p + sizeof(*ext) > end) ||
+		    (p + ipv6_ext_header_len(ext) > end))
+			return true;
+		next_header = ext->next_header;
+		p += ipv6_ext_header_len(ext);
+	}
+
+	if (next_header != IPPROTO_FRAGMENT) {
+		if (p == first)
+			return true;
+		memmove(first, p, end - p);
+		ipv6->next_header = next_header;
+		ipv6->payload_len = htons(end - p);
+		*in_bytes = sizeof(*ipv6) + (end - p);
+		return true;
+	}
+
+	frag = (const struct ipv6_frag_header *)p;
+	if (p + sizeof(*frag) > end)
+		return true;
+	frag_off = ntohs(frag->frag_off);
+
+	header = *ipv6;
+	header.next_header = frag->next_header;
+
+	ip_from_ipv6(&ipv6->src_ip, &src_ip);
+	ip_from_ipv6(&ipv6->dst_ip, &dst_ip);
+	slot = find_slot(reassembly, &src_ip, &dst_ip, ntohl(frag->id), 0,
+			 packet->time_usecs);
+	p += sizeof(*frag);
+	if (!add_fragment(reassembly, slot, &header, sizeof(header),
+			  p, frag_off & IPV6_FRAG_OFFMASK, end - p,
+			  (frag_off & IPV6_FRAG_MF) != 0))
+		return false;
+	return finish_datagram(reassembly, slot, packet, in_bytes);
+}
+
+bool ip_reassembly_add(struct ip_reassembly *reassembly,
+		       struct packet *packet, u16 ether_type, int *in_bytes)
+{
+	if (ether_type == ETHERTYPE_IP)
+		return add_ipv4(reassembly, packet, in_bytes);
+	if (ether_type == ETHERTYPE_IPV6)
+		return add_ipv6(reassembly, packet, in_bytes);
+	return true;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Interface for reassembling sniffed IPv4 and IPv6 fragments into
+ * whole datagrams before they are parsed.
+ *
+ * Datagrams under reassembly live in a fixed pool of slots, whose
+ * buffers are allocated on first use and then reused, so memory is
+ * bounded by the pool size. A datagram whose fragments do not all
+ * arrive within the timeout is dropped, and when the pool is full the
+ * oldest datagram is evicted. Overlapping fragments drop the whole
+ * datagram, as RFC 5722 requires for IPv6.
+ *
+ * The IPv6 hop-by-hop and destination options headers are removed from
+ * the packets we pass on, since a script cannot describe them anyway.
+ */
+
+#ifndef __IP_REASSEMBLY_H__
+#define __IP_REASSEMBLY_H__
+
+#include "types.h"
+
+#include "ip_address.h"
+#include "packet.h"
+
+/* Largest IP datagram (and so fragment payload) we reassemble. */
+#define IP_REASSEMBLY_MAX_BYTES		65535
+
+/* Largest IP header we keep for a datagram: a full IPv4 header with
+ * options, or a bare IPv6 header.
+ */
+#define IP_REASSEMBLY_HEADER_BYTES	60
+
+/* A datagram under reassembly. */
+struct ip_reassembly_slot {
+	bool in_use;
+	struct ip_address src_ip;
+	struct ip_address dst_ip;
+	u32 id;				/* IPv4/IPv6 fragment ID */
+	u8 protocol;			/* IPv4 protocol, or 0 for IPv6 */
+	s64 first_usecs;		/* when the first fragment arrived */
+
+	u8 header[IP_REASSEMBLY_HEADER_BYTES];	/* IP header to use */
+	int header_bytes;		/* 0 until any fragment arrives */
+	bool have_first;		/* has the offset 0 fragment come? */
+
+	u8 *payload;			/* IP_REASSEMBLY_MAX_BYTES (owned) */
+	u8 units[(IP_REASSEMBLY_MAX_BYTES + 63) / 64];
+					/* bitmap of 8-byte units received */
+	int payload_bytes;		/* total, or -1 until last fragment */
+	int received_bytes;		/* payload bytes received so far */
+	int end_bytes;			/* end of furthest fragment so far */
+
+	u16 num_fragments;
+	u16 fragment_bytes[PACKET_MAX_FRAGMENTS];
+};
+
+/* A pool of datagrams under reassembly. */
+struct ip_reassembly {
+	struct ip_reassembly_slot *slots;	/* array of slots (owned) */
+	int num_slots;
+	s64 timeout_usecs;		/* drop datagrams older than this */
+
+	/* Datagrams we gave up on, for debugging. */
+	int num_timeouts;
+	int num_evictions;
+	int num_drops;
+};
+
+/* Allocate a pool for reassembling up to max_datagrams datagrams at a
+ * time, each of which must be complete within timeout_usecs of its
+ * first fragment.
+ */
+extern struct ip_reassembly *ip_reassembly_new(int max_datagrams,
+					       s64 timeout_usecs);
+
+/* Free a reassembly pool and all its buffers. */
+extern void ip_reassembly_free(struct ip_reassembly *reassembly);
+
+/* Feed a sniffed packet of 'in_bytes' bytes starting at the packet's
+ * 'buffer' to the reassembly pool. Returns true if the packet is ready
+ * to be parsed: either it was not a fragment, or it was the last
+ * missing fragment of a datagram, in which case the packet's buffer,
+ * 'in_bytes', and fragment list now hold the whole datagram. Returns
+ * false if the packet was a fragment that the pool kept or dropped;
+ * the caller should go on to the next packet.
+ */
+extern bool ip_reassembly_add(struct ip_reassembly *reassembly,
+			      struct packet *packet, u16 ether_type,
+			      int *in_bytes);
+
+#endif /* __IP_REASSEMBLY_H__ */
@@ -56,6 +56,31 @@ struct ipv6 {
 	struct	in6_addr	dst_ip;
 };
 
+/* Generic layout of the IPv6 hop-by-hop, routing and destination
+ * options extension headers. See RFC 8200.
+ */
+struct ipv6_ext_header {
+	__u8			next_header;
+	__u8			hdr_len;	/* 8-octet units, less the first */
+};
+
+/* Return the length in bytes of an IPv6 extension header. */
+static inline int ipv6_ext_header_len(const struct ipv6_ext_header *ext)
+{
+	return (ext->hdr_len + 1) * 8;
+}
+
+/* IPv6 fragment header. See RFC 8200. */
+struct ipv6_frag_header {
+	__u8			next_header;
+	__u8			reserved;
+	__be16			frag_off;	/* offset and M flag */
+	__be32			id;
+};
+
+#define IPV6_FRAG_OFFMASK	0xfff8	/* fragment offset, in bytes */
+#define IPV6_FRAG_MF		0x0001	/* more fragments flag */
+
 /* ECN: RFC 3168: http://tools.ietf.org/html/rfc3168 */
 static inline u8 ipv6_ecn_bits(const struct ipv6 *ipv6)
 {
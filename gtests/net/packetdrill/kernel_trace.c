@@ -0,0 +1,679 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for capturing kernel tracepoints while a script runs.
+ */
+
+#include "kernel_trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ip_address.h"
+#include "ip_prefix.h"
+#include "logging.h"
+
+#ifdef linux
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+#define KERNEL_TRACE_RING_PAGES	64	/* data pages per CPU; power of 2 */
+#define KERNEL_TRACE_MAX_FIELDS	48
+#define KERNEL_TRACE_TEXT_BYTES	1024	/* longest record we print */
+
+/* Where tracefs may be mounted. */
+static const char *tracefs_event_dirs[] = {
+	"/sys/kernel/tracing/events",
+	"/sys/kernel/debug/tracing/events",
+};
+
+/* A field of a tracepoint's raw record, from its format file. */
+struct trace_field {
+	char name[32];
+	int offset;
+	int size;
+	bool is_signed;
+	bool is_array;
+	bool is_pointer;
+};
+
+/* A tracepoint we opened. */
+struct tracepoint {
+	char *name;			/* "system:event" (owned) */
+	struct trace_field fields[KERNEL_TRACE_MAX_FIELDS];
+	int num_fields;
+};
+
+/* A tracepoint open on one CPU, so we can tell whose records are whose. */
+struct trace_stream {
+	int fd;
+	u64 id;				/* from PERF_EVENT_IOC_ID */
+	int tracepoint;			/* index into the trace's tracepoints */
+};
+
+/* The ring buffer that all the tracepoints of one CPU write to. */
+struct trace_ring {
+	int fd;				/* stream that owns the mapping, or -1 */
+	struct perf_event_mmap_page *page;	/* control page, then data */
+	u8 *data;
+	u64 data_bytes;
+};
+
+/* A captured record or script event, ready to print. */
+struct trace_record {
+	s64 time_usecs;
+	u32 sequence;			/* keeps same-time records in order */
+	char *text;			/* (owned) */
+};
+
+struct kernel_trace {
+	char *file_path;		/* where to write, or NULL (owned) */
+	struct ip_prefix remote_prefix;	/* the test's remote addresses */
+	s64 realtime_offset_nsecs;	/* CLOCK_REALTIME - CLOCK_MONOTONIC */
+	s64 start_usecs;		/* live time of the script's start */
+
+	struct tracepoint *tracepoints;	/* (owned) */
+	int num_tracepoints;
+	struct trace_stream *streams;	/* (owned) */
+	int num_streams;
+	struct trace_ring *rings;	/* one per possible CPU (owned) */
+	int num_rings;
+	u8 *scratch;			/* a record that wraps the ring */
+
+	struct trace_record *records;	/* (owned) */
+	int num_records;
+	int max_records;
+	u32 next_sequence;
+	u64 num_dropped;		/* beyond KERNEL_TRACE_MAX_RECORDS */
+	u64 num_lost;			/* overwritten before we drained them */
+};
+
+/* Parse the field declarations of a tracepoint's format file, skipping
+ * the common fields and variable-length ones. Returns the tracepoint's
+ * ID, or -1 if the file does not exist.
+ */
+static s64 read_tracepoint_format(const char *name, struct tracepoint *tp)
+{
+	char *path = NULL, *system = strdup(name), *event = NULL;
+	char line[512];
+	FILE *f = NULL;
+	s64 id = -1;
+	int i;
+
+	event = strchr(system, ':');
+	if (event == NULL)
+		die("--kernel_trace: expected system:event, got '%s'\n", name);
+	*event++ = '\0';
+
+	for (i = 0; (f == NULL) && (i < ARRAY_SIZE(tracefs_event_dirs)); ++i) {
+		asprintf(&path, "%s/%s/%s/format",
+			 tracefs_event_dirs[i], system, event);
+		f = fopen(path, "r");
+		free(path);
+	}
+	free(system);
+	if (f == NULL)
+		return -1;
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		struct trace_field *field = &tp->fields[tp->num_fields];
+		char *decl, *semicolon, *field_name, *p;
+		int is_signed = 0;
+
+		if (sscanf(line, "ID: %lld", &id) == 1)
+			continue;
+		decl = strstr(line, "field:");
+		if ((decl == NULL) || (tp->num_fields == KERNEL_TRACE_MAX_FIELDS))
+			continue;
+		decl += strlen("field:");
+		semicolon = strchr(decl, ';');
+		if (semicolon == NULL)
+			continue;
+		*semicolon = '\0';
+		if (strstr(decl, "__data_loc") != NULL)
+			continue;
+
+		/* The name is the last word of the declaration. */
+		field_name = strrchr(decl, ' ');
+		field_name = (field_name != NULL) ? field_name + 1 : decl;
+		if (strncmp(field_name, "common_", strlen("common_")) == 0)
+			continue;
+		field->is_pointer = (strchr(decl, '*') != NULL);
+		p = strchr(field_name, '[');
+		field->is_array = (p != NULL);
+		if (p != NULL)
+			*p = '\0';
+		snprintf(field->name, sizeof(field->name), "%s", field_name);
+
+		p = strstr(semicolon + 1, "offset:");
+		if ((p == NULL) || (sscanf(p, "offset:%d;", &field->offset) != 1))
+			continue;
+		p = strstr(p, "size:");
+		if ((p == NULL) || (sscanf(p, "size:%d;", &field->size) != 1))
+			continue;
+		p = strstr(p, "signed:");
+		if ((p != NULL) && (sscanf(p, "signed:%d;", &is_signed) == 1))
+			field->is_signed = (is_signed != 0);
+		++tp->num_fields;
+	}
+	fclose(f);
+	return id;
+}
+
+/* Open the given tracepoint on every CPU, sending its records to that
+ * CPU's ring.
+ */
+static void open_tracepoint(struct kernel_trace *trace, int index, s64 id)
+{
+	const long page_bytes = sysconf(_SC_PAGESIZE);
+	struct perf_event_attr attr;
+	struct trace_stream *stream = NULL;
+	struct trace_ring *ring = NULL;
+	int cpu, fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_TRACEPOINT;
+	attr.config = id;
+	attr.sample_period = 1;
+	attr.sample_type = PERF_SAMPLE_IDENTIFIER | PERF_SAMPLE_TIME |
+			   PERF_SAMPLE_RAW;
+	attr.use_clockid = 1;
+	attr.clockid = CLOCK_MONOTONIC;
+
+	for (cpu = 0; cpu < trace->num_rings; ++cpu) {
+		fd = syscall(__NR_perf_event_open, &attr, -1 /* any task */,
+			     cpu, -1 /* no group */, PERF_FLAG_FD_CLOEXEC);
+		if ((fd < 0) && ((errno == ENODEV) || (errno == ENXIO)))
+			continue;	/* CPU is offline */
+		if (fd < 0) {
+			die("--kernel_trace: cannot open %s on CPU %d: %s "
+			    "(needs root or a low perf_event_paranoid)\n",
+			    trace->tracepoints[index].name, cpu,
+			    strerror(errno));
+		}
+
+		ring = &trace->rings[cpu];
+		if (ring->fd < 0) {
+			ring->data_bytes = KERNEL_TRACE_RING_PAGES * page_bytes;
+			ring->page = mmap(NULL, page_bytes + ring->data_bytes,
+					  PROT_READ | PROT_WRITE, MAP_SHARED,
+					  fd, 0);
+			if (ring->page == MAP_FAILED)
+				die_perror("mmap perf ring buffer");
+			ring->data = (u8 *)ring->page + page_bytes;
+			ring->fd = fd;
+		} else if (ioctl(fd, PERF_EVENT_IOC_SET_OUTPUT, ring->fd) < 0) {
+			die_perror("PERF_EVENT_IOC_SET_OUTPUT");
+		}
+
+		trace->streams = realloc(trace->streams,
+					 (trace->num_streams + 1) *
+					 sizeof(*trace->streams));
+		stream = &trace->streams[trace->num_streams++];
+		stream->fd = fd;
+		stream->tracepoint = index;
+		if (ioctl(fd, PERF_EVENT_IOC_ID, &stream->id) < 0)
+			die_perror("PERF_EVENT_IOC_ID");
+	}
+}
+
+/* Return CLOCK_REALTIME minus CLOCK_MONOTONIC. */
+static s64 clock_offset_nsecs(void)
+{
+	struct timespec realtime, monotonic;
+
+	if ((clock_gettime(CLOCK_MONOTONIC, &monotonic) < 0) ||
+	    (clock_gettime(CLOCK_REALTIME, &realtime) < 0))
+		die_perror("clock_gettime");
+	return ((s64)(realtime.tv_sec - monotonic.tv_sec) * 1000000000LL +
+		(realtime.tv_nsec - monotonic.tv_nsec));
+}
+
+struct kernel_trace *kernel_trace_new(const struct config *config)
+{
+	struct kernel_trace *trace = calloc(1, sizeof(struct kernel_trace));
+	const bool is_default = (strcmp(config->kernel_trace, "default") == 0);
+	char *names, *name, *saveptr = NULL;
+	struct tracepoint *tp = NULL;
+	struct ip_address ipv4;
+	s64 id;
+	int i;
+
+	if (config->kernel_trace_file != NULL)
+		trace->file_path = strdup(config->kernel_trace_file);
+	/* Compare IPv4-mapped IPv6 remote addresses as plain IPv4. */
+	trace->remote_prefix = config->live_remote_prefix;
+	if ((trace->remote_prefix.ip.address_family == AF_INET6) &&
+	    (ipv6_map_to_ipv4(trace->remote_prefix.ip, &ipv4) == STATUS_OK)) {
+		trace->remote_prefix.ip = ipv4;
+		trace->remote_prefix.prefix_len -= 96;
+	}
+	ip_prefix_normalize(&trace->remote_prefix);
+
+	trace->realtime_offset_nsecs = clock_offset_nsecs();
+
+	trace->num_rings = sysconf(_SC_NPROCESSORS_CONF);
+	trace->rings = calloc(trace->num_rings, sizeof(struct trace_ring));
+	for (i = 0; i < trace->num_rings; ++i)
+		trace->rings[i].fd = -1;
+	trace->scratch = malloc(1 << 16);	/* records are < 64KB */
+
+	names = strdup(is_default ? KERNEL_TRACE_DEFAULT_TRACEPOINTS :
+			config->kernel_trace);
+	for (name = strtok_r(names, ", ", &saveptr); name != NULL;
+	     name = strtok_r(NULL, ", ", &saveptr)) {
+		trace->tracepoints = realloc(trace->tracepoints,
+					     (trace->num_tracepoints + 1) *
+					     sizeof(*trace->tracepoints));
+		tp = &trace->tracepoints[trace->num_tracepoints];
+		memset(tp, 0, sizeof(*tp));
+		id = read_tracepoint_format(name, tp);
+		if (id < 0) {
+			if (!is_default)
+				die("--kernel_trace: no tracepoint %s "
+				    "(is tracefs mounted?)\n", name);
+			fprintf(stderr, "kernel_trace: skipping %s: "
+				"not in this kernel\n", name);
+			continue;
+		}
+		tp->name = strdup(name);
+		open_tracepoint(trace, trace->num_tracepoints++, id);
+	}
+	free(names);
+
+	if (trace->num_tracepoints == 0)
+		die("--kernel_trace: no tracepoints to capture\n");
+	return trace;
+}
+
+void kernel_trace_start(struct kernel_trace *trace, s64 start_usecs)
+{
+	trace->start_usecs = start_usecs;
+}
+
+/* Append a record, taking ownership of the text. */
+static void add_record(struct kernel_trace *trace, s64 time_usecs,
+		       char *text)
+{
+	struct trace_record *record = NULL;
+
+	if (trace->num_records == KERNEL_TRACE_MAX_RECORDS) {
+		++trace->num_dropped;
+		free(text);
+		return;
+	}
+	if (trace->num_records == trace->max_records) {
+		trace->max_records = trace->max_records ?
+				     2 * trace->max_records : 1024;
+		trace->records = realloc(trace->records,
+					 trace->max_records *
+					 sizeof(*trace->records));
+	}
+	record = &trace->records[trace->num_records++];
+	record->time_usecs = time_usecs;
+	record->sequence = trace->next_sequence++;
+	record->text = text;
+}
+
+/* Decode an address field: a raw IPv4 or IPv6 address, or a sockaddr.
+ * Returns false if the field does not hold an address.
+ */
+static bool field_address(const struct trace_field *field, const u8 *raw,
+			  struct ip_address *ip)
+{
+	const u8 *p = raw + field->offset;
+	struct in_addr ipv4;
+	struct in6_addr ipv6;
+	u16 family;
+
+	if (!field->is_array || (strstr(field->name, "addr") == NULL))
+		return false;
+
+	if (field->size == sizeof(struct sockaddr_in6)) {
+		memcpy(&family, p, sizeof(family));
+		if (family == AF_INET) {
+			memcpy(&ipv4, p + offsetof(struct sockaddr_in,
+						   sin_addr), sizeof(ipv4));
+			ip_from_ipv4(&ipv4, ip);
+			return true;
+		}
+		if (family == AF_INET6) {
+			memcpy(&ipv6, p + offsetof(struct sockaddr_in6,
+						   sin6_addr), sizeof(ipv6));
+			ip_from_ipv6(&ipv6, ip);
+			return true;
+		}
+		return false;
+	}
+	if (field->size == sizeof(ipv4)) {
+		memcpy(&ipv4, p, sizeof(ipv4));
+		ip_from_ipv4(&ipv4, ip);
+		return true;
+	}
+	if (field->size == sizeof(ipv6)) {
+		memcpy(&ipv6, p, sizeof(ipv6));
+		ip_from_ipv6(&ipv6, ip);
+		return true;
+	}
+	return false;
+}
+
+/* Is the given address in the test's remote prefix? */
+static bool is_remote_address(struct kernel_trace *trace,
+			      const struct ip_address *address)
+{
+	const struct ip_prefix *remote = &trace->remote_prefix;
+	struct ip_address ip = *address, ipv4;
+	struct ip_prefix prefix;
+
+	/* Dual-stack sockets report IPv4 peers as IPv4-mapped IPv6. */
+	if ((ip.address_family == AF_INET6) &&
+	    (ipv6_map_to_ipv4(ip, &ipv4) == STATUS_OK))
+		ip = ipv4;
+	if (ip.address_family != remote->ip.address_family)
+		return false;
+
+	prefix = ip_to_prefix(&ip, remote->prefix_len);
+	ip_prefix_normalize(&prefix);
+	return memcmp(&prefix.ip.ip, &remote->ip.ip,
+		      ip_address_length(ip.address_family)) == 0;
+}
+
+/* Turn a raw tracepoint record into a line of text, or return NULL if
+ * it is about a connection that is not part of the test.
+ */
+static char *format_record(struct kernel_trace *trace,
+			   const struct tracepoint *tp,
+			   const u8 *raw, u32 raw_bytes)
+{
+	char text[KERNEL_TRACE_TEXT_BYTES];
+	char ip_string[ADDR_STR_LEN];
+	struct ip_address ip;
+	bool has_address = false, is_remote = false;
+	int i, len = 0;
+	u64 value;
+	s64 signed_value;
+
+	len += snprintf(text + len, sizeof(text) - len, "%s:", tp->name);
+	for (i = 0; i < tp->num_fields; ++i) {
+		const struct trace_field *field = &tp->fields[i];
+
+		if ((field->offset + field->size > raw_bytes) ||
+		    field->is_pointer || (len >= sizeof(text)))
+			continue;
+		if (field_address(field, raw, &ip)) {
+			has_address = true;
+			if (is_remote_address(trace, &ip))
+				is_remote = true;
+			len += snprintf(text + len, sizeof(text) - len,
+					" %s=%s", field->name,
+					ip_to_string(&ip, ip_string));
+			continue;
+		}
+		if (field->is_array)
+			continue;
+
+		value = 0;
+		switch (field->size) {
+		case 1: value = *(u8 *)(raw + field->offset); break;
+		case 2: value = *(u16 *)(raw + field->offset); break;
+		case 4: value = *(u32 *)(raw + field->offset); break;
+		case 8: memcpy(&value, raw + field->offset, 8); break;
+		default: continue;
+		}
+		if (field->is_signed && (field->size < 8)) {
+			/* Sign-extend from the field's width. */
+			const int shift = 64 - 8 * field->size;
+
+			signed_value = (s64)(value << shift) >> shift;
+		} else {
+			signed_value = value;
+		}
+		if (field->is_signed)
+			len += snprintf(text + len, sizeof(text) - len,
+					" %s=%lld", field->name, signed_value);
+		else
+			len += snprintf(text + len, sizeof(text) - len,
+					" %s=%llu", field->name, value);
+	}
+
+	if (has_address && !is_remote)
+		return NULL;
+	return strdup(text);
+}
+
+/* Copy bytes out of a ring, which may wrap around its end. */
+static void ring_copy(const struct trace_ring *ring, u64 position,
+		      void *dst, u64 bytes)
+{
+	const u64 start = position % ring->data_bytes;
+	const u64 first = ring->data_bytes - start;
+
+	if (bytes <= first) {
+		memcpy(dst, ring->data + start, bytes);
+	} else {
+		memcpy(dst, ring->data + start, first);
+		memcpy((u8 *)dst + first, ring->data, bytes - first);
+	}
+}
+
+/* Handle one sample: IDENTIFIER, TIME, then the RAW size and data. */
+static void handle_sample(struct kernel_trace *trace, const u8 *record,
+			  int bytes)
+{
+	const u8 *p = record + sizeof(struct perf_event_header);
+	const struct tracepoint *tp = NULL;
+	u64 id, time_nsecs;
+	u32 raw_bytes;
+	char *text = NULL;
+	int i;
+
+	if (bytes < sizeof(struct perf_event_header) + 2 * sizeof(u64) +
+		    sizeof(u32))
+		return;
+	memcpy(&id, p, sizeof(id));
+	p += sizeof(id);
+	memcpy(&time_nsecs, p, sizeof(time_nsecs));
+	p += sizeof(time_nsecs);
+	memcpy(&raw_bytes, p, sizeof(raw_bytes));
+	p += sizeof(raw_bytes);
+	if (p + raw_bytes > record + bytes)
+		return;
+
+	for (i = 0; i < trace->num_streams; ++i) {
+		if (trace->streams[i].id == id) {
+			tp = &trace->tracepoints[trace->streams[i].tracepoint];
+			break;
+		}
+	}
+	if (tp == NULL)
+		return;
+
+	text = format_record(trace, tp, p, raw_bytes);
+	if (text != NULL)
+		add_record(trace, ((s64)time_nsecs +
+				   trace->realtime_offset_nsecs) / 1000, text);
+}
+
+/* Move every record waiting in every ring into our list. */
+static void drain_rings(struct kernel_trace *trace)
+{
+	struct perf_event_header header;
+	struct trace_ring *ring = NULL;
+	u64 head, tail, lost;
+	int i;
+
+	for (i = 0; i < trace->num_rings; ++i) {
+		ring = &trace->rings[i];
+		if (ring->fd < 0)
+			continue;
+		head = ring->page->data_head;
+		__sync_synchronize();	/* read head before the data */
+		tail = ring->page->data_tail;
+
+		while (tail + sizeof(header) <= head) {
+			ring_copy(ring, tail, &header, sizeof(header));
+			if ((header.size < sizeof(header)) ||
+			    (tail + header.size > head))
+				break;
+			ring_copy(ring, tail, trace->scratch, header.size);
+			if (header.type == PERF_RECORD_SAMPLE) {
+				handle_sample(trace, trace->scratch,
+					      header.size);
+			} else if (header.type == PERF_RECORD_LOST) {
+				/* After the header: id, then count lost. */
+				memcpy(&lost, trace->scratch + sizeof(header) +
+				       sizeof(u64), sizeof(lost));
+				trace->num_lost += lost;
+			}
+			tail += header.size;
+		}
+
+		__sync_synchronize();	/* finish reading before freeing */
+		ring->page->data_tail = tail;
+	}
+}
+
+void kernel_trace_note_event(struct kernel_trace *trace,
+			     int line_number, const char *description,
+			     s64 live_usecs)
+{
+	char *text = NULL;
+
+	drain_rings(trace);
+	asprintf(&text, "line %d: %s", line_number, description);
+	add_record(trace, live_usecs, text);
+}
+
+void kernel_trace_note(struct kernel_trace *trace, char *text,
+		       s64 live_usecs)
+{
+	add_record(trace, live_usecs, text);
+}
+
+/* Order records by time, then by when we collected them. */
+static int compare_records(const void *a, const void *b)
+{
+	const struct trace_record *x = a, *y = b;
+
+	if (x->time_usecs != y->time_usecs)
+		return (x->time_usecs < y->time_usecs) ? -1 : 1;
+	return (x->sequence < y->sequence) ? -1 : (x->sequence > y->sequence);
+}
+
+/* Write the merged timeline, with times in seconds from the start. */
+static void write_records(struct kernel_trace *trace, FILE *f)
+{
+	int i;
+
+	qsort(trace->records, trace->num_records, sizeof(*trace->records),
+	      compare_records);
+	fprintf(f, "kernel trace (seconds since script start):\n");
+	for (i = 0; i < trace->num_records; ++i) {
+		fprintf(f, "%10.6f %s\n",
+			(trace->records[i].time_usecs - trace->start_usecs) /
+			1000000.0, trace->records[i].text);
+	}
+	if (trace->num_dropped > 0)
+		fprintf(f, "kernel trace: dropped %llu records over %d\n",
+			trace->num_dropped, KERNEL_TRACE_MAX_RECORDS);
+	if (trace->num_lost > 0)
+		fprintf(f, "kernel trace: lost %llu records to full rings\n",
+			trace->num_lost);
+}
+
+void kernel_trace_finish(struct kernel_trace *trace, bool failed)
+{
+	const long page_bytes = sysconf(_SC_PAGESIZE);
+	FILE *f = NULL;
+	int i;
+
+	drain_rings(trace);
+
+	if (trace->file_path != NULL) {
+		f = fopen(trace->file_path, "w");
+		if (f == NULL) {
+			fprintf(stderr, "kernel_trace: cannot open %s: %s\n",
+				trace->file_path, strerror(errno));
+		} else {
+			write_records(trace, f);
+			fclose(f);
+		}
+	} else if (failed) {
+		write_records(trace, stderr);
+	}
+
+	for (i = 0; i < trace->num_streams; ++i)
+		close(trace->streams[i].fd);
+	for (i = 0; i < trace->num_rings; ++i) {
+		if (trace->rings[i].fd >= 0)
+			munmap(trace->rings[i].page,
+			       page_bytes + trace->rings[i].data_bytes);
+	}
+	for (i = 0; i < trace->num_tracepoints; ++i)
+		free(trace->tracepoints[i].name);
+	for (i = 0; i < trace->num_records; ++i)
+		free(trace->records[i].text);
+	free(trace->tracepoints);
+	free(trace->streams);
+	free(trace->rings);
+	free(trace->scratch);
+	free(trace->records);
+	free(trace->file_path);
+	memset(trace, 0, sizeof(*trace));  /* paranoia to help catch bugs */
+	free(trace);
+}
+
+#else  /* !linux */
+
+struct kernel_trace *kernel_trace_new(const struct config *config)
+{
+	die("--kernel_trace requires Linux\n");
+	return NULL;	/* not reached */
+}
+
+void kernel_trace_start(struct kernel_trace *trace, s64 start_usecs)
+{
+}
+
+void kernel_trace_note_event(struct kernel_trace *trace,
+			     int line_number, const char *description,
+			     s64 live_usecs)
+{
+}
+
+void kernel_trace_note(struct kernel_trace *trace, char *text,
+		       s64 live_usecs)
+{
+	free(text);
+}
+
+void kernel_trace_finish(struct kernel_trace *trace, bool failed)
+{
+}
+
+#endif  /* linux */
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Interface for capturing kernel tracepoints while a script runs, so a
+ * failing test shows what the kernel was doing around the failure: RTO
+ * firing, cwnd changing, retransmits, state changes.
+ *
+ * We open each tracepoint on every CPU with perf_event_open(2), with
+ * all the tracepoints of a CPU sharing one memory-mapped ring buffer.
+ * perf cannot stamp tracepoint records with CLOCK_REALTIME, the clock
+ * now_usecs() uses, so we stamp them with CLOCK_MONOTONIC and shift
+ * them by the offset between the two clocks when the trace starts.
+ * Draining the rings is a memory copy with no system calls, and we do
+ * it between events, off the timed path. Records of TCP connections
+ * whose addresses are all outside the test's remote prefix are
+ * dropped; records without addresses are kept.
+ *
+ * At the end of the run the records are merged by time with the
+ * script's events and written to the trace file, if there is one, or
+ * else to stderr if the test failed.
+ */
+
+#ifndef __KERNEL_TRACE_H__
+#define __KERNEL_TRACE_H__
+
+#include "types.h"
+
+#include "config.h"
+
+/* Tracepoints we capture for --kernel_trace=default. */
+#define KERNEL_TRACE_DEFAULT_TRACEPOINTS			\
+	"tcp:tcp_probe,tcp:tcp_retransmit_skb,"			\
+	"tcp:tcp_retransmit_synack,tcp:tcp_send_reset,"		\
+	"tcp:tcp_receive_reset,tcp:tcp_cong_state_set,"		\
+	"sock:inet_sock_set_state"
+
+/* Most records we keep for one run; later ones are counted and dropped. */
+#define KERNEL_TRACE_MAX_RECORDS	100000
+
+struct kernel_trace;
+
+/* Open the tracepoints the config asks for, or die. Tracepoints this
+ * kernel lacks are skipped with a warning if they came from the default
+ * list.
+ */
+extern struct kernel_trace *kernel_trace_new(const struct config *config);
+
+/* Set the live time that record times are printed relative to. */
+extern void kernel_trace_start(struct kernel_trace *trace, s64 start_usecs);
+
+/* Collect pending records, and note that the given script line's event
+ * finished at the given live time.
+ */
+extern void kernel_trace_note_event(struct kernel_trace *trace,
+				    int line_number, const char *description,
+				    s64 live_usecs);
+
+/* Add a record of our own with the given text, taking ownership of it,
+ * at the given live time; e.g. socket memory sampled by --skmem_trace.
+ */
+extern void kernel_trace_note(struct kernel_trace *trace, char *text,
+			      s64 live_usecs);
+
+/* Collect the last records, write the merged timeline if the config
+ * or a failure calls for it, and free the trace.
+ */
+extern void kernel_trace_finish(struct kernel_trace *trace, bool failed);
+
+#endif /* __KERNEL_TRACE_H__ */
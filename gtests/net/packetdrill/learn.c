@@ -0,0 +1,184 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for learn mode, which writes out a script with the
+ * outbound packets the kernel actually sent.
+ */
+
+#include "learn.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "logging.h"
+#include "packet_to_string.h"
+
+/* The script text we learned for one outbound packet event. */
+struct learned_event {
+	int line_number;	/* first line of the placeholder */
+	int end_line_number;	/* last line of the placeholder */
+	char *text;		/* what to write in its place */
+};
+
+struct learn {
+	char *path;			/* where to write the script */
+	struct learned_event *events;	/* in script order */
+	int num_events;
+	int max_events;
+};
+
+struct learn *learn_new(const char *path)
+{
+	struct learn *learn = calloc(1, sizeof(struct learn));
+
+	learn->path = strdup(path);
+	return learn;
+}
+
+/* Format the time the packet was sent in the style of the placeholder's
+ * timestamp: "*" stays "*", relative times stay relative to the end of
+ * the previous event, and absolute times stay absolute.
+ */
+static void learned_time_to_string(const struct event *event,
+				   s64 actual_usecs, char *buffer, int bytes)
+{
+	const char *sign = "";
+	s64 usecs = actual_usecs;
+
+	if (event->time_type == ANY_TIME) {
+		snprintf(buffer, bytes, "*");
+		return;
+	}
+	if ((event->time_type == RELATIVE_TIME) ||
+	    (event->time_type == RELATIVE_RANGE_TIME)) {
+		sign = "+";
+		usecs -= event->offset_usecs;
+		if (usecs < 0)
+			usecs = 0;
+	}
+	if (usecs % 1000 == 0)
+		snprintf(buffer, bytes, "%s%lld.%03lld", sign,
+			 usecs / 1000000, (usecs % 1000000) / 1000);
+	else
+		snprintf(buffer, bytes, "%s%lld.%06lld", sign,
+			 usecs / 1000000, usecs % 1000000);
+}
+
+void learn_outbound_packet(struct learn *learn,
+			   const struct event *event,
+			   const struct packet *script_packet,
+			   struct packet *actual_packet,
+			   s64 actual_usecs)
+{
+	struct learned_event *learned = NULL;
+	char *dump = NULL, *dump_error = NULL;
+	char time[64], subflow[32] = "", frags[32] = "";
+
+	if (packet_to_string(actual_packet, DUMP_SHORT,
+			     &dump, &dump_error) != STATUS_OK) {
+		fprintf(stderr, "%s: cannot learn packet for line %d: %s\n",
+			learn->path, event->line_number, dump_error);
+		free(dump);
+		free(dump_error);
+		return;
+	}
+	free(dump_error);
+
+	learned_time_to_string(event, actual_usecs, time, sizeof(time));
+	if (script_packet->mptcp_subflow != 0)
+		snprintf(subflow, sizeof(subflow), "subflow %d: ",
+			 script_packet->mptcp_subflow);
+	if (actual_packet->num_fragments > 1)
+		snprintf(frags, sizeof(frags), "frags %d: ",
+			 actual_packet->num_fragments);
+
+	if (learn->num_events == learn->max_events) {
+		learn->max_events = learn->max_events ?
+			learn->max_events * 2 : 64;
+		learn->events = realloc(learn->events,
+					learn->max_events *
+					sizeof(struct learned_event));
+	}
+	learned = &learn->events[learn->num_events++];
+	learned->line_number = event->line_number;
+	learned->end_line_number = event->end_line_number;
+	asprintf(&learned->text, "%s > %s%s%s", time, subflow, frags, dump);
+	free(dump);
+}
+
+int learn_write(struct learn *learn, const struct script *script,
+		char **error)
+{
+	const char *line = script->buffer;
+	const char *end = script->buffer + script->length;
+	const struct learned_event *learned = learn->events;
+	const struct learned_event *last = learn->events + learn->num_events;
+	int line_number = 1;
+	FILE *file = fopen(learn->path, "w");
+
+	if (file == NULL) {
+		asprintf(error, "cannot create %s: %s",
+			 learn->path, strerror(errno));
+		return STATUS_ERR;
+	}
+
+	while (line < end) {
+		const char *next = memchr(line, '\n', end - line);
+		const int line_bytes = (next != NULL) ? next - line : end - line;
+
+		if ((learned < last) && (learned->line_number == line_number)) {
+			/* Keep the placeholder's indentation. */
+			fwrite(line, 1, strspn(line, " \t"), file);
+			fprintf(file, "%s\n", learned->text);
+		} else if ((learned < last) &&
+			   (line_number > learned->line_number) &&
+			   (line_number <= learned->end_line_number)) {
+			/* Drop the rest of a placeholder that spans lines. */
+		} else {
+			fwrite(line, 1, line_bytes, file);
+			fputc('\n', file);
+		}
+		if ((learned < last) && (line_number >= learned->end_line_number))
+			learned++;
+
+		line += line_bytes + 1;
+		line_number++;
+	}
+
+	if (fclose(file) != 0) {
+		asprintf(error, "error writing %s: %s",
+			 learn->path, strerror(errno));
+		return STATUS_ERR;
+	}
+	return STATUS_OK;
+}
+
+void learn_free(struct learn *learn)
+{
+	int i;
+
+	if (learn == NULL)
+		return;
+	for (i = 0; i < learn->num_events; i++)
+		free(learn->events[i].text);
+	free(learn->events);
+	free(learn->path);
+	free(learn);
+}
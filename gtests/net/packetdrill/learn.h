@@ -0,0 +1,68 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Interface for learn mode, which writes out a copy of a script with
+ * each outbound packet line replaced by the packet the kernel actually
+ * sent, to help write the expectations for a new test.
+ *
+ * In learn mode an outbound packet line is only a placeholder: we take
+ * the next packet the kernel sends on the line's socket, whatever its
+ * headers, options, payload, and time, map it into script space the
+ * same way we do before comparing it with an expected packet, and note
+ * it for the line. The placeholder still matters for what the kernel
+ * cannot tell us, such as whether a SYN/ACK line opens a passive
+ * connection, so it should have the right flags; "<...>" is handy for
+ * the TCP options. When the script finishes, we write the completed
+ * script, keeping the placeholder's style of timestamp.
+ */
+
+#ifndef __LEARN_H__
+#define __LEARN_H__
+
+#include "types.h"
+
+#include "packet.h"
+#include "script.h"
+
+struct learn;
+
+/* Allocate state for learning a script into the file at the given path. */
+extern struct learn *learn_new(const char *path);
+
+/* Note that the given outbound packet event was answered by the given
+ * packet, already mapped into script space, which the kernel sent at
+ * the given script time.
+ */
+extern void learn_outbound_packet(struct learn *learn,
+				  const struct event *event,
+				  const struct packet *script_packet,
+				  struct packet *actual_packet,
+				  s64 actual_usecs);
+
+/* Write a copy of the given script, with the packets we learned in
+ * place of their placeholders. On success, returns STATUS_OK. On error
+ * returns STATUS_ERR and fills in *error.
+ */
+extern int learn_write(struct learn *learn, const struct script *script,
+		       char **error);
+
+/* Free all learn mode state. */
+extern void learn_free(struct learn *learn);
+
+#endif /* __LEARN_H__ */
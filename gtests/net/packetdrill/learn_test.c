@@ -0,0 +1,136 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Unit test for learn.c.
+ */
+
+#include "learn.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "assert.h"
+#include "tcp_packet.h"
+
+int debug_logging=0;
+
+/* Return a packet like one the kernel sends, with the given flags and
+ * payload.
+ */
+static struct packet *new_outbound_packet(const char *flags,
+					  u32 start_sequence,
+					  u16 payload_bytes)
+{
+	struct packet *packet = NULL;
+	char *error = NULL;
+
+	packet = new_tcp_packet(AF_INET, DIRECTION_OUTBOUND, ECN_NONE, flags,
+				start_sequence, payload_bytes, 1, 257, 0, NULL,
+				false, false, false, false, 0, 0, &error);
+	assert(packet != NULL);
+	return packet;
+}
+
+/* Learn the given packet for the placeholder on the given lines. */
+static void learn_packet(struct learn *learn, int line_number,
+			 int end_line_number, enum event_time_t time_type,
+			 s64 offset_usecs, struct packet *actual_packet,
+			 s64 actual_usecs)
+{
+	struct event event;
+
+	memset(&event, 0, sizeof(event));
+	event.line_number = line_number;
+	event.end_line_number = end_line_number;
+	event.time_type = time_type;
+	event.offset_usecs = offset_usecs;
+	event.type = PACKET_EVENT;
+	event.event.packet = actual_packet;
+	learn_outbound_packet(learn, &event, actual_packet, actual_packet,
+			      actual_usecs);
+	packet_free(actual_packet);
+}
+
+static void test_learn_write(void)
+{
+	char *input =
+		"0 socket(..., SOCK_STREAM, IPPROTO_TCP) = 3\n"
+		"+0 > S. 0:0(0) ack 1 <...>\n"
+		"  0.2 > . 1:1(0) ack 1\n"
+		"* > P. 1:1(0) ack 1\n"
+		"+0 > . 1:1(0) ack 1 <nop,\n"
+		"                     nop>\n"
+		"0.500 close(3) = 0\n";
+	const char *expected =
+		"0 socket(..., SOCK_STREAM, IPPROTO_TCP) = 3\n"
+		"+0.000250 > S. 0:0(0) ack 1 win 257\n"
+		"  0.200 > . 1:1(0) ack 1 win 257\n"
+		"* > P. 1:11(10) ack 1 win 257\n"
+		"+0.010 > F. 11:11(0) ack 1 win 257\n"
+		"0.500 close(3) = 0\n";
+	char path[] = "/tmp/learn_test.XXXXXX";
+	char output[1024];
+	struct script script;
+	struct learn *learn = NULL;
+	char *error = NULL;
+	FILE *file = NULL;
+	size_t bytes;
+	int fd;
+
+	fd = mkstemp(path);
+	assert(fd >= 0);
+	close(fd);
+
+	memset(&script, 0, sizeof(script));
+	script.buffer = input;
+	script.length = strlen(input);
+
+	/* A relative time keeps its sign, and microseconds show only
+	 * when there are any; an absolute time stays absolute, and the
+	 * indentation of the placeholder stays; "*" stays "*"; and all
+	 * lines of a multi-line placeholder are replaced by one line.
+	 */
+	learn = learn_new(path);
+	learn_packet(learn, 2, 2, RELATIVE_TIME, 100000,
+		     new_outbound_packet("S.", 0, 0), 100250);
+	learn_packet(learn, 3, 3, ABSOLUTE_TIME, 0,
+		     new_outbound_packet(".", 1, 0), 200000);
+	learn_packet(learn, 4, 4, ANY_TIME, 0,
+		     new_outbound_packet("P.", 1, 10), 300123);
+	learn_packet(learn, 5, 6, RELATIVE_TIME, 300123,
+		     new_outbound_packet("F.", 11, 0), 310123);
+	assert(learn_write(learn, &script, &error) == STATUS_OK);
+	learn_free(learn);
+
+	file = fopen(path, "r");
+	assert(file != NULL);
+	bytes = fread(output, 1, sizeof(output) - 1, file);
+	fclose(file);
+	unlink(path);
+	output[bytes] = '\0';
+	printf("learned = '%s'\n", output);
+	assert(strcmp(output, expected) == 0);
+}
+
+int main(void)
+{
+	test_learn_write();
+	return 0;
+}
@@ -25,10 +25,74 @@
 #include "link_layer.h"
 
 #include <stdlib.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "logging.h"
 
+/* Fill in the Ethernet header for injected packets of one IP version. */
+static void init_ether_header(struct ether_header *ether,
+			      const struct ether_addr *dst_addr,
+			      const struct ether_addr *src_addr,
+			      int address_family)
+{
+	ether_copy(ether->ether_dhost, dst_addr);
+	ether_copy(ether->ether_shost, src_addr);
+	ether->ether_type = htons(ether_type_for_family(address_family));
+}
+
+void ether_frame_headers_init(struct ether_frame_headers *headers,
+			      const struct ether_addr *dst_addr,
+			      const struct ether_addr *src_addr)
+{
+	init_ether_header(&headers->ipv4, dst_addr, src_addr, AF_INET);
+	init_ether_header(&headers->ipv6, dst_addr, src_addr, AF_INET6);
+}
+
+/* Fill in the two iovecs of the Ethernet frame for the given packet. */
+static void set_ether_frame(const struct ether_frame_headers *headers,
+			    struct packet *packet, struct iovec *ether_frame)
+{
+	/* Prepend an ethernet header. */
+	if (packet_address_family(packet) == AF_INET)
+		ether_frame[0].iov_base	= (void *)&headers->ipv4;
+	else
+		ether_frame[0].iov_base	= (void *)&headers->ipv6;
+	ether_frame[0].iov_len	= sizeof(struct ether_header);
+
+	/* Then after that we have the IP datagram. */
+	ether_frame[1].iov_base	= packet_start(packet);
+	ether_frame[1].iov_len	= packet->ip_bytes;
+}
+
+int ether_frame_send(struct packet_socket *psock,
+		     const struct ether_frame_headers *headers,
+		     struct packet *packet)
+{
+	struct iovec ether_frame[2];
+
+	set_ether_frame(headers, packet, ether_frame);
+	return packet_socket_writev(psock, ether_frame,
+				    ARRAY_SIZE(ether_frame));
+}
+
+int ether_frame_send_burst(struct packet_socket *psock,
+			   const struct ether_frame_headers *headers,
+			   struct packet **packets, int num_packets)
+{
+	struct iovec *ether_frames = calloc(2 * num_packets,
+					    sizeof(struct iovec));
+	int i, result;
+
+	for (i = 0; i < num_packets; ++i)
+		set_ether_frame(headers, packets[i], &ether_frames[2 * i]);
+	result = packet_socket_writev_burst(psock, ether_frames, 2,
+					    num_packets);
+
+	free(ether_frames);
+	return result;
+}
+
 #ifdef linux
 
 #include <net/if.h>
@@ -28,8 +28,38 @@
 #include "types.h"
 
 #include "ethernet.h"
+#include "packet.h"
+#include "packet_socket.h"
 
 /* Get the link layer address for the device with the given name, or die. */
 void get_hw_address(const char *name, struct ether_addr *hw_address);
 
+/* The Ethernet headers we put in front of the IP packets we inject
+ * through a packet socket, one per IP version, built once.
+ */
+struct ether_frame_headers {
+	struct ether_header ipv4;
+	struct ether_header ipv6;
+};
+
+/* Build the headers for frames from src_addr to dst_addr. */
+extern void ether_frame_headers_init(struct ether_frame_headers *headers,
+				     const struct ether_addr *dst_addr,
+				     const struct ether_addr *src_addr);
+
+/* Inject the given IP packet through the packet socket, behind the
+ * Ethernet header for its IP version. Return STATUS_OK on success, or
+ * STATUS_ERR on error.
+ */
+extern int ether_frame_send(struct packet_socket *psock,
+			    const struct ether_frame_headers *headers,
+			    struct packet *packet);
+
+/* Inject the given IP packets the same way, back to back. Return
+ * STATUS_OK on success, or STATUS_ERR if we could not send them all.
+ */
+extern int ether_frame_send_burst(struct packet_socket *psock,
+				  const struct ether_frame_headers *headers,
+				  struct packet **packets, int num_packets);
+
 #endif /* __LINK_LAYER_H__ */
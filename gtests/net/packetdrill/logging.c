@@ -25,38 +25,39 @@
 #include "run.h"
 #include "system.h"
 
+#include <errno.h>
 #include <stdarg.h>
 #include <stdlib.h>
 
 extern void __attribute__((noreturn)) die(char *format, ...)
 {
+	char *message = NULL;
 	va_list ap;
 
 	va_start(ap, format);
-	vfprintf(stderr, format, ap);
+	if (vasprintf(&message, format, ap) < 0)
+		message = NULL;
 	va_end(ap);
 
-	run_cleanup_command();
+	if (message != NULL)
+		fputs(message, stderr);
+
+	run_cleanup_all(message);
 
 	exit(EXIT_FAILURE);
 }
 
 void __attribute__((noreturn)) die_perror(char *message)
 {
-	perror(message);
-
-	run_cleanup_command();
+	int err = errno;
 
-	exit(EXIT_FAILURE);
+	die_strerror(message, err);
 }
 
 void __attribute__((noreturn)) die_strerror(char *message, int err)
 {
 	if ((message != NULL) && (strlen(message) > 0))
-		fprintf(stderr, "%s: %s\n", message, strerror(err));
+		die("%s: %s\n", message, strerror(err));
 	else
-		fprintf(stderr, "%s\n", strerror(err));
-	run_cleanup_command();
-
-	exit(EXIT_FAILURE);
+		die("%s\n", strerror(err));
 }
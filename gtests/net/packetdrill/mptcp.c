@@ -0,0 +1,1096 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for Multipath TCP (RFC 8684) option encoding, crypto,
+ * and script/live mapping.
+ */
+
+#include "mptcp.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "tcp.h"
+#include "tcp_options_iterator.h"
+#include "unaligned.h"
+
+struct mptcp_state *mptcp_state_new(void)
+{
+	return calloc(1, sizeof(struct mptcp_state));
+}
+
+void mptcp_state_free(struct mptcp_state *mptcp)
+{
+	if (mptcp == NULL)
+		return;
+	memset(mptcp, 0, sizeof(*mptcp));  /* paranoia to help catch bugs */
+	free(mptcp);
+}
+
+/* A small self-contained SHA-256 (FIPS 180-4), enough for MPTCP keys. */
+
+static const u32 sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline u32 ror32(u32 x, int n)
+{
+	return (x >> n) | (x << (32 - n));
+}
+
+static void sha256_block(u32 h[8], const u8 *block)
+{
+	u32 w[64], a, b, c, d, e, f, g, k, t1, t2;
+	int i;
+
+	for (i = 0; i < 16; ++i)
+		w[i] = get_unaligned_be32(block + 4 * i);
+	for (i = 16; i < 64; ++i) {
+		u32 s0 = ror32(w[i-15], 7) ^ ror32(w[i-15], 18) ^
+			 (w[i-15] >> 3);
+		u32 s1 = ror32(w[i-2], 17) ^ ror32(w[i-2], 19) ^
+			 (w[i-2] >> 10);
+		w[i] = w[i-16] + s0 + w[i-7] + s1;
+	}
+
+	a = h[0]; b = h[1]; c = h[2]; d = h[3];
+	e = h[4]; f = h[5]; g = h[6]; k = h[7];
+	for (i = 0; i < 64; ++i) {
+		t1 = k + (ror32(e, 6) ^ ror32(e, 11) ^ ror32(e, 25)) +
+		     ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+		t2 = (ror32(a, 2) ^ ror32(a, 13) ^ ror32(a, 22)) +
+		     ((a & b) ^ (a & c) ^ (b & c));
+		k = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+	h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+}
+
+void mptcp_sha256(const u8 *data, int len, u8 digest[32])
+{
+	u32 h[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+	u8 tail[128];
+	int full = len & ~63, rest = len - full, tail_len, i;
+
+	for (i = 0; i < full; i += 64)
+		sha256_block(h, data + i);
+
+	/* Pad the trailing partial block with 0x80, zeros, and the
+	 * message length in bits, spilling into a second block if needed.
+	 */
+	memset(tail, 0, sizeof(tail));
+	memcpy(tail, data + full, rest);
+	tail[rest] = 0x80;
+	tail_len = (rest < 56) ? 64 : 128;
+	put_unaligned_be64((u64)len * 8, tail + tail_len - 8);
+	for (i = 0; i < tail_len; i += 64)
+		sha256_block(h, tail + i);
+
+	for (i = 0; i < 8; ++i)
+		put_unaligned_be32(h[i], digest + 4 * i);
+}
+
+/* The longest HMAC message we compute: ADD_ADDR with an IPv6 address. */
+#define MPTCP_MAX_HMAC_MSG_BYTES	(1 + 16 + 2)
+
+void mptcp_hmac(u64 key1, u64 key2, const u8 *msg, int len,
+		u8 digest[MPTCP_HMAC_BYTES])
+{
+	u8 pad[64 + MPTCP_MAX_HMAC_MSG_BYTES];
+	u8 outer[64 + MPTCP_HMAC_BYTES];
+	u8 key[16];
+	int i;
+
+	assert(len <= MPTCP_MAX_HMAC_MSG_BYTES);
+	put_unaligned_be64(key1, key);
+	put_unaligned_be64(key2, key + 8);
+
+	/* inner = SHA256((key ^ ipad) || msg) */
+	memset(pad, 0x36, 64);
+	for (i = 0; i < sizeof(key); ++i)
+		pad[i] ^= key[i];
+	memcpy(pad + 64, msg, len);
+	mptcp_sha256(pad, 64 + len, outer + 64);
+
+	/* HMAC = SHA256((key ^ opad) || inner) */
+	memset(outer, 0x5c, 64);
+	for (i = 0; i < sizeof(key); ++i)
+		outer[i] ^= key[i];
+	mptcp_sha256(outer, sizeof(outer), digest);
+}
+
+u32 mptcp_key_token(u64 key)
+{
+	u8 input[8], digest[32];
+
+	put_unaligned_be64(key, input);
+	mptcp_sha256(input, sizeof(input), digest);
+	return get_unaligned_be32(digest);	/* most significant 32 bits */
+}
+
+u64 mptcp_key_idsn(u64 key)
+{
+	u8 input[8], digest[32];
+
+	put_unaligned_be64(key, input);
+	mptcp_sha256(input, sizeof(input), digest);
+	return get_unaligned_be64(digest + 24);	/* least significant 64 bits */
+}
+
+/* Return the wire bytes after the kind and length bytes. */
+static inline u8 *mptcp_option_bytes(const struct tcp_option *option)
+{
+	return (u8 *)option + 2;
+}
+
+static int mptcp_capable_parse(const struct tcp_option *option,
+			       struct mptcp_option *mp, char **error)
+{
+	const u8 *p = mptcp_option_bytes(option);
+
+	switch (option->length) {
+	case TCPOLEN_MPTCP_CAPABLE_CSUM:
+		mp->has_checksum = true;
+		mp->checksum = get_unaligned_be16(p + 20);
+		/* fall through */
+	case TCPOLEN_MPTCP_CAPABLE_DATA:
+		mp->has_data_len = true;
+		mp->data_len = get_unaligned_be16(p + 18);
+		/* fall through */
+	case TCPOLEN_MPTCP_CAPABLE_ACK:
+		mp->has_receiver_key = true;
+		mp->receiver_key = get_unaligned_be64(p + 10);
+		/* fall through */
+	case TCPOLEN_MPTCP_CAPABLE_SYNACK:
+		mp->has_sender_key = true;
+		mp->sender_key = get_unaligned_be64(p + 2);
+		/* fall through */
+	case TCPOLEN_MPTCP_CAPABLE_SYN:
+		break;
+	default:
+		asprintf(error, "bad MP_CAPABLE option length: %u",
+			 option->length);
+		return STATUS_ERR;
+	}
+	mp->version = p[0] & 0x0f;
+	mp->flags = p[1];
+	return STATUS_OK;
+}
+
+static int mptcp_join_parse(const struct tcp_option *option,
+			    struct mptcp_option *mp, char **error)
+{
+	const u8 *p = mptcp_option_bytes(option);
+
+	mp->flags = p[0] & MPTCP_JOIN_FLAG_BACKUP;
+	switch (option->length) {
+	case TCPOLEN_MPTCP_JOIN_SYN:
+		mp->addr_id = p[1];
+		mp->has_token = true;
+		mp->token = get_unaligned_be32(p + 2);
+		mp->has_nonce = true;
+		mp->nonce = get_unaligned_be32(p + 6);
+		break;
+	case TCPOLEN_MPTCP_JOIN_SYNACK:
+		mp->addr_id = p[1];
+		mp->hmac_bytes = MPTCP_JOIN_SYNACK_HMAC_BYTES;
+		memcpy(mp->hmac, p + 2, mp->hmac_bytes);
+		mp->has_nonce = true;
+		mp->nonce = get_unaligned_be32(p + 10);
+		break;
+	case TCPOLEN_MPTCP_JOIN_ACK:
+		mp->hmac_bytes = MPTCP_JOIN_ACK_HMAC_BYTES;
+		memcpy(mp->hmac, p + 2, mp->hmac_bytes);
+		break;
+	default:
+		asprintf(error, "bad MP_JOIN option length: %u",
+			 option->length);
+		return STATUS_ERR;
+	}
+	return STATUS_OK;
+}
+
+/* Return whether a DSS option is long enough to hold a field of the
+ * given size at the given offset past its kind and length bytes.
+ */
+static bool mptcp_dss_has_field(const struct tcp_option *option,
+				int offset, int bytes)
+{
+	return offset + bytes + 2 <= option->length;
+}
+
+static int mptcp_dss_parse(const struct tcp_option *option,
+			   struct mptcp_option *mp, char **error)
+{
+	const u8 *p = mptcp_option_bytes(option);
+	int offset = 2;
+	int bytes;
+
+	mp->flags = p[1] & 0x1f;
+	if (mp->flags & MPTCP_DSS_FLAG_ACK) {
+		bytes = (mp->flags & MPTCP_DSS_FLAG_ACK64) ? 8 : 4;
+		if (!mptcp_dss_has_field(option, offset, bytes))
+			goto bad_length;
+		if (bytes == 8)
+			mp->data_ack = get_unaligned_be64(p + offset);
+		else
+			mp->data_ack = get_unaligned_be32(p + offset);
+		offset += bytes;
+	}
+	if (mp->flags & MPTCP_DSS_FLAG_DSN) {
+		bytes = (mp->flags & MPTCP_DSS_FLAG_DSN64) ? 8 : 4;
+		if (!mptcp_dss_has_field(option, offset, bytes))
+			goto bad_length;
+		if (bytes == 8)
+			mp->dsn = get_unaligned_be64(p + offset);
+		else
+			mp->dsn = get_unaligned_be32(p + offset);
+		offset += bytes;
+		if (!mptcp_dss_has_field(option, offset, 4))
+			goto bad_length;
+		mp->ssn = get_unaligned_be32(p + offset);
+		offset += 4;
+		if (!mptcp_dss_has_field(option, offset, 2))
+			goto bad_length;
+		mp->has_data_len = true;
+		mp->data_len = get_unaligned_be16(p + offset);
+		offset += 2;
+		if (offset + 2 + 2 == option->length) {
+			mp->has_checksum = true;
+			mp->checksum = get_unaligned_be16(p + offset);
+			offset += 2;
+		}
+	}
+	if (offset + 2 != option->length)
+		goto bad_length;
+	return STATUS_OK;
+
+bad_length:
+	asprintf(error, "bad DSS option length: %u", option->length);
+	return STATUS_ERR;
+}
+
+static int mptcp_add_addr_parse(const struct tcp_option *option,
+				struct mptcp_option *mp, char **error)
+{
+	const u8 *p = mptcp_option_bytes(option);
+	int rest = option->length - 4;	/* bytes after the address id */
+	int addr_bytes;
+
+	mp->flags = p[0] & MPTCP_ADD_ADDR_FLAG_ECHO;
+	mp->addr_id = p[1];
+	if (rest == 4 || rest == 6 || rest == 12 || rest == 14) {
+		mp->addr.address_family = AF_INET;
+		addr_bytes = 4;
+	} else if (rest == 16 || rest == 18 || rest == 24 || rest == 26) {
+		mp->addr.address_family = AF_INET6;
+		addr_bytes = 16;
+	} else {
+		asprintf(error, "bad ADD_ADDR option length: %u",
+			 option->length);
+		return STATUS_ERR;
+	}
+	memcpy(mp->addr.ip.bytes, p + 2, addr_bytes);
+	rest -= addr_bytes;
+	if (rest == 2 || rest == 10) {
+		mp->has_port = true;
+		mp->port = get_unaligned_be16(p + 2 + addr_bytes);
+		rest -= 2;
+	}
+	if (rest == MPTCP_ADD_ADDR_HMAC_BYTES) {
+		mp->hmac_bytes = MPTCP_ADD_ADDR_HMAC_BYTES;
+		memcpy(mp->hmac, p + option->length - 2 - rest, rest);
+	}
+	return STATUS_OK;
+}
+
+int mptcp_option_parse(const struct tcp_option *option,
+		       struct mptcp_option *mp, char **error)
+{
+	memset(mp, 0, sizeof(*mp));
+	if (option->length < 4) {
+		asprintf(error, "MPTCP option too short");
+		return STATUS_ERR;
+	}
+	mp->subtype = option->data.mptcp.subtype >> 4;
+	switch (mp->subtype) {
+	case MPTCP_SUBTYPE_CAPABLE:
+		return mptcp_capable_parse(option, mp, error);
+	case MPTCP_SUBTYPE_JOIN:
+		return mptcp_join_parse(option, mp, error);
+	case MPTCP_SUBTYPE_DSS:
+		return mptcp_dss_parse(option, mp, error);
+	case MPTCP_SUBTYPE_ADD_ADDR:
+		return mptcp_add_addr_parse(option, mp, error);
+	default:
+		asprintf(error, "unsupported MPTCP option subtype: %u",
+			 mp->subtype);
+		return STATUS_ERR;
+	}
+}
+
+int mptcp_option_length(const struct mptcp_option *mp)
+{
+	int length = 4;
+
+	switch (mp->subtype) {
+	case MPTCP_SUBTYPE_CAPABLE:
+		if (mp->has_checksum)
+			return TCPOLEN_MPTCP_CAPABLE_CSUM;
+		if (mp->has_data_len)
+			return TCPOLEN_MPTCP_CAPABLE_DATA;
+		if (mp->has_receiver_key)
+			return TCPOLEN_MPTCP_CAPABLE_ACK;
+		if (mp->has_sender_key)
+			return TCPOLEN_MPTCP_CAPABLE_SYNACK;
+		return TCPOLEN_MPTCP_CAPABLE_SYN;
+	case MPTCP_SUBTYPE_JOIN:
+		if (mp->has_token)
+			return TCPOLEN_MPTCP_JOIN_SYN;
+		if (mp->has_nonce)
+			return TCPOLEN_MPTCP_JOIN_SYNACK;
+		return TCPOLEN_MPTCP_JOIN_ACK;
+	case MPTCP_SUBTYPE_DSS:
+		if (mp->flags & MPTCP_DSS_FLAG_ACK)
+			length += (mp->flags & MPTCP_DSS_FLAG_ACK64) ? 8 : 4;
+		if (mp->flags & MPTCP_DSS_FLAG_DSN) {
+			length += (mp->flags & MPTCP_DSS_FLAG_DSN64) ? 8 : 4;
+			length += 4 + 2;
+			if (mp->has_checksum)
+				length += 2;
+		}
+		return length;
+	case MPTCP_SUBTYPE_ADD_ADDR:
+		length += ip_address_length(mp->addr.address_family);
+		if (mp->has_port)
+			length += 2;
+		return length + mp->hmac_bytes;
+	default:
+		assert(!"bad MPTCP subtype");
+	}
+	return 0;
+}
+
+void mptcp_option_write(const struct mptcp_option *mp,
+			struct tcp_option *option)
+{
+	u8 *p = mptcp_option_bytes(option);
+	int offset;
+
+	option->kind = TCPOPT_MPTCP;
+	option->length = mptcp_option_length(mp);
+	memset(p, 0, option->length - 2);
+	p[0] = mp->subtype << 4;
+
+	switch (mp->subtype) {
+	case MPTCP_SUBTYPE_CAPABLE:
+		p[0] |= mp->version & 0x0f;
+		p[1] = mp->flags;
+		if (mp->has_sender_key)
+			put_unaligned_be64(mp->sender_key, p + 2);
+		if (mp->has_receiver_key)
+			put_unaligned_be64(mp->receiver_key, p + 10);
+		if (mp->has_data_len)
+			put_unaligned_be16(mp->data_len, p + 18);
+		if (mp->has_checksum)
+			put_unaligned_be16(mp->checksum, p + 20);
+		break;
+	case MPTCP_SUBTYPE_JOIN:
+		p[0] |= mp->flags & MPTCP_JOIN_FLAG_BACKUP;
+		if (mp->has_token) {
+			p[1] = mp->addr_id;
+			put_unaligned_be32(mp->token, p + 2);
+			put_unaligned_be32(mp->nonce, p + 6);
+		} else if (mp->has_nonce) {
+			p[1] = mp->addr_id;
+			memcpy(p + 2, mp->hmac, MPTCP_JOIN_SYNACK_HMAC_BYTES);
+			put_unaligned_be32(mp->nonce, p + 10);
+		} else {
+			memcpy(p + 2, mp->hmac, MPTCP_JOIN_ACK_HMAC_BYTES);
+		}
+		break;
+	case MPTCP_SUBTYPE_DSS:
+		p[1] = mp->flags;
+		offset = 2;
+		if (mp->flags & MPTCP_DSS_FLAG_ACK) {
+			if (mp->flags & MPTCP_DSS_FLAG_ACK64) {
+				put_unaligned_be64(mp->data_ack, p + offset);
+				offset += 8;
+			} else {
+				put_unaligned_be32(mp->data_ack, p + offset);
+				offset += 4;
+			}
+		}
+		if (mp->flags & MPTCP_DSS_FLAG_DSN) {
+			if (mp->flags & MPTCP_DSS_FLAG_DSN64) {
+				put_unaligned_be64(mp->dsn, p + offset);
+				offset += 8;
+			} else {
+				put_unaligned_be32(mp->dsn, p + offset);
+				offset += 4;
+			}
+			put_unaligned_be32(mp->ssn, p + offset);
+			put_unaligned_be16(mp->data_len, p + offset + 4);
+			offset += 6;
+			if (mp->has_checksum)
+				put_unaligned_be16(mp->checksum, p + offset);
+		}
+		break;
+	case MPTCP_SUBTYPE_ADD_ADDR:
+		p[0] |= mp->flags & MPTCP_ADD_ADDR_FLAG_ECHO;
+		p[1] = mp->addr_id;
+		offset = 2 + ip_address_length(mp->addr.address_family);
+		memcpy(p + 2, mp->addr.ip.bytes, offset - 2);
+		if (mp->has_port) {
+			put_unaligned_be16(mp->port, p + offset);
+			offset += 2;
+		}
+		memcpy(p + offset, mp->hmac, mp->hmac_bytes);
+		break;
+	default:
+		assert(!"bad MPTCP subtype");
+	}
+}
+
+int mptcp_option_init(struct mptcp_option *mp, const char *subtype,
+		      char **error)
+{
+	memset(mp, 0, sizeof(*mp));
+	if (strcmp(subtype, "capable") == 0) {
+		mp->subtype = MPTCP_SUBTYPE_CAPABLE;
+		mp->version = 1;
+		mp->flags = MPTCP_CAPABLE_FLAG_H;
+	} else if (strcmp(subtype, "join") == 0) {
+		mp->subtype = MPTCP_SUBTYPE_JOIN;
+	} else if (strcmp(subtype, "dss") == 0) {
+		mp->subtype = MPTCP_SUBTYPE_DSS;
+	} else if (strcmp(subtype, "add_addr") == 0) {
+		mp->subtype = MPTCP_SUBTYPE_ADD_ADDR;
+		mp->addr.address_family = AF_INET;
+	} else {
+		asprintf(error, "unknown MPTCP option subtype: %s", subtype);
+		return STATUS_ERR;
+	}
+	return STATUS_OK;
+}
+
+/* Report a field name that does not belong to the option's subtype. */
+static int mptcp_bad_field(const char *name, char **error)
+{
+	asprintf(error, "unexpected MPTCP option field: %s", name);
+	return STATUS_ERR;
+}
+
+int mptcp_option_set_flag(struct mptcp_option *mp, const char *name,
+			  char **error)
+{
+	if (mp->subtype == MPTCP_SUBTYPE_CAPABLE &&
+	    strcmp(name, "v0") == 0)
+		mp->version = 0;
+	else if (mp->subtype == MPTCP_SUBTYPE_CAPABLE &&
+		 strcmp(name, "v1") == 0)
+		mp->version = 1;
+	else if (mp->subtype == MPTCP_SUBTYPE_JOIN &&
+		 strcmp(name, "backup") == 0)
+		mp->flags |= MPTCP_JOIN_FLAG_BACKUP;
+	else if (mp->subtype == MPTCP_SUBTYPE_DSS &&
+		 strcmp(name, "ack64") == 0)
+		mp->flags |= MPTCP_DSS_FLAG_ACK64;
+	else if (mp->subtype == MPTCP_SUBTYPE_DSS &&
+		 strcmp(name, "dsn64") == 0)
+		mp->flags |= MPTCP_DSS_FLAG_DSN64;
+	else if (mp->subtype == MPTCP_SUBTYPE_DSS &&
+		 strcmp(name, "fin") == 0)
+		mp->flags |= MPTCP_DSS_FLAG_DATA_FIN;
+	else if (mp->subtype == MPTCP_SUBTYPE_ADD_ADDR &&
+		 strcmp(name, "echo") == 0)
+		mp->flags |= MPTCP_ADD_ADDR_FLAG_ECHO;
+	else
+		return mptcp_bad_field(name, error);
+	return STATUS_OK;
+}
+
+int mptcp_option_set_integer(struct mptcp_option *mp, const char *name,
+			     s64 value, char **error)
+{
+	const u8 subtype = mp->subtype;
+
+	if (subtype == MPTCP_SUBTYPE_CAPABLE && !strcmp(name, "flags")) {
+		if (!is_valid_u8(value))
+			goto out_of_range;
+		mp->flags = value;
+	} else if (subtype == MPTCP_SUBTYPE_CAPABLE && !strcmp(name, "key")) {
+		/* The first key is the sender's, the second the receiver's. */
+		if (!mp->has_sender_key) {
+			mp->has_sender_key = true;
+			mp->sender_key = value;
+		} else if (!mp->has_receiver_key) {
+			mp->has_receiver_key = true;
+			mp->receiver_key = value;
+		} else {
+			asprintf(error, "too many MP_CAPABLE keys");
+			return STATUS_ERR;
+		}
+	} else if ((subtype == MPTCP_SUBTYPE_CAPABLE ||
+		    subtype == MPTCP_SUBTYPE_DSS) && !strcmp(name, "dlen")) {
+		if (!is_valid_u16(value))
+			goto out_of_range;
+		mp->has_data_len = true;
+		mp->data_len = value;
+	} else if ((subtype == MPTCP_SUBTYPE_CAPABLE ||
+		    subtype == MPTCP_SUBTYPE_DSS) && !strcmp(name, "csum")) {
+		if (!is_valid_u16(value))
+			goto out_of_range;
+		mp->has_checksum = true;
+		mp->checksum = value;
+	} else if ((subtype == MPTCP_SUBTYPE_JOIN ||
+		    subtype == MPTCP_SUBTYPE_ADD_ADDR) && !strcmp(name, "id")) {
+		if (!is_valid_u8(value))
+			goto out_of_range;
+		mp->addr_id = value;
+	} else if (subtype == MPTCP_SUBTYPE_JOIN && !strcmp(name, "token")) {
+		if (!is_valid_u32(value))
+			goto out_of_range;
+		mp->has_token = true;
+		mp->token = value;
+	} else if (subtype == MPTCP_SUBTYPE_JOIN && !strcmp(name, "nonce")) {
+		if (!is_valid_u32(value))
+			goto out_of_range;
+		mp->has_nonce = true;
+		mp->nonce = value;
+	} else if ((subtype == MPTCP_SUBTYPE_JOIN ||
+		    subtype == MPTCP_SUBTYPE_ADD_ADDR) && !strcmp(name, "hmac")) {
+		/* An integer gives the leading 64 bits of the HMAC. */
+		if (value < 0)
+			goto out_of_range;
+		memset(mp->hmac, 0, sizeof(mp->hmac));
+		put_unaligned_be64(value, mp->hmac);
+	} else if (subtype == MPTCP_SUBTYPE_DSS && !strcmp(name, "dack")) {
+		/* Whether it must fit in 32 bits depends on ack64, which
+		 * may come later, so mptcp_option_new() checks that.
+		 */
+		if (value < 0)
+			goto out_of_range;
+		mp->flags |= MPTCP_DSS_FLAG_ACK;
+		mp->data_ack = value;
+	} else if (subtype == MPTCP_SUBTYPE_DSS && !strcmp(name, "dsn")) {
+		if (value < 0)
+			goto out_of_range;
+		mp->flags |= MPTCP_DSS_FLAG_DSN;
+		mp->dsn = value;
+	} else if (subtype == MPTCP_SUBTYPE_DSS && !strcmp(name, "sseq")) {
+		if (!is_valid_u32(value))
+			goto out_of_range;
+		mp->ssn = value;
+	} else if (subtype == MPTCP_SUBTYPE_ADD_ADDR && !strcmp(name, "port")) {
+		if (!is_valid_u16(value))
+			goto out_of_range;
+		mp->has_port = true;
+		mp->port = value;
+	} else {
+		return mptcp_bad_field(name, error);
+	}
+	return STATUS_OK;
+
+out_of_range:
+	asprintf(error, "MPTCP option %s value out of range", name);
+	return STATUS_ERR;
+}
+
+/* Parse a string of hex digits into the given buffer, right-padding
+ * with zeros. Returns STATUS_OK on success; on failure returns
+ * STATUS_ERR and sets error message.
+ */
+static int parse_hex_bytes(const char *hex, u8 *buf, int buf_len,
+			   char **error)
+{
+	int i, len = strlen(hex);
+
+	if (len % 2 != 0 || len / 2 > buf_len) {
+		asprintf(error, "bad MPTCP HMAC: %s", hex);
+		return STATUS_ERR;
+	}
+	memset(buf, 0, buf_len);
+	for (i = 0; i < len / 2; ++i) {
+		unsigned int byte;
+
+		if (sscanf(hex + 2 * i, "%2x", &byte) != 1) {
+			asprintf(error, "bad MPTCP HMAC: %s", hex);
+			return STATUS_ERR;
+		}
+		buf[i] = byte;
+	}
+	return STATUS_OK;
+}
+
+int mptcp_option_set_string(struct mptcp_option *mp, const char *name,
+			    const char *value, char **error)
+{
+	if ((mp->subtype == MPTCP_SUBTYPE_JOIN ||
+	     mp->subtype == MPTCP_SUBTYPE_ADD_ADDR) &&
+	    strcmp(name, "hmac") == 0)
+		return parse_hex_bytes(value, mp->hmac, sizeof(mp->hmac),
+				       error);
+
+	if (mp->subtype == MPTCP_SUBTYPE_ADD_ADDR && strcmp(name, "ip") == 0) {
+		if (inet_pton(AF_INET, value, &mp->addr.ip.v4) == 1) {
+			mp->addr.address_family = AF_INET;
+		} else if (inet_pton(AF_INET6, value, &mp->addr.ip.v6) == 1) {
+			mp->addr.address_family = AF_INET6;
+		} else {
+			asprintf(error, "bad ADD_ADDR address: %s", value);
+			return STATUS_ERR;
+		}
+		return STATUS_OK;
+	}
+
+	return mptcp_bad_field(name, error);
+}
+
+struct tcp_option *mptcp_option_new(const struct mptcp_option *script_mp,
+				    char **error)
+{
+	struct mptcp_option mp = *script_mp;
+	struct tcp_option *option = NULL;
+
+	/* Fill in the layout details implied by the script fields. */
+	switch (mp.subtype) {
+	case MPTCP_SUBTYPE_CAPABLE:
+		if (mp.has_checksum && !mp.has_data_len) {
+			asprintf(error, "MP_CAPABLE csum requires dlen");
+			return NULL;
+		}
+		if (mp.has_data_len && !mp.has_receiver_key) {
+			asprintf(error, "MP_CAPABLE dlen requires two keys");
+			return NULL;
+		}
+		break;
+	case MPTCP_SUBTYPE_JOIN:
+		if (mp.has_token)
+			mp.has_nonce = true;
+		else if (mp.has_nonce)
+			mp.hmac_bytes = MPTCP_JOIN_SYNACK_HMAC_BYTES;
+		else
+			mp.hmac_bytes = MPTCP_JOIN_ACK_HMAC_BYTES;
+		break;
+	case MPTCP_SUBTYPE_DSS:
+		if ((mp.flags & MPTCP_DSS_FLAG_DSN) && !mp.has_data_len) {
+			asprintf(error, "DSS mapping requires dlen");
+			return NULL;
+		}
+		if ((mp.flags & MPTCP_DSS_FLAG_ACK) &&
+		    !(mp.flags & MPTCP_DSS_FLAG_ACK64) &&
+		    !is_valid_u32(mp.data_ack)) {
+			asprintf(error, "DSS dack out of range without ack64");
+			return NULL;
+		}
+		if ((mp.flags & MPTCP_DSS_FLAG_DSN) &&
+		    !(mp.flags & MPTCP_DSS_FLAG_DSN64) &&
+		    !is_valid_u32(mp.dsn)) {
+			asprintf(error, "DSS dsn out of range without dsn64");
+			return NULL;
+		}
+		break;
+	case MPTCP_SUBTYPE_ADD_ADDR:
+		if (!(mp.flags & MPTCP_ADD_ADDR_FLAG_ECHO))
+			mp.hmac_bytes = MPTCP_ADD_ADDR_HMAC_BYTES;
+		break;
+	}
+
+	option = tcp_option_new(TCPOPT_MPTCP, mptcp_option_length(&mp));
+	mptcp_option_write(&mp, option);
+	return option;
+}
+
+static void hmac_to_string(FILE *s, const struct mptcp_option *mp)
+{
+	int i;
+
+	fputs(" hmac=", s);
+	for (i = 0; i < mp->hmac_bytes; ++i)
+		fprintf(s, "%02x", mp->hmac[i]);
+}
+
+int mptcp_option_to_string(FILE *s, const struct tcp_option *option,
+			   char **error)
+{
+	struct mptcp_option mp;
+	char buffer[ADDR_STR_LEN];
+
+	if (mptcp_option_parse(option, &mp, error))
+		return STATUS_ERR;
+
+	fputs("mptcp", s);
+	switch (mp.subtype) {
+	case MPTCP_SUBTYPE_CAPABLE:
+		fprintf(s, " capable v%u flags=0x%x", mp.version, mp.flags);
+		if (mp.has_sender_key)
+			fprintf(s, " key=0x%llx", mp.sender_key);
+		if (mp.has_receiver_key)
+			fprintf(s, " key=0x%llx", mp.receiver_key);
+		if (mp.has_data_len)
+			fprintf(s, " dlen=%u", mp.data_len);
+		if (mp.has_checksum)
+			fprintf(s, " csum=0x%x", mp.checksum);
+		break;
+	case MPTCP_SUBTYPE_JOIN:
+		fputs(" join", s);
+		if (mp.flags & MPTCP_JOIN_FLAG_BACKUP)
+			fputs(" backup", s);
+		if (mp.has_nonce)
+			fprintf(s, " id=%u", mp.addr_id);
+		if (mp.has_token)
+			fprintf(s, " token=0x%x", mp.token);
+		if (mp.hmac_bytes > 0)
+			hmac_to_string(s, &mp);
+		if (mp.has_nonce)
+			fprintf(s, " nonce=0x%x", mp.nonce);
+		break;
+	case MPTCP_SUBTYPE_DSS:
+		fputs(" dss", s);
+		if (mp.flags & MPTCP_DSS_FLAG_ACK)
+			fprintf(s, " dack=%llu", mp.data_ack);
+		if (mp.flags & MPTCP_DSS_FLAG_ACK64)
+			fputs(" ack64", s);
+		if (mp.flags & MPTCP_DSS_FLAG_DSN)
+			fprintf(s, " dsn=%llu sseq=%u dlen=%u",
+				mp.dsn, mp.ssn, mp.data_len);
+		if (mp.flags & MPTCP_DSS_FLAG_DSN64)
+			fputs(" dsn64", s);
+		if (mp.has_checksum)
+			fprintf(s, " csum=0x%x", mp.checksum);
+		if (mp.flags & MPTCP_DSS_FLAG_DATA_FIN)
+			fputs(" fin", s);
+		break;
+	case MPTCP_SUBTYPE_ADD_ADDR:
+		fputs(" add_addr", s);
+		if (mp.flags & MPTCP_ADD_ADDR_FLAG_ECHO)
+			fputs(" echo", s);
+		fprintf(s, " id=%u ip=%s", mp.addr_id,
+			ip_to_string(&mp.addr, buffer));
+		if (mp.has_port)
+			fprintf(s, " port=%u", mp.port);
+		if (mp.hmac_bytes > 0)
+			hmac_to_string(s, &mp);
+		break;
+	}
+	return STATUS_OK;
+}
+
+/* Return the per-subflow state for the given subflow index. */
+static struct mptcp_subflow *mptcp_subflow(struct mptcp_state *mptcp,
+					   int subflow)
+{
+	assert(subflow >= 0 && subflow < MPTCP_MAX_SUBFLOWS);
+	return &mptcp->subflows[subflow];
+}
+
+static void mptcp_set_remote_key(struct mptcp_state *mptcp, u64 key)
+{
+	if (mptcp->has_remote_key)
+		return;
+	mptcp->has_remote_key = true;
+	mptcp->remote_key = key;
+	mptcp->remote_idsn = mptcp_key_idsn(key);
+}
+
+/* Return true iff all of the given HMAC bytes are zero, which in a
+ * script means "fill in the correct value".
+ */
+static bool is_zero_hmac(const struct mptcp_option *mp)
+{
+	int i;
+
+	for (i = 0; i < mp->hmac_bytes; ++i) {
+		if (mp->hmac[i] != 0)
+			return false;
+	}
+	return true;
+}
+
+/* Compute the HMAC for the ADD_ADDR option mp sent by the holder of
+ * key1, and store its rightmost 64 bits in *hmac.
+ */
+static void mptcp_add_addr_hmac(const struct mptcp_option *mp,
+				u64 key1, u64 key2, u8 *hmac)
+{
+	u8 msg[MPTCP_MAX_HMAC_MSG_BYTES], digest[MPTCP_HMAC_BYTES];
+	int addr_bytes = ip_address_length(mp->addr.address_family);
+
+	msg[0] = mp->addr_id;
+	memcpy(msg + 1, mp->addr.ip.bytes, addr_bytes);
+	put_unaligned_be16(mp->has_port ? mp->port : 0, msg + 1 + addr_bytes);
+	mptcp_hmac(key1, key2, msg, 1 + addr_bytes + 2, digest);
+	memcpy(hmac, digest + MPTCP_HMAC_BYTES - MPTCP_ADD_ADDR_HMAC_BYTES,
+	       MPTCP_ADD_ADDR_HMAC_BYTES);
+}
+
+/* Compute the MP_JOIN HMAC sent by the holder of key1 and nonce1. */
+static void mptcp_join_hmac(u64 key1, u64 key2, u32 nonce1, u32 nonce2,
+			    u8 digest[MPTCP_HMAC_BYTES])
+{
+	u8 msg[8];
+
+	put_unaligned_be32(nonce1, msg);
+	put_unaligned_be32(nonce2, msg + 4);
+	mptcp_hmac(key1, key2, msg, sizeof(msg), digest);
+}
+
+bool packet_has_mptcp_option(struct packet *packet)
+{
+	struct tcp_options_iterator iter;
+	struct tcp_option *option = NULL;
+	char *error = NULL;
+	bool found = false;
+
+	for (option = tcp_options_begin(packet, &iter); option != NULL;
+	     option = tcp_options_next(&iter, &error)) {
+		if (option->kind == TCPOPT_MPTCP) {
+			found = true;
+			break;
+		}
+	}
+	free(error);
+	return found;
+}
+
+/* Find the first MPTCP option of the given subtype in the packet.
+ * Returns STATUS_OK if found; otherwise returns STATUS_ERR.
+ */
+static int find_mptcp_option(struct packet *packet, u8 subtype,
+			     struct mptcp_option *mp)
+{
+	struct tcp_options_iterator iter;
+	struct tcp_option *option = NULL;
+	char *error = NULL;
+
+	for (option = tcp_options_begin(packet, &iter); option != NULL;
+	     option = tcp_options_next(&iter, &error)) {
+		if (option->kind != TCPOPT_MPTCP)
+			continue;
+		if (mptcp_option_parse(option, mp, &error))
+			break;
+		if (mp->subtype == subtype)
+			return STATUS_OK;
+	}
+	free(error);
+	return STATUS_ERR;
+}
+
+static void map_inbound_option(struct mptcp_state *mptcp,
+			       struct mptcp_subflow *sf,
+			       struct mptcp_option *mp)
+{
+	const u64 local_idsn = mptcp->has_local_key ?
+		mptcp->live_local_idsn : 0;
+	u8 digest[MPTCP_HMAC_BYTES];
+
+	switch (mp->subtype) {
+	case MPTCP_SUBTYPE_CAPABLE:
+		if (mp->has_sender_key)
+			mptcp_set_remote_key(mptcp, mp->sender_key);
+		if (mp->has_receiver_key && mptcp->has_local_key &&
+		    mp->receiver_key == mptcp->script_local_key)
+			mp->receiver_key = mptcp->live_local_key;
+		break;
+	case MPTCP_SUBTYPE_JOIN:
+		if (mp->has_nonce)
+			sf->remote_nonce = mp->nonce;
+		if (!mptcp->has_local_key || !mptcp->has_remote_key)
+			break;
+		if (mp->has_token) {
+			if (mp->token == 0 ||
+			    mp->token ==
+			    mptcp_key_token(mptcp->script_local_key))
+				mp->token =
+				    mptcp_key_token(mptcp->live_local_key);
+		} else if (is_zero_hmac(mp)) {
+			mptcp_join_hmac(mptcp->remote_key,
+					mptcp->live_local_key,
+					sf->remote_nonce,
+					sf->live_local_nonce, digest);
+			memcpy(mp->hmac, digest, mp->hmac_bytes);
+		}
+		break;
+	case MPTCP_SUBTYPE_DSS:
+		/* Data sequence numbers in the script are relative to the
+		 * IDSN of the sending end, much like TCP sequence numbers.
+		 */
+		if (mp->flags & MPTCP_DSS_FLAG_ACK)
+			mp->data_ack += local_idsn;
+		if (mp->flags & MPTCP_DSS_FLAG_DSN)
+			mp->dsn += mptcp->remote_idsn;
+		break;
+	case MPTCP_SUBTYPE_ADD_ADDR:
+		if (mp->hmac_bytes > 0 && is_zero_hmac(mp) &&
+		    mptcp->has_local_key && mptcp->has_remote_key)
+			mptcp_add_addr_hmac(mp, mptcp->remote_key,
+					    mptcp->live_local_key, mp->hmac);
+		break;
+	}
+}
+
+int mptcp_map_inbound_packet(struct mptcp_state *mptcp, int subflow,
+			     struct packet *live_packet, char **error)
+{
+	struct mptcp_subflow *sf = mptcp_subflow(mptcp, subflow);
+	struct tcp_options_iterator iter;
+	struct tcp_option *option = NULL;
+	struct mptcp_option mp;
+
+	for (option = tcp_options_begin(live_packet, &iter); option != NULL;
+	     option = tcp_options_next(&iter, error)) {
+		if (option->kind != TCPOPT_MPTCP)
+			continue;
+		if (mptcp_option_parse(option, &mp, error))
+			return STATUS_ERR;
+		map_inbound_option(mptcp, sf, &mp);
+		mptcp_option_write(&mp, option);
+	}
+	return *error ? STATUS_ERR : STATUS_OK;
+}
+
+/* If the actual HMAC matches the one we expect from the live keys,
+ * replace it with the HMAC from the script.
+ */
+static void map_outbound_hmac(struct mptcp_option *mp,
+			      const struct mptcp_option *script_mp,
+			      const u8 *expected)
+{
+	if (memcmp(mp->hmac, expected, mp->hmac_bytes) == 0)
+		memcpy(mp->hmac, script_mp->hmac, mp->hmac_bytes);
+}
+
+static void map_outbound_option(struct mptcp_state *mptcp,
+				struct mptcp_subflow *sf,
+				struct mptcp_option *mp,
+				struct packet *script_packet)
+{
+	const u64 remote_idsn = mptcp->has_remote_key ?
+		mptcp->remote_idsn : 0;
+	struct mptcp_option script_mp;
+	u8 digest[MPTCP_HMAC_BYTES], hmac[MPTCP_ADD_ADDR_HMAC_BYTES];
+	bool has_script_mp =
+		(find_mptcp_option(script_packet, mp->subtype,
+				   &script_mp) == STATUS_OK);
+
+	if (!has_script_mp)
+		memset(&script_mp, 0, sizeof(script_mp));
+
+	switch (mp->subtype) {
+	case MPTCP_SUBTYPE_CAPABLE:
+		if (mp->has_sender_key && !mptcp->has_local_key) {
+			/* First sighting of the kernel's key. */
+			mptcp->has_local_key = true;
+			mptcp->live_local_key = mp->sender_key;
+			mptcp->live_local_idsn = mptcp_key_idsn(mp->sender_key);
+			mptcp->script_local_key = script_mp.has_sender_key ?
+				script_mp.sender_key : mp->sender_key;
+		}
+		if (mp->has_sender_key &&
+		    mp->sender_key == mptcp->live_local_key)
+			mp->sender_key = mptcp->script_local_key;
+		if (mp->has_receiver_key)
+			mptcp_set_remote_key(mptcp, mp->receiver_key);
+		break;
+	case MPTCP_SUBTYPE_JOIN:
+		if (mp->has_nonce) {
+			if (!sf->has_local_nonce) {
+				sf->has_local_nonce = true;
+				sf->live_local_nonce = mp->nonce;
+				sf->script_local_nonce = script_mp.has_nonce ?
+					script_mp.nonce : mp->nonce;
+			}
+			if (mp->nonce == sf->live_local_nonce)
+				mp->nonce = sf->script_local_nonce;
+		}
+		if (!mptcp->has_local_key || !mptcp->has_remote_key)
+			break;
+		if (mp->has_token) {
+			if (mp->token == mptcp_key_token(mptcp->remote_key))
+				mp->token = script_mp.token;
+		} else {
+			mptcp_join_hmac(mptcp->live_local_key,
+					mptcp->remote_key,
+					sf->live_local_nonce,
+					sf->remote_nonce, digest);
+			map_outbound_hmac(mp, &script_mp, digest);
+		}
+		break;
+	case MPTCP_SUBTYPE_DSS:
+		if (mp->flags & MPTCP_DSS_FLAG_ACK)
+			mp->data_ack -= remote_idsn;
+		if (mp->flags & MPTCP_DSS_FLAG_DSN)
+			mp->dsn -= mptcp->live_local_idsn;
+		/* We do not recompute the DSS checksum, which covers the
+		 * live data sequence numbers, so accept what the kernel sent.
+		 */
+		if (mp->has_checksum && script_mp.has_checksum)
+			mp->checksum = script_mp.checksum;
+		break;
+	case MPTCP_SUBTYPE_ADD_ADDR:
+		if (mp->hmac_bytes == 0 ||
+		    !mptcp->has_local_key || !mptcp->has_remote_key)
+			break;
+		mptcp_add_addr_hmac(mp, mptcp->live_local_key,
+				    mptcp->remote_key, hmac);
+		map_outbound_hmac(mp, &script_mp, hmac);
+		break;
+	}
+}
+
+int mptcp_map_outbound_packet(struct mptcp_state *mptcp, int subflow,
+			      struct packet *actual_packet,
+			      struct packet *script_packet,
+			      char **error)
+{
+	struct mptcp_subflow *sf = mptcp_subflow(mptcp, subflow);
+	struct tcp_options_iterator iter;
+	struct tcp_option *option = NULL;
+	struct mptcp_option mp;
+
+	for (option = tcp_options_begin(actual_packet, &iter); option != NULL;
+	     option = tcp_options_next(&iter, error)) {
+		if (option->kind != TCPOPT_MPTCP)
+			continue;
+		if (mptcp_option_parse(option, &mp, error))
+			return STATUS_ERR;
+		map_outbound_option(mptcp, sf, &mp, script_packet);
+		mptcp_option_write(&mp, option);
+	}
+	return *error ? STATUS_ERR : STATUS_OK;
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Interface for Multipath TCP (RFC 8684) option encoding, crypto, and
+ * the per-connection state used to map MPTCP keys, nonces, tokens,
+ * HMACs and data sequence numbers between script and live space.
+ */
+
+#ifndef __MPTCP_H__
+#define __MPTCP_H__
+
+#include "types.h"
+
+#include "ip_address.h"
+#include "packet.h"
+#include "tcp_options.h"
+
+/* MPTCP option subtypes. */
+#define MPTCP_SUBTYPE_CAPABLE		0
+#define MPTCP_SUBTYPE_JOIN		1
+#define MPTCP_SUBTYPE_DSS		2
+#define MPTCP_SUBTYPE_ADD_ADDR		3
+
+/* MP_CAPABLE option lengths. */
+#define TCPOLEN_MPTCP_CAPABLE_SYN	4	/* v1 SYN: no key */
+#define TCPOLEN_MPTCP_CAPABLE_SYNACK	12	/* sender key only */
+#define TCPOLEN_MPTCP_CAPABLE_ACK	20	/* sender and receiver key */
+#define TCPOLEN_MPTCP_CAPABLE_DATA	22	/* ... plus data-level length */
+#define TCPOLEN_MPTCP_CAPABLE_CSUM	24	/* ... plus DSS checksum */
+
+/* MP_JOIN option lengths. */
+#define TCPOLEN_MPTCP_JOIN_SYN		12
+#define TCPOLEN_MPTCP_JOIN_SYNACK	16
+#define TCPOLEN_MPTCP_JOIN_ACK		24
+
+/* MP_CAPABLE flag bits. */
+#define MPTCP_CAPABLE_FLAG_A		0x80	/* checksum required */
+#define MPTCP_CAPABLE_FLAG_H		0x01	/* HMAC-SHA256 */
+
+/* MP_JOIN flag bits. */
+#define MPTCP_JOIN_FLAG_BACKUP		0x01
+
+/* DSS flag bits. */
+#define MPTCP_DSS_FLAG_DATA_FIN		0x10
+#define MPTCP_DSS_FLAG_DSN64		0x08
+#define MPTCP_DSS_FLAG_DSN		0x04
+#define MPTCP_DSS_FLAG_ACK64		0x02
+#define MPTCP_DSS_FLAG_ACK		0x01
+
+/* ADD_ADDR flag bits. */
+#define MPTCP_ADD_ADDR_FLAG_ECHO	0x01
+
+#define MPTCP_HMAC_BYTES		32	/* full HMAC-SHA256 digest */
+#define MPTCP_JOIN_SYNACK_HMAC_BYTES	8	/* truncated to 64 bits */
+#define MPTCP_JOIN_ACK_HMAC_BYTES	20	/* truncated to 160 bits */
+#define MPTCP_ADD_ADDR_HMAC_BYTES	8	/* truncated to 64 bits */
+
+/* Maximum number of subflows per MPTCP connection in a script. */
+#define MPTCP_MAX_SUBFLOWS		8
+
+/* A decoded MPTCP option, in host byte order. Which fields are
+ * meaningful depends on the subtype and the has_* bits, which together
+ * determine the on-the-wire layout.
+ */
+struct mptcp_option {
+	u8 subtype;		/* MPTCP_SUBTYPE_* */
+	u8 version;		/* MP_CAPABLE version */
+	u8 flags;		/* subtype-specific flag bits */
+
+	/* MP_CAPABLE */
+	bool has_sender_key;
+	bool has_receiver_key;
+	u64 sender_key;
+	u64 receiver_key;
+
+	/* MP_JOIN and ADD_ADDR */
+	u8 addr_id;
+	bool has_token;
+	bool has_nonce;
+	u32 token;
+	u32 nonce;
+	int hmac_bytes;		/* bytes of truncated HMAC on the wire */
+	u8 hmac[MPTCP_JOIN_ACK_HMAC_BYTES];
+
+	/* DSS */
+	u64 data_ack;
+	u64 dsn;
+	u32 ssn;		/* relative subflow sequence number */
+
+	/* DSS and MP_CAPABLE */
+	bool has_data_len;
+	bool has_checksum;
+	u16 data_len;
+	u16 checksum;
+
+	/* ADD_ADDR */
+	struct ip_address addr;
+	bool has_port;
+	u16 port;
+};
+
+/* Per-subflow state for an MPTCP connection. */
+struct mptcp_subflow {
+	u32 remote_nonce;		/* nonce chosen by the remote end */
+	bool has_local_nonce;		/* learned the kernel's nonce yet? */
+	u32 script_local_nonce;		/* kernel's nonce in the script */
+	u32 live_local_nonce;		/* kernel's nonce on the wire */
+};
+
+/* Connection-level MPTCP state, shared by all subflows of a socket.
+ * The remote key is chosen by the script, so its script and live values
+ * are identical. The local key is chosen by the kernel under test, so
+ * we learn the live value from the first outbound MP_CAPABLE that
+ * carries it, and map between that and the value in the script.
+ */
+struct mptcp_state {
+	bool has_remote_key;
+	u64 remote_key;
+	u64 remote_idsn;		/* IDSN derived from remote_key */
+
+	bool has_local_key;
+	u64 script_local_key;
+	u64 live_local_key;
+	u64 live_local_idsn;		/* IDSN derived from live_local_key */
+
+	struct mptcp_subflow subflows[MPTCP_MAX_SUBFLOWS];
+};
+
+/* Allocate and free connection-level MPTCP state. */
+extern struct mptcp_state *mptcp_state_new(void);
+extern void mptcp_state_free(struct mptcp_state *mptcp);
+
+/* Compute the SHA-256 digest of the given data. */
+extern void mptcp_sha256(const u8 *data, int len, u8 digest[32]);
+
+/* Compute HMAC-SHA256 of msg using the 16-byte key key1 || key2, with
+ * each key in network byte order, as specified in RFC 8684.
+ */
+extern void mptcp_hmac(u64 key1, u64 key2, const u8 *msg, int len,
+		       u8 digest[MPTCP_HMAC_BYTES]);
+
+/* Derive the connection token and initial data sequence number
+ * from an MPTCP key.
+ */
+extern u32 mptcp_key_token(u64 key);
+extern u64 mptcp_key_idsn(u64 key);
+
+/* Decode an MPTCP option from its wire format. Returns STATUS_OK on
+ * success; on failure returns STATUS_ERR and sets error message.
+ */
+extern int mptcp_option_parse(const struct tcp_option *option,
+			      struct mptcp_option *mp, char **error);
+
+/* Return the on-the-wire length of the given decoded option. */
+extern int mptcp_option_length(const struct mptcp_option *mp);
+
+/* Encode the decoded option into the given TCP option, which must have
+ * room for mptcp_option_length(mp) bytes.
+ */
+extern void mptcp_option_write(const struct mptcp_option *mp,
+			       struct tcp_option *option);
+
+/* Helpers for building an MPTCP option from a script. The option
+ * starts as the named subtype and is then refined field by field.
+ * Each returns STATUS_OK on success; on failure returns STATUS_ERR and
+ * sets error message.
+ */
+extern int mptcp_option_init(struct mptcp_option *mp, const char *subtype,
+			     char **error);
+extern int mptcp_option_set_flag(struct mptcp_option *mp, const char *name,
+				 char **error);
+extern int mptcp_option_set_integer(struct mptcp_option *mp,
+				    const char *name, s64 value,
+				    char **error);
+extern int mptcp_option_set_string(struct mptcp_option *mp,
+				   const char *name, const char *value,
+				   char **error);
+
+/* Allocate a new TCP option holding the wire format of the given
+ * MPTCP option. Returns NULL and sets error message on failure.
+ */
+extern struct tcp_option *mptcp_option_new(const struct mptcp_option *mp,
+					   char **error);
+
+/* Print the given MPTCP option in script syntax. */
+extern int mptcp_option_to_string(FILE *s, const struct tcp_option *option,
+				  char **error);
+
+/* Return true iff the TCP packet carries any MPTCP options. */
+extern bool packet_has_mptcp_option(struct packet *packet);
+
+/* Map MPTCP option values in an inbound packet from script to live
+ * space, filling in any tokens and HMACs that the script left as zero.
+ * Returns STATUS_OK on success; on failure returns STATUS_ERR and sets
+ * error message.
+ */
+extern int mptcp_map_inbound_packet(struct mptcp_state *mptcp, int subflow,
+				    struct packet *live_packet, char **error);
+
+/* Map MPTCP option values in an outbound packet from live to script
+ * space. Tokens and HMACs that are correct for the live keys and nonces
+ * are rewritten to the values given in the script, so that only wrong
+ * ones show up as option mismatches. Returns STATUS_OK on success; on
+ * failure returns STATUS_ERR and sets error message.
+ */
+extern int mptcp_map_outbound_packet(struct mptcp_state *mptcp, int subflow,
+				     struct packet *actual_packet,
+				     struct packet *script_packet,
+				     char **error);
+
+#endif /* __MPTCP_H__ */
@@ -0,0 +1,256 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Unit test for mptcp.c.
+ */
+
+#include "mptcp.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+#include "tcp.h"
+
+int debug_logging=0;
+
+static void assert_digest(const u8 *digest, const char *expected)
+{
+	char hex[2 * MPTCP_HMAC_BYTES + 1];
+	int i;
+
+	for (i = 0; i < MPTCP_HMAC_BYTES; ++i)
+		sprintf(hex + 2 * i, "%02x", digest[i]);
+	assert(strcmp(hex, expected) == 0);
+}
+
+static void test_sha256(void)
+{
+	u8 digest[32];
+	u8 data[200];
+
+	mptcp_sha256((const u8 *)"abc", 3, digest);
+	assert_digest(digest,
+		      "ba7816bf8f01cfea414140de5dae2223"
+		      "b00361a396177a9cb410ff61f20015ad");
+
+	/* Multi-block message whose padding spills into an extra block. */
+	memset(data, 'a', sizeof(data));
+	mptcp_sha256(data, 120, digest);
+	assert_digest(digest,
+		      "2f3d335432c70b580af0e8e1b3674a7c"
+		      "020d683aa5f73aaaedfdc55af904c21c");
+}
+
+/* Test vectors from the Linux MPTCP crypto self-test, where the keys
+ * and messages are the ASCII bytes of the strings.
+ */
+static void test_hmac(void)
+{
+	u8 digest[MPTCP_HMAC_BYTES];
+
+	mptcp_hmac(0x3062306230623062ULL, 0x3062306230623062ULL,
+		   (const u8 *)"48692054", 8, digest);
+	assert_digest(digest,
+		      "8385e24fb4235ac37556b6b886db1062"
+		      "84a1da671699f46db1f235ec622dcafa");
+
+	mptcp_hmac(0x3031303230333034ULL, 0x3035303630373038ULL,
+		   (const u8 *)"cdcdcdcd", 8, digest);
+	assert_digest(digest,
+		      "e73b9ba9969969cefb04aa0d6df18ec2"
+		      "fcc075b6f23b4d8c4da736a5dbbc6e7d");
+}
+
+static void test_key_token_and_idsn(void)
+{
+	assert(mptcp_key_token(0x0123456789abcdefULL) == 0x55c53f5d);
+	assert(mptcp_key_idsn(0x0123456789abcdefULL) ==
+	       0x570762cd38be9818ULL);
+}
+
+/* Build an option from script fields, then check its wire format
+ * parses back to the same values and prints in script syntax.
+ */
+static void test_dss_option(void)
+{
+	struct mptcp_option mp, parsed;
+	struct tcp_option *option = NULL;
+	char *error = NULL;
+	char *dump = NULL;
+	size_t size = 0;
+	FILE *s = NULL;
+
+	assert(mptcp_option_init(&mp, "dss", &error) == STATUS_OK);
+	assert(mptcp_option_set_integer(&mp, "dack", 1001, &error) ==
+	       STATUS_OK);
+	assert(mptcp_option_set_flag(&mp, "ack64", &error) == STATUS_OK);
+	assert(mptcp_option_set_integer(&mp, "dsn", 1, &error) == STATUS_OK);
+	assert(mptcp_option_set_integer(&mp, "sseq", 1, &error) ==
+	       STATUS_OK);
+	assert(mptcp_option_set_integer(&mp, "dlen", 1000, &error) ==
+	       STATUS_OK);
+	assert(mptcp_option_set_flag(&mp, "dsn64", &error) == STATUS_OK);
+	assert(mptcp_option_set_flag(&mp, "nope", &error) == STATUS_ERR);
+	free(error);
+	error = NULL;
+
+	option = mptcp_option_new(&mp, &error);
+	assert(option != NULL);
+	assert(option->kind == TCPOPT_MPTCP);
+	assert(option->length == 4 + 8 + 8 + 4 + 2);
+
+	assert(mptcp_option_parse(option, &parsed, &error) == STATUS_OK);
+	assert(parsed.subtype == MPTCP_SUBTYPE_DSS);
+	assert(parsed.data_ack == 1001);
+	assert(parsed.dsn == 1);
+	assert(parsed.ssn == 1);
+	assert(parsed.data_len == 1000);
+	assert(!parsed.has_checksum);
+
+	s = open_memstream(&dump, &size);
+	assert(mptcp_option_to_string(s, option, &error) == STATUS_OK);
+	fclose(s);
+	assert(strcmp(dump, "mptcp dss dack=1001 ack64 "
+			    "dsn=1 sseq=1 dlen=1000 dsn64") == 0);
+	free(dump);
+
+	/* A DSS option too short for the fields its flags announce is
+	 * rejected before any field past its end is read.
+	 */
+	option->length = 4 + 4;
+	assert(mptcp_option_parse(option, &parsed, &error) == STATUS_ERR);
+	free(error);
+	error = NULL;
+	option->length = 4 + 8 + 8 + 2;
+	assert(mptcp_option_parse(option, &parsed, &error) == STATUS_ERR);
+	free(error);
+	error = NULL;
+	option->length = 4 + 8 + 8 + 4;
+	assert(mptcp_option_parse(option, &parsed, &error) == STATUS_ERR);
+	free(error);
+	free(option);
+}
+
+static void test_join_and_add_addr_options(void)
+{
+	struct mptcp_option mp, parsed;
+	struct tcp_option *option = NULL;
+	char *error = NULL;
+
+	/* A join with a nonce but no token is the SYN/ACK form. */
+	assert(mptcp_option_init(&mp, "join", &error) == STATUS_OK);
+	assert(mptcp_option_set_integer(&mp, "id", 1, &error) == STATUS_OK);
+	assert(mptcp_option_set_integer(&mp, "nonce", 0x1234, &error) ==
+	       STATUS_OK);
+	option = mptcp_option_new(&mp, &error);
+	assert(option->length == TCPOLEN_MPTCP_JOIN_SYNACK);
+	assert(mptcp_option_parse(option, &parsed, &error) == STATUS_OK);
+	assert(parsed.addr_id == 1);
+	assert(parsed.nonce == 0x1234);
+	assert(parsed.hmac_bytes == MPTCP_JOIN_SYNACK_HMAC_BYTES);
+	free(option);
+
+	assert(mptcp_option_init(&mp, "add_addr", &error) == STATUS_OK);
+	assert(mptcp_option_set_integer(&mp, "id", 2, &error) == STATUS_OK);
+	assert(mptcp_option_set_string(&mp, "ip", "2001:db8::1", &error) ==
+	       STATUS_OK);
+	assert(mptcp_option_set_integer(&mp, "port", 8080, &error) ==
+	       STATUS_OK);
+	option = mptcp_option_new(&mp, &error);
+	assert(option->length == 4 + 16 + 2 + MPTCP_ADD_ADDR_HMAC_BYTES);
+	assert(mptcp_option_parse(option, &parsed, &error) == STATUS_OK);
+	assert(parsed.addr.address_family == AF_INET6);
+	assert(parsed.has_port);
+	assert(parsed.port == 8080);
+	assert(parsed.hmac_bytes == MPTCP_ADD_ADDR_HMAC_BYTES);
+	free(option);
+}
+
+/* Field values must fit the wire format; a DSS dack or dsn only fits
+ * in 64 bits with ack64 or dsn64, which may follow it in the script.
+ */
+static void test_option_ranges(void)
+{
+	struct mptcp_option mp;
+	struct tcp_option *option = NULL;
+	char *error = NULL;
+
+	assert(mptcp_option_init(&mp, "join", &error) == STATUS_OK);
+	assert(mptcp_option_set_integer(&mp, "id", 256, &error) ==
+	       STATUS_ERR);
+	free(error);
+	error = NULL;
+	assert(mptcp_option_set_integer(&mp, "nonce", 0x100000000LL,
+					&error) == STATUS_ERR);
+	free(error);
+	error = NULL;
+	assert(mptcp_option_set_integer(&mp, "hmac", -1, &error) ==
+	       STATUS_ERR);
+	free(error);
+	error = NULL;
+
+	assert(mptcp_option_init(&mp, "dss", &error) == STATUS_OK);
+	assert(mptcp_option_set_integer(&mp, "dack", -1, &error) ==
+	       STATUS_ERR);
+	free(error);
+	error = NULL;
+	assert(mptcp_option_set_integer(&mp, "dsn", -1, &error) ==
+	       STATUS_ERR);
+	free(error);
+	error = NULL;
+
+	assert(mptcp_option_set_integer(&mp, "dack", 0x100000000LL,
+					&error) == STATUS_OK);
+	assert(mptcp_option_new(&mp, &error) == NULL);
+	free(error);
+	error = NULL;
+	assert(mptcp_option_set_flag(&mp, "ack64", &error) == STATUS_OK);
+	option = mptcp_option_new(&mp, &error);
+	assert(option != NULL);
+	free(option);
+
+	assert(mptcp_option_set_integer(&mp, "dsn", 0x100000000LL,
+					&error) == STATUS_OK);
+	assert(mptcp_option_set_integer(&mp, "sseq", 1, &error) ==
+	       STATUS_OK);
+	assert(mptcp_option_set_integer(&mp, "dlen", 65536, &error) ==
+	       STATUS_ERR);
+	free(error);
+	error = NULL;
+	assert(mptcp_option_set_integer(&mp, "dlen", 1000, &error) ==
+	       STATUS_OK);
+	assert(mptcp_option_new(&mp, &error) == NULL);
+	free(error);
+	error = NULL;
+	assert(mptcp_option_set_flag(&mp, "dsn64", &error) == STATUS_OK);
+	option = mptcp_option_new(&mp, &error);
+	assert(option != NULL);
+	free(option);
+}
+
+int main(void)
+{
+	test_sha256();
+	test_hmac();
+	test_key_token_and_idsn();
+	test_dss_option();
+	test_join_and_add_addr_options();
+	test_option_ranges();
+	return 0;
+}
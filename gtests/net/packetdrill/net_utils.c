@@ -29,13 +29,14 @@
 #include <unistd.h>
 
 #include "logging.h"
+#include "system.h"
 
 static void verbose_system(const char *command)
 {
 	int result;
 
 	DEBUGP("running: '%s'\n", command);
-	result = system(command);
+	result = spawn_system(command);
 	DEBUGP("result: %d\n", result);
 	if (result != 0)
 		DEBUGP("error executing command '%s'\n", command);
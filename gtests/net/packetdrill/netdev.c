@@ -59,8 +59,10 @@
 #include "packet.h"
 #include "packet_parser.h"
 #include "packet_socket.h"
+#include "system.h"
 #include "tcp.h"
 #include "tun.h"
+#include "tun_capture.h"
 
 /* Internal private state for the netdev for purely local tests. */
 struct local_netdev {
@@ -72,6 +74,8 @@ struct local_netdev {
 	int ipv6_control_fd;	/* fd for IPv6 configuration of tun interface */
 	int index;		/* interface index from if_nametoindex */
 	struct packet_socket *psock;	/* for sniffing packets (owned) */
+	struct ip_reassembly *reassembly;	/* for sniffed fragments */
+	struct tun_capture *capture;	/* for --tun_capture, or NULL */
 	bool persistent;
 };
 
@@ -104,9 +108,9 @@ static void cleanup_old_device(struct config *config,
 		 config->tun_device);
 	DEBUGP("running: '%s'\n", cleanup_command);
 #ifdef DEBUG
-	result = system(cleanup_command);
+	result = spawn_system(cleanup_command);
 #else
-	system(cleanup_command);
+	spawn_system(cleanup_command);
 #endif
 	DEBUGP("result: %d\n", result);
 	free(cleanup_command);
@@ -166,7 +170,7 @@ static void create_device(struct config *config, struct local_netdev *netdev)
 	DEBUGP("utun index: '%d'\n", netdev->index);
 	if (config->mtu != TUN_DRIVER_DEFAULT_MTU) {
 		asprintf(&command, "ifconfig %s mtu %d", netdev->name, config->mtu);
-		if (system(command) < 0)
+		if (spawn_system(command) < 0)
 			die("Error executing %s\n", command);
 		free(command);
 	}
@@ -199,7 +203,7 @@ static void create_device(struct config *config, struct local_netdev *netdev)
 	tun_fd = open(tun_path, O_RDWR);
 #if defined(__FreeBSD__)
 	if ((tun_fd < 0) && (errno == ENOENT)) {
-		if (system("kldload -q if_tun") < 0) {
+		if (spawn_system("kldload -q if_tun") < 0) {
 			die_perror("kldload -q if_tun");
 		}
 		tun_fd = open(tun_path, O_RDWR);
@@ -219,6 +223,11 @@ static void create_device(struct config *config, struct local_netdev *netdev)
 	struct ifreq ifr;
 	memset(&ifr, 0, sizeof(ifr));
 	ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+	/* In NAPI mode the tun driver hands the packets we write to a
+	 * NAPI instance, so they go through GRO as on a real NIC.
+	 */
+	if (config->tun_napi)
+		ifr.ifr_flags |= IFF_NAPI;
 	int status = ioctl(netdev->tun_fd, TUNSETIFF, (void *)&ifr);
 	if (status < 0)
 		die_perror("TUNSETIFF");
@@ -275,7 +284,7 @@ static void create_device(struct config *config, struct local_netdev *netdev)
 		char *command;
 		asprintf(&command, "ethtool -s %s speed %u autoneg off",
 			 netdev->name, config->speed);
-		if (system(command) < 0)
+		if (spawn_system(command) < 0)
 			die("Error executing %s\n", command);
 		free(command);
 
@@ -284,7 +293,7 @@ static void create_device(struct config *config, struct local_netdev *netdev)
 		 * used by TCP's cwnd bound. */
 		asprintf(&command, "ifconfig %s down; sleep 1; ifconfig %s up; "
 			      "sleep 1", netdev->name, netdev->name);
-		if (system(command) < 0)
+		if (spawn_system(command) < 0)
 			die("Error executing %s\n", command);
 		free(command);
 	}
@@ -293,7 +302,7 @@ static void create_device(struct config *config, struct local_netdev *netdev)
 		char *command;
 		asprintf(&command, "ifconfig %s mtu %d",
 			 netdev->name, config->mtu);
-		if (system(command) < 0)
+		if (spawn_system(command) < 0)
 			die("Error executing %s\n", command);
 		free(command);
 	}
@@ -377,7 +386,7 @@ static void route_traffic_to_device(struct config *config,
 		assert(!"bad wire protocol");
 	}
 #endif /* defined(linux) */
-	int result = system(route_command);
+	int result = spawn_system(route_command);
 	if ((result == -1) || (WEXITSTATUS(result) != 0)) {
 		die("error executing route command '%s'\n",
 		    route_command);
@@ -406,13 +415,24 @@ struct netdev *local_netdev_new(struct config *config)
 			      &config->live_gateway_ip);
 
 	route_traffic_to_device(config, netdev);
+#ifdef linux
+	/* With --tun_capture we only need a packet socket to measure the
+	 * capture against.
+	 */
+	if (config->tun_capture)
+		netdev->capture = tun_capture_new(netdev->tun_fd);
+	if (!config->tun_capture || config->tun_capture_compare)
+		netdev->psock = packet_socket_new(netdev->name);
+#else
 	netdev->psock = packet_socket_new(netdev->name);
+#endif
 #if !defined(linux)
 	/* Make sure we only see packets from the machine under test. */
 	packet_socket_set_filter(netdev->psock,
 				 NULL,
 				 &config->live_local_ip);  /* client IP */
 #endif /* !defined(linux) */
+	netdev->reassembly = netdev_reassembly_new(config);
 
 	return (struct netdev *)netdev;
 }
@@ -421,8 +441,14 @@ static void local_netdev_free(struct netdev *a_netdev)
 {
 	struct local_netdev *netdev = to_local_netdev(a_netdev);
 
+	if (netdev->capture != NULL) {
+		if (netdev->psock != NULL)
+			tun_capture_report(netdev->capture, stdout);
+		tun_capture_free(netdev->capture);
+	}
 	if (netdev->psock)
 		packet_socket_free(netdev->psock);
+	ip_reassembly_free(netdev->reassembly);
 	if (netdev->tun_fd >= 0) {
 		close(netdev->tun_fd);
 #if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
@@ -432,7 +458,7 @@ static void local_netdev_free(struct netdev *a_netdev)
 			asprintf(&cleanup_command,
 			         "/sbin/ifconfig %s destroy > /dev/null 2>&1",
 			         netdev->name);
-			system(cleanup_command);
+			spawn_system(cleanup_command);
 			free(cleanup_command);
 		}
 #endif
@@ -531,7 +557,112 @@ static void local_netdev_read_queue(struct local_netdev *netdev,
 	}
 }
 
+/* What to do with a packet we just sniffed. */
+enum sniffed_packet_t {
+	SNIFFED_SKIP,		/* not one for us (yet); sniff another */
+	SNIFFED_OK,		/* a packet for us, parsed */
+	SNIFFED_BAD,		/* a packet for us, that failed to parse */
+};
+
+/* Reassemble, filter, and parse the given freshly sniffed packet. On
+ * anything but SNIFFED_OK, frees the packet and sets *packet to NULL.
+ */
+static enum sniffed_packet_t finish_sniffed_packet(
+	struct ip_reassembly *reassembly, u16 ether_type, int in_bytes,
+	u8 udp_encaps, const struct packet_filter *filter,
+	struct packet **packet, char **error)
+{
+	enum packet_parse_result_t result;
+	struct packet_flow flow;
+
+	/* Hold on to fragments until their datagram is complete. */
+	if ((reassembly != NULL) &&
+	    !ip_reassembly_add(reassembly, *packet, ether_type, &in_bytes)) {
+		packet_free(*packet);
+		*packet = NULL;
+		return SNIFFED_SKIP;
+	}
+
+	/* Drop packets of flows we don't care about before
+	 * paying for a full parse and validation.
+	 */
+	if ((filter != NULL) &&
+	    parse_packet_flow((*packet)->buffer, in_bytes, ether_type,
+			      udp_encaps, &flow) &&
+	    !filter->match(filter->arg, &flow)) {
+		packet_free(*packet);
+		*packet = NULL;
+		return SNIFFED_SKIP;
+	}
+
+	result = parse_packet(*packet, in_bytes, ether_type, udp_encaps,
+			      error);
+
+	if (result == PACKET_OK)
+		return SNIFFED_OK;
+
+	packet_free(*packet);
+	*packet = NULL;
+
+	if (result == PACKET_BAD)
+		return SNIFFED_BAD;
+
+	DEBUGP("parse_result:%d; error parsing packet: %s\n",
+	       result, *error);
+	return SNIFFED_SKIP;
+}
+
+/* Sniff the next packet from the tun capture's reader thread. With
+ * --tun_capture_compare, also sniff the packet socket's copy of it and
+ * measure how far apart the two timestamps are.
+ */
+static int local_netdev_capture_receive(struct local_netdev *netdev,
+					u8 udp_encaps,
+					const struct packet_filter *filter,
+					struct packet **packet, char **error)
+{
+	assert(*packet == NULL);	/* should be no packet yet */
+
+	while (1) {
+		u16 ether_type, psock_ether_type;
+		int in_bytes = 0, psock_bytes = 0;
+
+		*packet = packet_new(PACKET_READ_BYTES);
+		tun_capture_receive(netdev->capture, *packet, &ether_type,
+				    &in_bytes);
+
+		if (netdev->psock != NULL) {
+			struct packet *copy = packet_new(PACKET_READ_BYTES);
+
+			/* The packet socket sees each packet before the
+			 * tun queue does, so its copy is already waiting.
+			 */
+			while (packet_socket_receive(netdev->psock,
+						     DIRECTION_OUTBOUND,
+						     &psock_ether_type, copy,
+						     &psock_bytes))
+				;
+			tun_capture_compare(netdev->capture,
+					    *packet, in_bytes,
+					    copy, psock_bytes);
+			packet_free(copy);
+		}
+
+		switch (finish_sniffed_packet(netdev->reassembly, ether_type,
+					      in_bytes, udp_encaps, filter,
+					      packet, error)) {
+		case SNIFFED_SKIP:
+			break;
+		case SNIFFED_OK:
+			return STATUS_OK;
+		case SNIFFED_BAD:
+			return STATUS_ERR;
+		}
+	}
+}
+
 static int local_netdev_receive(struct netdev *a_netdev, u8 udp_encaps,
+				const struct packet_filter *filter,
 				struct packet **packet, char **error)
 {
 	struct local_netdev *netdev = to_local_netdev(a_netdev);
@@ -540,15 +671,31 @@ static int local_netdev_receive(struct netdev *a_netdev, u8 udp_encaps,
 
 	DEBUGP("local_netdev_receive\n");
 
-	status = netdev_receive_loop(netdev->psock, DIRECTION_OUTBOUND,
-				     udp_encaps,packet, &num_packets, error);
+	/* The reader thread dequeues every packet; nothing to free up. */
+	if (netdev->capture != NULL)
+		return local_netdev_capture_receive(netdev, udp_encaps,
+						    filter, packet, error);
+
+	status = netdev_receive_loop(netdev->psock, netdev->reassembly,
+				     DIRECTION_OUTBOUND, udp_encaps, filter,
+				     packet, &num_packets, error);
 	local_netdev_read_queue(netdev, num_packets);
 	return status;
 }
 
+struct ip_reassembly *netdev_reassembly_new(const struct config *config)
+{
+	if (config->reassembly_datagrams == 0)
+		return NULL;
+	return ip_reassembly_new(config->reassembly_datagrams,
+				 config->reassembly_timeout_usecs);
+}
+
 int netdev_receive_loop(struct packet_socket *psock,
+			struct ip_reassembly *reassembly,
 			enum direction_t direction,
 			u8 udp_encaps,
+			const struct packet_filter *filter,
 			struct packet **packet,
 			int *num_packets,
 			char **error)
@@ -560,7 +707,6 @@ int netdev_receive_loop(struct packet_socket *psock,
 	*num_packets = 0;
 	while (1) {
 		int in_bytes = 0;
-		enum packet_parse_result_t result;
 
 		*packet = packet_new(PACKET_READ_BYTES);
 
@@ -573,20 +719,17 @@ int netdev_receive_loop(struct packet_socket *psock,
 		}
 
 		++*num_packets;
-		result = parse_packet(*packet, in_bytes, ether_type, udp_encaps,
-				      error);
 
-		if (result == PACKET_OK)
+		switch (finish_sniffed_packet(reassembly, ether_type,
+					      in_bytes, udp_encaps, filter,
+					      packet, error)) {
+		case SNIFFED_SKIP:
+			break;
+		case SNIFFED_OK:
 			return STATUS_OK;
-
-		packet_free(*packet);
-		*packet = NULL;
-
-		if (result == PACKET_BAD)
+		case SNIFFED_BAD:
 			return STATUS_ERR;
-
-		DEBUGP("parse_result:%d; error parsing packet: %s\n",
-		       result, *error);
+		}
 	}
 
 	assert(!"should not be reached");
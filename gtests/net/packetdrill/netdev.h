@@ -29,12 +29,21 @@
 #include "types.h"
 
 #include "config.h"
+#include "ip_reassembly.h"
 #include "packet.h"
 #include "packet_parser.h"
 #include "packet_socket.h"
 
 struct netdev_ops;
 
+/* A first-stage filter for sniffed packets. Packets whose flow the
+ * match function rejects are dropped before being fully parsed.
+ */
+struct packet_filter {
+	bool (*match)(void *arg, const struct packet_flow *flow);
+	void *arg;
+};
+
 /* A C-style poor-man's "pure virtual" netdev. */
 struct netdev {
 	struct netdev_ops *ops;	/* C-style vtable pointer */
@@ -48,11 +57,20 @@ struct netdev_ops {
 	int (*send)(struct netdev *netdev,
 		    struct packet *packet);
 
-	/* Sniff the next TCP/IP packet leaving the kernel and return a
-	 * pointer to the newly-allocated packet. Caller must free the packet
-	 * with packet_free().
+	/* Inject a burst of raw TCP/IP packets back to back, with as
+	 * few system calls as the device allows. Optional; if NULL we
+	 * call send() for each packet.
+	 */
+	int (*send_burst)(struct netdev *netdev,
+			  struct packet **packets, int num_packets);
+
+	/* Sniff the next TCP/IP packet leaving the kernel that passes
+	 * the given filter (if not NULL) and return a pointer to the
+	 * newly-allocated packet. Caller must free the packet with
+	 * packet_free().
 	 */
 	int (*receive)(struct netdev *netdev, u8 udp_encaps,
+		       const struct packet_filter *filter,
 		       struct packet **packet, char **error);
 };
 
@@ -70,26 +88,55 @@ static inline int netdev_send(struct netdev *netdev,
 	return netdev->ops->send(netdev, packet);
 }
 
-/* Sniff the next TCP/IP packet leaving the kernel and return a
- * pointer to the newly-allocated packet. Caller must free the packet
- * with packet_free().
+/* Inject a burst of raw TCP/IP packets into the kernel back to back. */
+static inline int netdev_send_burst(struct netdev *netdev,
+				    struct packet **packets, int num_packets)
+{
+	int i;
+
+	if (netdev->ops->send_burst != NULL)
+		return netdev->ops->send_burst(netdev, packets, num_packets);
+	for (i = 0; i < num_packets; ++i) {
+		if (netdev->ops->send(netdev, packets[i]))
+			return STATUS_ERR;
+	}
+	return STATUS_OK;
+}
+
+/* Sniff the next TCP/IP packet leaving the kernel that passes the
+ * given filter (if not NULL) and return a pointer to the
+ * newly-allocated packet. Caller must free the packet with
+ * packet_free().
  */
 static inline int netdev_receive(struct netdev *netdev,
 				 u8 udp_encaps,
+				 const struct packet_filter *filter,
 				 struct packet **packet,
 				 char **error)
 {
-	return netdev->ops->receive(netdev, udp_encaps, packet, error);
+	return netdev->ops->receive(netdev, udp_encaps, filter, packet, error);
 }
 
 
+/* Allocate the pool for reassembling sniffed IP fragments that the
+ * config asks for, or return NULL if fragments should not be
+ * reassembled.
+ */
+extern struct ip_reassembly *netdev_reassembly_new(
+	const struct config *config);
+
 /* Keep sniffing packets leaving the kernel until we see one we know
- * about and can parse. Return a pointer to the newly-allocated
- * packet. Caller must free the packet with packet_free().
+ * about and can parse. If a reassembly pool is given, fragments are
+ * collected there and only whole datagrams are returned. If a filter is
+ * given, packets whose flow it rejects are skipped without being
+ * parsed. Return a pointer to the newly-allocated packet. Caller must
+ * free the packet with packet_free().
  */
 extern int netdev_receive_loop(struct packet_socket *psock,
+			       struct ip_reassembly *reassembly,
 			       enum direction_t direction,
 			       u8 udp_encaps,
+			       const struct packet_filter *filter,
 			       struct packet **packet,
 			       int *num_packets,
 			       char **error);
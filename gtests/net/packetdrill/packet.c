@@ -54,7 +54,9 @@ struct header_type_info header_types[HEADER_NUM_TYPES] = {
 struct packet *packet_new(u32 buffer_bytes)
 {
 	struct packet *packet = calloc(1, sizeof(struct packet));
-	packet->buffer = malloc(buffer_bytes);
+	packet->headroom_bytes = PACKET_MAX_HEADER_BYTES;
+	packet->buffer = (u8 *)malloc(packet->headroom_bytes + buffer_bytes) +
+			 packet->headroom_bytes;
 	packet->buffer_bytes = buffer_bytes;
 	packet->chunk_list = sctp_chunk_list_new();
 	return packet;
@@ -63,7 +65,7 @@ struct packet *packet_new(u32 buffer_bytes)
 void packet_free(struct packet *packet)
 {
 	sctp_chunk_list_free(packet->chunk_list);
-	free(packet->buffer);
+	free(packet->buffer - packet->headroom_bytes);
 	memset(packet, 0, sizeof(*packet));  /* paranoia to help catch bugs */
 	free(packet);
 }
@@ -165,6 +167,10 @@ static struct packet *packet_copy_with_headroom(struct packet *old_packet,
 	packet->time_usecs	= old_packet->time_usecs;
 	packet->flags		= old_packet->flags;
 	packet->ecn		= old_packet->ecn;
+	packet->mptcp_subflow	= old_packet->mptcp_subflow;
+	packet->num_fragments	= old_packet->num_fragments;
+	memcpy(packet->fragment_bytes, old_packet->fragment_bytes,
+	       sizeof(packet->fragment_bytes));
 
 	packet_copy_headers(packet, old_packet, bytes_headroom);
 
@@ -255,6 +261,37 @@ static void packet_finish_encapsulation_headers(struct packet *packet)
 	}
 }
 
+/* Prepend the outer headers to the inner packet in place, using the
+ * headroom reserved in front of its buffer, so that no byte of the
+ * inner packet (or pointer into it) has to move.
+ */
+static void packet_encapsulate_in_headroom(struct packet *outer,
+					   struct packet *inner)
+{
+	const int outer_headers = packet_header_count(outer);
+	const int inner_headers = packet_header_count(inner);
+
+	assert(inner->headroom_bytes >= outer->ip_bytes);
+
+	inner->buffer		-= outer->ip_bytes;
+	inner->buffer_bytes	+= outer->ip_bytes;
+	inner->headroom_bytes	-= outer->ip_bytes;
+	memcpy(inner->buffer, outer->buffer, outer->ip_bytes);
+
+	/* Move the inner header metadata to make room for the outer. */
+	memmove(inner->headers + outer_headers, inner->headers + 0,
+		inner_headers * sizeof(struct header));
+
+	/* Copy over the metadata about the outer headers. */
+	packet_copy_headers(inner, outer, 0);
+
+	assert(packet_header_count(inner) == outer_headers + inner_headers);
+
+	packet_finish_encapsulation_headers(inner);
+
+	inner->ip_bytes += outer->ip_bytes;
+}
+
 struct packet *packet_encapsulate(struct packet *outer, struct packet *inner)
 {
 	struct packet *packet = NULL;
@@ -263,6 +300,18 @@ struct packet *packet_encapsulate(struct packet *outer, struct packet *inner)
 
 	assert(outer_headers + inner_headers <= PACKET_MAX_HEADERS);
 
+	/* Fragmentation applies to the datagram as a whole. */
+	if (outer->num_fragments != 0) {
+		inner->num_fragments = outer->num_fragments;
+		memcpy(inner->fragment_bytes, outer->fragment_bytes,
+		       sizeof(inner->fragment_bytes));
+	}
+
+	if (inner->headroom_bytes >= outer->ip_bytes) {
+		packet_encapsulate_in_headroom(outer, inner);
+		return inner;
+	}
+
 	/* Copy the inner packet bits and header metadata. */
 	packet = packet_copy_with_headroom(inner, outer->ip_bytes);
 
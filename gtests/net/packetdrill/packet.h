@@ -66,6 +66,9 @@ static const int PACKET_READ_BYTES = 64 * 1024;
 /* Maximum number of bytes of headers. */
 #define PACKET_MAX_HEADER_BYTES	256
 
+/* Maximum number of IP fragments we reassemble a datagram from. */
+#define PACKET_MAX_FRAGMENTS	64
+
 /* TCP/UDP/IPv4 packet, including IPv4 header, TCP/UDP header, and data. There
  * may also be a link layer header between the 'buffer' and 'ip'
  * pointers, but we typically ignore that. The 'buffer_bytes' field
@@ -75,6 +78,9 @@ static const int PACKET_READ_BYTES = 64 * 1024;
 struct packet {
 	u8 *buffer;		/* data buffer: full contents of packet */
 	u32 buffer_bytes;	/* bytes of space in data buffer */
+	u32 headroom_bytes;	/* bytes reserved before 'buffer' for
+				 * prepending outer (GRE/MPLS/IP) headers
+				 */
 	u32 ip_bytes;		/* bytes in outermost IP hdrs/payload */
 	enum direction_t direction;	/* direction packet is traveling */
 
@@ -122,11 +128,23 @@ struct packet {
 
 	enum ip_ecn_t ecn;	/* IPv4/IPv6 ECN treatment for packet */
 
+	u8 mptcp_subflow;	/* script MPTCP subflow (0 is the initial one) */
+
+	/* For a live packet, the IP fragments it was reassembled from, if
+	 * any. For a script packet, the fragments expected: 0 means not
+	 * checked, and fragment_bytes[] entries of 0 mean the count is
+	 * checked but not the sizes.
+	 */
+	u16 num_fragments;
+	u16 fragment_bytes[PACKET_MAX_FRAGMENTS];  /* IP payload of each */
+
 	__be32 *tcp_ts_val;	/* location of TCP timestamp val, or NULL */
 	__be32 *tcp_ts_ecr;	/* location of TCP timestamp ecr, or NULL */
 };
 
-/* Allocate and initialize a packet. */
+/* Allocate and initialize a packet, with PACKET_MAX_HEADER_BYTES of
+ * headroom so that it can later be encapsulated without a copy.
+ */
 extern struct packet *packet_new(u32 buffer_length);
 
 /* Free all the memory used by the packet. */
@@ -155,8 +173,10 @@ extern struct header *packet_append_header(struct packet *packet,
 					   enum header_t header_type,
 					   int header_bytes);
 
-/* Return a newly-allocated packet that is a copy of the given inner packet
- * but with the given outer packet prepended.
+/* Return a packet that is the given inner packet with the given outer
+ * packet prepended. If the inner packet has enough headroom the outer
+ * headers are written into it in place and the inner packet itself is
+ * returned; otherwise the result is a newly-allocated copy.
  */
 extern struct packet *packet_encapsulate(struct packet *outer,
 					 struct packet *inner);
@@ -167,7 +187,8 @@ static inline struct packet *packet_encapsulate_and_free(struct packet *outer,
 {
 	struct packet *packet = packet_encapsulate(outer, inner);
 	packet_free(outer);
-	packet_free(inner);
+	if (packet != inner)
+		packet_free(inner);
 	return packet;
 }
 
@@ -170,6 +170,69 @@ int parse_packet(struct packet *packet, int in_bytes,
 	return PACKET_BAD;
 }
 
+/* Return true iff the flow of a packet with the given layer 4 protocol
+ * is given by the ports at the start of its layer 4 header.
+ */
+static bool is_flow_protocol(u8 protocol)
+{
+	return (protocol == IPPROTO_TCP) || (protocol == IPPROTO_UDP) ||
+	       (protocol == IPPROTO_UDPLITE) || (protocol == IPPROTO_SCTP);
+}
+
+bool parse_packet_flow(const u8 *buffer, int in_bytes,
+		       u16 ether_type, u8 udp_encaps,
+		       struct packet_flow *flow)
+{
+	const u8 *packet_end = buffer + in_bytes;
+	const u8 *l4 = NULL;
+
+	/* With UDP encapsulation the flow is that of the inner header. */
+	if (udp_encaps != 0)
+		return false;
+
+	memset(flow, 0, sizeof(*flow));
+	if (ether_type == ETHERTYPE_IP) {
+		const struct ipv4 *ipv4 = (const struct ipv4 *)buffer;
+
+		if ((buffer + sizeof(*ipv4) > packet_end) ||
+		    (ipv4->version != 4) || (ipv4->ihl < 5) ||
+		    (ntohs(ipv4->frag_off) & (IP_MF | IP_OFFMASK)) ||
+		    !is_flow_protocol(ipv4->protocol))
+			return false;
+		ip_from_ipv4(&ipv4->src_ip, &flow->src_ip);
+		ip_from_ipv4(&ipv4->dst_ip, &flow->dst_ip);
+		flow->protocol = ipv4->protocol;
+		l4 = buffer + ipv4_header_len(ipv4);
+	} else if (ether_type == ETHERTYPE_IPV6) {
+		const struct ipv6 *ipv6 = (const struct ipv6 *)buffer;
+
+		if ((buffer + sizeof(*ipv6) > packet_end) ||
+		    (ipv6->version != 6) ||
+		    !is_flow_protocol(ipv6->next_header))
+			return false;
+		ip_from_ipv6(&ipv6->src_ip, &flow->src_ip);
+		ip_from_ipv6(&ipv6->dst_ip, &flow->dst_ip);
+		flow->protocol = ipv6->next_header;
+		l4 = buffer + sizeof(*ipv6);
+	} else {
+		return false;
+	}
+
+	/* SCTP, TCP, UDP and UDPLite all start with the two ports. */
+	if (flow->protocol == IPPROTO_TCP) {
+		const struct tcp *tcp = (const struct tcp *)l4;
+
+		if (l4 + sizeof(*tcp) > packet_end)
+			return false;
+		flow->is_tcp_syn = tcp->syn && !tcp->ack;
+	} else if (l4 + 2 * sizeof(__be16) > packet_end) {
+		return false;
+	}
+	flow->src_port = ((const __be16 *)l4)[0];
+	flow->dst_port = ((const __be16 *)l4)[1];
+	return true;
+}
+
 /* Parse the IPv4 header and the TCP header inside. Return a
  * packet_parse_result_t.
  * Note that packet_end points to the byte beyond the end of packet.
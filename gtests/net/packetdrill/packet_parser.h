@@ -25,6 +25,7 @@
 #ifndef __PACKET_PARSER_H__
 #define __PACKET_PARSER_H__
 
+#include "ip_address.h"
 #include "packet.h"
 
 enum packet_parse_result_t {
@@ -44,4 +45,27 @@ enum packet_parse_result_t {
 int parse_packet(struct packet *packet, int in_bytes,
 		 u16 ether_type, u8 udp_encaps, char **error);
 
+/* The addresses and ports of a packet, which a first-stage filter can
+ * use to decide whether a sniffed packet is worth a full parse.
+ */
+struct packet_flow {
+	struct ip_address src_ip;
+	struct ip_address dst_ip;
+	__be16 src_port;
+	__be16 dst_port;
+	u8 protocol;		/* IPPROTO_TCP, IPPROTO_UDP, etc */
+	bool is_tcp_syn;	/* TCP SYN without ACK? */
+};
+
+/* Cheaply extract the flow of a raw packet of length 'in_bytes' from
+ * the fixed offsets of its IP and layer 4 headers, without validating
+ * or parsing the rest of the packet. Returns true on success. Returns
+ * false if the flow cannot be found that way (encapsulated packets,
+ * IPv6 extension headers, IP fragments, truncated headers, etc), in
+ * which case the caller must run parse_packet() to find out.
+ */
+extern bool parse_packet_flow(const u8 *buffer, int in_bytes,
+			      u16 ether_type, u8 udp_encaps,
+			      struct packet_flow *flow);
+
 #endif /* __PACKET_PARSER_H__ */
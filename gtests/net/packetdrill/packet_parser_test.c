@@ -23,7 +23,9 @@
  */
 
 #include "assert.h"
+#include "checksum.h"
 #include "ethernet.h"
+#include "ip_reassembly.h"
 #include "packet_parser.h"
 
 #include <stdlib.h>
@@ -765,6 +767,93 @@ static void test_parse_icmpv6_packet(void)
 	packet_free(packet);
 }
 
+static void test_parse_packet_flow(void)
+{
+	/* A TCP/IPv4 SYN: 192.0.2.1:53055 > 192.168.0.1:8080 */
+	u8 data[] = {
+		0x45, 0x00, 0x00, 0x28, 0x00, 0x00, 0x00, 0x00,
+		0xff, 0x06, 0x39, 0x25, 0xc0, 0x00, 0x02, 0x01,
+		0xc0, 0xa8, 0x00, 0x01, 0xcf, 0x3f, 0x1f, 0x90,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x50, 0x02, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00
+	};
+	struct packet_flow flow;
+
+	assert(parse_packet_flow(data, sizeof(data), ETHERTYPE_IP, 0, &flow));
+	assert(flow.protocol == IPPROTO_TCP);
+	assert(flow.src_ip.ip.v4.s_addr == htonl(0xc0000201));
+	assert(flow.dst_ip.ip.v4.s_addr == htonl(0xc0a80001));
+	assert(flow.src_port == htons(53055));
+	assert(flow.dst_port == htons(8080));
+	assert(flow.is_tcp_syn);
+
+	/* Truncated layer 4 headers and UDP encapsulation need a full parse. */
+	assert(!parse_packet_flow(data, 30, ETHERTYPE_IP, 0, &flow));
+	assert(!parse_packet_flow(data, sizeof(data), ETHERTYPE_IP,
+				  IPPROTO_TCP, &flow));
+
+	/* So do IP fragments. */
+	data[6] = 0x20;
+	assert(!parse_packet_flow(data, sizeof(data), ETHERTYPE_IP, 0, &flow));
+}
+
+/* Make an IPv4 fragment of a UDP datagram 192.0.2.1:53055 > 192.168.0.1:8080
+ * carrying 16 bytes of data: 24 bytes of IP payload in all.
+ */
+static int make_ipv4_udp_fragment(u8 *buffer, int offset, int bytes, bool more)
+{
+	u8 payload[24] = {
+		0xcf, 0x3f, 0x1f, 0x90, 0x00, 0x18, 0x00, 0x00,
+	};
+	struct ipv4 *ipv4 = (struct ipv4 *)buffer;
+
+	memset(ipv4, 0, sizeof(*ipv4));
+	ipv4->version = 4;
+	ipv4->ihl = 5;
+	ipv4->tot_len = htons(sizeof(*ipv4) + bytes);
+	ipv4->id = htons(7);
+	ipv4->frag_off = htons((more ? IP_MF : 0) | (offset / 8));
+	ipv4->ttl = 64;
+	ipv4->protocol = IPPROTO_UDP;
+	ipv4->src_ip.s_addr = htonl(0xc0000201);
+	ipv4->dst_ip.s_addr = htonl(0xc0a80001);
+	ipv4->check = ipv4_checksum(ipv4, sizeof(*ipv4));
+	memcpy(buffer + sizeof(*ipv4), payload + offset, bytes);
+	return sizeof(*ipv4) + bytes;
+}
+
+static void test_reassemble_ipv4_fragments(void)
+{
+	struct ip_reassembly *reassembly = ip_reassembly_new(2, 1000000);
+	struct packet *packet = packet_new(PACKET_READ_BYTES);
+	char *error = NULL;
+	int in_bytes;
+
+	/* The last fragment comes first, then an overlapping pair. */
+	in_bytes = make_ipv4_udp_fragment(packet->buffer, 16, 8, false);
+	assert(!ip_reassembly_add(reassembly, packet, ETHERTYPE_IP, &in_bytes));
+	in_bytes = make_ipv4_udp_fragment(packet->buffer, 8, 16, true);
+	assert(!ip_reassembly_add(reassembly, packet, ETHERTYPE_IP, &in_bytes));
+	assert(reassembly->num_drops == 1);
+
+	in_bytes = make_ipv4_udp_fragment(packet->buffer, 16, 8, false);
+	assert(!ip_reassembly_add(reassembly, packet, ETHERTYPE_IP, &in_bytes));
+	in_bytes = make_ipv4_udp_fragment(packet->buffer, 0, 16, true);
+	assert(ip_reassembly_add(reassembly, packet, ETHERTYPE_IP, &in_bytes));
+	assert(in_bytes == sizeof(struct ipv4) + 24);
+	assert(packet->num_fragments == 2);
+	assert(packet->fragment_bytes[0] == 8);
+	assert(packet->fragment_bytes[1] == 16);
+
+	assert(parse_packet(packet, in_bytes, ETHERTYPE_IP, 0, &error) ==
+	       PACKET_OK);
+	assert(packet->udp != NULL);
+	assert(packet_payload_len(packet) == 16);
+
+	packet_free(packet);
+	ip_reassembly_free(reassembly);
+}
+
 int main(void)
 {
 	test_parse_sctp_ipv4_packet();
@@ -781,5 +870,7 @@ int main(void)
 	test_parse_ipv4_gre_mpls_ipv4_tcp_packet();
 	test_parse_icmpv4_packet();
 	test_parse_icmpv6_packet();
+	test_parse_packet_flow();
+	test_reassemble_ipv4_fragments();
 	return 0;
 }
@@ -49,12 +49,25 @@ extern void packet_socket_set_filter(
 	const struct ether_addr *client_ether_addr,
 	const struct ip_address *client_live_ip);
 
+/* Discard any packets already queued on the packet socket, without
+ * blocking.
+ */
+extern void packet_socket_drain(struct packet_socket *psock);
+
 /* Send the given packet using writev. Return STATUS_OK on success,
  * or STATUS_ERR if writev returns an error.
  */
 extern int packet_socket_writev(struct packet_socket *psock,
 				const struct iovec *iov, int iovcnt);
 
+/* Send num_frames packets back to back, where packet i is made of the
+ * iovcnt iovecs starting at iov[i * iovcnt]. Return STATUS_OK on
+ * success, or STATUS_ERR if we could not send them all.
+ */
+extern int packet_socket_writev_burst(struct packet_socket *psock,
+				      const struct iovec *iov, int iovcnt,
+				      int num_frames);
+
 /* Do a blocking sniff of the next packet going over the given device
  * in the given direction, fill in the given packet with the sniffed
  * packet info, and return the number of bytes in the packet in
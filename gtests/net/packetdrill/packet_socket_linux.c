@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <sys/uio.h>
 #include <unistd.h>
 
@@ -217,6 +218,16 @@ void packet_socket_free(struct packet_socket *psock)
 	free(psock);
 }
 
+void packet_socket_drain(struct packet_socket *psock)
+{
+	char byte;
+
+	/* MSG_TRUNC discards the rest of each frame for us. */
+	while (recv(psock->packet_fd, &byte, sizeof(byte),
+		    MSG_DONTWAIT | MSG_TRUNC) >= 0)
+		;
+}
+
 int packet_socket_writev(struct packet_socket *psock,
 			 const struct iovec *iov, int iovcnt)
 {
@@ -227,6 +238,33 @@ int packet_socket_writev(struct packet_socket *psock,
 	return STATUS_OK;
 }
 
+int packet_socket_writev_burst(struct packet_socket *psock,
+			       const struct iovec *iov, int iovcnt,
+			       int num_frames)
+{
+	struct mmsghdr *msgs = calloc(num_frames, sizeof(struct mmsghdr));
+	int i, sent = 0, result = STATUS_OK;
+
+	for (i = 0; i < num_frames; ++i) {
+		msgs[i].msg_hdr.msg_iov = (struct iovec *)&iov[i * iovcnt];
+		msgs[i].msg_hdr.msg_iovlen = iovcnt;
+	}
+
+	/* Hand the kernel the whole burst in as few calls as it takes. */
+	while (sent < num_frames) {
+		i = sendmmsg(psock->packet_fd, msgs + sent, num_frames - sent, 0);
+		if (i < 0) {
+			perror("sendmmsg");
+			result = STATUS_ERR;
+			break;
+		}
+		sent += i;
+	}
+
+	free(msgs);
+	return result;
+}
+
 int packet_socket_receive(struct packet_socket *psock,
 			  enum direction_t direction, u16 *ether_type,
 			  struct packet *packet, int *in_bytes)
@@ -217,6 +217,30 @@ int packet_socket_writev(struct packet_socket *psock,
 	return STATUS_OK;
 }
 
+int packet_socket_writev_burst(struct packet_socket *psock,
+			       const struct iovec *iov, int iovcnt,
+			       int num_frames)
+{
+	int i;
+
+	/* pcap has no way to inject more than one packet per call. */
+	for (i = 0; i < num_frames; ++i) {
+		if (packet_socket_writev(psock, &iov[i * iovcnt], iovcnt))
+			return STATUS_ERR;
+	}
+	return STATUS_OK;
+}
+
+void packet_socket_drain(struct packet_socket *psock)
+{
+	struct pcap_pkthdr *pkt_header = NULL;
+	const u8 *pkt_data = NULL;
+
+	/* In immediate mode pcap_next_ex() returns 0 once the queue is empty. */
+	while (pcap_next_ex(psock->pcap, &pkt_header, &pkt_data) == 1)
+		;
+}
+
 int packet_socket_receive(struct packet_socket *psock,
 			  enum direction_t direction, u16 *ether_type,
 			  struct packet *packet, int *in_bytes)
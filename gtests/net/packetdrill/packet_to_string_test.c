@@ -30,6 +30,8 @@
 #include "ethernet.h"
 #include "packet_parser.h"
 #include "logging.h"
+#include "packet_checksum.h"
+#include "tcp_packet.h"
 
 int debug_logging = 0;
 #define DEBUG_LOGGING 1
@@ -1250,6 +1252,69 @@ static void test_udplite_ipv6_packet_to_string(void)
 	packet_free(packet);
 }
 
+/* Build an AccECN option the way the script parser does. */
+static struct tcp_option *new_accecn_option(u8 kind, const u32 *counters,
+					    int num_counters)
+{
+	struct tcp_option *option =
+		tcp_option_new(kind, TCPOLEN_ACCECN_BASE);
+	int i;
+
+	for (i = 0; i < num_counters; ++i) {
+		set_accecn_option_counter(option, i, counters[i]);
+		option->length += TCPOLEN_ACCECN_COUNTER;
+	}
+	return option;
+}
+
+static void test_tcp_accecn_options_round_trip(void)
+{
+	const u32 accecn0_counters[] = { 1, 0x10000, 0xffffff };
+	const u32 accecn1_counters[] = { 70000 };
+	struct tcp_options *options = tcp_options_new();
+	struct packet *script_packet = NULL, *packet = NULL;
+	char *error = NULL, *dump = NULL;
+	enum packet_parse_result_t result;
+	int status = 0;
+
+	/* Generate the options on the wire... */
+	assert(tcp_options_append(options,
+				  new_accecn_option(TCPOPT_ACCECN0,
+						    accecn0_counters, 3)) ==
+	       STATUS_OK);
+	assert(tcp_options_append(options,
+				  new_accecn_option(TCPOPT_ACCECN1,
+						    accecn1_counters, 1)) ==
+	       STATUS_OK);
+	script_packet = new_tcp_packet(AF_INET, DIRECTION_INBOUND, ECN_NONE,
+				       ".", 1, 0, 1, 257, 0, options,
+				       false, false, false, false, 0, 0,
+				       &error);
+	assert(script_packet != NULL);
+	free(options);
+	checksum_packet(script_packet);
+
+	/* ...then parse them back and print them in script syntax. */
+	packet = packet_new(script_packet->ip_bytes);
+	memcpy(packet->buffer, packet_start(script_packet),
+	       script_packet->ip_bytes);
+	result = parse_packet(packet, script_packet->ip_bytes, ETHERTYPE_IP,
+			      0, &error);
+	assert(result == PACKET_OK);
+	assert(error == NULL);
+
+	status = packet_to_string(packet, DUMP_SHORT, &dump, &error);
+	assert(status == STATUS_OK);
+	assert(error == NULL);
+	printf("dump = '%s'\n", dump);
+	assert(strcmp(dump, ". 1:1(0) ack 1 win 257 "
+		      "<accecn0 1 65536 16777215,accecn1 70000>") == 0);
+	free(dump);
+
+	packet_free(packet);
+	packet_free(script_packet);
+}
+
 int main(void)
 {
 	test_tcp_udp_ipv4_packet_to_string();
@@ -1264,5 +1329,6 @@ int main(void)
 	test_gre_mpls_tcp_ipv4_packet_to_string();
 	test_udplite_ipv4_packet_to_string();
 	test_udplite_ipv6_packet_to_string();
+	test_tcp_accecn_options_round_trip();
 	return 0;
 }
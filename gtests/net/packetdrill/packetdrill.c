@@ -30,11 +30,17 @@
 #if defined(__FreeBSD__)
 #include <pthread_np.h>
 #endif
+#ifdef linux
+#include <sched.h>
+#endif
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include "assert.h"
 #include "config.h"
+#include "logging.h"
 #include "parse.h"
 #include "run.h"
 #include "script.h"
@@ -67,6 +73,423 @@ static void run_init_scripts(struct config *config)
 	free(scripts);
 }
 
+/* A script to run on one of the threads of a --parallel run. */
+struct script_job {
+	struct config config;
+	struct script script;
+};
+
+/* The scripts of a --parallel run, and which one to start next. */
+struct script_pool {
+	pthread_mutex_t mutex;		/* protects next_job */
+	struct script_job *jobs;	/* array of all scripts (owned) */
+	int num_jobs;
+	int next_job;
+};
+
+#ifdef linux
+/* Move this thread into a network namespace of its own, with the
+ * loopback device up, so that scripts running on other threads can use
+ * the same tun device name and addresses without seeing our packets.
+ */
+static void enter_new_netns(const char *script_path)
+{
+	char *error = NULL;
+
+	if (unshare(CLONE_NEWNET) < 0)
+		die_perror("unshare(CLONE_NEWNET)");
+	if (safe_system("ip link set dev lo up", &error)) {
+		die("%s: error setting up loopback device: %s\n",
+		    script_path, error);
+	}
+}
+#endif
+
+/* Each thread of a --parallel run takes scripts from the pool, one at a
+ * time, until they are all running.
+ */
+static void *script_pool_thread(void *arg)
+{
+	struct script_pool *pool = arg;
+	struct script_job *job = NULL;
+	int err;
+
+	while (1) {
+		if ((err = pthread_mutex_lock(&pool->mutex)) != 0)
+			die_strerror("pthread_mutex_lock", err);
+		job = NULL;
+		if (pool->next_job < pool->num_jobs)
+			job = &pool->jobs[pool->next_job++];
+		if ((err = pthread_mutex_unlock(&pool->mutex)) != 0)
+			die_strerror("pthread_mutex_unlock", err);
+		if (job == NULL)
+			break;
+
+		if (job->config.dry_run)
+			continue;
+#ifdef linux
+		enter_new_netns(job->config.script_path);
+#endif
+		run_init_scripts(&job->config);
+		run_script(&job->config, &job->script);
+	}
+	return NULL;
+}
+
+/* Run the given scripts on a pool of threads, up to 'parallel' at once.
+ * As when running scripts one after another, the first failure ends the
+ * whole run with a failing exit status.
+ */
+static void run_scripts_in_parallel(int argc, char *argv[], int parallel,
+				    char **script_paths)
+{
+	struct script_pool pool;
+	pthread_t *threads = NULL;
+	int i, num_threads, err;
+
+	memset(&pool, 0, sizeof(pool));
+	while (script_paths[pool.num_jobs] != NULL)
+		++pool.num_jobs;
+	pool.jobs = calloc(pool.num_jobs, sizeof(struct script_job));
+
+	/* Parse everything before starting any threads, since getopt(3)
+	 * and the parser are not thread-safe, and so that a typo in one
+	 * script does not leave others half run.
+	 */
+	for (i = 0; i < pool.num_jobs; ++i) {
+		if (parse_script_and_set_config(argc, argv,
+						&pool.jobs[i].config,
+						&pool.jobs[i].script,
+						script_paths[i], NULL))
+			exit(EXIT_FAILURE);
+	}
+
+	if ((err = pthread_mutex_init(&pool.mutex, NULL)) != 0)
+		die_strerror("pthread_mutex_init", err);
+	num_threads = parallel < pool.num_jobs ? parallel : pool.num_jobs;
+	threads = calloc(num_threads, sizeof(pthread_t));
+	for (i = 0; i < num_threads; ++i) {
+		if ((err = create_thread(&threads[i],
+					 script_pool_thread, &pool)) != 0)
+			die_strerror("pthread_create", err);
+	}
+	for (i = 0; i < num_threads; ++i) {
+		if ((err = pthread_join(threads[i], NULL)) != 0)
+			die_strerror("pthread_join", err);
+	}
+	pthread_mutex_destroy(&pool.mutex);
+
+	for (i = 0; i < pool.num_jobs; ++i) {
+		free_script(&pool.jobs[i].script);
+		cleanup_config(&pool.jobs[i].config);
+	}
+	free(pool.jobs);
+	free(threads);
+}
+
+/* One point of a --sweep: a script to run with one value for each of
+ * the swept symbols.
+ */
+struct sweep_point {
+	struct config config;
+	struct script script;
+	char **values;		/* value of each swept symbol (owned) */
+	pid_t pid;		/* process running it, or 0 */
+	int status;		/* its wait(2) status */
+	s64 start_usecs;	/* when it started */
+	s64 end_usecs;		/* when it finished */
+};
+
+/* The symbols of a --sweep, and the values to try for each. The last
+ * may be the option perturb_seed, for --perturb_seeds.
+ */
+struct sweep {
+	int num_symbols;
+	char **symbols;		/* in command line order (not owned) */
+	bool has_seeds;		/* is the last symbol perturb_seed? */
+	char ***values;		/* NULL-terminated values of each (owned) */
+	int *num_values;
+	struct sweep_point *points;	/* all points of all scripts (owned) */
+	int num_points;
+};
+
+/* Split a comma-separated list of values into a NULL-terminated array. */
+static char **split_sweep_values(const char *list, int *num_values)
+{
+	char *copy = strdup(list), *value = NULL, *saveptr = NULL;
+	char **values = calloc(strlen(list) + 2, sizeof(char *));
+
+	*num_values = 0;
+	for (value = strtok_r(copy, ",", &saveptr); value != NULL;
+	     value = strtok_r(NULL, ",", &saveptr))
+		values[(*num_values)++] = strdup(value);
+	free(copy);
+	return values;
+}
+
+/* Parse the given script with the given point's values defined, by
+ * appending a --define for each to a copy of our command line, so they
+ * win over any -D for the same symbol. A seed is passed as an option.
+ */
+static void parse_sweep_point(int argc, char *argv[], struct sweep *sweep,
+			      struct sweep_point *point,
+			      const char *script_path)
+{
+	int point_argc = argc + sweep->num_symbols;
+	char **point_argv = calloc(point_argc + 1, sizeof(char *));
+	int i;
+
+	for (i = 0; i < argc; ++i)
+		point_argv[i] = argv[i];
+	for (i = 0; i < sweep->num_symbols; ++i) {
+		const bool is_option = sweep->has_seeds &&
+			(i == sweep->num_symbols - 1);
+
+		asprintf(&point_argv[argc + i],
+			 is_option ? "--%s=%s" : "--define=%s=%s",
+			 sweep->symbols[i], point->values[i]);
+	}
+	if (parse_script_and_set_config(point_argc, point_argv,
+					&point->config, &point->script,
+					script_path, NULL))
+		exit(EXIT_FAILURE);
+	for (i = 0; i < sweep->num_symbols; ++i)
+		free(point_argv[argc + i]);
+	free(point_argv);
+}
+
+/* Start running the given point in a child process of its own, in its
+ * own network namespace, so that a failing point cannot end the sweep or
+ * disturb the points running beside it.
+ */
+static void start_sweep_point(struct sweep_point *point)
+{
+	fflush(stdout);
+	fflush(stderr);
+	point->start_usecs = now_usecs();
+	point->pid = fork();
+	if (point->pid < 0)
+		die_perror("fork");
+	if (point->pid > 0)
+		return;
+
+	/* Points finish in any order, so only append the result record,
+	 * and leave rendering the JUnit XML to run_sweep().
+	 */
+	point->config.junit_path = NULL;
+#ifdef linux
+	enter_new_netns(point->config.script_path);
+#endif
+	run_init_scripts(&point->config);
+	run_script(&point->config, &point->script);
+	exit(EXIT_SUCCESS);
+}
+
+/* Print a table of the outcome of each point of the sweep, with a
+ * column for the script if we swept more than one.
+ */
+static void print_sweep_results(struct sweep *sweep, bool show_scripts)
+{
+	int *widths = calloc(sweep->num_symbols + 1, sizeof(int));
+	int i, j, len;
+
+	widths[0] = strlen("script");
+	for (j = 0; j < sweep->num_symbols; ++j)
+		widths[j + 1] = strlen(sweep->symbols[j]);
+	for (i = 0; i < sweep->num_points; ++i) {
+		struct sweep_point *point = &sweep->points[i];
+
+		len = strlen(point->config.script_path);
+		if (len > widths[0])
+			widths[0] = len;
+		for (j = 0; j < sweep->num_symbols; ++j) {
+			len = strlen(point->values[j]);
+			if (len > widths[j + 1])
+				widths[j + 1] = len;
+		}
+	}
+
+	if (show_scripts)
+		printf("%-*s  ", widths[0], "script");
+	for (j = 0; j < sweep->num_symbols; ++j)
+		printf("%-*s  ", widths[j + 1], sweep->symbols[j]);
+	printf("%-6s  %10s\n", "result", "secs");
+	for (i = 0; i < sweep->num_points; ++i) {
+		struct sweep_point *point = &sweep->points[i];
+		const int status = point->status;
+
+		if (show_scripts)
+			printf("%-*s  ", widths[0], point->config.script_path);
+		for (j = 0; j < sweep->num_symbols; ++j)
+			printf("%-*s  ", widths[j + 1], point->values[j]);
+		printf("%-6s  %10.3f",
+		       (WIFEXITED(status) && WEXITSTATUS(status) == 0) ?
+		       "pass" : "FAIL",
+		       usecs_to_secs(point->end_usecs - point->start_usecs));
+		if (WIFEXITED(status) && WEXITSTATUS(status) != 0)
+			printf("  (exit status %d)", WEXITSTATUS(status));
+		else if (WIFSIGNALED(status))
+			printf("  (signal %d)", WTERMSIG(status));
+		printf("\n");
+	}
+	free(widths);
+}
+
+/* Render the JUnit XML of each results file of the sweep, now that all
+ * the points have appended their records to it.
+ */
+static void render_sweep_junit(struct sweep *sweep)
+{
+	char *error = NULL;
+	int i, j;
+
+	for (i = 0; i < sweep->num_points; ++i) {
+		const struct config *config = &sweep->points[i].config;
+
+		if (config->junit_path == NULL)
+			continue;
+		for (j = 0; j < i; ++j) {
+			const struct config *done = &sweep->points[j].config;
+
+			if ((done->junit_path != NULL) &&
+			    (strcmp(done->results_path,
+				    config->results_path) == 0) &&
+			    (strcmp(done->junit_path,
+				    config->junit_path) == 0))
+				break;
+		}
+		if (j < i)
+			continue;
+		if (results_render_junit(config->results_path,
+					 config->junit_path, &error)) {
+			fprintf(stderr, "%s\n", error);
+			free(error);
+			error = NULL;
+		}
+	}
+}
+
+/* Run each of the given scripts once for every combination of the
+ * values given with --sweep, and for each of the seeds given with
+ * --perturb_seeds, up to 'parallel' points at once, and print
+ * a table of the results. Unlike a plain run, a failing point does not
+ * stop the others. Returns the exit status for the whole sweep.
+ */
+static int run_sweep(int argc, char *argv[], struct config *config,
+		     char **script_paths)
+{
+	struct sweep sweep;
+	struct definition *def = NULL;
+	int num_scripts = 0, points_per_script = 1;
+	int i, j, k, next_point, running, status;
+	bool failed = false;
+
+	memset(&sweep, 0, sizeof(sweep));
+	for (def = config->sweeps; def != NULL; def = def->next)
+		++sweep.num_symbols;
+	sweep.has_seeds = (config->perturb_seeds > 1);
+	if (sweep.has_seeds)
+		++sweep.num_symbols;
+	sweep.symbols = calloc(sweep.num_symbols, sizeof(char *));
+	sweep.values = calloc(sweep.num_symbols, sizeof(char **));
+	sweep.num_values = calloc(sweep.num_symbols, sizeof(int));
+	/* Seeds vary fastest, so the points for a set of values are
+	 * together in the table.
+	 */
+	j = sweep.num_symbols;
+	if (sweep.has_seeds) {
+		--j;
+		sweep.symbols[j] = "perturb_seed";
+		sweep.num_values[j] = config->perturb_seeds;
+		sweep.values[j] = calloc(config->perturb_seeds + 1,
+					 sizeof(char *));
+		for (k = 0; k < config->perturb_seeds; ++k) {
+			asprintf(&sweep.values[j][k], "%llu",
+				 config->perturb_seed + k);
+		}
+		points_per_script *= sweep.num_values[j];
+	}
+	/* The list is newest first; we want command line order. */
+	for (def = config->sweeps; def != NULL; def = def->next) {
+		--j;
+		sweep.symbols[j] = def->symbol;
+		sweep.values[j] = split_sweep_values(def->value,
+						     &sweep.num_values[j]);
+		if (sweep.num_values[j] == 0)
+			die("bad sweep: %s=%s\n", def->symbol, def->value);
+		points_per_script *= sweep.num_values[j];
+	}
+
+	while (script_paths[num_scripts] != NULL)
+		++num_scripts;
+	sweep.num_points = num_scripts * points_per_script;
+	sweep.points = calloc(sweep.num_points, sizeof(struct sweep_point));
+
+	/* Parse every point before running any, as --parallel does. The
+	 * last symbol varies fastest.
+	 */
+	for (i = 0; i < sweep.num_points; ++i) {
+		struct sweep_point *point = &sweep.points[i];
+
+		point->values = calloc(sweep.num_symbols, sizeof(char *));
+		k = i % points_per_script;
+		for (j = sweep.num_symbols - 1; j >= 0; --j) {
+			point->values[j] =
+				sweep.values[j][k % sweep.num_values[j]];
+			k /= sweep.num_values[j];
+		}
+		parse_sweep_point(argc, argv, &sweep, point,
+				  script_paths[i / points_per_script]);
+	}
+
+	if (!config->dry_run) {
+		next_point = 0;
+		running = 0;
+		while ((next_point < sweep.num_points) || (running > 0)) {
+			if ((next_point < sweep.num_points) &&
+			    (running < config->parallel)) {
+				start_sweep_point(&sweep.points[next_point++]);
+				++running;
+				continue;
+			}
+			pid_t pid = wait(&status);
+			if (pid < 0)
+				die_perror("wait");
+			for (i = 0; i < sweep.num_points; ++i) {
+				struct sweep_point *point = &sweep.points[i];
+
+				if (point->pid != pid)
+					continue;
+				point->status = status;
+				point->end_usecs = now_usecs();
+				point->pid = 0;
+				--running;
+				if (!WIFEXITED(status) ||
+				    WEXITSTATUS(status) != 0)
+					failed = true;
+			}
+		}
+		print_sweep_results(&sweep, num_scripts > 1);
+		render_sweep_junit(&sweep);
+	}
+
+	for (i = 0; i < sweep.num_points; ++i) {
+		free_script(&sweep.points[i].script);
+		cleanup_config(&sweep.points[i].config);
+		free(sweep.points[i].values);
+	}
+	for (j = 0; j < sweep.num_symbols; ++j) {
+		for (k = 0; k < sweep.num_values[j]; ++k)
+			free(sweep.values[j][k]);
+		free(sweep.values[j]);
+	}
+	free(sweep.points);
+	free(sweep.values);
+	free(sweep.num_values);
+	free(sweep.symbols);
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[])
 {
 	struct config config;
@@ -113,6 +536,19 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
+	if ((config.sweeps != NULL) || (config.perturb_seeds > 1)) {
+		int status = run_sweep(argc, argv, &config, arg);
+
+		cleanup_config(&config);
+		return status;
+	}
+
+	if (config.parallel > 1) {
+		run_scripts_in_parallel(argc, argv, config.parallel, arg);
+		cleanup_config(&config);
+		return 0;
+	}
+
 	/* Parse and run each script on the command line. */
 	for (; *arg != NULL; ++arg) {
 		struct script script;
@@ -126,11 +562,14 @@ int main(int argc, char *argv[])
 		if (config.dry_run)
 			continue;
 
-		run_init_scripts(&config);
+		/* A re-verified script does not touch the machine. */
+		if (config.reverify_path == NULL)
+			run_init_scripts(&config);
 		run_script(&config, &script);
 		free_script(&script);
 	}
 
+	wire_client_session_end();
 	cleanup_config(&config);
 	return 0;
 }
@@ -93,10 +93,12 @@
 #include "gre_packet.h"
 #include "ip.h"
 #include "ip_packet.h"
+#include "ip_reassembly.h"
 #include "icmp_packet.h"
 #include "logging.h"
 #include "mpls.h"
 #include "mpls_packet.h"
+#include "mptcp.h"
 #include "sctp_packet.h"
 #include "tcp_packet.h"
 #include "udp_packet.h"
@@ -123,7 +125,6 @@ extern char *yytext;
 extern int yylex(void);
 extern int yyparse(void);
 extern int yywrap(void);
-extern const char *cleanup_cmd;
 
 /* This mutex guards all parser global variables declared in this file. */
 pthread_mutex_t parser_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -548,8 +549,10 @@ static struct tcp_option *new_tcp_exp_fast_open_option(const char *cookie_string
 	struct syscall_spec *syscall;
 	struct command_spec *command;
 	struct code_spec *code;
+	struct sysctl_spec *sysctl;
 	struct tcp_option *tcp_option;
 	struct tcp_options *tcp_options;
+	struct mptcp_option *mptcp_option;
 	struct expression *expression;
 	struct expression_list *expression_list;
 	struct errno_spec *errno_info;
@@ -565,7 +568,8 @@ static struct tcp_option *new_tcp_exp_fast_open_option(const char *cookie_string
 %token <reserved> SF_HDTR_HEADERS SF_HDTR_TRAILERS
 %token <reserved> FD EVENTS REVENTS ONOFF LINGER
 %token <reserved> ACK ECR EOL MSS NOP SACK NR_SACK SACKOK TIMESTAMP VAL WIN WSCALE PRO
-%token <reserved> URG EXP_FAST_OPEN FAST_OPEN
+%token <reserved> URG EXP_FAST_OPEN FAST_OPEN MPTCP SUBFLOW ACCECN0 ACCECN1
+%token <reserved> FRAGS SYSCTL
 %token <reserved> IOV_BASE IOV_LEN
 %token <reserved> ECT0 ECT1 CE ECT01 NO_ECN
 %token <reserved> IPV4 IPV6 ICMP SCTP UDP UDPLITE GRE MTU
@@ -664,10 +668,11 @@ static struct tcp_option *new_tcp_exp_fast_open_option(const char *cookie_string
 %type <packet> sctp_packet_spec tcp_packet_spec
 %type <packet> udp_packet_spec udplite_packet_spec
 %type <packet> icmp_packet_spec
-%type <packet> packet_prefix
+%type <packet> packet_prefix packet_frags
 %type <syscall> syscall_spec
 %type <command> command_spec
 %type <code> code_spec
+%type <sysctl> sysctl_spec
 %type <mpls_stack> mpls_stack
 %type <mpls_stack_entry> mpls_stack_entry
 %type <integer> opt_mpls_stack_bottom
@@ -682,7 +687,8 @@ static struct tcp_option *new_tcp_exp_fast_open_option(const char *cookie_string
 %type <tcp_sequence_info> seq
 %type <transport_info> opt_icmp_echoed
 %type <tcp_options> opt_tcp_options tcp_option_list
-%type <tcp_option> tcp_option sack_block_list sack_block
+%type <tcp_option> tcp_option sack_block_list sack_block accecn_option
+%type <mptcp_option> mptcp_option
 %type <string> function_name
 %type <expression_list> expression_list function_arguments
 %type <expression> expression binary_expression array
@@ -922,6 +928,7 @@ event
 : event_time action  {
 	$$ = $2;
 	$$->line_number = $1->line_number;   /* use timestamp's line */
+	$$->end_line_number = @2.last_line;
 	$$->time_usecs  = $1->time_usecs;
 	$$->time_usecs_end  = $1->time_usecs_end;
 	$$->time_type = $1->time_type;
@@ -1001,6 +1008,7 @@ action
 | syscall_spec { $$ = new_event(SYSCALL_EVENT); $$->event.syscall = $1; }
 | command_spec { $$ = new_event(COMMAND_EVENT); $$->event.command = $1; }
 | code_spec    { $$ = new_event(CODE_EVENT);    $$->event.code    = $1; }
+| sysctl_spec  { $$ = new_event(SYSCTL_EVENT);  $$->event.sysctl  = $1; }
 ;
 
 packet_spec
@@ -2426,6 +2434,7 @@ tcp_packet_spec
 	char *error = NULL;
 	struct packet *outer = $1, *inner = NULL;
 	enum direction_t direction = outer->direction;
+	u8 mptcp_subflow = outer->mptcp_subflow;
 
 	if (($8 == NULL) && (direction != DIRECTION_OUTBOUND)) {
 		yylineno = @8.first_line;
@@ -2454,6 +2463,7 @@ tcp_packet_spec
 	}
 
 	$$ = packet_encapsulate_and_free(outer, inner);
+	$$->mptcp_subflow = mptcp_subflow;
 }
 ;
 
@@ -2553,6 +2563,33 @@ packet_prefix
 	free(ip_dst);
 	$$ = packet;
 }
+| packet_prefix SUBFLOW INTEGER ':' {
+	struct packet *packet = $1;
+	if (!is_valid_u8($3) || $3 >= MPTCP_MAX_SUBFLOWS) {
+		semantic_error("MPTCP subflow out of range");
+	}
+	packet->mptcp_subflow = $3;
+	$$ = packet;
+}
+| packet_prefix FRAGS INTEGER ':' {
+	struct packet *packet = $1;
+	if (packet->direction != DIRECTION_OUTBOUND) {
+		semantic_error("frags can only be used with outbound packets");
+	}
+	if ($3 < 2 || $3 > PACKET_MAX_FRAGMENTS) {
+		semantic_error("number of fragments out of range");
+	}
+	packet->num_fragments = $3;
+	$$ = packet;
+}
+| packet_frags ')' ':' {
+	struct packet *packet = $1;
+	/* One fragment would just be the whole datagram. */
+	if (packet->num_fragments < 2) {
+		semantic_error("frags needs at least two fragment sizes");
+	}
+	$$ = packet;
+}
 | packet_prefix GRE ':' {
 	char *error = NULL;
 	struct packet *packet = $1;
@@ -2572,6 +2609,32 @@ packet_prefix
 }
 ;
 
+packet_frags
+: packet_prefix FRAGS '(' INTEGER {
+	struct packet *packet = $1;
+	if (packet->direction != DIRECTION_OUTBOUND) {
+		semantic_error("frags can only be used with outbound packets");
+	}
+	if ($4 <= 0 || $4 > IP_REASSEMBLY_MAX_BYTES) {
+		semantic_error("fragment size out of range");
+	}
+	packet->num_fragments = 1;
+	packet->fragment_bytes[0] = $4;
+	$$ = packet;
+}
+| packet_frags ',' INTEGER {
+	struct packet *packet = $1;
+	if (packet->num_fragments == PACKET_MAX_FRAGMENTS) {
+		semantic_error("too many fragments");
+	}
+	if ($3 <= 0 || $3 > IP_REASSEMBLY_MAX_BYTES) {
+		semantic_error("fragment size out of range");
+	}
+	packet->fragment_bytes[packet->num_fragments++] = $3;
+	$$ = packet;
+}
+;
+
 mpls_stack
 :				{
 	$$ = mpls_stack_new();
@@ -2880,6 +2943,88 @@ tcp_option
 		free(error);
 	}
 }
+| accecn_option  {
+	$$ = $1;
+}
+| mptcp_option  {
+	char *error = NULL;
+	$$ = mptcp_option_new($1, &error);
+	free($1);
+	if ($$ == NULL) {
+		assert(error != NULL);
+		semantic_error(error);
+		free(error);
+	}
+}
+;
+
+mptcp_option
+: MPTCP WORD  {
+	char *error = NULL;
+	$$ = calloc(1, sizeof(struct mptcp_option));
+	if (mptcp_option_init($$, $2, &error)) {
+		semantic_error(error);
+		free(error);
+	}
+	free($2);
+}
+| mptcp_option WORD  {
+	char *error = NULL;
+	$$ = $1;
+	if (mptcp_option_set_flag($$, $2, &error)) {
+		semantic_error(error);
+		free(error);
+	}
+	free($2);
+}
+| mptcp_option WORD '=' INTEGER  {
+	char *error = NULL;
+	$$ = $1;
+	if (mptcp_option_set_integer($$, $2, $4, &error)) {
+		semantic_error(error);
+		free(error);
+	}
+	free($2);
+}
+| mptcp_option WORD '=' HEX_INTEGER  {
+	char *error = NULL;
+	$$ = $1;
+	if (mptcp_option_set_integer($$, $2, $4, &error)) {
+		semantic_error(error);
+		free(error);
+	}
+	free($2);
+}
+| mptcp_option WORD '=' WORD  {
+	char *error = NULL;
+	$$ = $1;
+	if (mptcp_option_set_string($$, $2, $4, &error)) {
+		semantic_error(error);
+		free(error);
+	}
+	free($2);
+	free($4);
+}
+| mptcp_option WORD '=' IPV4_ADDR  {
+	char *error = NULL;
+	$$ = $1;
+	if (mptcp_option_set_string($$, $2, $4, &error)) {
+		semantic_error(error);
+		free(error);
+	}
+	free($2);
+	free($4);
+}
+| mptcp_option WORD '=' IPV6_ADDR  {
+	char *error = NULL;
+	$$ = $1;
+	if (mptcp_option_set_string($$, $2, $4, &error)) {
+		semantic_error(error);
+		free(error);
+	}
+	free($2);
+	free($4);
+}
 ;
 
 abs_integer
@@ -2892,6 +3037,28 @@ ignore_integer
 | ELLIPSIS     { $$.integer = 0; $$.ignore = true; }
 ;
 
+accecn_option
+: ACCECN0  {
+	$$ = tcp_option_new(TCPOPT_ACCECN0, TCPOLEN_ACCECN_BASE);
+}
+| ACCECN1  {
+	$$ = tcp_option_new(TCPOPT_ACCECN1, TCPOLEN_ACCECN_BASE);
+}
+| accecn_option INTEGER  {
+	const int num_counters =
+		($1->length - TCPOLEN_ACCECN_BASE) / TCPOLEN_ACCECN_COUNTER;
+	if (num_counters >= MAX_ACCECN_COUNTERS) {
+		semantic_error("too many AccECN counters");
+	}
+	if ($2 < 0 || $2 > 0xffffff) {
+		semantic_error("AccECN counter out of range");
+	}
+	set_accecn_option_counter($1, num_counters, $2);
+	$1->length += TCPOLEN_ACCECN_COUNTER;
+	$$ = $1;
+}
+;
+
 sack_block_list
 : sack_block                 { $$ = $1; }
 | sack_block_list sack_block {
@@ -5934,6 +6101,25 @@ code_spec
 }
 ;
 
+sysctl_spec
+: SYSCTL STRING '=' STRING {
+	if ($2[0] == '\0')
+		semantic_error("empty sysctl name");
+	$$ = calloc(1, sizeof(struct sysctl_spec));
+	$$->name = $2;
+	$$->value = $4;
+	current_script_line = yylineno;
+}
+| SYSCTL STRING '=' INTEGER {
+	if ($2[0] == '\0')
+		semantic_error("empty sysctl name");
+	$$ = calloc(1, sizeof(struct sysctl_spec));
+	$$->name = $2;
+	asprintf(&$$->value, "%lld", $4);
+	current_script_line = yylineno;
+}
+;
+
 null
 : NULL_ {
 	$$ = new_expression(EXPR_NULL);
@@ -5948,6 +6134,5 @@ opt_cleanup_command
 cleanup_command
 : command_spec {
 	out_script->cleanup_command = $1;
-	cleanup_cmd = out_script->cleanup_command->command_line;
 }
 ;
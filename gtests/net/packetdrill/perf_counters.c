@@ -0,0 +1,353 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for measuring what each script event costs the kernel.
+ */
+
+#include "perf_counters.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "logging.h"
+
+#ifdef linux
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+
+/* Column headings for the report, in enum perf_counter_t order. */
+static const char *perf_counter_names[PERF_NUM_COUNTERS] = {
+	[PERF_TASK_CLOCK]		= "task_ns",
+	[PERF_CYCLES_USER]		= "cycles_u",
+	[PERF_CYCLES_KERNEL]		= "cycles_k",
+	[PERF_INSTRUCTIONS_USER]	= "instr_u",
+	[PERF_INSTRUCTIONS_KERNEL]	= "instr_k",
+	[PERF_CONTEXT_SWITCHES]		= "ctx_sw",
+	[PERF_SOFTIRQS]			= "softirqs",
+};
+
+/* The counters of one thread. The task clock leads the group, so one
+ * read(2) returns all the counters at once.
+ */
+struct perf_thread {
+	int group_fd;			/* group leader, or -1 if not open */
+	int fds[PERF_NUM_COUNTERS];	/* -1 for counters not open */
+	int index[PERF_NUM_COUNTERS];	/* position in a group read, or -1 */
+	int num_open;
+};
+
+static __thread struct perf_thread thread_counters = { .group_fd = -1 };
+
+/* Look up the ID of the tracepoint that fires each time a softirq runs.
+ * Returns -1 if tracefs is not mounted.
+ */
+static s64 softirq_tracepoint_id(void)
+{
+	const char *paths[] = {
+		"/sys/kernel/tracing/events/irq/softirq_entry/id",
+		"/sys/kernel/debug/tracing/events/irq/softirq_entry/id",
+	};
+	char buf[32];
+	int i, fd, bytes;
+
+	for (i = 0; i < ARRAY_SIZE(paths); ++i) {
+		fd = open(paths[i], O_RDONLY);
+		if (fd < 0)
+			continue;
+		bytes = read(fd, buf, sizeof(buf) - 1);
+		close(fd);
+		if (bytes > 0) {
+			buf[bytes] = '\0';
+			return atoll(buf);
+		}
+	}
+	return -1;
+}
+
+/* Fill in the attributes for the given counter. Returns false if this
+ * machine cannot count it.
+ */
+static bool perf_counter_attr(enum perf_counter_t counter,
+			      struct perf_event_attr *attr)
+{
+	s64 id;
+
+	memset(attr, 0, sizeof(*attr));
+	attr->size = sizeof(*attr);
+	attr->read_format = PERF_FORMAT_GROUP;
+	attr->exclude_hv = 1;
+
+	switch (counter) {
+	case PERF_TASK_CLOCK:
+		attr->type = PERF_TYPE_SOFTWARE;
+		attr->config = PERF_COUNT_SW_TASK_CLOCK;
+		return true;
+	case PERF_CYCLES_USER:
+	case PERF_CYCLES_KERNEL:
+		attr->type = PERF_TYPE_HARDWARE;
+		attr->config = PERF_COUNT_HW_CPU_CYCLES;
+		attr->exclude_kernel = (counter == PERF_CYCLES_USER);
+		attr->exclude_user = (counter == PERF_CYCLES_KERNEL);
+		return true;
+	case PERF_INSTRUCTIONS_USER:
+	case PERF_INSTRUCTIONS_KERNEL:
+		attr->type = PERF_TYPE_HARDWARE;
+		attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+		attr->exclude_kernel = (counter == PERF_INSTRUCTIONS_USER);
+		attr->exclude_user = (counter == PERF_INSTRUCTIONS_KERNEL);
+		return true;
+	case PERF_CONTEXT_SWITCHES:
+		attr->type = PERF_TYPE_SOFTWARE;
+		attr->config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+		return true;
+	case PERF_SOFTIRQS:
+		id = softirq_tracepoint_id();
+		if (id < 0)
+			return false;
+		attr->type = PERF_TYPE_TRACEPOINT;
+		attr->config = id;
+		return true;
+	case PERF_NUM_COUNTERS:
+		break;
+	}
+	assert(!"bad perf counter");
+	return false;
+}
+
+void perf_thread_start(struct perf_counters *perf)
+{
+	struct perf_thread *thread = &thread_counters;
+	struct perf_event_attr attr;
+	int i;
+
+	if (perf == NULL)
+		return;
+	assert(thread->group_fd < 0);
+
+	thread->num_open = 0;
+	for (i = 0; i < PERF_NUM_COUNTERS; ++i) {
+		thread->fds[i] = -1;
+		thread->index[i] = -1;
+		if (!perf_counter_attr(i, &attr))
+			continue;
+		thread->fds[i] = syscall(__NR_perf_event_open, &attr,
+					 0 /* this thread */, -1 /* any CPU */,
+					 thread->group_fd,
+					 PERF_FLAG_FD_CLOEXEC);
+		if (thread->fds[i] < 0) {
+			if (i == PERF_TASK_CLOCK)
+				die_perror("perf_event_open task-clock");
+			DEBUGP("cannot count %s: %s\n",
+			       perf_counter_names[i], strerror(errno));
+			continue;
+		}
+		if (thread->group_fd < 0)
+			thread->group_fd = thread->fds[i];
+		thread->index[i] = thread->num_open++;
+	}
+}
+
+void perf_thread_stop(struct perf_counters *perf)
+{
+	struct perf_thread *thread = &thread_counters;
+	int i;
+
+	if (perf == NULL)
+		return;
+	for (i = 0; i < PERF_NUM_COUNTERS; ++i) {
+		if (thread->fds[i] >= 0)
+			close(thread->fds[i]);
+		thread->fds[i] = -1;
+	}
+	thread->group_fd = -1;
+}
+
+struct perf_counters *perf_counters_new(void)
+{
+	struct perf_counters *perf = calloc(1, sizeof(struct perf_counters));
+	int i;
+
+	perf_thread_start(perf);
+	for (i = 0; i < PERF_NUM_COUNTERS; ++i)
+		perf->available[i] = (thread_counters.fds[i] >= 0);
+	return perf;
+}
+
+void perf_counters_free(struct perf_counters *perf)
+{
+	if (perf == NULL)
+		return;
+	perf_thread_stop(perf);
+	free(perf->lines);
+	memset(perf, 0, sizeof(*perf));  /* paranoia to help catch bugs */
+	free(perf);
+}
+
+/* Read all of the calling thread's counters with one system call. */
+static void perf_thread_read(struct perf_values *values)
+{
+	struct perf_thread *thread = &thread_counters;
+	u64 buf[1 + PERF_NUM_COUNTERS];	/* count, then values */
+	int i;
+
+	assert(thread->group_fd >= 0);
+	if (read(thread->group_fd, buf, sizeof(buf)) < 0)
+		die_perror("read perf counters");
+	assert(buf[0] == thread->num_open);
+
+	for (i = 0; i < PERF_NUM_COUNTERS; ++i) {
+		if (thread->index[i] >= 0)
+			values->values[i] = buf[1 + thread->index[i]];
+		else
+			values->values[i] = 0;
+	}
+}
+
+void perf_event_begin(struct perf_counters *perf, struct perf_values *start)
+{
+	if (perf == NULL)
+		return;
+	perf_thread_read(start);
+}
+
+/* Find the cost record of the given script line, adding it if needed.
+ * Events mostly run in line order, so we search from the end.
+ */
+static struct perf_line *perf_find_line(struct perf_counters *perf,
+					int line_number)
+{
+	struct perf_line *line = NULL;
+	int i;
+
+	for (i = perf->num_lines; i > 0; --i) {
+		if (perf->lines[i - 1].line_number == line_number)
+			return &perf->lines[i - 1];
+		if (perf->lines[i - 1].line_number < line_number)
+			break;
+	}
+
+	if (perf->num_lines == perf->max_lines) {
+		perf->max_lines = perf->max_lines ? 2 * perf->max_lines : 64;
+		perf->lines = realloc(perf->lines,
+				      perf->max_lines * sizeof(*perf->lines));
+	}
+	line = &perf->lines[i];
+	memmove(line + 1, line, (perf->num_lines - i) * sizeof(*line));
+	++perf->num_lines;
+
+	memset(line, 0, sizeof(*line));
+	line->line_number = line_number;
+	return line;
+}
+
+void perf_event_end(struct perf_counters *perf, int line_number,
+		    const struct perf_values *start)
+{
+	struct perf_values end;
+	struct perf_line *line = NULL;
+	u64 delta;
+	int i;
+
+	if (perf == NULL)
+		return;
+	perf_thread_read(&end);
+
+	line = perf_find_line(perf, line_number);
+	++line->num_events;
+	for (i = 0; i < PERF_NUM_COUNTERS; ++i) {
+		delta = end.values[i] - start->values[i];
+		line->total.values[i] += delta;
+		perf->total.values[i] += delta;
+	}
+}
+
+/* Print one row of the report. */
+static void perf_print_values(struct perf_counters *perf, FILE *f,
+			      const struct perf_values *values)
+{
+	int i;
+
+	for (i = 0; i < PERF_NUM_COUNTERS; ++i) {
+		if (perf->available[i])
+			fprintf(f, " %12llu", (u64)values->values[i]);
+		else
+			fprintf(f, " %12s", "-");
+	}
+	fprintf(f, "\n");
+}
+
+void perf_counters_report(struct perf_counters *perf,
+			  const char *script_path, FILE *f)
+{
+	int i, num_events = 0;
+
+	fprintf(f, "%s: kernel cost per script line:\n", script_path);
+	fprintf(f, "%6s %6s", "line", "events");
+	for (i = 0; i < PERF_NUM_COUNTERS; ++i)
+		fprintf(f, " %12s", perf_counter_names[i]);
+	fprintf(f, "\n");
+
+	for (i = 0; i < perf->num_lines; ++i) {
+		fprintf(f, "%6d %6d", perf->lines[i].line_number,
+			perf->lines[i].num_events);
+		perf_print_values(perf, f, &perf->lines[i].total);
+		num_events += perf->lines[i].num_events;
+	}
+	fprintf(f, "%6s %6d", "total", num_events);
+	perf_print_values(perf, f, &perf->total);
+}
+
+#else  /* !linux */
+
+struct perf_counters *perf_counters_new(void)
+{
+	die("--perf_counters requires Linux\n");
+	return NULL;	/* not reached */
+}
+
+void perf_counters_free(struct perf_counters *perf)
+{
+}
+
+void perf_thread_start(struct perf_counters *perf)
+{
+}
+
+void perf_thread_stop(struct perf_counters *perf)
+{
+}
+
+void perf_event_begin(struct perf_counters *perf, struct perf_values *start)
+{
+}
+
+void perf_event_end(struct perf_counters *perf, int line_number,
+		    const struct perf_values *start)
+{
+}
+
+void perf_counters_report(struct perf_counters *perf,
+			  const char *script_path, FILE *f)
+{
+}
+
+#endif  /* linux */
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Interface for measuring what each script event costs the kernel, using
+ * perf_event_open(2) counters on the threads that run the events.
+ *
+ * Each thread that runs events (the main thread, and the system call
+ * thread for blocking calls) opens its own group of counters. We read
+ * the group just before and just after the work of a system call or an
+ * inbound packet injection, and charge the difference to the event's
+ * script line, so waiting for an event's time is not counted. At the
+ * end of the script we print the totals for each line and for the
+ * whole script.
+ *
+ * Cycles and instructions are counted separately for user and kernel
+ * mode when perf_event_paranoid allows it. Counters the machine or the
+ * kernel does not offer are left out and reported as "-".
+ */
+
+#ifndef __PERF_COUNTERS_H__
+#define __PERF_COUNTERS_H__
+
+#include "types.h"
+
+#include <stdio.h>
+
+/* The counters we read for each event. */
+enum perf_counter_t {
+	PERF_TASK_CLOCK,		/* on-CPU time, in nanoseconds */
+	PERF_CYCLES_USER,
+	PERF_CYCLES_KERNEL,
+	PERF_INSTRUCTIONS_USER,
+	PERF_INSTRUCTIONS_KERNEL,
+	PERF_CONTEXT_SWITCHES,
+	PERF_SOFTIRQS,			/* softirqs run in this thread */
+	PERF_NUM_COUNTERS,
+};
+
+/* A snapshot or sum of the counters. */
+struct perf_values {
+	u64 values[PERF_NUM_COUNTERS];
+};
+
+/* The cost charged to one script line. */
+struct perf_line {
+	int line_number;
+	int num_events;			/* times the line's event ran */
+	struct perf_values total;
+};
+
+/* Per-script counter state. */
+struct perf_counters {
+	bool available[PERF_NUM_COUNTERS];	/* could we open it? */
+	struct perf_line *lines;	/* sorted by line number (owned) */
+	int num_lines;
+	int max_lines;
+	struct perf_values total;	/* sum over all lines */
+};
+
+/* Allocate per-script counter state, and open counters for the calling
+ * thread, which must be the main thread.
+ */
+extern struct perf_counters *perf_counters_new(void);
+
+/* Close the calling thread's counters and free the counter state. */
+extern void perf_counters_free(struct perf_counters *perf);
+
+/* Open counters for the calling thread. Does nothing if perf is NULL. */
+extern void perf_thread_start(struct perf_counters *perf);
+
+/* Close the calling thread's counters. Does nothing if perf is NULL. */
+extern void perf_thread_stop(struct perf_counters *perf);
+
+/* Read the calling thread's counters before the work of an event. Does
+ * nothing if perf is NULL.
+ */
+extern void perf_event_begin(struct perf_counters *perf,
+			     struct perf_values *start);
+
+/* Read the calling thread's counters after the work of an event, and
+ * charge the cost since perf_event_begin() to the given script line.
+ * Caller must hold the global run lock. Does nothing if perf is NULL.
+ */
+extern void perf_event_end(struct perf_counters *perf, int line_number,
+			   const struct perf_values *start);
+
+/* Print the cost of each script line and the total to the given file. */
+extern void perf_counters_report(struct perf_counters *perf,
+				 const char *script_path, FILE *f);
+
+#endif /* __PERF_COUNTERS_H__ */
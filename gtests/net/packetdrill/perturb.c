@@ -0,0 +1,173 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for seeded random perturbation of inbound packets.
+ */
+
+#include "perturb.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+
+struct perturb {
+	u64 random_state;		/* generator state */
+	int jitter_usecs;		/* most we delay an event by */
+	int drop_percent;		/* chance of dropping a packet */
+	int dup_percent;		/* chance of sending a packet twice */
+	int reorder_percent;		/* chance of moving a packet */
+	struct packet *held;		/* copy held back to send later */
+	struct packet *released;	/* held copy just handed out */
+	struct packet **to_send;	/* what we handed out last time */
+	int max_to_send;
+	int num_jittered;
+	int num_dropped;
+	int num_duplicated;
+	int num_reordered;
+};
+
+struct perturb *perturb_new(const struct config *config)
+{
+	struct perturb *perturb = calloc(1, sizeof(struct perturb));
+
+	perturb->random_state = config->perturb_seed;
+	perturb->jitter_usecs = config->perturb_jitter_usecs;
+	perturb->drop_percent = config->perturb_drop_percent;
+	perturb->dup_percent = config->perturb_dup_percent;
+	perturb->reorder_percent = config->perturb_reorder_percent;
+	return perturb;
+}
+
+/* Return the next number from a splitmix64 generator. We use our own
+ * rather than random(3) so a seed means the same thing everywhere.
+ */
+static u64 perturb_random(struct perturb *perturb)
+{
+	u64 z = (perturb->random_state += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/* Return true with the given percent chance. */
+static bool perturb_chance(struct perturb *perturb, int percent)
+{
+	if (percent <= 0)
+		return false;
+	return (perturb_random(perturb) % 100) < percent;
+}
+
+s64 perturb_jitter_usecs(struct perturb *perturb)
+{
+	s64 usecs;
+
+	if (perturb->jitter_usecs <= 0)
+		return 0;
+	usecs = perturb_random(perturb) % (perturb->jitter_usecs + 1);
+	if (usecs > 0)
+		++perturb->num_jittered;
+	return usecs;
+}
+
+int perturb_inbound_packets(struct perturb *perturb,
+			    struct packet **packets, int num_packets,
+			    struct packet ***to_send)
+{
+	struct packet **order = calloc(num_packets, sizeof(struct packet *));
+	struct packet *swap = NULL;
+	int i, num_to_send = 0;
+
+	assert(perturb->released == NULL);
+	if (perturb->max_to_send < 2 * num_packets + 1) {
+		perturb->max_to_send = 2 * num_packets + 1;
+		perturb->to_send = realloc(perturb->to_send,
+					   perturb->max_to_send *
+					   sizeof(struct packet *));
+	}
+
+	/* Swap neighbours within a burst, such as an ACK train. */
+	memcpy(order, packets, num_packets * sizeof(struct packet *));
+	for (i = 0; i + 1 < num_packets; ++i) {
+		if (perturb_chance(perturb, perturb->reorder_percent)) {
+			swap = order[i];
+			order[i] = order[i + 1];
+			order[i + 1] = swap;
+			++perturb->num_reordered;
+			++i;	/* do not move the same packet twice */
+		}
+	}
+
+	for (i = 0; i < num_packets; ++i) {
+		if (perturb_chance(perturb, perturb->drop_percent)) {
+			++perturb->num_dropped;
+			continue;
+		}
+		/* Hold a lone packet back until after the next one. */
+		if ((num_packets == 1) && (perturb->held == NULL) &&
+		    perturb_chance(perturb, perturb->reorder_percent)) {
+			perturb->held = packet_copy(order[i]);
+			++perturb->num_reordered;
+			continue;
+		}
+		perturb->to_send[num_to_send++] = order[i];
+		if (perturb_chance(perturb, perturb->dup_percent)) {
+			perturb->to_send[num_to_send++] = order[i];
+			++perturb->num_duplicated;
+		}
+	}
+
+	/* Something went out ahead of the held packet, so it can follow. */
+	if ((num_to_send > 0) && (perturb->held != NULL)) {
+		perturb->released = perturb->held;
+		perturb->held = NULL;
+		perturb->to_send[num_to_send++] = perturb->released;
+	}
+
+	free(order);
+	*to_send = perturb->to_send;
+	return num_to_send;
+}
+
+void perturb_inbound_done(struct perturb *perturb)
+{
+	if (perturb->released != NULL) {
+		packet_free(perturb->released);
+		perturb->released = NULL;
+	}
+}
+
+void perturb_report(const struct perturb *perturb, FILE *out)
+{
+	fprintf(out, "perturbed inbound packets: %d jittered, %d dropped, "
+		"%d duplicated, %d reordered\n",
+		perturb->num_jittered, perturb->num_dropped,
+		perturb->num_duplicated, perturb->num_reordered);
+}
+
+void perturb_free(struct perturb *perturb)
+{
+	if (perturb == NULL)
+		return;
+	perturb_inbound_done(perturb);
+	if (perturb->held != NULL)
+		packet_free(perturb->held);
+	free(perturb->to_send);
+	free(perturb);
+}
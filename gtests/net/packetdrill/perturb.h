@@ -0,0 +1,79 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Interface for --perturb, which applies seeded, bounded random
+ * perturbations to the inbound packets of a script, to stress the
+ * kernel's loss recovery and reordering handling beyond hand-written
+ * cases.
+ *
+ * Each inbound packet may be dropped, duplicated, swapped with its
+ * neighbour in a burst, or held back until just after the next inbound
+ * packet we send, and each inbound packet event may be delayed by up
+ * to a bounded jitter. All the choices come from a small generator of
+ * our own, seeded from --perturb_seed, and are made in script order, so
+ * a run with the same script, spec and seed makes the same choices.
+ *
+ * Since the kernel will then not send exactly what the script expects,
+ * outbound packet mismatches only warn under --perturb, and a perturbed
+ * script should check invariants instead: system call results (say,
+ * that all data was delivered), and assertions in code events on
+ * tcp_info (say, that cwnd never dropped below a floor, or that there
+ * were no spurious RTOs).
+ */
+
+#ifndef __PERTURB_H__
+#define __PERTURB_H__
+
+#include "types.h"
+
+#include <stdio.h>
+#include "config.h"
+#include "packet.h"
+
+struct perturb;
+
+/* Allocate perturbation state, seeded from the config. */
+extern struct perturb *perturb_new(const struct config *config);
+
+/* Return how long to delay the next inbound packet event, in
+ * microseconds.
+ */
+extern s64 perturb_jitter_usecs(struct perturb *perturb);
+
+/* Decide the fate of the given inbound packets, which the script wants
+ * sent now, in order, and which must already have their checksums.
+ * Fills in *to_send with the packets to actually send, in order, and
+ * returns how many there are. A packet may appear twice, and a packet
+ * held back from an earlier call may appear at the end. The array and
+ * any held packet in it belong to us until perturb_inbound_done().
+ */
+extern int perturb_inbound_packets(struct perturb *perturb,
+				   struct packet **packets, int num_packets,
+				   struct packet ***to_send);
+
+/* Release what the last perturb_inbound_packets() handed out. */
+extern void perturb_inbound_done(struct perturb *perturb);
+
+/* Print how many packets we perturbed in each way. */
+extern void perturb_report(const struct perturb *perturb, FILE *out);
+
+/* Free perturbation state, including any packet still held back. */
+extern void perturb_free(struct perturb *perturb);
+
+#endif /* __PERTURB_H__ */
@@ -40,6 +40,7 @@
 #define HAVE_FMEMOPEN           1
 #define TUN_DIR                 "/dev/net"
 #define HAVE_TCP_INFO           1
+#define HAVE_SOCK_DIAG          1
 
 #endif  /* linux */
 
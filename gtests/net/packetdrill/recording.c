@@ -0,0 +1,810 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for recording a live run and re-verifying a script
+ * against the recording.
+ */
+
+#include "recording.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ethernet.h"
+#include "logging.h"
+#include "packet.h"
+#include "packet_parser.h"
+#include "run.h"
+
+/* The first bytes of a recording file. Recordings are written in the
+ * byte order of the machine, and are meant to be re-verified there.
+ */
+#define RECORDING_MAGIC		"pdrec01\n"
+#define RECORDING_MAGIC_BYTES	8
+
+/* Types of the records in a recording file. */
+enum record_t {
+	RECORD_START = 1,	/* usecs: live start time of the run */
+	RECORD_PACKET,		/* an outbound packet the netdev sniffed */
+	RECORD_SYSCALL,		/* the outcome of a system call */
+	RECORD_OUTPUT,		/* a buffer a system call filled in */
+	RECORD_CODE_DATA,	/* the data a code event collected */
+};
+
+/* The header of each record in a recording file, followed by
+ * data_bytes of data:
+ *
+ *   RECORD_PACKET: index is the number of IP fragments the packet was
+ *     reassembled from; the data is the IP payload size of each (u16)
+ *     followed by the packet, starting at its outermost IP header.
+ *   RECORD_SYSCALL: the data is the NUL-terminated system call name.
+ *   RECORD_OUTPUT: index is the system call; outputs of a call are in
+ *     the order it filled them in.
+ *   RECORD_CODE_DATA: value is the type of the data.
+ */
+struct record {
+	u32 type;		/* enum record_t */
+	u32 data_bytes;		/* bytes of data after this header */
+	s64 usecs;		/* live time the record is about */
+	s64 value;		/* system call result, or code data type */
+	s32 index;		/* number of the system call in the run */
+	s32 err;		/* errno of a system call */
+};
+
+/* A recorded outbound packet. */
+struct recorded_packet {
+	s64 usecs;			/* when it was sniffed */
+	u16 num_fragments;
+	u16 fragment_bytes[PACKET_MAX_FRAGMENTS];
+	u8 *bytes;			/* from outermost IP header (owned) */
+	int len;
+};
+
+/* A buffer a system call filled in, or data a code event collected. */
+struct recorded_buffer {
+	int type;			/* for code event data */
+	void *data;			/* (owned) */
+	int bytes;
+};
+
+/* The outcome of a recorded system call. */
+struct recorded_syscall {
+	char *name;			/* NULL if not in the recording */
+	s64 end_usecs;			/* when it returned */
+	s64 result;
+	int err;
+	struct recorded_buffer *outputs;	/* in order (owned) */
+	int num_outputs;
+};
+
+struct recording {
+	char *path;			/* file name (owned) */
+	char *script_path;		/* for error messages (owned) */
+	bool is_replay;			/* re-verifying, or recording? */
+	pthread_mutex_t mutex;		/* protects all fields below */
+	pthread_cond_t clock_moved;	/* virtual clock or blocked call */
+	int next_syscall;		/* number of the next system call */
+
+	/* For recording. */
+	FILE *file;			/* NULL once closed */
+
+	/* For re-verifying. */
+	struct recorded_packet *packets;	/* array of packets (owned) */
+	int num_packets;
+	int next_packet;
+	struct recorded_syscall *syscalls;	/* by call number (owned) */
+	int num_syscalls;
+	struct recorded_buffer *code_data;	/* array of data (owned) */
+	int num_code_data;
+	int next_code_data;
+	s64 start_usecs;		/* live start time of the run */
+	s64 now_usecs;			/* the virtual clock */
+	bool is_blocked;		/* is a blocking call waiting? */
+	s64 blocked_end_usecs;		/* if so, when it returns */
+};
+
+/* The system call the calling thread is running. Blocking calls run on
+ * the system call thread while the main thread runs other calls, so
+ * this is per thread.
+ */
+struct recording_thread {
+	int syscall;			/* number of the call in the run */
+	const char *name;		/* its name (not owned) */
+	int next_output;		/* outputs filled in so far */
+	s64 end_usecs;			/* when it returned */
+};
+static __thread struct recording_thread current_call = { .syscall = -1 };
+
+static void recording_lock(struct recording *recording)
+{
+	int err;
+
+	if ((err = pthread_mutex_lock(&recording->mutex)) != 0)
+		die_strerror("pthread_mutex_lock", err);
+}
+
+static void recording_unlock(struct recording *recording)
+{
+	int err;
+
+	if ((err = pthread_mutex_unlock(&recording->mutex)) != 0)
+		die_strerror("pthread_mutex_unlock", err);
+}
+
+static void recording_broadcast(struct recording *recording)
+{
+	int err;
+
+	if ((err = pthread_cond_broadcast(&recording->clock_moved)) != 0)
+		die_strerror("pthread_cond_broadcast", err);
+}
+
+static void recording_wait(struct recording *recording)
+{
+	int err;
+
+	if ((err = pthread_cond_wait(&recording->clock_moved,
+				     &recording->mutex)) != 0)
+		die_strerror("pthread_cond_wait", err);
+}
+
+/* Append a record with up to two pieces of data to the file. */
+static void write_record(struct recording *recording, struct record *record,
+			 const void *data, int data_bytes,
+			 const void *more_data, int more_data_bytes)
+{
+	bool failed = false;
+
+	record->data_bytes = data_bytes + more_data_bytes;
+
+	recording_lock(recording);
+	if (recording->file != NULL &&
+	    ((fwrite(record, sizeof(*record), 1, recording->file) != 1) ||
+	     (fwrite(data, 1, data_bytes, recording->file) != data_bytes) ||
+	     (fwrite(more_data, 1, more_data_bytes, recording->file) !=
+	      more_data_bytes)))
+		failed = true;
+	recording_unlock(recording);
+
+	/* die() closes the recording, so it must not hold the lock. */
+	if (failed) {
+		die("error writing recording %s: %s\n",
+		    recording->path, strerror(errno));
+	}
+}
+
+/* Read the next record and its data from a recording file. Returns
+ * false at the end of the file. Dies if the file is cut short.
+ */
+static bool read_record(struct recording *recording, FILE *file,
+			struct record *record, u8 **data)
+{
+	size_t bytes = fread(record, 1, sizeof(*record), file);
+
+	if (bytes == 0 && feof(file))
+		return false;
+	if (bytes != sizeof(*record))
+		goto truncated;
+	*data = malloc(record->data_bytes + 1);
+	if (fread(*data, 1, record->data_bytes, file) != record->data_bytes)
+		goto truncated;
+	(*data)[record->data_bytes] = '\0';
+	return true;
+
+truncated:
+	die("%s: recording %s is truncated\n",
+	    recording->script_path, recording->path);
+}
+
+/* Make room for one more element in a growing array. */
+static void *grow_array(void *array, int count, size_t element_bytes)
+{
+	/* Double the size each time count reaches a power of two. */
+	if (count == 0)
+		return realloc(array, 16 * element_bytes);
+	if ((count >= 16) && ((count & (count - 1)) == 0))
+		return realloc(array, 2 * count * element_bytes);
+	return array;
+}
+
+static void load_packet(struct recording *recording,
+			const struct record *record, u8 *data)
+{
+	struct recorded_packet *packet = NULL;
+	const int fragment_list_bytes = record->index * sizeof(u16);
+
+	if ((record->index < 0) || (record->index > PACKET_MAX_FRAGMENTS) ||
+	    (record->data_bytes <= fragment_list_bytes)) {
+		die("%s: bad packet in recording %s\n",
+		    recording->script_path, recording->path);
+	}
+	recording->packets = grow_array(recording->packets,
+					recording->num_packets,
+					sizeof(*recording->packets));
+	packet = &recording->packets[recording->num_packets++];
+	memset(packet, 0, sizeof(*packet));
+	packet->usecs = record->usecs;
+	packet->num_fragments = record->index;
+	memcpy(packet->fragment_bytes, data, fragment_list_bytes);
+	packet->len = record->data_bytes - fragment_list_bytes;
+	packet->bytes = malloc(packet->len);
+	memcpy(packet->bytes, data + fragment_list_bytes, packet->len);
+	free(data);
+}
+
+/* Return the recorded system call with the given number, making room
+ * for it if need be.
+ */
+static struct recorded_syscall *recorded_syscall(struct recording *recording,
+						 int index)
+{
+	if (index >= recording->num_syscalls) {
+		recording->syscalls = realloc(recording->syscalls,
+					      (index + 1) *
+					      sizeof(*recording->syscalls));
+		memset(&recording->syscalls[recording->num_syscalls], 0,
+		       (index + 1 - recording->num_syscalls) *
+		       sizeof(*recording->syscalls));
+		recording->num_syscalls = index + 1;
+	}
+	return &recording->syscalls[index];
+}
+
+static void load_syscall(struct recording *recording,
+			 const struct record *record, u8 *data)
+{
+	struct recorded_syscall *syscall = NULL;
+
+	if (record->index < 0) {
+		die("%s: bad system call in recording %s\n",
+		    recording->script_path, recording->path);
+	}
+	syscall = recorded_syscall(recording, record->index);
+	syscall->name = (char *)data;
+	syscall->end_usecs = record->usecs;
+	syscall->result = record->value;
+	syscall->err = record->err;
+}
+
+static void load_output(struct recording *recording,
+			const struct record *record, u8 *data)
+{
+	struct recorded_syscall *syscall = NULL;
+	struct recorded_buffer *output = NULL;
+
+	if (record->index < 0) {
+		die("%s: bad system call output in recording %s\n",
+		    recording->script_path, recording->path);
+	}
+	syscall = recorded_syscall(recording, record->index);
+	syscall->outputs = grow_array(syscall->outputs, syscall->num_outputs,
+				      sizeof(*syscall->outputs));
+	output = &syscall->outputs[syscall->num_outputs++];
+	output->type = 0;
+	output->data = data;
+	output->bytes = record->data_bytes;
+}
+
+static void load_code_data(struct recording *recording,
+			   const struct record *record, u8 *data)
+{
+	struct recorded_buffer *code_data = NULL;
+
+	recording->code_data = grow_array(recording->code_data,
+					  recording->num_code_data,
+					  sizeof(*recording->code_data));
+	code_data = &recording->code_data[recording->num_code_data++];
+	code_data->type = record->value;
+	code_data->data = data;
+	code_data->bytes = record->data_bytes;
+}
+
+/* Read a whole recording into memory. */
+static void load_recording(struct recording *recording)
+{
+	char magic[RECORDING_MAGIC_BYTES];
+	struct record record;
+	bool have_start = false;
+	u8 *data = NULL;
+	FILE *file = NULL;
+
+	file = fopen(recording->path, "r");
+	if (file == NULL) {
+		die("%s: cannot open recording %s: %s\n",
+		    recording->script_path, recording->path, strerror(errno));
+	}
+	if ((fread(magic, 1, sizeof(magic), file) != sizeof(magic)) ||
+	    (memcmp(magic, RECORDING_MAGIC, sizeof(magic)) != 0)) {
+		die("%s: %s is not a packetdrill recording\n",
+		    recording->script_path, recording->path);
+	}
+
+	while (read_record(recording, file, &record, &data)) {
+		switch (record.type) {
+		case RECORD_START:
+			recording->start_usecs = record.usecs;
+			have_start = true;
+			free(data);
+			break;
+		case RECORD_PACKET:
+			load_packet(recording, &record, data);
+			break;
+		case RECORD_SYSCALL:
+			load_syscall(recording, &record, data);
+			break;
+		case RECORD_OUTPUT:
+			load_output(recording, &record, data);
+			break;
+		case RECORD_CODE_DATA:
+			load_code_data(recording, &record, data);
+			break;
+		default:
+			die("%s: bad record type %u in recording %s\n",
+			    recording->script_path, record.type,
+			    recording->path);
+		}
+	}
+	fclose(file);
+
+	if (!have_start) {
+		die("%s: recording %s has no start time\n",
+		    recording->script_path, recording->path);
+	}
+	recording->now_usecs = recording->start_usecs;
+	DEBUGP("loaded recording %s: %d packets, %d system calls, "
+	       "%d code data\n", recording->path, recording->num_packets,
+	       recording->num_syscalls, recording->num_code_data);
+}
+
+struct recording *recording_new(const struct config *config)
+{
+	struct recording *recording = calloc(1, sizeof(struct recording));
+	int err;
+
+	if (((err = pthread_mutex_init(&recording->mutex, NULL)) != 0) ||
+	    ((err = pthread_cond_init(&recording->clock_moved, NULL)) != 0))
+		die_strerror("pthread_mutex_init", err);
+	recording->script_path = strdup(config->script_path);
+	recording->is_replay = (config->reverify_path != NULL);
+
+	if (recording->is_replay) {
+		recording->path = strdup(config->reverify_path);
+		load_recording(recording);
+	} else {
+		recording->path = strdup(config->record_path);
+		recording->file = fopen(recording->path, "w");
+		if (recording->file == NULL) {
+			die("%s: cannot create recording %s: %s\n",
+			    recording->script_path, recording->path,
+			    strerror(errno));
+		}
+		if (fwrite(RECORDING_MAGIC, 1, RECORDING_MAGIC_BYTES,
+			   recording->file) != RECORDING_MAGIC_BYTES) {
+			die("error writing recording %s: %s\n",
+			    recording->path, strerror(errno));
+		}
+	}
+	return recording;
+}
+
+bool recording_is_replay(const struct recording *recording)
+{
+	return recording->is_replay;
+}
+
+void recording_start(struct recording *recording, s64 start_usecs)
+{
+	struct record record = {
+		.type = RECORD_START,
+		.usecs = start_usecs,
+	};
+
+	if (!recording->is_replay)
+		write_record(recording, &record, NULL, 0, NULL, 0);
+}
+
+/* Move the virtual clock forward to the given time, if it is behind. */
+static void recording_advance_clock(struct recording *recording, s64 usecs)
+{
+	recording_lock(recording);
+	if (recording->now_usecs < usecs) {
+		recording->now_usecs = usecs;
+		recording_broadcast(recording);
+	}
+	recording_unlock(recording);
+}
+
+s64 recording_now_usecs(struct recording *recording)
+{
+	s64 usecs;
+
+	recording_lock(recording);
+	usecs = recording->now_usecs;
+	recording_unlock(recording);
+	return usecs;
+}
+
+void recording_run_until(struct recording *recording, s64 usecs)
+{
+	recording_lock(recording);
+	while (recording->is_blocked &&
+	       (recording->blocked_end_usecs <= usecs)) {
+		if (recording->now_usecs < recording->blocked_end_usecs)
+			recording->now_usecs = recording->blocked_end_usecs;
+		recording_broadcast(recording);
+		recording_wait(recording);
+	}
+	if (recording->now_usecs < usecs) {
+		recording->now_usecs = usecs;
+		recording_broadcast(recording);
+	}
+	recording_unlock(recording);
+}
+
+void recording_unblock(struct recording *recording, s64 max_usecs)
+{
+	recording_lock(recording);
+	if (recording->is_blocked &&
+	    (recording->blocked_end_usecs <= max_usecs) &&
+	    (recording->now_usecs < recording->blocked_end_usecs)) {
+		recording->now_usecs = recording->blocked_end_usecs;
+		recording_broadcast(recording);
+	}
+	recording_unlock(recording);
+}
+
+void recording_syscall_begin(struct recording *recording, const char *name)
+{
+	recording_lock(recording);
+	current_call.syscall = recording->next_syscall++;
+	recording_unlock(recording);
+	current_call.name = name;
+	current_call.next_output = 0;
+	current_call.end_usecs = -1;
+}
+
+s64 record_syscall(struct recording *recording, s64 result)
+{
+	const int saved_errno = errno;
+	struct record record = {
+		.type = RECORD_SYSCALL,
+		.usecs = now_usecs(),
+		.value = result,
+		.index = current_call.syscall,
+		.err = saved_errno,
+	};
+
+	assert(current_call.syscall >= 0);
+	current_call.end_usecs = record.usecs;
+	write_record(recording, &record, current_call.name,
+		     strlen(current_call.name) + 1, NULL, 0);
+	errno = saved_errno;
+	return result;
+}
+
+/* Return the recording's outcome of the calling thread's current
+ * system call, or die if it has none or it was a different call.
+ */
+static struct recorded_syscall *current_recorded_syscall(
+	struct recording *recording)
+{
+	struct recorded_syscall *syscall = NULL;
+	const int index = current_call.syscall;
+
+	assert(index >= 0);
+	if (index < recording->num_syscalls)
+		syscall = &recording->syscalls[index];
+	if ((syscall == NULL) || (syscall->name == NULL)) {
+		die("%s: recording %s has no system call #%d (%s)\n",
+		    recording->script_path, recording->path,
+		    index + 1, current_call.name);
+	}
+	if (strcmp(syscall->name, current_call.name) != 0) {
+		die("%s: system call #%d is %s in recording %s, not %s\n",
+		    recording->script_path, index + 1, syscall->name,
+		    recording->path, current_call.name);
+	}
+	return syscall;
+}
+
+s64 replay_syscall(struct recording *recording, bool is_blocking)
+{
+	struct recorded_syscall *syscall = NULL;
+
+	syscall = current_recorded_syscall(recording);
+	current_call.end_usecs = syscall->end_usecs;
+
+	if (is_blocking) {
+		recording_lock(recording);
+		recording->is_blocked = true;
+		recording->blocked_end_usecs = syscall->end_usecs;
+		while (recording->now_usecs < syscall->end_usecs)
+			recording_wait(recording);
+		recording_unlock(recording);
+	}
+
+	errno = syscall->err;
+	return syscall->result;
+}
+
+void recording_syscall_done(struct recording *recording)
+{
+	if (!recording->is_replay)
+		return;
+	recording_lock(recording);
+	recording->is_blocked = false;
+	recording_broadcast(recording);
+	recording_unlock(recording);
+}
+
+s64 recording_syscall_end_usecs(struct recording *recording)
+{
+	assert(current_call.end_usecs >= 0);
+	return current_call.end_usecs;
+}
+
+void recording_output(struct recording *recording, void *buffer, int bytes)
+{
+	struct record record = {
+		.type = RECORD_OUTPUT,
+		.index = current_call.syscall,
+	};
+	struct recorded_syscall *syscall = NULL;
+	struct recorded_buffer *output = NULL;
+	const int ordinal = current_call.next_output++;
+
+	if (!recording->is_replay) {
+		write_record(recording, &record, buffer, bytes, NULL, 0);
+		return;
+	}
+
+	syscall = current_recorded_syscall(recording);
+	if (ordinal >= syscall->num_outputs) {
+		die("%s: recording %s has no output #%d of system call "
+		    "#%d (%s)\n", recording->script_path, recording->path,
+		    ordinal + 1, current_call.syscall + 1, syscall->name);
+	}
+	output = &syscall->outputs[ordinal];
+	if (bytes == 0)
+		return;
+	memset(buffer, 0, bytes);
+	memcpy(buffer, output->data,
+	       output->bytes < bytes ? output->bytes : bytes);
+}
+
+void record_code_data(struct recording *recording, int data_type,
+		      const void *data, int bytes)
+{
+	struct record record = {
+		.type = RECORD_CODE_DATA,
+		.usecs = now_usecs(),
+		.value = data_type,
+	};
+
+	write_record(recording, &record, data, bytes, NULL, 0);
+}
+
+int replay_code_data(struct recording *recording, int *data_type,
+		     void **data, int *bytes, char **error)
+{
+	const struct recorded_buffer *code_data = NULL;
+
+	if (recording->next_code_data >= recording->num_code_data) {
+		asprintf(error, "no more code event data in recording %s",
+			 recording->path);
+		return STATUS_ERR;
+	}
+	code_data = &recording->code_data[recording->next_code_data++];
+	*data_type = code_data->type;
+	*bytes = code_data->bytes;
+	*data = malloc(code_data->bytes);
+	memcpy(*data, code_data->data, code_data->bytes);
+	return STATUS_OK;
+}
+
+int recording_next_code_data_type(struct recording *recording)
+{
+	if (recording->next_code_data >= recording->num_code_data)
+		return 0;
+	return recording->code_data[recording->next_code_data].type;
+}
+
+void recording_close(struct recording *recording)
+{
+	FILE *file = NULL;
+
+	recording_lock(recording);
+	file = recording->file;
+	recording->file = NULL;
+	recording_unlock(recording);
+
+	if ((file != NULL) && (fclose(file) != 0)) {
+		fprintf(stderr, "error writing recording %s: %s\n",
+			recording->path, strerror(errno));
+	}
+}
+
+void recording_free(struct recording *recording)
+{
+	int i, j;
+
+	recording_close(recording);
+	for (i = 0; i < recording->num_packets; ++i)
+		free(recording->packets[i].bytes);
+	free(recording->packets);
+	for (i = 0; i < recording->num_syscalls; ++i) {
+		free(recording->syscalls[i].name);
+		for (j = 0; j < recording->syscalls[i].num_outputs; ++j)
+			free(recording->syscalls[i].outputs[j].data);
+		free(recording->syscalls[i].outputs);
+	}
+	free(recording->syscalls);
+	for (i = 0; i < recording->num_code_data; ++i)
+		free(recording->code_data[i].data);
+	free(recording->code_data);
+	pthread_cond_destroy(&recording->clock_moved);
+	pthread_mutex_destroy(&recording->mutex);
+	free(recording->script_path);
+	free(recording->path);
+	free(recording);
+}
+
+/* A netdev that records the packets a live netdev sniffs, or that
+ * stands in for the kernel when re-verifying.
+ */
+struct recording_netdev {
+	struct netdev netdev;		/* "inherit" from netdev */
+
+	struct recording *recording;	/* not owned */
+	struct netdev *live_netdev;	/* or NULL if re-verifying (owned) */
+};
+
+struct netdev_ops recording_netdev_ops;
+
+static void recording_netdev_free(struct netdev *a_netdev)
+{
+	struct recording_netdev *netdev = (struct recording_netdev *)a_netdev;
+
+	if (netdev->live_netdev != NULL)
+		netdev_free(netdev->live_netdev);
+	memset(netdev, 0, sizeof(*netdev));  /* paranoia */
+	free(netdev);
+}
+
+static int recording_netdev_send(struct netdev *a_netdev,
+				 struct packet *packet)
+{
+	struct recording_netdev *netdev = (struct recording_netdev *)a_netdev;
+
+	if (netdev->live_netdev == NULL)
+		return STATUS_OK;	/* nobody to hear it */
+	return netdev_send(netdev->live_netdev, packet);
+}
+
+static int recording_netdev_send_burst(struct netdev *a_netdev,
+				       struct packet **packets,
+				       int num_packets)
+{
+	struct recording_netdev *netdev = (struct recording_netdev *)a_netdev;
+
+	if (netdev->live_netdev == NULL)
+		return STATUS_OK;
+	return netdev_send_burst(netdev->live_netdev, packets, num_packets);
+}
+
+/* Save a packet the live netdev sniffed. */
+static void record_packet(struct recording *recording, struct packet *packet)
+{
+	struct record record = {
+		.type = RECORD_PACKET,
+		.usecs = packet->time_usecs ? packet->time_usecs : now_usecs(),
+		.index = packet->num_fragments,
+	};
+
+	write_record(recording, &record,
+		     packet->fragment_bytes,
+		     packet->num_fragments * sizeof(u16),
+		     packet_start(packet), packet->ip_bytes);
+}
+
+/* Return the next recorded outbound packet that passes the filter. */
+static int replay_packet(struct recording *recording, u8 udp_encaps,
+			 const struct packet_filter *filter,
+			 struct packet **packet, char **error)
+{
+	const struct recorded_packet *recorded = NULL;
+	enum packet_parse_result_t result;
+	struct packet_flow flow;
+	u16 ether_type;
+
+	while (recording->next_packet < recording->num_packets) {
+		recorded = &recording->packets[recording->next_packet++];
+		recording_advance_clock(recording, recorded->usecs);
+
+		ether_type = ((recorded->bytes[0] >> 4) == 6) ?
+			     ETHERTYPE_IPV6 : ETHERTYPE_IP;
+		if ((filter != NULL) &&
+		    parse_packet_flow(recorded->bytes, recorded->len,
+				      ether_type, udp_encaps, &flow) &&
+		    !filter->match(filter->arg, &flow))
+			continue;
+
+		*packet = packet_new(recorded->len);
+		memcpy((*packet)->buffer, recorded->bytes, recorded->len);
+		result = parse_packet(*packet, recorded->len, ether_type,
+				      udp_encaps, error);
+		if (result == PACKET_OK) {
+			(*packet)->time_usecs = recorded->usecs;
+			(*packet)->num_fragments = recorded->num_fragments;
+			memcpy((*packet)->fragment_bytes,
+			       recorded->fragment_bytes,
+			       sizeof(recorded->fragment_bytes));
+			return STATUS_OK;
+		}
+		packet_free(*packet);
+		*packet = NULL;
+		if (result == PACKET_BAD)
+			return STATUS_ERR;
+		free(*error);
+		*error = NULL;
+	}
+
+	asprintf(error, "no more outbound packets in recording %s",
+		 recording->path);
+	return STATUS_ERR;
+}
+
+static int recording_netdev_receive(struct netdev *a_netdev, u8 udp_encaps,
+				    const struct packet_filter *filter,
+				    struct packet **packet, char **error)
+{
+	struct recording_netdev *netdev = (struct recording_netdev *)a_netdev;
+
+	if (netdev->live_netdev == NULL)
+		return replay_packet(netdev->recording, udp_encaps, filter,
+				     packet, error);
+
+	if (netdev_receive(netdev->live_netdev, udp_encaps, filter,
+			   packet, error))
+		return STATUS_ERR;
+	record_packet(netdev->recording, *packet);
+	return STATUS_OK;
+}
+
+struct netdev *recording_netdev_new(struct recording *recording,
+				    struct netdev *live_netdev)
+{
+	struct recording_netdev *netdev =
+		calloc(1, sizeof(struct recording_netdev));
+
+	assert((live_netdev == NULL) == recording->is_replay);
+	netdev->netdev.ops = &recording_netdev_ops;
+	netdev->recording = recording;
+	netdev->live_netdev = live_netdev;
+	return (struct netdev *)netdev;
+}
+
+struct netdev_ops recording_netdev_ops = {
+	.free = recording_netdev_free,
+	.send = recording_netdev_send,
+	.send_burst = recording_netdev_send_burst,
+	.receive = recording_netdev_receive,
+};
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Interface for recording a live run of a script, and for re-verifying
+ * a script offline against such a recording, with no kernel under test.
+ *
+ * With --record=<file>, we save what the kernel did during the run:
+ * each sniffed outbound packet and when it was sniffed, the result,
+ * errno, and return time of each system call along with any values it
+ * filled in for us (getsockopt() option values, accept() addresses,
+ * poll() events), and the data that code events collected (tcp_info or
+ * sock_diag snapshots). The file is written even when the run fails.
+ *
+ * With --reverify=<file>, we run the script again, but nothing reaches
+ * a kernel: the netdev drops inbound packets and hands out the recorded
+ * outbound ones, system calls return their recorded results, and code
+ * events get their recorded data. All the usual checks run on these,
+ * so editing a script's expectations and re-checking them takes
+ * milliseconds instead of the script's full duration.
+ *
+ * While re-verifying, now_usecs() reads a virtual clock rather than the
+ * wall clock. Waiting for an event moves the clock to the event's time,
+ * sniffing a recorded packet moves it to the packet's time, and a
+ * blocking system call returns once the clock reaches its recorded
+ * return time. So timing checks see the live run's times, and the
+ * script runs as fast as we can check it.
+ *
+ * System calls are matched to the recording by their order in the run,
+ * and outbound packets by the order they were sniffed, so a script that
+ * adds or removes system calls, or expects different packets, can no
+ * longer be checked against an old recording. Shell commands, sysctl
+ * statements, and init and cleanup commands are skipped when
+ * re-verifying, since they act on the machine rather than on the
+ * script's sockets.
+ */
+
+#ifndef __RECORDING_H__
+#define __RECORDING_H__
+
+#include "types.h"
+
+#include "config.h"
+#include "netdev.h"
+
+struct recording;
+
+/* Open the recording the config asks for: create the file for
+ * --record, or load the whole file for --reverify. Dies on error.
+ */
+extern struct recording *recording_new(const struct config *config);
+
+/* Are we re-verifying against this recording, rather than recording? */
+extern bool recording_is_replay(const struct recording *recording);
+
+/* Note the live time at which the run starts. */
+extern void recording_start(struct recording *recording, s64 start_usecs);
+
+/* When recording, return a netdev that passes everything through to the
+ * given live netdev and saves each packet it sniffs. When re-verifying,
+ * live_netdev must be NULL, and we return a netdev that drops inbound
+ * packets and sniffs the recorded outbound ones.
+ */
+extern struct netdev *recording_netdev_new(struct recording *recording,
+					   struct netdev *live_netdev);
+
+/* Note that the calling thread is starting the next system call of the
+ * run, with the given name.
+ */
+extern void recording_syscall_begin(struct recording *recording,
+				    const char *name);
+
+/* Save the result and errno of the calling thread's current system
+ * call. Returns the result and leaves errno as it was.
+ */
+extern s64 record_syscall(struct recording *recording, s64 result);
+
+/* Return the recorded result of the calling thread's current system
+ * call and set errno to the recorded errno. For a blocking call, first
+ * wait until the virtual clock reaches the call's return time. Dies if
+ * the recording does not have a matching call.
+ */
+extern s64 replay_syscall(struct recording *recording, bool is_blocking);
+
+/* Note that the calling thread's blocking system call has finished, so
+ * the virtual clock may move on past it.
+ */
+extern void recording_syscall_done(struct recording *recording);
+
+/* Return the live time at which the calling thread's current system
+ * call returned.
+ */
+extern s64 recording_syscall_end_usecs(struct recording *recording);
+
+/* Save, or when re-verifying fill in, the next buffer of 'bytes' bytes
+ * that the calling thread's current system call filled in.
+ */
+extern void recording_output(struct recording *recording,
+			     void *buffer, int bytes);
+
+/* Save the data of the given type that a code event collected. */
+extern void record_code_data(struct recording *recording, int data_type,
+			     const void *data, int bytes);
+
+/* Return a malloc-ed copy of the next recorded code event data and its
+ * type. On success, returns STATUS_OK; on error returns STATUS_ERR and
+ * fills in *error.
+ */
+extern int replay_code_data(struct recording *recording, int *data_type,
+			    void **data, int *bytes, char **error);
+
+/* Return the type of the next recorded code event data, or 0 if there
+ * is none left.
+ */
+extern int recording_next_code_data_type(struct recording *recording);
+
+/* Return the virtual clock of a recording being re-verified. */
+extern s64 recording_now_usecs(struct recording *recording);
+
+/* Move the virtual clock forward to the given time. If a blocking
+ * system call returns by then, first move the clock to its return time
+ * and wait for the call to finish. Must be called without the global
+ * run lock held.
+ */
+extern void recording_run_until(struct recording *recording, s64 usecs);
+
+/* If a blocking system call returns no later than the given time, move
+ * the virtual clock to its return time and let it finish, without
+ * waiting for it.
+ */
+extern void recording_unblock(struct recording *recording, s64 max_usecs);
+
+/* Flush and close the file being recorded, if any. Safe to call more
+ * than once, and from die().
+ */
+extern void recording_close(struct recording *recording);
+
+/* Close and free a recording. */
+extern void recording_free(struct recording *recording);
+
+#endif /* __RECORDING_H__ */
@@ -0,0 +1,552 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for machine-readable results in JSON lines and JUnit
+ * XML.
+ */
+
+#include "results.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "logging.h"
+
+/* The largest result record we read back when rendering JUnit XML. */
+#define RESULTS_MAX_LINE_BYTES	(64 * 1024)
+
+/* Substrings of error messages that tell us what kind of check failed,
+ * most specific first, since a timing error may be reported while
+ * handling a packet or a system call.
+ */
+static const struct {
+	const char *substring;
+	const char *error_class;
+} error_classes[] = {
+	{ "timing error",		"timing" },
+	{ "timing noise",		"host" },
+	{ "handling packet",		"packet" },
+	{ "injecting packets",		"packet" },
+	{ "runtime error in code",	"code" },
+	{ "runtime error in",		"syscall" },
+	{ "exiting while",		"syscall" },
+	{ "command",			"command" },
+	{ "sysctl",			"sysctl" },
+	{ "parse error",		"parse" },
+	{ NULL,				"other" },
+};
+
+/* Serializes writing records and rendering JUnit XML among the scripts
+ * of a --parallel run, which share one process.
+ */
+static pthread_mutex_t results_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Take results_mutex with all signals blocked, since our signal
+ * handler writes a record too.
+ */
+static void results_lock(sigset_t *saved_mask)
+{
+	sigset_t all;
+	int err;
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, saved_mask);
+	if ((err = pthread_mutex_lock(&results_mutex)) != 0)
+		die_strerror("pthread_mutex_lock", err);
+}
+
+static void results_unlock(const sigset_t *saved_mask)
+{
+	int err;
+
+	if ((err = pthread_mutex_unlock(&results_mutex)) != 0)
+		die_strerror("pthread_mutex_unlock", err);
+	pthread_sigmask(SIG_SETMASK, saved_mask, NULL);
+}
+
+static int render_junit(const char *results_path, const char *junit_path,
+			char **error);
+
+/* Wall clock time, even when re-verifying on a virtual clock. */
+static s64 wall_usecs(void)
+{
+	struct timeval tv;
+
+	if (gettimeofday(&tv, NULL) < 0)
+		return 0;
+	return (s64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+void results_start(struct script_result *result,
+		   const char *results_path, const char *junit_path,
+		   const char *script_path, s64 parse_usecs)
+{
+	memset(result, 0, sizeof(*result));
+	result->results_path = results_path;
+	result->junit_path = junit_path;
+	result->script_path = script_path;
+	result->parse_usecs = parse_usecs;
+	result->start_usecs = wall_usecs();
+	result->setup_usecs = -1;
+}
+
+void results_setup_done(struct script_result *result)
+{
+	result->setup_usecs = wall_usecs() - result->start_usecs;
+}
+
+void results_note_slack(struct script_result *result, s64 slack_usecs)
+{
+	if (!result->has_slack || (slack_usecs < result->worst_slack_usecs)) {
+		result->has_slack = true;
+		result->worst_slack_usecs = slack_usecs;
+	}
+}
+
+/* Print the given string as a JSON string. */
+static void json_string(FILE *s, const char *string)
+{
+	const unsigned char *c = NULL;
+
+	fputc('"', s);
+	for (c = (const unsigned char *)string; *c != '\0'; ++c) {
+		if ((*c == '"') || (*c == '\\'))
+			fprintf(s, "\\%c", *c);
+		else if (*c == '\n')
+			fputs("\\n", s);
+		else if (*c == '\t')
+			fputs("\\t", s);
+		else if (*c < 0x20)
+			fprintf(s, "\\u%04x", *c);
+		else
+			fputc(*c, s);
+	}
+	fputc('"', s);
+}
+
+/* Return the script line number at the start of an error message of
+ * the form "script.pkt:123: ...", or 0 if there is none.
+ */
+static int error_line_number(const char *script_path, const char *error)
+{
+	const char *where = strstr(error, script_path);
+
+	if ((where == NULL) || (where[strlen(script_path)] != ':'))
+		return 0;
+	return atoi(where + strlen(script_path) + 1);
+}
+
+/* Return what kind of check the given error message is from. */
+static const char *error_class(const char *error)
+{
+	int i;
+
+	for (i = 0; error_classes[i].substring != NULL; ++i) {
+		if (strstr(error, error_classes[i].substring) != NULL)
+			break;
+	}
+	return error_classes[i].error_class;
+}
+
+/* Format the host timing noise and derived tolerances of a run. */
+static void calibration_to_json(FILE *s,
+				const struct calibration *calibration)
+{
+	int i;
+
+	fprintf(s, ",\"calibration\":{\"sleep_overshoot_usecs\":%lld,"
+		"\"loopback_usecs\":%lld,\"sniff_delay_usecs\":%lld,"
+		"\"tolerance_usecs\":{",
+		calibration->sleep_overshoot_usecs,
+		calibration->loopback_usecs,
+		calibration->sniff_delay_usecs);
+	for (i = 0; i < NUM_TIMING_CLASSES; ++i) {
+		fprintf(s, "%s\"%s\":%d", i ? "," : "",
+			timing_class_name(i),
+			calibration->tolerance_usecs[i]);
+	}
+	fprintf(s, "},\"too_noisy\":%s}",
+		calibration->too_noisy ? "true" : "false");
+}
+
+/* Format the JSON line for the given run. */
+static char *result_to_json(const struct script_result *result,
+			    const char *error)
+{
+	char *json = NULL;
+	size_t size = 0;
+	FILE *s = open_memstream(&json, &size);
+	const int line = error ? error_line_number(result->script_path,
+						   error) : 0;
+
+	fputs("{\"script\":", s);
+	json_string(s, result->script_path);
+	fprintf(s, ",\"verdict\":\"%s\"", error ? "fail" : "pass");
+	if (line > 0)
+		fprintf(s, ",\"line\":%d", line);
+	else
+		fputs(",\"line\":null", s);
+	if (error != NULL) {
+		fprintf(s, ",\"error_class\":\"%s\",\"error\":",
+			error_class(error));
+		json_string(s, error);
+	} else {
+		fputs(",\"error_class\":null,\"error\":null", s);
+	}
+	fprintf(s, ",\"wall_secs\":%.6f",
+		usecs_to_secs(wall_usecs() - result->start_usecs));
+	if (result->setup_usecs >= 0)
+		fprintf(s, ",\"setup_secs\":%.6f",
+			usecs_to_secs(result->setup_usecs));
+	else
+		fputs(",\"setup_secs\":null", s);
+	fprintf(s, ",\"parse_secs\":%.6f,\"events\":%d,\"packets\":%d",
+		usecs_to_secs(result->parse_usecs),
+		result->num_events, result->num_packets);
+	if (result->has_slack)
+		fprintf(s, ",\"worst_slack_usecs\":%lld",
+			result->worst_slack_usecs);
+	else
+		fputs(",\"worst_slack_usecs\":null", s);
+	if (result->calibrated)
+		calibration_to_json(s, &result->calibration);
+	else
+		fputs(",\"calibration\":null", s);
+	fputs("}\n", s);
+	fclose(s);
+	return json;
+}
+
+/* Append the record for the run and render the JUnit XML if asked.
+ * Called with results_mutex held.
+ */
+static int write_record(struct script_result *result, const char *error,
+			char **error_out)
+{
+	char *json = NULL;
+	int fd, len, written;
+
+	/* One write(2) to a file opened for appending, so records from
+	 * scripts running in other processes do not interleave.
+	 */
+	json = result_to_json(result, error);
+	len = strlen(json);
+	fd = open(result->results_path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+	if (fd < 0) {
+		asprintf(error_out, "cannot open results file %s: %s",
+			 result->results_path, strerror(errno));
+		free(json);
+		return STATUS_ERR;
+	}
+	written = write(fd, json, len);
+	if ((written != len) || (close(fd) < 0)) {
+		asprintf(error_out, "error writing results file %s: %s",
+			 result->results_path, strerror(errno));
+		free(json);
+		return STATUS_ERR;
+	}
+	free(json);
+
+	if (result->junit_path != NULL)
+		return render_junit(result->results_path,
+				    result->junit_path, error_out);
+	return STATUS_OK;
+}
+
+int results_write(struct script_result *result, const char *error,
+		  char **error_out)
+{
+	int status = STATUS_OK;
+	sigset_t saved_mask;
+
+	if (result->results_path == NULL)
+		return STATUS_OK;
+
+	/* The scripts of a --parallel run share this process, so check
+	 * and set 'written' under the lock too.
+	 */
+	results_lock(&saved_mask);
+	if (!result->written) {
+		result->written = true;
+		status = write_record(result, error, error_out);
+	}
+	results_unlock(&saved_mask);
+	return status;
+}
+
+/* The fields of a result record that go into JUnit XML. */
+struct junit_case {
+	char *script;
+	char *verdict;
+	char *error_class;
+	char *error;
+	double wall_secs;
+};
+
+/* Parse a JSON string starting at the opening quote, and return a copy
+ * of it, with *end just past the closing quote. We only need to undo
+ * the escapes that json_string() makes.
+ */
+static char *parse_json_string(const char *start, const char **end)
+{
+	char *string = malloc(strlen(start) + 1), *out = string;
+	const char *c = start + 1;
+	unsigned int code;
+
+	while ((*c != '\0') && (*c != '"')) {
+		if ((*c == '\\') && (c[1] != '\0')) {
+			++c;
+			if (*c == 'n')
+				*out++ = '\n';
+			else if (*c == 't')
+				*out++ = '\t';
+			else if ((*c == 'u') && (sscanf(c + 1, "%4x",
+							 &code) == 1)) {
+				*out++ = (char)code;
+				c += 4;
+			} else
+				*out++ = *c;
+			++c;
+		} else {
+			*out++ = *c++;
+		}
+	}
+	*out = '\0';
+	*end = (*c == '"') ? c + 1 : c;
+	return string;
+}
+
+/* Return the end of the JSON object starting at the given '{'. */
+static const char *skip_json_object(const char *c)
+{
+	int depth = 0;
+
+	do {
+		if (*c == '"') {
+			free(parse_json_string(c, &c));
+			continue;
+		}
+		if (*c == '{')
+			++depth;
+		else if (*c == '}')
+			--depth;
+		++c;
+	} while ((depth > 0) && (*c != '\0'));
+	return c;
+}
+
+/* Parse the top-level fields of one of our result records. Returns
+ * STATUS_ERR if the line is not one.
+ */
+static int parse_junit_case(const char *line, struct junit_case *test)
+{
+	const char *c = line;
+
+	memset(test, 0, sizeof(*test));
+	while ((*c == ' ') || (*c == '\t'))
+		++c;
+	if (*c++ != '{')
+		return STATUS_ERR;
+	while (*c == '"') {
+		char *key = parse_json_string(c, &c);
+		char *value = NULL;
+
+		if (*c++ != ':') {
+			free(key);
+			return STATUS_ERR;
+		}
+		if (*c == '"') {
+			value = parse_json_string(c, &c);
+		} else if (*c == '{') {
+			c = skip_json_object(c);
+		} else {
+			const size_t len = strcspn(c, ",}");
+
+			if (strncmp(c, "null", len) != 0)
+				value = strndup(c, len);
+			c += len;
+		}
+
+		if (strcmp(key, "script") == 0)
+			test->script = value;
+		else if (strcmp(key, "verdict") == 0)
+			test->verdict = value;
+		else if (strcmp(key, "error_class") == 0)
+			test->error_class = value;
+		else if (strcmp(key, "error") == 0)
+			test->error = value;
+		else if (strcmp(key, "wall_secs") == 0) {
+			test->wall_secs = value ? atof(value) : 0;
+			free(value);
+		} else
+			free(value);
+		free(key);
+
+		if (*c == ',')
+			++c;
+	}
+	return ((test->script != NULL) && (test->verdict != NULL)) ?
+		STATUS_OK : STATUS_ERR;
+}
+
+static void free_junit_case(struct junit_case *test)
+{
+	free(test->script);
+	free(test->verdict);
+	free(test->error_class);
+	free(test->error);
+}
+
+/* Print the given string with XML special characters escaped. */
+static void xml_string(FILE *s, const char *string)
+{
+	const unsigned char *c = NULL;
+
+	for (c = (const unsigned char *)string; *c != '\0'; ++c) {
+		if (*c == '<')
+			fputs("&lt;", s);
+		else if (*c == '>')
+			fputs("&gt;", s);
+		else if (*c == '&')
+			fputs("&amp;", s);
+		else if (*c == '"')
+			fputs("&quot;", s);
+		else if ((*c < 0x20) && (*c != '\n') && (*c != '\t'))
+			fputc(' ', s);	/* not allowed in XML 1.0 */
+		else
+			fputc(*c, s);
+	}
+}
+
+int results_render_junit(const char *results_path, const char *junit_path,
+			 char **error)
+{
+	sigset_t saved_mask;
+	int status;
+
+	results_lock(&saved_mask);
+	status = render_junit(results_path, junit_path, error);
+	results_unlock(&saved_mask);
+	return status;
+}
+
+/* Render the JUnit XML. Called with results_mutex held. */
+static int render_junit(const char *results_path, const char *junit_path,
+			char **error)
+{
+	FILE *in = NULL, *out = NULL, *cases = NULL;
+	char *line = malloc(RESULTS_MAX_LINE_BYTES);
+	char *cases_xml = NULL, *tmp_path = NULL;
+	size_t cases_size = 0;
+	int num_tests = 0, num_failures = 0;
+	double total_secs = 0;
+	int result = STATUS_ERR;
+	int fd = -1;
+
+	in = fopen(results_path, "r");
+	if (in == NULL) {
+		asprintf(error, "cannot open results file %s: %s",
+			 results_path, strerror(errno));
+		goto out;
+	}
+
+	/* Render the test cases first, so we know the totals. */
+	cases = open_memstream(&cases_xml, &cases_size);
+	while (fgets(line, RESULTS_MAX_LINE_BYTES, in) != NULL) {
+		struct junit_case test;
+
+		if (parse_junit_case(line, &test) == STATUS_OK) {
+			const bool failed = strcmp(test.verdict, "pass") != 0;
+
+			++num_tests;
+			num_failures += failed;
+			total_secs += test.wall_secs;
+			fputs("  <testcase classname=\"packetdrill\" name=\"",
+			      cases);
+			xml_string(cases, test.script);
+			fprintf(cases, "\" time=\"%.6f\"", test.wall_secs);
+			if (failed) {
+				fputs(">\n    <failure type=\"", cases);
+				xml_string(cases, test.error_class ?
+					   test.error_class : "other");
+				fputs("\">", cases);
+				xml_string(cases, test.error ?
+					   test.error : "");
+				fputs("</failure>\n  </testcase>\n", cases);
+			} else {
+				fputs("/>\n", cases);
+			}
+		}
+		free_junit_case(&test);
+	}
+	fclose(cases);
+
+	/* Write a file of our own and rename it into place, so readers
+	 * never see half of one, even with other processes rendering too.
+	 */
+	asprintf(&tmp_path, "%s.XXXXXX", junit_path);
+	fd = mkstemp(tmp_path);
+	if (fd < 0) {
+		asprintf(error, "cannot create %s: %s",
+			 tmp_path, strerror(errno));
+		goto out;
+	}
+	/* mkstemp(3) makes the file private to us. */
+	fchmod(fd, 0644);
+	out = fdopen(fd, "w");
+	if (out == NULL) {
+		asprintf(error, "cannot open %s: %s",
+			 tmp_path, strerror(errno));
+		close(fd);
+		unlink(tmp_path);
+		goto out;
+	}
+	fprintf(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<testsuite name=\"packetdrill\" tests=\"%d\" "
+		"failures=\"%d\" time=\"%.6f\">\n%s</testsuite>\n",
+		num_tests, num_failures, total_secs, cases_xml);
+	if (fclose(out) != 0) {
+		asprintf(error, "error writing %s: %s",
+			 tmp_path, strerror(errno));
+		unlink(tmp_path);
+		goto out;
+	}
+	if (rename(tmp_path, junit_path) < 0) {
+		asprintf(error, "cannot rename %s to %s: %s",
+			 tmp_path, junit_path, strerror(errno));
+		unlink(tmp_path);
+		goto out;
+	}
+	result = STATUS_OK;
+
+out:
+	if (in != NULL)
+		fclose(in);
+	free(cases_xml);
+	free(tmp_path);
+	free(line);
+	return result;
+}
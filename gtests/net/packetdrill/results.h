@@ -0,0 +1,88 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Interface for machine-readable results: with --results, we append one
+ * JSON object per script to a file, as a line of its own, as soon as
+ * the script passes or fails, so the results of earlier scripts survive
+ * a crash or a hung run. Each record has the script's verdict, and for
+ * failures the failing line, the class of error, and the error message,
+ * along with how long the script took to parse, set up, and run, how
+ * many events and packets it ran, and the smallest timing slack of any
+ * event that was on time. With --calibrate, the record also has the
+ * host timing noise we measured and the tolerances we derived from it.
+ *
+ * With --junit, after each record we also render the whole results
+ * file as JUnit XML, for CI systems. Since the JSON lines file is the
+ * source of truth, scripts run in other processes (as with --sweep) all
+ * end up in the XML too: those processes only append their records, and
+ * the sweep renders the XML once they have all exited. A script that
+ * fails to parse gets a record of class "parse".
+ */
+
+#ifndef __RESULTS_H__
+#define __RESULTS_H__
+
+#include "types.h"
+
+#include "calibrate.h"
+
+/* What we measure of one script run, for its result record. */
+struct script_result {
+	const char *results_path;	/* JSON lines file to append to */
+	const char *junit_path;		/* JUnit XML file to render, or NULL */
+	const char *script_path;
+	s64 parse_usecs;		/* time to parse the script */
+	s64 start_usecs;		/* wall clock time run started */
+	s64 setup_usecs;		/* time to set up, or -1 if not done */
+	int num_events;			/* events run so far */
+	int num_packets;		/* packet events run so far */
+	bool has_slack;			/* has an event had timing slack? */
+	s64 worst_slack_usecs;		/* least slack of any timed event */
+	bool calibrated;		/* did we run with --calibrate? */
+	struct calibration calibration;	/* host noise and tolerances */
+	bool written;			/* have we written the record? */
+};
+
+/* Start measuring a script run. */
+extern void results_start(struct script_result *result,
+			  const char *results_path, const char *junit_path,
+			  const char *script_path, s64 parse_usecs);
+
+/* Note that setup is done and the first event is about to run. */
+extern void results_setup_done(struct script_result *result);
+
+/* Note that an event happened on time with the given slack to spare. */
+extern void results_note_slack(struct script_result *result,
+			       s64 slack_usecs);
+
+/* Append the record for the run, which passed if 'error' is NULL and
+ * otherwise failed with the given error message, and render the JUnit
+ * XML if asked. Writes at most one record per run. On success, returns
+ * STATUS_OK. On error returns STATUS_ERR and fills in *error_out.
+ */
+extern int results_write(struct script_result *result, const char *error,
+			 char **error_out);
+
+/* Render the given JSON lines results file as JUnit XML. On success,
+ * returns STATUS_OK. On error returns STATUS_ERR and fills in *error.
+ */
+extern int results_render_junit(const char *results_path,
+				const char *junit_path, char **error);
+
+#endif /* __RESULTS_H__ */
@@ -36,16 +36,20 @@
 #include <sys/times.h>
 #include <unistd.h>
 #include "ip.h"
+#include "kernel_trace.h"
 #include "logging.h"
 #include "netdev.h"
 #include "wire_client_netdev.h"
 #include "parse.h"
 #include "run_command.h"
+#include "run_sysctl.h"
 #include "run_packet.h"
 #include "run_system_call.h"
 #include "script.h"
 #include "socket.h"
+#include "socket_diag.h"
 #include "system.h"
+#include "veth_netdev.h"
 #include "tcp.h"
 #include "tcp_options.h"
 
@@ -68,26 +72,84 @@ const int MAX_SPIN_USECS = 100;
 const int MAX_SPIN_USECS = 20;
 #endif
 
-/* Global bool init_cmd_exed */
-bool init_cmd_exed = false;
+/* What to clean up for the script this thread is running. A script's
+ * system call thread shares the context of its main thread.
+ */
+static __thread struct run_context *current_context = NULL;
+
+/* The contexts of all the scripts running in this process, so that a
+ * failure in one can clean up after all of them before we exit.
+ */
+static pthread_mutex_t live_contexts_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct run_context *live_contexts = NULL;
+
+/* Take live_contexts_mutex with all signals blocked, so that a signal
+ * handler cannot deadlock on it.
+ */
+static void live_contexts_lock(sigset_t *saved_mask)
+{
+	sigset_t all;
+	int err;
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, saved_mask);
+	if ((err = pthread_mutex_lock(&live_contexts_mutex)) != 0)
+		die_strerror("pthread_mutex_lock", err);
+}
+
+static void live_contexts_unlock(const sigset_t *saved_mask)
+{
+	int err;
 
-/* Global bool init_cmd_exists */
-bool init_cmd_exists = false;
+	if ((err = pthread_mutex_unlock(&live_contexts_mutex)) != 0)
+		die_strerror("pthread_mutex_unlock", err);
+	pthread_sigmask(SIG_SETMASK, saved_mask, NULL);
+}
 
-/* Final command to always execute at end of script, in order to clean up: */
-const char *cleanup_cmd;
+/* Add or remove a run from the list of live runs. */
+static void live_contexts_add(struct run_context *context)
+{
+	sigset_t saved_mask;
 
-/* Path of currently-executing script, for use in cleanup command errors: */
-const char *script_path;
+	live_contexts_lock(&saved_mask);
+	context->next = live_contexts;
+	live_contexts = context;
+	live_contexts_unlock(&saved_mask);
+}
 
-static struct state *state = NULL;
+static void live_contexts_remove(struct run_context *context)
+{
+	struct run_context **link = NULL;
+	sigset_t saved_mask;
+
+	live_contexts_lock(&saved_mask);
+	for (link = &live_contexts; *link != NULL; link = &(*link)->next) {
+		if (*link == context) {
+			*link = context->next;
+			break;
+		}
+	}
+	context->next = NULL;
+	live_contexts_unlock(&saved_mask);
+}
+
+/* Set the state a failure should clean up after for the given run. */
+static void live_contexts_set_state(struct run_context *context,
+				    struct state *state)
+{
+	sigset_t saved_mask;
+
+	live_contexts_lock(&saved_mask);
+	context->state = state;
+	live_contexts_unlock(&saved_mask);
+}
 
 struct state *state_new(struct config *config,
 			struct script *script,
 			struct netdev *netdev)
 {
 	struct state *state = calloc(1, sizeof(struct state));
-	int err;
+	int err, i;
 
 	if ((err = pthread_mutex_init(&state->mutex, NULL)) != 0)
 		die_strerror("pthread_mutex_init", err);
@@ -97,10 +159,21 @@ struct state *state_new(struct config *config,
 	state->config = config;
 	state->script = script;
 	state->netdev = netdev;
-	state->packets = packets_new();
+	state->packets = packets_new(config);
+	/* Open the main thread's counters before the syscall thread
+	 * starts and opens its own.
+	 */
+	if (config->perf_counters)
+		state->perf = perf_counters_new();
 	state->syscalls = syscalls_new(state);
 	state->code = code_new(config);
+	if (config->learn_path != NULL)
+		state->learn = learn_new(config->learn_path);
+	if (config->perturb)
+		state->perturb = perturb_new(config);
 	state->sockets = NULL;
+	for (i = 0; i < NUM_TIMING_CLASSES; ++i)
+		state->tolerance_usecs[i] = config->tolerance_usecs;
 	return state;
 }
 
@@ -114,7 +187,9 @@ static void close_all_sockets(struct state *state)
 {
 	struct socket *socket = state->sockets;
 	while (socket != NULL) {
-		if (socket->live.fd >= 0 && !socket->is_closed) {
+		/* Live fds from a recording are not ours to close. */
+		if (socket->live.fd >= 0 && !socket->is_closed &&
+		    !is_reverifying(state)) {
 			assert(socket->script.fd >= 0);
 			DEBUGP("closing struct state socket "
 			       "live.fd:%d script.fd:%d\n",
@@ -155,7 +230,16 @@ void state_free(struct state *state, int about_to_die)
 	/* We have to stop the system call thread first, since it's using
 	 * sockets that we want to close and reset.
 	 */
+	/* Once we start freeing the state, a failure elsewhere must not
+	 * clean it up too.
+	 */
+	if (state->context != NULL)
+		live_contexts_set_state(state->context, NULL);
+
 	syscalls_free(state, state->syscalls, about_to_die);
+	perf_counters_free(state->perf);
+	learn_free(state->learn);
+	perturb_free(state->perturb);
 
 	/* Then we close the sockets and reset the connections, while
 	 * we still have a netdev for injecting reset packets to free
@@ -163,7 +247,8 @@ void state_free(struct state *state, int about_to_die)
 	 */
 	close_all_sockets(state);
 
-	netdev_free(state->netdev);
+	if (!state->keep_netdev)
+		netdev_free(state->netdev);
 	packets_free(state->packets);
 	code_free(state->code);
 
@@ -178,6 +263,11 @@ void state_free(struct state *state, int about_to_die)
 s64 now_usecs(void)
 {
 	struct timeval tv;
+
+	if ((current_context != NULL) &&
+	    (current_context->recording != NULL) &&
+	    recording_is_replay(current_context->recording))
+		return recording_now_usecs(current_context->recording);
 	if (gettimeofday(&tv, NULL) < 0)
 		die_perror("gettimeofday");
 	return timeval_to_usecs(&tv);
@@ -191,7 +281,8 @@ s64 now_usecs(void)
  * points at an event other than the one whose time we're currently
  * checking.
  */
-int verify_time(struct state *state, enum event_time_t time_type,
+int verify_time(struct state *state, enum timing_class timing,
+		enum event_time_t time_type,
 		s64 script_usecs, s64 script_usecs_end,
 		s64 live_usecs, const char *description, char **error)
 {
@@ -199,7 +290,8 @@ int verify_time(struct state *state, enum event_time_t time_type,
 	s64 expected_usecs_end = script_usecs_end -
 		state->script_start_time_usecs;
 	s64 actual_usecs = live_usecs - state->live_start_time_usecs;
-	int tolerance_usecs = state->config->tolerance_usecs;
+	int tolerance_usecs = state->tolerance_usecs[timing];
+	s64 slack_usecs;
 
 	DEBUGP("expected: %.3f actual: %.3f  (secs)\n",
 	       usecs_to_secs(script_usecs), usecs_to_secs(actual_usecs));
@@ -237,9 +329,16 @@ int verify_time(struct state *state, enum event_time_t time_type,
 						       offset_usecs));
 			}
 			return STATUS_ERR;
-		} else {
-			return STATUS_OK;
 		}
+		slack_usecs = actual_usecs - (expected_usecs - tolerance_usecs);
+		if (slack_usecs > (expected_usecs_end + tolerance_usecs) -
+		    actual_usecs)
+			slack_usecs = (expected_usecs_end + tolerance_usecs) -
+				actual_usecs;
+		if (state->context != NULL)
+			results_note_slack(&state->context->result,
+					   slack_usecs);
+		return STATUS_OK;
 	}
 
 	if ((actual_usecs < (expected_usecs - tolerance_usecs)) ||
@@ -251,9 +350,11 @@ int verify_time(struct state *state, enum event_time_t time_type,
 			 usecs_to_secs(script_usecs),
 			 usecs_to_secs(actual_usecs));
 		return STATUS_ERR;
-	} else {
-		return STATUS_OK;
 	}
+	slack_usecs = tolerance_usecs - llabs(actual_usecs - expected_usecs);
+	if (state->context != NULL)
+		results_note_slack(&state->context->result, slack_usecs);
+	return STATUS_OK;
 }
 
 /* Return a static string describing the given event, for error messages. */
@@ -281,6 +382,8 @@ static const char *event_description(struct event *event)
 		return "command";
 	case CODE_EVENT:
 		return "data collection for code";
+	case SYSCTL_EVENT:
+		return "sysctl";
 	case INVALID_EVENT:
 	case NUM_EVENT_TYPES:
 		assert(!"bogus type");
@@ -290,11 +393,36 @@ static const char *event_description(struct event *event)
 	return "invalid event";
 }
 
+/* Return the kind of event the given event is, for its tolerance. */
+static enum timing_class event_timing_class(struct event *event)
+{
+	switch (event->type) {
+	case PACKET_EVENT:
+		if (packet_direction(event->event.packet) ==
+		    DIRECTION_OUTBOUND)
+			return TIMING_OUTBOUND;
+		return TIMING_INBOUND;
+	case SYSCALL_EVENT:
+		return TIMING_SYSCALL;
+	case COMMAND_EVENT:
+	case CODE_EVENT:
+	case SYSCTL_EVENT:
+		return TIMING_OTHER;
+	case INVALID_EVENT:
+	case NUM_EVENT_TYPES:
+		assert(!"bogus type");
+		break;
+	/* We omit default case so compiler catches missing values. */
+	}
+	return TIMING_OTHER;
+}
+
 void check_event_time(struct state *state, s64 live_usecs)
 {
 	char *error = NULL;
 	const char *description = event_description(state->event);
 	if (verify_time(state,
+			event_timing_class(state->event),
 			state->event->time_type,
 			state->event->time_usecs,
 			state->event->time_usecs_end, live_usecs,
@@ -341,6 +469,15 @@ void wait_for_event(struct state *state)
 	DEBUGP("waiting until %lld -- now is %lld\n",
 	       event_usecs, now_usecs());
 	run_unlock(state);
+	if (is_reverifying(state))
+		recording_run_until(state->recording, event_usecs);
+	wait_until_usecs(event_usecs);
+	run_lock(state);
+	check_event_time(state, now_usecs());
+}
+
+void wait_until_usecs(s64 event_usecs)
+{
 	while (1) {
 		const s64 wait_usecs = event_usecs - now_usecs();
 		if (wait_usecs <= 0)
@@ -378,8 +515,6 @@ void wait_for_event(struct state *state)
 		 * two to wait, so we spin.
 		 */
 	}
-	run_lock(state);
-	check_event_time(state, now_usecs());
 }
 
 int get_next_event(struct state *state, char **error)
@@ -426,6 +561,19 @@ int get_next_event(struct state *state, char **error)
 	return STATUS_OK;
 }
 
+/* Run a burst of inbound packet events that are all due at the same
+ * time; exit on error.
+ */
+static void run_local_packet_burst(struct state *state, int num_packets)
+{
+	char *error = NULL;
+
+	if (run_inbound_packet_burst(state, num_packets, &error)) {
+		state_free(state, 1);
+		die("%s", error);
+	}
+}
+
 /* Run the given packet event; print warnings/errors, and exit on error. */
 static void run_local_packet_event(struct state *state, struct event *event,
 				   struct packet *packet)
@@ -532,14 +680,11 @@ static s64 schedule_start_time_usecs(void)
 #endif
 }
 
+/* die() cleans up after every running script, including their sockets
+ * and netdevs.
+ */
 void signal_handler(int signal_number)
 {
-	if (state != NULL) {
-		close_all_sockets(state);
-		if (state->netdev != NULL) {
-			netdev_free(state->netdev);
-		}
-	}
 	die("Handled signal %d\n", signal_number);
 }
 
@@ -548,32 +693,209 @@ void signal_handler(int signal_number)
  * matter whether the test passes or fails. This makes the cleanup command a
  * good place to undo any sysctl settings the script changed, for example.
  */
-int run_cleanup_command(void)
+static int cleanup_context(struct run_context *context)
 {
-	if (cleanup_cmd != NULL && (!init_cmd_exists || init_cmd_exed)) {
-		char *error = NULL;
+	char *error = NULL;
+	int result = STATUS_OK;
 
-		if (safe_system(cleanup_cmd, &error)) {
+	if ((context == NULL) || context->cleaned_up)
+		return STATUS_OK;
+	context->cleaned_up = true;
+
+	/* Show what the kernel was doing when the test failed. */
+	if (context->kernel_trace != NULL) {
+		kernel_trace_finish(context->kernel_trace, true);
+		context->kernel_trace = NULL;
+	}
+
+	/* Keep what we recorded of a failed run. */
+	if (context->recording != NULL)
+		recording_close(context->recording);
+
+	/* A re-verified script did not touch the machine. */
+	if ((context->recording != NULL) &&
+	    recording_is_replay(context->recording))
+		return STATUS_OK;
+
+	if (context->cleanup_cmd != NULL &&
+	    (!context->init_cmd_exists || context->init_cmd_exed)) {
+		if (safe_system(context->cleanup_cmd, &error)) {
 			fprintf(stderr,
 				"%s: error executing cleanup command: %s\n",
-				 script_path, error);
+				 context->script_path, error);
 			free(error);
-			return STATUS_ERR;
+			error = NULL;
+			result = STATUS_ERR;
 		}
 	}
-	return STATUS_OK;
+
+	/* Put back any tunables the script changed with sysctl statements. */
+	if (sysctl_restore_all(&context->saved_sysctls, &error)) {
+		fprintf(stderr, "%s: error restoring sysctl: %s\n",
+			context->script_path, error);
+		free(error);
+		result = STATUS_ERR;
+	}
+	return result;
 }
 
+int run_cleanup_command(void)
+{
+	return cleanup_context(current_context);
+}
+
+/* Write the failing result record for the given run, if it has not
+ * written one yet.
+ */
+static void report_failure(struct run_context *context, const char *message)
+{
+	char *error = NULL;
+
+	if (results_write(&context->result, message, &error)) {
+		fprintf(stderr, "%s: %s\n", context->script_path, error);
+		free(error);
+	}
+}
+
+/* Close the sockets and free the netdev of a run's state. */
+static void free_state_resources(struct state *state)
+{
+	close_all_sockets(state);
+	state->sockets = NULL;
+	if (!state->keep_netdev && (state->netdev != NULL)) {
+		netdev_free(state->netdev);
+		state->netdev = NULL;
+	}
+}
+
+void run_cleanup_all(const char *message)
+{
+	static __thread bool cleaning_up = false;
+	struct run_context *context = NULL;
+	char *aborted = NULL;
+	sigset_t saved_mask;
+
+	/* If cleaning up fails and dies, just exit. */
+	if (cleaning_up)
+		return;
+	cleaning_up = true;
+
+	/* We hold the list until we exit, so no run can start, finish,
+	 * or free its state meanwhile. A failure on another thread waits
+	 * here for us to exit.
+	 */
+	live_contexts_lock(&saved_mask);
+
+	if (current_context != NULL) {
+		report_failure(current_context, message);
+		asprintf(&aborted, "aborted after a failure in %s\n",
+			 current_context->script_path);
+	} else {
+		asprintf(&aborted, "aborted after a failure\n");
+	}
+	for (context = live_contexts; context != NULL;
+	     context = context->next) {
+		if (context != current_context)
+			report_failure(context, aborted);
+	}
+	free(aborted);
+
+	for (context = live_contexts; context != NULL;
+	     context = context->next)
+		cleanup_context(context);
+
+	/* Last, since the threads of other scripts may still be using
+	 * them until we exit.
+	 */
+	for (context = live_contexts; context != NULL;
+	     context = context->next) {
+		if (context->state != NULL)
+			free_state_resources(context->state);
+	}
+}
+
+void run_set_context(struct run_context *context)
+{
+	current_context = context;
+}
+
+
+/* Finish measuring the host's timing noise for --calibrate, and warn
+ * about, or with --calibrate_strict fail on, a host too noisy for the
+ * script's tolerance.
+ */
+static void calibrate(struct config *config, struct calibrator *calibrator,
+		      struct netdev *netdev, struct script_result *result)
+{
+	char *error = NULL, *summary = NULL;
+
+	if (calibrator_finish(calibrator, netdev, &result->calibration,
+			      &error)) {
+		die("%s: error calibrating timing: %s\n",
+		    config->script_path, error);
+	}
+	result->calibrated = true;
+	if (config->verbose) {
+		summary = calibration_to_string(&result->calibration);
+		printf("calibration: %s\n", summary);
+		free(summary);
+	}
+	error = calibration_noise_error(&result->calibration, config);
+	if (error == NULL)
+		return;
+	if (config->calibrate_strict)
+		die("%s: %s\n", config->script_path, error);
+	fprintf(stderr, "%s: warning: %s\n", config->script_path, error);
+	free(error);
+}
+
+/* For --skmem_trace, add the socket memory of the socket under test
+ * to the trace, so drops and buffer pressure line up with the packets.
+ */
+static void trace_skmem(struct state *state, struct kernel_trace *trace)
+{
+#if HAVE_SOCK_DIAG
+	u32 meminfo[SK_MEMINFO_VARS];
+	char *error = NULL, *values = NULL, *text = NULL;
+	int fd = -1;
+
+	if (state->socket_under_test == NULL)
+		return;
+	fd = state->socket_under_test->live.fd;
+	if (sk_meminfo_get(fd, meminfo, &error)) {
+		DEBUGP("no skmem for trace: %s\n", error);
+		free(error);
+		return;
+	}
+	values = sk_meminfo_to_string(meminfo);
+	asprintf(&text, "skmem fd %d: %s", state->socket_under_test->script.fd,
+		 values);
+	free(values);
+	kernel_trace_note(trace, text, now_usecs());
+#endif  /* HAVE_SOCK_DIAG */
+}
 
 void run_script(struct config *config, struct script *script)
 {
 	char *error = NULL;
+	struct state *state = NULL;
 	struct netdev *netdev = NULL;
 	struct event *event = NULL;
-
-	init_cmd_exed = false;
-	if (script->init_command != NULL)
-		init_cmd_exists = true;
+	struct run_context context;
+	struct calibrator *calibrator = NULL;
+	const bool reverify = (config->reverify_path != NULL);
+	int num_packets;
+
+	memset(&context, 0, sizeof(context));
+	context.script_path = config->script_path;
+	if (script->cleanup_command != NULL)
+		context.cleanup_cmd = script->cleanup_command->command_line;
+	context.init_cmd_exists = (script->init_command != NULL);
+	results_start(&context.result, config->results_path,
+		      config->junit_path, config->script_path,
+		      script->parse_usecs);
+	run_set_context(&context);
+	live_contexts_add(&context);
 
 	if (signal(SIGINT, signal_handler) == SIG_ERR) {
 		die("could not set up signal handler for SIGINT!");
@@ -584,52 +906,100 @@ void run_script(struct config *config, struct script *script)
 	if (signal(SIGHUP, signal_handler) == SIG_ERR) {
 		die("could not set up signal handler for SIGHUP!");
 	}
+	/* A perturbed script may wait forever for a packet the kernel
+	 * never needed to send, so give up on it after a while.
+	 */
+	if (config->perturb && (config->perturb_timeout_secs > 0)) {
+		if (signal(SIGALRM, signal_handler) == SIG_ERR) {
+			die("could not set up signal handler for SIGALRM!");
+		}
+		alarm(config->perturb_timeout_secs);
+	}
 
 	DEBUGP("run_script: running script\n");
 
-	set_scheduling_priority();
-	lock_memory();
+	if ((config->record_path != NULL) || reverify)
+		context.recording = recording_new(config);
+
+	/* Re-verifying is not timing sensitive. */
+	if (!reverify) {
+		set_scheduling_priority();
+		lock_memory();
+	}
 
 	/* This interpreter loop runs for local mode or wire client mode. */
 	assert(!config->is_wire_server);
 
-	script_path = config->script_path;
+	/* Measure how late we wake up while the device is set up. */
+	if (config->calibrate)
+		calibrator = calibrator_start(config);
 
 	/* How we use the network is of course a little different in
 	 * each of the two cases....
 	 */
-	if (config->is_wire_client)
+	if (reverify)
+		netdev = NULL;
+	else if (config->is_wire_client)
 		netdev = wire_client_netdev_new(config);
+	else if (config->is_veth)
+		netdev = veth_netdev_new(config);
 	else
 		netdev = local_netdev_new(config);
+	if (calibrator != NULL)
+		calibrate(config, calibrator, netdev, &context.result);
+	if (context.recording != NULL)
+		netdev = recording_netdev_new(context.recording, netdev);
 
 	state = state_new(config, script, netdev);
+	state->context = &context;
+	state->recording = context.recording;
+	live_contexts_set_state(&context, state);
+	/* A tolerance the script asks for wins over what we measured. */
+	if (context.result.calibrated && !config->script_tolerance) {
+		memcpy(state->tolerance_usecs,
+		       context.result.calibration.tolerance_usecs,
+		       sizeof(state->tolerance_usecs));
+	}
+	if (config->kernel_trace != NULL)
+		context.kernel_trace = kernel_trace_new(config);
 
 	if (config->is_wire_client) {
-		state->wire_client = wire_client_new();
+		if (config->wire_session)
+			state->wire_client = wire_client_session();
+		else
+			state->wire_client = wire_client_new();
 		wire_client_init(state->wire_client, config, script, state);
 	}
 
-	if (script->init_command != NULL) {
+	if ((script->init_command != NULL) && !reverify) {
 		if (safe_system(script->init_command->command_line,
 				&error)) {
-			asprintf(&error, "%s: error executing init command: %s\n",
-				 config->script_path, error);
-			free(error);
-			exit(EXIT_FAILURE);
+			die("%s: error executing init command: %s\n",
+			    config->script_path, error);
 		}
-		init_cmd_exed = true;
+		context.init_cmd_exed = true;
 	}
 
 	signal(SIGPIPE, SIG_IGN);	/* ignore EPIPE */
 
-	state->live_start_time_usecs = schedule_start_time_usecs();
+	/* When re-verifying, the clock starts where the recording did. */
+	if (reverify)
+		state->live_start_time_usecs = now_usecs();
+	else
+		state->live_start_time_usecs = schedule_start_time_usecs();
 	DEBUGP("live_start_time_usecs is %lld\n",
 	       state->live_start_time_usecs);
+	if (context.recording != NULL)
+		recording_start(context.recording,
+				state->live_start_time_usecs);
+	if (context.kernel_trace != NULL)
+		kernel_trace_start(context.kernel_trace,
+				   state->live_start_time_usecs);
 
 	if (state->wire_client != NULL)
 		wire_client_send_client_starting(state->wire_client);
 
+	results_setup_done(&context.result);
 	while (1) {
 		if (get_next_event(state, &error)) {
 			state_free(state, 1);
@@ -647,14 +1017,27 @@ void run_script(struct config *config, struct script *script)
 		 * have completed, if any.
 		 */
 		adjust_relative_event_times(state, event);
+		if ((state->perturb != NULL) &&
+		    (event->type == PACKET_EVENT) &&
+		    (packet_direction(event->event.packet) ==
+		     DIRECTION_INBOUND))
+			event->time_usecs +=
+				perturb_jitter_usecs(state->perturb);
 
 		switch (event->type) {
 		case PACKET_EVENT:
 			/* For wire clients, the server handles packets. */
-			if (!config->is_wire_client) {
+			if (config->is_wire_client)
+				break;
+			num_packets = inbound_burst_length(event);
+			context.result.num_packets += num_packets;
+			/* The rest of the burst is counted below. */
+			context.result.num_events += num_packets - 1;
+			if (num_packets > 1)
+				run_local_packet_burst(state, num_packets);
+			else
 				run_local_packet_event(state, event,
 						       event->event.packet);
-			}
 			break;
 		case SYSCALL_EVENT:
 			run_system_call_event(state, event,
@@ -668,20 +1051,41 @@ void run_script(struct config *config, struct script *script)
 			run_code_event(state, event,
 				       event->event.code->text);
 			break;
+		case SYSCTL_EVENT:
+			run_sysctl_event(state, event,
+					 event->event.sysctl);
+			break;
 		case INVALID_EVENT:
 		case NUM_EVENT_TYPES:
 			assert(!"bogus type");
 			break;
 		/* We omit default case so compiler catches missing values. */
 		}
+		context.result.num_events++;
+
+		if (context.kernel_trace != NULL) {
+			kernel_trace_note_event(context.kernel_trace,
+						state->event->line_number,
+						event_description(state->event),
+						now_usecs());
+			if (config->skmem_trace &&
+			    (event->type == PACKET_EVENT))
+				trace_skmem(state, context.kernel_trace);
+		}
 	}
 
 	/* Wait for any outstanding packet events we requested on the server. */
 	if (state->wire_client != NULL)
 		wire_client_next_event(state->wire_client, NULL);
 
+	if (context.kernel_trace != NULL) {
+		kernel_trace_finish(context.kernel_trace, false);
+		context.kernel_trace = NULL;
+	}
+
 	if (run_cleanup_command() == STATUS_ERR)
-		exit(EXIT_FAILURE);
+		die("%s: error cleaning up after the script\n",
+		    config->script_path);
 
 	if (code_execute(state->code, &error)) {
 		char *script_path = strdup(state->config->script_path);
@@ -692,11 +1096,67 @@ void run_script(struct config *config, struct script *script)
 		free(error);
 	}
 
+	if (state->perf != NULL)
+		perf_counters_report(state->perf, config->script_path, stdout);
+
+	if ((state->perturb != NULL) && config->verbose)
+		perturb_report(state->perturb, stdout);
+
+	if ((state->learn != NULL) &&
+	    learn_write(state->learn, script, &error)) {
+		state_free(state, 1);
+		die("%s: %s\n", config->script_path, error);
+	}
+
 	state_free(state, 0);
 
+	if (results_write(&context.result, NULL, &error))
+		die("%s: %s\n", config->script_path, error);
+
+	if (context.recording != NULL) {
+		struct recording *recording = context.recording;
+
+		context.recording = NULL;
+		recording_free(recording);
+	}
+	live_contexts_remove(&context);
+	run_set_context(NULL);
+
 	DEBUGP("run_script: done running\n");
 }
 
+/* Write the failing result record for a script that did not parse.
+ * If the parse failed before the options were finalized, the config has
+ * no results file yet, so take it from the command line.
+ */
+static void report_parse_failure(int argc, char *argv[],
+				 const struct config *config,
+				 const struct script *script)
+{
+	struct config command_line;
+	struct script_result result;
+	const char *results_path = config->results_path;
+	const char *junit_path = config->junit_path;
+	char *error = NULL;
+
+	memset(&command_line, 0, sizeof(command_line));
+	if (results_path == NULL) {
+		set_default_config(&command_line);
+		parse_command_line_options(argc, argv, &command_line);
+		results_path = command_line.results_path;
+		junit_path = command_line.junit_path;
+	}
+	if (results_path != NULL) {
+		results_start(&result, results_path, junit_path,
+			      config->script_path, script->parse_usecs);
+		if (results_write(&result, "parse error", &error)) {
+			fprintf(stderr, "%s: %s\n", config->script_path, error);
+			free(error);
+		}
+	}
+	cleanup_config(&command_line);
+}
+
 int parse_script_and_set_config(int argc, char *argv[],
 				struct config *config,
 				struct script *script,
@@ -709,6 +1169,8 @@ int parse_script_and_set_config(int argc, char *argv[],
 		.config = config,
 		.script = script,
 	};
+	s64 start_usecs = now_usecs();
+	int result;
 
 	DEBUGP("parse_and_run_script: %s\n", script_path);
 	assert(script_path != NULL);
@@ -723,5 +1185,9 @@ int parse_script_and_set_config(int argc, char *argv[],
 	else
 		read_script(script_path, script);
 
-	return parse_script(config, script, &invocation);
+	result = parse_script(config, script, &invocation);
+	script->parse_usecs = now_usecs() - start_usecs;
+	if (result != STATUS_OK)
+		report_parse_failure(argc, argv, config, script);
+	return result;
 }
@@ -49,6 +49,17 @@
  *
  *   o sleeping while waiting for the start time of the system call
  *   o the actual function call to invoke the blocking system call itself
+ *
+ * With --parallel, several scripts run at once, each on a thread of its
+ * own (in its own network namespace on Linux) that plays the role of
+ * the main thread above, with its own state and system call thread.
+ * Nothing about a run lives in globals: what die() needs to clean up
+ * after a script is in a struct run_context that the script's threads
+ * find through a thread-local pointer. Since die() and our signal
+ * handlers end the whole process, they clean up after every script
+ * that is running, which they find in a process-wide list of the live
+ * run contexts. Only the process's initial thread handles the signals
+ * that end a run; every thread we start has them blocked.
  */
 
 #ifndef __RUN_H__
@@ -60,9 +71,15 @@
 #include <pthread.h>
 #include <stdlib.h>
 #include <sys/socket.h>
+#include "calibrate.h"
 #include "code.h"
 #include "config.h"
+#include "learn.h"
 #include "netdev.h"
+#include "perf_counters.h"
+#include "perturb.h"
+#include "recording.h"
+#include "results.h"
 #include "run_packet.h"
 #include "run_system_call.h"
 #include "script.h"
@@ -85,11 +102,35 @@ extern int parse_script_and_set_config(int argc, char *argv[],
 
 /* Private implementation details follow below... */
 
+struct saved_sysctl;
+struct kernel_trace;
+
+/* What we must undo after a script, whether it passes or dies. This
+ * outlives struct state, since most failure paths free the state just
+ * before calling die().
+ */
+struct run_context {
+	const char *script_path;	/* for cleanup error messages */
+	const char *cleanup_cmd;	/* final command to run, or NULL */
+	bool init_cmd_exists;		/* does the script have one? */
+	bool init_cmd_exed;		/* has it run successfully? */
+	bool cleaned_up;		/* have we already cleaned up? */
+	struct saved_sysctl *saved_sysctls;	/* tunables to restore */
+	struct kernel_trace *kernel_trace;	/* to dump on failure */
+	struct recording *recording;	/* to close on failure, or NULL */
+	struct script_result result;	/* for --results */
+	struct state *state;		/* sockets and netdev to clean up on
+					 * failure, or NULL if freed
+					 */
+	struct run_context *next;	/* next in the list of live runs */
+};
+
 /* All the runtime state for a test. */
 struct state {
 	pthread_mutex_t mutex;		/* global lock for all global state */
 	struct config *config;		/* test configuration */
 	struct netdev *netdev;		/* for sending/receiving TCP packets */
+	bool keep_netdev;		/* netdev outlives us (--wire_session) */
 	struct packets *packets;	/* for processing packets */
 	struct syscalls *syscalls;	/* for running system calls */
 	struct socket *sockets;		/* list of all live sockets */
@@ -98,7 +139,17 @@ struct state {
 	struct event *event;			/* the current event */
 	struct event *last_event;		/* previous event */
 	struct code_state *code;	/* for running post-processing code */
+	struct run_context *context;	/* what to clean up (not owned) */
 	struct wire_client *wire_client;	/* for on-the-wire tests */
+	struct perf_counters *perf;	/* cost of each event, or NULL */
+	struct learn *learn;		/* packets sent, for --learn, or NULL */
+	struct perturb *perturb;	/* for --perturb, or NULL */
+	struct recording *recording;	/* --record/--reverify, or NULL
+					 * (not owned)
+					 */
+	int tolerance_usecs[NUM_TIMING_CLASSES];	/* per kind of event,
+							 * from --calibrate
+							 */
 	s64 script_start_time_usecs;	/* time of first event in script */
 	s64 script_last_time_usecs;	/* time of previous event in script */
 	s64 live_start_time_usecs;	/* time of first event in live test */
@@ -112,6 +163,20 @@ extern struct state *state_new(struct config *config,
 /* Free all run-time state for a test. */
 void state_free(struct state *state, int about_to_die);
 
+/* Are we re-verifying the script against a recording, with no kernel? */
+static inline bool is_reverifying(const struct state *state)
+{
+	return (state->recording != NULL) &&
+	       recording_is_replay(state->recording);
+}
+
+/* Clean up after every script that is running, before die() exits:
+ * write their failing result records, with the given error message for
+ * this thread's script, run their cleanup commands, restore their
+ * sysctls, close their sockets, and free their netdevs.
+ */
+extern void run_cleanup_all(const char *message);
+
 /* Grab the global lock for all global state. */
 static inline void run_lock(struct state *state)
 {
@@ -130,7 +195,9 @@ static inline void run_unlock(struct state *state)
 		die_strerror("pthread_mutex_unlock", err);
 }
 
-/* Get the wall clock time of day in microseconds. */
+/* Get the wall clock time of day in microseconds, or the virtual clock
+ * of a recording we are re-verifying the script against.
+ */
 extern s64 now_usecs(void);
 
 /* Convert script time to live wall clock time. */
@@ -155,14 +222,16 @@ static inline s64 live_time_to_script_time_usecs(struct state *state,
  * See if something that happened at the given actual live wall time
  * in microseconds happened reasonably close to the time at which we
  * wanted it to happen in the script. verify_time compares the
- * given script and live times and returns STATUS_OK on success or on
+ * given script and live times, with the tolerance for the given kind
+ * of event, and returns STATUS_OK on success or on
  * failure returns STATUS_ERR and fills in *error using the given
  * description.  The check_event_time variant is a shortcut
  * for the common case: it looks at the current event and on failure
  * it prints the error message to stderr and exits with an error
  * status.  For time ranges the end time is specified in script_usecs_end.
  */
-extern int verify_time(struct state *state, enum event_time_t time_type,
+extern int verify_time(struct state *state, enum timing_class timing,
+		       enum event_time_t time_type,
 		       s64 script_usecs, s64 script_usecs_end,
 		       s64 live_usecs, const char *description, char **error);
 extern void check_event_time(struct state *state, s64 live_usecs);
@@ -179,6 +248,9 @@ extern void adjust_relative_event_times(struct state *state,
  */
 extern void wait_for_event(struct state *state);
 
+/* Sleep and/or spin until the given live time, as we do for events. */
+extern void wait_until_usecs(s64 event_usecs);
+
 /* Advance the interpreter state to the next event. */
 extern int get_next_event(struct state *state, char **error);
 
@@ -188,7 +260,13 @@ extern void set_scheduling_priority(void);
 /* Try to pin our pages into RAM. */
 extern void lock_memory(void);
 
-/* Run final command we always execute at end of script, to clean up. */
+/* Make the given context the one that die() cleans up for this thread. */
+extern void run_set_context(struct run_context *context);
+
+/* Run final command we always execute at end of script, to clean up,
+ * and restore any tunables it changed. Only the first call for a given
+ * run does anything.
+ */
 extern int run_cleanup_command(void);
 
 #endif /* __RUN_H__ */
@@ -43,6 +43,10 @@ void run_command_event(
 	/* Wait for the right time before firing off this event. */
 	wait_for_event(state);
 
+	/* The command acted on the machine, not on the recording. */
+	if (is_reverifying(state))
+		return;
+
 	char *error = NULL;
 	if (safe_system(command->command_line, &error))
 		goto error_out;
@@ -34,6 +34,7 @@
 #include "checksum.h"
 #include "gre.h"
 #include "logging.h"
+#include "mptcp.h"
 #include "netdev.h"
 #include "packet.h"
 #include "packet_checksum.h"
@@ -78,22 +79,68 @@ static u16 ephemeral_port(void)
 	return ntohs(addr.sin_port);
 }
 
-/* Return the next ephemeral port to use. We want quick results for
- * the very common case where there is only one remote port to use
- * over the course of a test. So we avoid paying the overhead of the
- * several system calls in ephemeral_port() right before injecting an
- * incoming SYN by pre-allocating and caching a single port to use
- * before starting each test.
+/* Reserve a pool of unique remote (IP, port) tuples for the test.
+ * Scripts that open many connections would otherwise pay for the
+ * several system calls in ephemeral_port() right before injecting
+ * each incoming SYN. So before starting each test we spread the
+ * requested number of tuples over the addresses in the remote prefix,
+ * starting at live_remote_ip, and only reserve as many ephemeral
+ * ports as we need to cover the tuples that do not fit in the prefix.
+ * The route for the whole remote prefix already points at our
+ * device, so the extra addresses need no further setup. Tuple 0 is
+ * always live_remote_ip and the first reserved port.
  */
-static u16 next_ephemeral_port(struct state *state)
+static void remote_tuples_new(struct packets *packets,
+			      const struct config *config)
 {
-	if (state->packets->next_ephemeral_port >= 0) {
-		int port = state->packets->next_ephemeral_port;
-		assert(port <= 0xffff);
-		state->packets->next_ephemeral_port = -1;
-		return port;
+	const struct ip_address *base = &config->live_remote_ip;
+	int num_tuples = config->remote_tuples;
+	struct ip_address *ips = calloc(num_tuples, sizeof(*ips));
+	u16 *ports = NULL;
+	int num_ips = 0, num_ports = 0, i;
+
+	for (num_ips = 0; num_ips < num_tuples; ++num_ips) {
+		if (ip_prefix_offset_ip(&config->live_remote_prefix, base,
+					num_ips, &ips[num_ips]) != STATUS_OK)
+			break;
+	}
+	if (num_ips == 0) {
+		/* The remote IP is configured outside its own prefix. */
+		ips[0] = *base;
+		num_ips = 1;
+	}
+
+	num_ports = (num_tuples + num_ips - 1) / num_ips;
+	ports = calloc(num_ports, sizeof(*ports));
+	for (i = 0; i < num_ports; ++i)
+		ports[i] = ephemeral_port();
+
+	packets->remote_tuples = calloc(num_tuples, sizeof(struct endpoint));
+	for (i = 0; i < num_tuples; ++i) {
+		packets->remote_tuples[i].ip = ips[i % num_ips];
+		packets->remote_tuples[i].port = htons(ports[i / num_ips]);
+	}
+	packets->num_remote_tuples = num_tuples;
+	packets->next_remote_tuple = 0;
+
+	free(ports);
+	free(ips);
+}
+
+/* Return the next remote tuple to use. We want quick results for the
+ * common case, so we hand out tuples from the pool reserved before
+ * the test started. Only if the pool runs dry do we fall back to
+ * allocating a fresh port for live_remote_ip on demand.
+ */
+static void next_remote_tuple(struct state *state, struct endpoint *remote)
+{
+	struct packets *packets = state->packets;	/* shortcut */
+
+	if (packets->next_remote_tuple < packets->num_remote_tuples) {
+		*remote = packets->remote_tuples[packets->next_remote_tuple++];
 	} else {
-		return ephemeral_port();
+		remote->ip = state->config->live_remote_ip;
+		remote->port = htons(ephemeral_port());
 	}
 }
 
@@ -140,34 +187,58 @@ static void verbose_packet_dump(struct state *state, const char *type,
 	}
 }
 
-/* See if the live packet matches the live 4-tuple of the socket under test. */
-static struct socket *find_socket_for_live_packet(
-	struct state *state, const struct packet *packet,
-	enum direction_t *direction)
+/* See if the packet tuple matches the live 4-tuple of the given socket. */
+static bool is_live_packet_for_socket(struct socket *socket,
+				      const struct tuple *packet_tuple,
+				      enum direction_t *direction)
 {
-	struct socket *socket = state->socket_under_test;	/* shortcut */
-
-	DEBUGP("find_connect_for_live_packet\n");
-	if (socket == NULL)
-		return NULL;
+	struct tuple live_outbound, live_inbound;
 
-	struct tuple packet_tuple, live_outbound, live_inbound;
-	get_packet_tuple(packet, &packet_tuple);
-	/* Is packet inbound to the socket under test? */
+	/* Is packet inbound to the socket? */
 	socket_get_inbound(&socket->live, &live_inbound);
-	if (is_equal_tuple(&packet_tuple, &live_inbound)) {
+	if (is_equal_tuple(packet_tuple, &live_inbound)) {
 		*direction = DIRECTION_INBOUND;
 		DEBUGP("inbound live packet, socket in state %d\n",
 		       socket->state);
-		return socket;
+		return true;
 	}
-	/* Is packet outbound from the socket under test? */
+	/* Is packet outbound from the socket? */
 	socket_get_outbound(&socket->live, &live_outbound);
-	if (is_equal_tuple(&packet_tuple, &live_outbound)) {
+	if (is_equal_tuple(packet_tuple, &live_outbound)) {
 		*direction = DIRECTION_OUTBOUND;
 		DEBUGP("outbound live packet, socket in state %d\n",
 		       socket->state);
+		return true;
+	}
+	return false;
+}
+
+/* See if the live packet matches the live 4-tuple of the socket under
+ * test, or of one of its MPTCP subflows.
+ */
+static struct socket *find_socket_for_live_packet(
+	struct state *state, const struct packet *packet,
+	enum direction_t *direction)
+{
+	struct socket *socket = state->socket_under_test;	/* shortcut */
+	struct socket *subflow = NULL;
+
+	DEBUGP("find_connect_for_live_packet\n");
+	if (socket == NULL)
+		return NULL;
+
+	struct tuple packet_tuple;
+	get_packet_tuple(packet, &packet_tuple);
+	if (is_live_packet_for_socket(socket, &packet_tuple, direction))
 		return socket;
+	if (socket->mptcp == NULL)
+		return NULL;
+	for (subflow = state->sockets; subflow != NULL;
+	     subflow = subflow->next) {
+		if ((subflow->mptcp_master == socket) &&
+		    is_live_packet_for_socket(subflow, &packet_tuple,
+					      direction))
+			return subflow;
 	}
 	return NULL;
 }
@@ -199,8 +270,7 @@ static struct socket *setup_new_child_socket(struct state *state, const struct p
 	/* Set up the live info for this socket based
 	 * on the script packet and our overall config.
 	 */
-	socket->live.remote.ip		= config->live_remote_ip;
-	socket->live.remote.port	= htons(next_ephemeral_port(state));
+	next_remote_tuple(state, &socket->live.remote);
 	socket->live.local.ip		= config->live_local_ip;
 	socket->live.local.port		= htons(config->live_bind_port);
 	socket->live.fd			= -1;
@@ -513,6 +583,40 @@ static struct socket *find_connect_for_live_packet(
 	return socket;
 }
 
+/* Look for an MPTCP subflow that the script expects the kernel to open,
+ * and that would emit this outgoing live SYN. If found, bind the
+ * subflow to the live 4-tuple and ISN of the SYN.
+ */
+static struct socket *find_mptcp_join_for_live_packet(
+	struct state *state, struct packet *packet,
+	enum direction_t *direction)
+{
+	struct socket *socket = NULL;
+	struct tuple tuple;
+
+	DEBUGP("find_mptcp_join_for_live_packet\n");
+	*direction = DIRECTION_INVALID;
+	if (!packet->tcp || !packet->tcp->syn || packet->tcp->ack)
+		return NULL;
+
+	for (socket = state->sockets; socket != NULL; socket = socket->next) {
+		if ((socket->mptcp_master == state->socket_under_test) &&
+		    (socket->mptcp_master != NULL) &&
+		    (socket->state == SOCKET_ACTIVE_SYN_SENT) &&
+		    (socket->live.local.port == 0))
+			break;
+	}
+	if (socket == NULL)
+		return NULL;
+
+	get_packet_tuple(packet, &tuple);
+	*direction = DIRECTION_OUTBOUND;
+	socket->live.local	= tuple.src;
+	socket->live.remote	= tuple.dst;
+	socket->live.local_isn	= ntohl(packet->tcp->seq);
+	return socket;
+}
+
 /* Convert outbound TCP timestamp value from scripted value to live value. */
 static int get_outbound_ts_val_mapping(
 	struct socket *socket, u32 script_timestamp, u32 *live_timestamp)
@@ -564,6 +668,17 @@ static int find_tcp_timestamp(struct packet *packet, char **error)
 	return *error ? STATUS_ERR : STATUS_OK;
 }
 
+/* Return true iff the socket is using MPTCP, setting up the MPTCP state
+ * for the connection when the given packet is the first to carry MPTCP
+ * options.
+ */
+static bool socket_has_mptcp(struct socket *socket, struct packet *packet)
+{
+	if (socket->mptcp == NULL && packet_has_mptcp_option(packet))
+		socket->mptcp = mptcp_state_new();
+	return socket->mptcp != NULL;
+}
+
 /* A helper to help translate SACK sequence numbers between live and
  * script space. Specifically, it offsets SACK block sequence numbers
  * by the given 'ack_offset'. Returns STATUS_OK on success; on
@@ -1003,6 +1118,12 @@ static int map_inbound_packet(
 	if (offset_sack_blocks(live_packet, ack_offset, error))
 		return STATUS_ERR;
 
+	/* Remap MPTCP keys, tokens, HMACs and data sequence numbers. */
+	if (socket_has_mptcp(socket, live_packet) &&
+	    mptcp_map_inbound_packet(socket->mptcp, socket->mptcp_subflow,
+				     live_packet, error))
+		return STATUS_ERR;
+
 	/* Find the timestamp echo reply is, so we can remap that below. */
 	if (find_tcp_timestamp(live_packet, error))
 		return STATUS_ERR;
@@ -1262,6 +1383,12 @@ static int map_outbound_live_packet(
 	if (offset_sack_blocks(actual_packet, ack_offset, error))
 		return STATUS_ERR;
 
+	/* Rewrite MPTCP option values from live to script space. */
+	if (socket_has_mptcp(socket, actual_packet) &&
+	    mptcp_map_outbound_packet(socket->mptcp, socket->mptcp_subflow,
+				      actual_packet, script_packet, error))
+		return STATUS_ERR;
+
 	/* Extract location of script and actual TCP timestamp values. */
 	if (find_tcp_timestamp(script_packet, error))
 		return STATUS_ERR;
@@ -1285,6 +1412,13 @@ static int map_outbound_live_packet(
 			socket->first_script_ts_val = script_ts_val;
 			socket->first_actual_ts_val = actual_ts_val;
 		}
+	}
+	/* Even when the script packet leaves out its TCP options, show
+	 * the actual TS val in script space once we have a baseline.
+	 */
+	if ((actual_packet->tcp_ts_val != NULL) &&
+	    socket->found_first_tcp_ts) {
+		u32 actual_ts_val = packet_tcp_ts_val(actual_packet);
 
 		/* Rewrite TCP timestamp value to script space, so we
 		 * can compare the script and actual outbound TCP
@@ -2790,13 +2924,93 @@ static int verify_header(
 	return verifier(actual_packet, script_packet, layer, udp_encaps, error);
 }
 
+/* Return the number of outer (encapsulation) header layers in front of
+ * the innermost IP header of the given packet.
+ */
+static int packet_outer_layers(const struct packet *packet)
+{
+	const u8 *ip = (packet->ipv4 != NULL) ?
+		(const u8 *)packet->ipv4 : (const u8 *)packet->ipv6;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(packet->headers); ++i) {
+		if (packet->headers[i].type == HEADER_NONE ||
+		    packet->headers[i].h.ptr == ip)
+			break;
+	}
+	return i;
+}
+
+/* Copy the given number of outer header layers of the packet into
+ * template, zeroing the fields that change from packet to packet:
+ * lengths, checksums, IPv4 IDs, and GRE sequence numbers. Outer lengths
+ * follow from the inner ones, which are still verified for every
+ * packet. Return the number of bytes copied, or -1 if there are too
+ * many.
+ */
+static int outer_headers_template(const struct packet *packet,
+				  int outer_layers, u8 *template)
+{
+	const u8 *start = packet->headers[0].h.ptr;
+	const int bytes = packet->headers[outer_layers].h.ptr - start;
+	int i;
+
+	if (bytes > PACKET_MAX_HEADER_BYTES)
+		return -1;
+	memcpy(template, start, bytes);
+
+	for (i = 0; i < outer_layers; ++i) {
+		const struct header *header = &packet->headers[i];
+		u8 *h = template + (header->h.ptr - start);
+
+		switch (header->type) {
+		case HEADER_IPV4: {
+			struct ipv4 *ipv4 = (struct ipv4 *)h;
+
+			ipv4->tot_len = 0;
+			ipv4->id = 0;
+			ipv4->check = 0;
+			break;
+		}
+		case HEADER_IPV6:
+			((struct ipv6 *)h)->payload_len = 0;
+			break;
+		case HEADER_UDP: {
+			struct udp *udp = (struct udp *)h;
+
+			udp->len = 0;
+			udp->check = 0;
+			break;
+		}
+		case HEADER_GRE: {
+			const struct gre *gre = header->h.gre;
+			u8 *word = h + sizeof(struct gre);
+
+			if (gre->has_checksum)
+				memset(word, 0, 4);
+			if (gre->has_seq)
+				memset(h + gre_len(gre) - 4, 0, 4);
+			break;
+		}
+		default:
+			break;
+		}
+	}
+	return bytes;
+}
+
 /* Verify that required actual header fields are as the script expected. */
 static int verify_outbound_live_headers(
+	struct socket *socket,
 	const struct packet *actual_packet,
 	const struct packet *script_packet, u8 udp_encaps, char **error)
 {
 	const int actual_headers = packet_header_count(actual_packet);
 	const int script_headers = packet_header_count(script_packet);
+	const int outer_layers = packet_outer_layers(script_packet);
+	u8 script_template[PACKET_MAX_HEADER_BYTES];
+	u8 actual_template[PACKET_MAX_HEADER_BYTES];
+	int template_bytes = -1;
 	int i;
 
 	DEBUGP("verify_outbound_live_headers\n");
@@ -2814,8 +3028,33 @@ static int verify_outbound_live_headers(
 		return STATUS_ERR;
 	}
 
+	/* If the outer headers match those of the last packet of this flow
+	 * that verified, there is no need to check them field by field.
+	 */
+	i = 0;
+	if ((outer_layers > 0) &&
+	    (packet_outer_layers(actual_packet) == outer_layers)) {
+		template_bytes = outer_headers_template(
+			script_packet, outer_layers, script_template);
+		if ((template_bytes > 0) &&
+		    (outer_headers_template(actual_packet, outer_layers,
+					    actual_template) !=
+		     template_bytes))
+			template_bytes = -1;
+		if ((template_bytes > 0) &&
+		    (template_bytes == socket->outer_template_bytes) &&
+		    (script_packet->ecn == socket->outer_template_ecn) &&
+		    !memcmp(script_template, socket->outer_script_template,
+			    template_bytes) &&
+		    !memcmp(actual_template, socket->outer_actual_template,
+			    template_bytes)) {
+			DEBUGP("outer headers match flow template\n");
+			i = outer_layers;
+		}
+	}
+
 	/* Compare actual vs script headers, layer by layer. */
-	for (i = 0; i < ARRAY_SIZE(script_packet->headers); ++i) {
+	for (; i < ARRAY_SIZE(script_packet->headers); ++i) {
 		if (script_packet->headers[i].type == HEADER_NONE)
 			break;
 
@@ -2824,6 +3063,15 @@ static int verify_outbound_live_headers(
 			return STATUS_ERR;
 	}
 
+	if (template_bytes > 0) {
+		memcpy(socket->outer_script_template, script_template,
+		       template_bytes);
+		memcpy(socket->outer_actual_template, actual_template,
+		       template_bytes);
+		socket->outer_template_bytes = template_bytes;
+		socket->outer_template_ecn = script_packet->ecn;
+	}
+
 	return STATUS_OK;
 }
 
@@ -2907,6 +3155,38 @@ static int verify_outbound_live_payload(
 	return STATUS_OK;
 }
 
+/* Verify that the actual packet came in the IP fragments the script
+ * expected, if it said.
+ */
+static int verify_outbound_live_fragments(
+	const struct packet *actual_packet,
+	const struct packet *script_packet, char **error)
+{
+	int i;
+
+	if (script_packet->num_fragments == 0)
+		return STATUS_OK;
+
+	if (check_field("ip_fragments",
+			script_packet->num_fragments,
+			actual_packet->num_fragments, error))
+		return STATUS_ERR;
+
+	for (i = 0; i < script_packet->num_fragments; ++i) {
+		if (script_packet->fragment_bytes[i] == 0)
+			continue;
+		if (script_packet->fragment_bytes[i] !=
+		    actual_packet->fragment_bytes[i]) {
+			asprintf(error, "live packet IP fragment %d: "
+				 "expected: %u bytes vs actual: %u bytes", i,
+				 script_packet->fragment_bytes[i],
+				 actual_packet->fragment_bytes[i]);
+			return STATUS_ERR;
+		}
+	}
+	return STATUS_OK;
+}
+
 /* Verify that the outbound packet correctly matches the expected
  * outbound packet from the script.
  * Return STATUS_OK upon success.  If non_fatal_packet is unset in the
@@ -2943,13 +3223,29 @@ static int verify_outbound_live_packet(
 		    state->config->udp_encaps, error))
 		goto out;
 
+	/* In learn mode the script packet is only a placeholder. */
+	if (state->learn != NULL) {
+		learn_outbound_packet(state->learn, state->event,
+				      script_packet, actual_packet,
+				      actual_usecs);
+		packet_free(actual_packet);
+		return STATUS_OK;
+	}
+
 	/* Verify actual IP, TCP/UDP header values matched expected ones. */
-	if (verify_outbound_live_headers(actual_packet, script_packet,
+	if (verify_outbound_live_headers(socket, actual_packet, script_packet,
 					 state->config->udp_encaps, error)) {
 		non_fatal = true;
 		goto out;
 	}
 
+	/* Verify the IP fragments the datagram was reassembled from. */
+	if (verify_outbound_live_fragments(actual_packet, script_packet,
+					   error)) {
+		non_fatal = true;
+		goto out;
+	}
+
 	if (script_packet->tcp) {
 		/* Verify TCP options matched expected values. */
 		if (verify_outbound_live_tcp_options(
@@ -2968,7 +3264,7 @@ static int verify_outbound_live_packet(
 
 	/* Verify that kernel sent packet at the time the script expected. */
 	DEBUGP("packet time_usecs: %lld\n", live_packet->time_usecs);
-	if (verify_time(state, time_type, script_usecs,
+	if (verify_time(state, TIMING_OUTBOUND, time_type, script_usecs,
 				script_usecs_end, live_packet->time_usecs,
 				"outbound packet", error)) {
 		non_fatal = true;
@@ -2993,6 +3289,56 @@ out:
 	return result;
 }
 
+/* Return true iff an outbound live packet of the given flow could be
+ * accepted by sniff_outbound_live_packet(): one that is from the
+ * socket under test or one of its MPTCP subflows, that is from a
+ * pending connect(), or that is a SYN opening a pending MPTCP subflow.
+ * This only looks at addresses, ports, and the SYN flag, so it runs
+ * before the packet is fully parsed.
+ */
+static bool is_outbound_live_flow_of_interest(void *arg,
+					      const struct packet_flow *flow)
+{
+	struct state *state = arg;
+	struct socket *socket = state->socket_under_test;	/* shortcut */
+	struct socket *subflow = NULL;
+	struct tuple tuple, live_outbound;
+
+	if (socket == NULL)
+		return false;
+
+	memset(&tuple, 0, sizeof(tuple));
+	tuple.src.ip	= flow->src_ip;
+	tuple.dst.ip	= flow->dst_ip;
+	tuple.src.port	= flow->src_port;
+	tuple.dst.port	= flow->dst_port;
+
+	socket_get_outbound(&socket->live, &live_outbound);
+	if (is_equal_tuple(&tuple, &live_outbound))
+		return true;
+
+	if (((socket->state == SOCKET_ACTIVE_INIT_SENT) ||
+	     (socket->state == SOCKET_ACTIVE_SYN_SENT) ||
+	     (socket->state == SOCKET_ACTIVE_CONNECTING)) &&
+	    is_equal_ip(&tuple.dst.ip, &socket->live.remote.ip) &&
+	    is_equal_port(tuple.dst.port, socket->live.remote.port))
+		return true;
+
+	for (subflow = state->sockets; subflow != NULL;
+	     subflow = subflow->next) {
+		if (subflow->mptcp_master != socket)
+			continue;
+		socket_get_outbound(&subflow->live, &live_outbound);
+		if (is_equal_tuple(&tuple, &live_outbound))
+			return true;
+		if (flow->is_tcp_syn &&
+		    (subflow->state == SOCKET_ACTIVE_SYN_SENT) &&
+		    (subflow->live.local.port == 0))
+			return true;
+	}
+	return false;
+}
+
 /* Sniff the next outbound live packet and return it. */
 static int sniff_outbound_live_packet(
 	struct state *state, struct socket *expected_socket,
@@ -3001,10 +3347,14 @@ static int sniff_outbound_live_packet(
 	DEBUGP("sniff_outbound_live_packet\n");
 	struct socket *socket = NULL;
 	enum direction_t direction = DIRECTION_INVALID;
+	const struct packet_filter filter = {
+		.match = is_outbound_live_flow_of_interest,
+		.arg = state,
+	};
 	assert(*packet == NULL);
 	while (1) {
 		if (netdev_receive(state->netdev, state->config->udp_encaps,
-				   packet, error))
+				   &filter, packet, error))
 			return STATUS_ERR;
 		/* See if the packet matches an existing, known socket. */
 		socket = find_socket_for_live_packet(state, *packet,
@@ -3016,6 +3366,11 @@ static int sniff_outbound_live_packet(
 						      &direction);
 		if ((socket != NULL) && (direction == DIRECTION_OUTBOUND))
 			break;
+		/* See if the packet opens an expected MPTCP subflow. */
+		socket = find_mptcp_join_for_live_packet(state, *packet,
+							 &direction);
+		if ((socket != NULL) && (direction == DIRECTION_OUTBOUND))
+			break;
 		packet_free(*packet);
 		*packet = NULL;
 	}
@@ -3050,6 +3405,96 @@ static bool is_script_packet_match_for_socket(
 	return false;
 }
 
+/* Return the socket for the given MPTCP subflow of the given socket,
+ * or NULL if the script has not opened that subflow yet.
+ */
+static struct socket *find_mptcp_subflow(struct state *state,
+					 struct socket *master, u8 subflow)
+{
+	struct socket *socket = NULL;
+
+	for (socket = state->sockets; socket != NULL; socket = socket->next) {
+		if ((socket->mptcp_master == master) &&
+		    (socket->mptcp_subflow == subflow))
+			return socket;
+	}
+	return NULL;
+}
+
+/* Create a socket object for a new MPTCP subflow of the socket under
+ * test, opened by the given script SYN. The subflow shares the script
+ * 4-tuple of the initial subflow, but gets its own live 4-tuple: for
+ * inbound SYNs we pick a fresh remote tuple, and for outbound SYNs we
+ * learn the live tuple from the SYN the kernel sends.
+ */
+static struct socket *handle_mptcp_join_for_script_packet(
+	struct state *state, const struct packet *packet,
+	enum direction_t direction)
+{
+	struct socket *master = state->socket_under_test;	/* shortcut */
+	struct socket *socket = NULL;
+
+	DEBUGP("handle_mptcp_join_for_script_packet\n");
+	if (!packet->tcp->syn || packet->tcp->ack)
+		return NULL;
+
+	if (master->mptcp == NULL)
+		master->mptcp = mptcp_state_new();
+
+	socket = socket_new(state);
+	socket->address_family	= master->address_family;
+	socket->protocol	= master->protocol;
+	socket->mptcp		= master->mptcp;
+	socket->mptcp_master	= master;
+	socket->mptcp_subflow	= packet->mptcp_subflow;
+
+	socket->script.local	= master->script.local;
+	socket->script.remote	= master->script.remote;
+	socket->script.fd	= -1;
+	socket->live.fd		= -1;
+
+	if (direction == DIRECTION_INBOUND) {
+		socket->state = SOCKET_PASSIVE_PACKET_RECEIVED;
+		socket->live.local = master->live.local;
+		next_remote_tuple(state, &socket->live.remote);
+		socket->script.remote_isn = ntohl(packet->tcp->seq);
+		socket->live.remote_isn = ntohl(packet->tcp->seq);
+	} else {
+		socket->state = SOCKET_ACTIVE_SYN_SENT;
+		socket->script.local_isn = ntohl(packet->tcp->seq);
+	}
+	return socket;
+}
+
+/* Find or create the socket object for a script packet on an MPTCP
+ * subflow other than the initial one.
+ */
+static int find_or_create_mptcp_subflow_for_script_packet(
+	struct state *state, struct packet *packet,
+	enum direction_t direction, struct socket **socket,
+	char **error)
+{
+	struct socket *master = state->socket_under_test;	/* shortcut */
+
+	if ((packet->tcp == NULL) || (master == NULL) ||
+	    (master->protocol != IPPROTO_TCP)) {
+		asprintf(error, "no MPTCP connection for subflow %u packet",
+			 packet->mptcp_subflow);
+		return STATUS_ERR;
+	}
+
+	*socket = find_mptcp_subflow(state, master, packet->mptcp_subflow);
+	if (*socket == NULL)
+		*socket = handle_mptcp_join_for_script_packet(state, packet,
+							      direction);
+	if (*socket == NULL) {
+		asprintf(error, "MPTCP subflow %u must start with a SYN",
+			 packet->mptcp_subflow);
+		return STATUS_ERR;
+	}
+	return STATUS_OK;
+}
+
 /* Find or create a socket object matching the given packet. */
 static int find_or_create_socket_for_script_packet(
 	struct state *state, struct packet *packet,
@@ -3060,6 +3505,10 @@ static int find_or_create_socket_for_script_packet(
 
 	DEBUGP("find_or_create_socket_for_script_packet\n");
 
+	if (packet->mptcp_subflow != 0)
+		return find_or_create_mptcp_subflow_for_script_packet(
+			state, packet, direction, socket, error);
+
 	if ((packet->tcp != NULL) || (packet->sctp != NULL)) {
 		/* Is this an inbound packet matching a listening
 		 * socket? If so, this call will create a new child
@@ -3146,6 +3595,10 @@ static int do_outbound_script_packet(
 	if (sniff_outbound_live_packet(state, socket, &live_packet, error))
 		goto out;
 
+	ecn_mark_outbound_packet(&state->packets->outbound_ecn_queue,
+				 &socket->ecn_marks, live_packet,
+				 state->event->time_usecs);
+
 	if (packet->tcp) {
 		if ((socket->state == SOCKET_PASSIVE_PACKET_RECEIVED) &&
 		    packet->tcp->syn && packet->tcp->ack) {
@@ -3315,10 +3768,13 @@ static int send_live_ip_packet(struct netdev *netdev,
 	return netdev_send(netdev, packet);
 }
 
-/* Perform the action implied by an inbound packet in a script */
-static int do_inbound_script_packet(
+/* Perform the action implied by an inbound packet in a script, and
+ * build the live packet to inject, without checksums.
+ */
+static int prepare_inbound_script_packet(
 	struct state *state, struct packet *packet,
-	struct socket *socket,	char **error)
+	struct socket *socket, struct packet **live_packet_out,
+	char **error)
 {
 	struct _sctp_init_ack_chunk *init_ack;
 	struct sctp_chunk_list_item *item;
@@ -3472,6 +3928,11 @@ static int do_inbound_script_packet(
 			       error))
 		goto out;
 
+	/* Apply the emulated bottleneck's CE marks and their feedback. */
+	ecn_mark_inbound_packet(&state->packets->inbound_ecn_queue,
+				live_packet, state->event->time_usecs);
+	ecn_marks_to_inbound_ack(&socket->ecn_marks, live_packet);
+
 	verbose_packet_dump(state, "inbound injected", live_packet,
 			    live_time_to_script_time_usecs(
 				    state, now_usecs()));
@@ -3510,14 +3971,82 @@ static int do_inbound_script_packet(
 			set_packet_tuple(live_packet, &live_inbound, state->config->udp_encaps != 0);
 	}
 
-	/* Inject live packet into kernel. */
-	result = send_live_ip_packet(state->netdev, live_packet);
+	*live_packet_out = live_packet;
+	return STATUS_OK;
 
 out:
 	packet_free(live_packet);
 	return result;
 }
 
+/* Inject the given checksummed inbound packets as --perturb decides. */
+static int send_perturbed_packets(struct state *state,
+				  struct packet **packets, int num_packets)
+{
+	struct packet **to_send = NULL;
+	int num_to_send, result = STATUS_OK;
+
+	num_to_send = perturb_inbound_packets(state->perturb, packets,
+					      num_packets, &to_send);
+	if (num_to_send > 0)
+		result = netdev_send_burst(state->netdev, to_send,
+					   num_to_send);
+	perturb_inbound_done(state->perturb);
+	return result;
+}
+
+/* Perform the action implied by an inbound packet in a script */
+static int do_inbound_script_packet(
+	struct state *state, struct packet *packet,
+	struct socket *socket,	char **error)
+{
+	struct packet *live_packet = NULL;
+	struct perf_values perf_start;
+	int result = STATUS_ERR;
+
+	if (prepare_inbound_script_packet(state, packet, socket,
+					  &live_packet, error))
+		return STATUS_ERR;
+
+	/* Inject live packet into kernel. */
+	perf_event_begin(state->perf, &perf_start);
+	if (state->perturb != NULL) {
+		checksum_packet(live_packet);
+		result = send_perturbed_packets(state, &live_packet, 1);
+	} else {
+		result = send_live_ip_packet(state->netdev, live_packet);
+	}
+	perf_event_end(state->perf, state->event->line_number, &perf_start);
+
+	packet_free(live_packet);
+	return result;
+}
+
+int prepare_inbound_packet_event(
+	struct state *state, struct event *event, struct packet *packet,
+	struct packet **live_packet, char **error)
+{
+	char *err = NULL;
+	struct socket *socket = NULL;
+
+	DEBUGP("%d: prepare inbound packet\n", event->line_number);
+	assert(packet_direction(packet) == DIRECTION_INBOUND);
+
+	if (find_or_create_socket_for_script_packet(
+		    state, packet, DIRECTION_INBOUND, &socket, &err) ||
+	    prepare_inbound_script_packet(state, packet, socket,
+					  live_packet, &err)) {
+		asprintf(error, "%s:%d: error handling packet: %s\n",
+			 state->config->script_path, event->line_number, err);
+		free(err);
+		return STATUS_ERR;
+	}
+
+	/* Fill in layer 3 and layer 4 checksums */
+	checksum_packet(*live_packet);
+	return STATUS_OK;
+}
+
 int run_packet_event(
 	struct state *state, struct event *event, struct packet *packet,
 	char **error)
@@ -3566,6 +4095,110 @@ out:
 	return result;
 }
 
+/* Is the given event an inbound packet that the script wants injected at
+ * the same time as the inbound packet event 'first'?
+ */
+static bool is_same_time_inbound_packet(const struct event *first,
+					const struct event *event)
+{
+	if ((event == NULL) || (event->type != PACKET_EVENT) ||
+	    (packet_direction(event->event.packet) != DIRECTION_INBOUND))
+		return false;
+	if (event->time_type == RELATIVE_TIME)
+		return event->time_usecs == 0;
+	return (first->time_type == ABSOLUTE_TIME) &&
+	       (event->time_type == ABSOLUTE_TIME) &&
+	       (event->time_usecs == first->time_usecs);
+}
+
+int inbound_burst_length(const struct event *first)
+{
+	const struct event *event = NULL;
+	int num_packets = 1;
+
+	if ((packet_direction(first->event.packet) != DIRECTION_INBOUND) ||
+	    ((first->time_type != ABSOLUTE_TIME) &&
+	     (first->time_type != RELATIVE_TIME)))
+		return 1;
+	for (event = first->next; is_same_time_inbound_packet(first, event);
+	     event = event->next)
+		++num_packets;
+	return num_packets;
+}
+
+/* Running the packets of a burst one at a time would leave each packet
+ * waiting for the full event cycle of the one before, so the last packet
+ * of a long burst would land well after the first. Instead we build and
+ * checksum them all up front, then hand them to the netdev as one batch
+ * at the burst's time, and check each packet's time against when the
+ * batch went out. The spread of the burst is printed with --verbose.
+ */
+int run_inbound_packet_burst(struct state *state, int num_packets,
+			     char **error)
+{
+	struct event **events = calloc(num_packets, sizeof(struct event *));
+	struct packet **live_packets =
+		calloc(num_packets, sizeof(struct packet *));
+	struct perf_values perf_start;
+	s64 start_usecs, end_usecs;
+	int result = STATUS_ERR;
+	int i;
+
+	for (i = 0; i < num_packets; ++i) {
+		if (i > 0) {
+			if (get_next_event(state, error))
+				goto out;
+			/* A +0 packet is due at the same time as the first. */
+			if (state->event->time_type == RELATIVE_TIME) {
+				state->event->time_usecs = events[0]->time_usecs;
+				state->event->offset_usecs =
+					events[0]->offset_usecs;
+			}
+		}
+		events[i] = state->event;
+		if (prepare_inbound_packet_event(state, events[i],
+						 events[i]->event.packet,
+						 &live_packets[i], error))
+			goto out;
+	}
+
+	state->event = events[0];
+	wait_for_event(state);
+	start_usecs = now_usecs();
+	/* The kernel's cost for the whole burst goes to its first line. */
+	perf_event_begin(state->perf, &perf_start);
+	if ((state->perturb != NULL) ?
+	    send_perturbed_packets(state, live_packets, num_packets) :
+	    netdev_send_burst(state->netdev, live_packets, num_packets)) {
+		asprintf(error, "%s:%d: error injecting packets\n",
+			 state->config->script_path, events[0]->line_number);
+		goto out;
+	}
+	perf_event_end(state->perf, events[0]->line_number, &perf_start);
+	end_usecs = now_usecs();
+
+	for (i = 1; i < num_packets; ++i) {
+		state->event = events[i];
+		check_event_time(state, end_usecs);
+	}
+	state->event = events[num_packets - 1];
+
+	if (state->config->verbose) {
+		printf("inbound burst of %d packets: %lld usecs\n",
+		       num_packets, end_usecs - start_usecs);
+	}
+	result = STATUS_OK;
+
+out:
+	for (i = 0; i < num_packets; ++i) {
+		if (live_packets[i] != NULL)
+			packet_free(live_packets[i]);
+	}
+	free(live_packets);
+	free(events);
+	return result;
+}
+
 /* Inject a TCP RST packet to clear the connection state out of the
  * kernel, so the connection does not continue to retransmit packets
  * that may be sniffed during later test executions and cause false
@@ -3699,17 +4332,20 @@ int abort_association(struct state *state, struct socket *socket)
 	return result;
 }
 
-struct packets *packets_new(void)
+struct packets *packets_new(const struct config *config)
 {
 	struct packets *packets = calloc(1, sizeof(struct packets));
 
-	packets->next_ephemeral_port = ephemeral_port();  /* cache a port */
+	remote_tuples_new(packets, config);
+	ecn_queue_init(&packets->inbound_ecn_queue, &config->ecn_marking);
+	ecn_queue_init(&packets->outbound_ecn_queue, &config->ecn_marking);
 
 	return packets;
 }
 
 void packets_free(struct packets *packets)
 {
+	free(packets->remote_tuples);
 	memset(packets, 0, sizeof(*packets));  /* to help catch bugs */
 	free(packets);
 }
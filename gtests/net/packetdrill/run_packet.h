@@ -27,8 +27,11 @@
 
 #include "types.h"
 
+#include "ecn_marking.h"
 #include "script.h"
 
+struct config;
+struct endpoint;
 struct event;
 struct packet;
 struct socket;
@@ -36,11 +39,18 @@ struct state;
 
 /* Internal state for the packet-handling module. */
 struct packets {
-	int next_ephemeral_port;	/* cached port to use, or -1 */
+	/* Pool of remote (IP, port) tuples reserved before the test. */
+	struct endpoint *remote_tuples;	/* array of pre-allocated tuples */
+	int num_remote_tuples;		/* number of tuples in the array */
+	int next_remote_tuple;		/* index of next tuple to hand out */
+
+	/* Emulated ECN bottleneck queues, shared by all connections. */
+	struct ecn_queue inbound_ecn_queue;
+	struct ecn_queue outbound_ecn_queue;
 };
 
 /* Allocate and return internal state for the packets module. */
-extern struct packets *packets_new(void);
+extern struct packets *packets_new(const struct config *config);
 
 /* Tear down packets module state and free up the resources it has allocated. */
 extern void packets_free(struct packets *packets);
@@ -54,6 +64,35 @@ extern int run_packet_event(struct state *state,
 			    struct packet *packet,
 			    char **error);
 
+/* Do everything for an inbound packet event except inject it: map the
+ * script packet to its live connection and return the live packet, with
+ * checksums filled in, in *live_packet. This lets a burst of inbound
+ * packets be built up front and injected back to back. On success,
+ * return STATUS_OK; on error return STATUS_ERR and fill in a
+ * malloc-allocated error message in *error.
+ */
+extern int prepare_inbound_packet_event(struct state *state,
+					struct event *event,
+					struct packet *packet,
+					struct packet **live_packet,
+					char **error);
+
+/* Return the number of inbound packet events, starting with the given
+ * packet event, that the script wants injected at the same time: at the
+ * same absolute time, or at +0 after the first. Returns 1 for outbound
+ * packets.
+ */
+extern int inbound_burst_length(const struct event *first);
+
+/* Run a burst of num_packets inbound packet events, starting with the
+ * current event, that are all due at the same time. Leaves the last of
+ * them as the current event. On success, return STATUS_OK; on error
+ * return STATUS_ERR and fill in a malloc-allocated error message in
+ * *error.
+ */
+extern int run_inbound_packet_burst(struct state *state, int num_packets,
+				    char **error);
+
 /* Inject a TCP RST packet to clear the connection state out of the kernel. */
 extern int reset_connection(struct state *state,
 			    struct socket *socket);
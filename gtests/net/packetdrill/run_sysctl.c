@@ -0,0 +1,279 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for a module to set kernel tunables from a test script.
+ */
+
+#include "run_sysctl.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "logging.h"
+#include "run.h"
+#include "script.h"
+
+#ifdef linux
+
+/* The old value of a tunable the script changed. */
+struct saved_sysctl {
+	char *path;			/* file below /proc/sys (owned) */
+	char *value;			/* value before the script ran (owned) */
+	struct saved_sysctl *next;	/* next older saved tunable */
+};
+
+/* Map a tunable name to its file below /proc/sys. Names with a slash are
+ * taken as paths, so any dots in them (as in VLAN device names) are kept.
+ * Returns a malloc-ed path, or NULL and fills in *error.
+ */
+static char *sysctl_path(const char *name, char **error)
+{
+	char *path = NULL, *p = NULL;
+	const char *component = NULL;
+	const bool is_path = (strchr(name, '/') != NULL);
+
+	if ((name[0] == '\0') || (name[0] == '/') || (name[0] == '.')) {
+		asprintf(error, "bad sysctl name '%s'", name);
+		return NULL;
+	}
+	/* Do not let a script escape /proc/sys. */
+	component = name;
+	while (component != NULL) {
+		if ((strncmp(component, "..", 2) == 0) &&
+		    ((component[2] == '/') || (component[2] == '\0'))) {
+			asprintf(error, "bad sysctl name '%s'", name);
+			return NULL;
+		}
+		component = strchr(component, '/');
+		if (component != NULL)
+			++component;
+	}
+
+	asprintf(&path, "/proc/sys/%s", name);
+	if (!is_path) {
+		for (p = path + strlen("/proc/sys/"); *p != '\0'; ++p) {
+			if (*p == '.')
+				*p = '/';
+		}
+	}
+	return path;
+}
+
+/* Read the current value of the tunable at the given path, without any
+ * trailing newline. Returns a malloc-ed value, or NULL and sets errno,
+ * to EFBIG if the value does not fit in SYSCTL_MAX_VALUE_BYTES, since
+ * we could not put back a value we only read part of.
+ */
+static char *sysctl_read_path(const char *path)
+{
+	char buf[SYSCTL_MAX_VALUE_BYTES];
+	int fd, bytes, total = 0;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	while (total < sizeof(buf)) {
+		bytes = read(fd, buf + total, sizeof(buf) - total);
+		if (bytes < 0) {
+			const int saved_errno = errno;
+
+			close(fd);
+			errno = saved_errno;
+			return NULL;
+		}
+		if (bytes == 0)
+			break;
+		total += bytes;
+	}
+	close(fd);
+
+	/* No room left for the terminating NUL, so the value is too long. */
+	if (total == sizeof(buf)) {
+		errno = EFBIG;
+		return NULL;
+	}
+
+	while ((total > 0) && (buf[total - 1] == '\n'))
+		--total;
+	buf[total] = '\0';
+	return strdup(buf);
+}
+
+/* Write the given value to the tunable at the given path. */
+static int sysctl_write_path(const char *path, const char *value,
+			     char **error)
+{
+	const int len = strlen(value);
+	int fd, bytes;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0) {
+		asprintf(error, "cannot open %s: %s", path, strerror(errno));
+		return STATUS_ERR;
+	}
+	bytes = write(fd, value, len);
+	if (bytes != len) {
+		asprintf(error, "cannot write '%s' to %s: %s", value, path,
+			 bytes < 0 ? strerror(errno) : "short write");
+		close(fd);
+		return STATUS_ERR;
+	}
+	if (close(fd) < 0) {
+		asprintf(error, "cannot write '%s' to %s: %s", value, path,
+			 strerror(errno));
+		return STATUS_ERR;
+	}
+	return STATUS_OK;
+}
+
+/* Save the old value of the tunable at the given path, most recently
+ * changed first, unless the script already changed it, in which case we
+ * already have the original value.
+ */
+static int sysctl_save(struct saved_sysctl **saved_sysctls,
+		       const char *path, char **error)
+{
+	struct saved_sysctl *saved = NULL;
+	char *value = NULL;
+
+	for (saved = *saved_sysctls; saved != NULL; saved = saved->next) {
+		if (strcmp(saved->path, path) == 0)
+			return STATUS_OK;
+	}
+
+	value = sysctl_read_path(path);
+	if (value == NULL) {
+		/* Write-only tunables (like net.ipv4.route.flush) are
+		 * actions rather than settings, so there is nothing to put
+		 * back.
+		 */
+		if (errno == EACCES)
+			return STATUS_OK;
+		if (errno == EFBIG) {
+			asprintf(error, "cannot save %s: value does not "
+				 "fit in %d bytes", path,
+				 SYSCTL_MAX_VALUE_BYTES);
+			return STATUS_ERR;
+		}
+		asprintf(error, "cannot read %s: %s", path, strerror(errno));
+		return STATUS_ERR;
+	}
+
+	saved = calloc(1, sizeof(struct saved_sysctl));
+	saved->path = strdup(path);
+	saved->value = value;
+	saved->next = *saved_sysctls;
+	*saved_sysctls = saved;
+	return STATUS_OK;
+}
+
+int sysctl_write(struct saved_sysctl **saved_sysctls,
+		 const char *name, const char *value, char **error)
+{
+	char *path = NULL;
+	int result = STATUS_ERR;
+
+	DEBUGP("sysctl %s = %s\n", name, value);
+
+	path = sysctl_path(name, error);
+	if (path == NULL)
+		return STATUS_ERR;
+
+	if (sysctl_save(saved_sysctls, path, error) == STATUS_OK &&
+	    sysctl_write_path(path, value, error) == STATUS_OK)
+		result = STATUS_OK;
+
+	free(path);
+	return result;
+}
+
+int sysctl_restore_all(struct saved_sysctl **saved_sysctls, char **error)
+{
+	struct saved_sysctl *saved = NULL;
+	int result = STATUS_OK;
+	char *restore_error = NULL;
+
+	while (*saved_sysctls != NULL) {
+		saved = *saved_sysctls;
+		*saved_sysctls = saved->next;
+
+		DEBUGP("sysctl restore %s = %s\n", saved->path, saved->value);
+		if (sysctl_write_path(saved->path, saved->value,
+				      &restore_error) == STATUS_ERR) {
+			if (result == STATUS_OK)
+				*error = restore_error;
+			else
+				free(restore_error);
+			restore_error = NULL;
+			result = STATUS_ERR;
+		}
+		free(saved->path);
+		free(saved->value);
+		free(saved);
+	}
+	return result;
+}
+
+#else  /* !linux */
+
+int sysctl_write(struct saved_sysctl **saved_sysctls,
+		 const char *name, const char *value, char **error)
+{
+	asprintf(error, "sysctl statements are only supported on Linux");
+	return STATUS_ERR;
+}
+
+int sysctl_restore_all(struct saved_sysctl **saved_sysctls, char **error)
+{
+	return STATUS_OK;
+}
+
+#endif  /* linux */
+
+void run_sysctl_event(
+	struct state *state, struct event *event, struct sysctl_spec *sysctl)
+{
+	char *script_path = NULL;
+	char *error = NULL;
+
+	DEBUGP("%d: sysctl %s = %s\n", event->line_number,
+	       sysctl->name, sysctl->value);
+
+	/* Wait for the right time before firing off this event. */
+	wait_for_event(state);
+
+	/* The recorded run already had the tunable set. */
+	if (is_reverifying(state))
+		return;
+
+	if (sysctl_write(&state->context->saved_sysctls,
+			 sysctl->name, sysctl->value, &error))
+		goto error_out;
+	return;
+
+error_out:
+	script_path = strdup(state->config->script_path);
+	state_free(state, 1);
+	die("%s:%d: error setting sysctl %s: %s\n",
+	    script_path, event->line_number, sysctl->name, error);
+	free(script_path);
+	free(error);
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Interface for a module to set kernel tunables from a test script by
+ * writing /proc/sys directly, rather than forking a shell to run
+ * sysctl(8) for each one.
+ *
+ * The first time a script sets a given tunable, we save its old value,
+ * and at cleanup we put back the old values of everything the script
+ * changed, in reverse order, so a test leaves the machine as it found
+ * it even when it fails part of the way through.
+ */
+
+#ifndef __RUN_SYSCTL_H__
+#define __RUN_SYSCTL_H__
+
+#include "types.h"
+
+#include "run.h"
+#include "script.h"
+
+/* Largest sysctl value we save and restore. */
+#define SYSCTL_MAX_VALUE_BYTES	4096
+
+/* Set the given tunable, named either sysctl(8) style with dots
+ * ("net.ipv4.tcp_ecn") or as a path below /proc/sys with slashes
+ * ("net/ipv4/tcp_ecn"), to the given value, first saving the old value
+ * in the given list of a run's saved tunables. On success, returns
+ * STATUS_OK. On error returns STATUS_ERR and fills in *error.
+ */
+extern int sysctl_write(struct saved_sysctl **saved_sysctls,
+			const char *name, const char *value, char **error);
+
+/* Put back the old values of all tunables in the given list, most
+ * recent first, and forget them. Tries all of them even if one
+ * fails. On success, returns STATUS_OK. On error returns STATUS_ERR and
+ * fills in *error with the first failure.
+ */
+extern int sysctl_restore_all(struct saved_sysctl **saved_sysctls,
+			      char **error);
+
+/* Set the tunable at the time the script says. */
+extern void run_sysctl_event(struct state *state,
+			     struct event *event,
+			     struct sysctl_spec *sysctl);
+
+#endif /* __RUN_SYSCTL_H__ */
@@ -66,6 +66,8 @@
 #include "logging.h"
 #include "run.h"
 #include "script.h"
+#include "socket_diag.h"
+#include "system.h"
 
 static int to_live_fd(struct state *state, int script_fd, int *live_fd,
 		      char **error);
@@ -1655,6 +1657,8 @@ static void begin_syscall(struct state *state, struct syscall_spec *syscall)
 {
 	int err;
 
+	if (state->recording != NULL)
+		recording_syscall_begin(state->recording, syscall->name);
 	if (is_blocking_syscall(syscall)) {
 		assert(state->syscalls->state == SYSCALL_ENQUEUED);
 		state->syscalls->state = SYSCALL_RUNNING;
@@ -1665,6 +1669,34 @@ static void begin_syscall(struct state *state, struct syscall_spec *syscall)
 	}
 }
 
+/* Make the given live system call, and with --record save its outcome.
+ * With --reverify, skip the call and return its recorded outcome.
+ */
+#define LIVE_SYSCALL(state, syscall, call)				\
+	(((state)->recording == NULL) ? (call) :			\
+	 recording_is_replay((state)->recording) ?			\
+	 replay_syscall((state)->recording,				\
+			is_blocking_syscall(syscall)) :			\
+	 record_syscall((state)->recording, (call)))
+
+/* Save, or with --reverify fill in, a buffer the current live system
+ * call filled in for us.
+ */
+static void live_syscall_output(struct state *state, void *buffer, int bytes)
+{
+	if (state->recording != NULL)
+		recording_output(state->recording, buffer, bytes);
+}
+
+/* Close a live fd that a system call gave us, unless it came from a
+ * recording, in which case it is not ours to close.
+ */
+static void close_live_fd(struct state *state, int live_fd)
+{
+	if (!is_reverifying(state))
+		close(live_fd);
+}
+
 /* Verify that the system call returned the expected result code and
  * errno value. Returns STATUS_OK on success; on failure returns
  * STATUS_ERR and sets error message. Callers should call this function
@@ -1683,9 +1715,13 @@ static int end_syscall(struct state *state, struct syscall_spec *syscall,
 
 	/* For blocking calls, advance state and reacquire the global lock. */
 	if (is_blocking_syscall(syscall)) {
-		s64 live_end_usecs = now_usecs();
+		s64 live_end_usecs = (state->recording != NULL) ?
+			recording_syscall_end_usecs(state->recording) :
+			now_usecs();
 		DEBUGP("syscall thread: end_syscall grabs lock\n");
 		run_lock(state);
+		if (state->recording != NULL)
+			recording_syscall_done(state->recording);
 		state->syscalls->live_end_usecs = live_end_usecs;
 		assert(state->syscalls->state == SYSCALL_RUNNING);
 		state->syscalls->state = SYSCALL_DONE;
@@ -2120,11 +2156,11 @@ static int syscall_socket(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = socket(domain, type, protocol);
+	result = LIVE_SYSCALL(state, syscall, socket(domain, type, protocol));
 
 	if (end_syscall(state, syscall, CHECK_FD, result, error)) {
 		if (result >= 0) {
-			close(result);
+			close_live_fd(state, result);
 		}
 		return STATUS_ERR;
 	}
@@ -2135,18 +2171,19 @@ static int syscall_socket(struct state *state, struct syscall_spec *syscall,
 		live_fd = result;
 		/* If IPv4-mapped IPv6 addresses are used, disable IPV6_V6ONLY */
 		if (state->config->socket_domain == AF_INET6 &&
-		    state->config->wire_protocol == AF_INET) {
+		    state->config->wire_protocol == AF_INET &&
+		    !is_reverifying(state)) {
 			if (setsockopt(live_fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(int)) < 0) {
 				die_perror("setsockopt IPV6_V6ONLY");
 			}
 		}
 		if (get_s32(syscall->result, &script_fd, error)) {
-			close(live_fd);
+			close_live_fd(state, live_fd);
 			return STATUS_ERR;
 		}
 		if (run_syscall_socket(state, domain, protocol,
 				       script_fd, live_fd, error)) {
-			close(live_fd);
+			close_live_fd(state, live_fd);
 			return STATUS_ERR;
 		}
 	}
@@ -2178,7 +2215,8 @@ static int syscall_bind(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = bind(live_fd, (struct sockaddr *)&live_addr, live_addrlen);
+	result = LIVE_SYSCALL(state, syscall,
+		bind(live_fd, (struct sockaddr *)&live_addr, live_addrlen));
 
 	return end_syscall(state, syscall, CHECK_EXACT, result, error);
 }
@@ -2199,7 +2237,7 @@ static int syscall_listen(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = listen(live_fd, backlog);
+	result = LIVE_SYSCALL(state, syscall, listen(live_fd, backlog));
 
 	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
 		return STATUS_ERR;
@@ -2229,11 +2267,14 @@ static int syscall_accept(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = accept(live_fd, (struct sockaddr *)&live_addr, &live_addrlen);
+	result = LIVE_SYSCALL(state, syscall,
+		accept(live_fd, (struct sockaddr *)&live_addr, &live_addrlen));
+	live_syscall_output(state, &live_addrlen, sizeof(live_addrlen));
+	live_syscall_output(state, &live_addr, sizeof(live_addr));
 
 	if (end_syscall(state, syscall, CHECK_FD, result, error)) {
 		if (result >= 0) {
-			close(result);
+			close_live_fd(state, result);
 		}
 		return STATUS_ERR;
 	}
@@ -2241,14 +2282,14 @@ static int syscall_accept(struct state *state, struct syscall_spec *syscall,
 	if (result >= 0) {
 		live_accepted_fd = result;
 		if (get_s32(syscall->result, &script_accepted_fd, error)) {
-			close(live_accepted_fd);
+			close_live_fd(state, live_accepted_fd);
 			return STATUS_ERR;
 		}
 		if (run_syscall_accept(
 			    state, script_accepted_fd, live_accepted_fd,
 			    (struct sockaddr *)&live_addr, live_addrlen,
 			    error)) {
-			close(live_accepted_fd);
+			close_live_fd(state, live_accepted_fd);
 			return STATUS_ERR;
 		}
 	}
@@ -2280,7 +2321,8 @@ static int syscall_connect(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = connect(live_fd, (struct sockaddr *)&live_addr, live_addrlen);
+	result = LIVE_SYSCALL(state, syscall,
+		connect(live_fd, (struct sockaddr *)&live_addr, live_addrlen));
 
 	return end_syscall(state, syscall, CHECK_EXACT, result, error);
 }
@@ -2305,7 +2347,7 @@ static int syscall_read(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = read(live_fd, buf, count);
+	result = LIVE_SYSCALL(state, syscall, read(live_fd, buf, count));
 
 	int status = end_syscall(state, syscall, CHECK_EXACT, result, error);
 
@@ -2348,7 +2390,7 @@ static int syscall_readv(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = readv(live_fd, iov, iov_count);
+	result = LIVE_SYSCALL(state, syscall, readv(live_fd, iov, iov_count));
 
 	status = end_syscall(state, syscall, CHECK_EXACT, result, error);
 
@@ -2379,7 +2421,7 @@ static int syscall_recv(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = recv(live_fd, buf, count, flags);
+	result = LIVE_SYSCALL(state, syscall, recv(live_fd, buf, count, flags));
 
 	int status = end_syscall(state, syscall, CHECK_EXACT, result, error);
 
@@ -2415,8 +2457,9 @@ static int syscall_recvfrom(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = recvfrom(live_fd, buf, count, flags,
-			  (struct sockaddr *)&live_addr, &live_addrlen);
+	result = LIVE_SYSCALL(state, syscall,
+		recvfrom(live_fd, buf, count, flags,
+			 (struct sockaddr *)&live_addr, &live_addrlen));
 
 	int status = end_syscall(state, syscall, CHECK_EXACT, result, error);
 
@@ -2432,6 +2475,7 @@ static int syscall_recvmsg(struct state *state, struct syscall_spec *syscall,
 	struct msghdr *msg = NULL;
 	size_t iov_len = 0;
 	int expected_msg_flags = 0;
+	size_t control_capacity, i;
 	int status = STATUS_ERR;
 
 	if (check_arg_count(args, 3, error))
@@ -2451,10 +2495,20 @@ static int syscall_recvmsg(struct state *state, struct syscall_spec *syscall,
 		goto error_out;
 
 	expected_msg_flags = msg->msg_flags;
+	control_capacity = msg->msg_controllen;
 
 	begin_syscall(state, syscall);
 
-	result = recvmsg(live_fd, msg, flags);
+	result = LIVE_SYSCALL(state, syscall, recvmsg(live_fd, msg, flags));
+	live_syscall_output(state, &msg->msg_flags, sizeof(msg->msg_flags));
+	live_syscall_output(state, &msg->msg_controllen,
+			    sizeof(msg->msg_controllen));
+	if (msg->msg_controllen > control_capacity)
+		msg->msg_controllen = control_capacity;
+	live_syscall_output(state, msg->msg_control, control_capacity);
+	for (i = 0; i < msg->msg_iovlen; i++)
+		live_syscall_output(state, msg->msg_iov[i].iov_base,
+				    msg->msg_iov[i].iov_len);
 
 	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
 		goto error_out;
@@ -2498,7 +2552,7 @@ static int syscall_write(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = write(live_fd, buf, count);
+	result = LIVE_SYSCALL(state, syscall, write(live_fd, buf, count));
 
 	int status = end_syscall(state, syscall, CHECK_EXACT, result, error);
 
@@ -2541,7 +2595,7 @@ static int syscall_writev(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = writev(live_fd, iov, iov_count);
+	result = LIVE_SYSCALL(state, syscall, writev(live_fd, iov, iov_count));
 
 	status = end_syscall(state, syscall, CHECK_EXACT, result, error);
 
@@ -2572,7 +2626,7 @@ static int syscall_send(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = send(live_fd, buf, count, flags);
+	result = LIVE_SYSCALL(state, syscall, send(live_fd, buf, count, flags));
 
 	int status = end_syscall(state, syscall, CHECK_EXACT, result, error);
 
@@ -2614,8 +2668,9 @@ static int syscall_sendto(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = sendto(live_fd, buf, count, flags,
-			(struct sockaddr *)&live_addr, live_addrlen);
+	result = LIVE_SYSCALL(state, syscall,
+		sendto(live_fd, buf, count, flags,
+		       (struct sockaddr *)&live_addr, live_addrlen));
 
 	int status = end_syscall(state, syscall, CHECK_EXACT, result, error);
 
@@ -2659,7 +2714,7 @@ static int syscall_sendmsg(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = sendmsg(live_fd, msg, flags);
+	result = LIVE_SYSCALL(state, syscall, sendmsg(live_fd, msg, flags));
 
 	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
 		goto error_out;
@@ -2694,14 +2749,15 @@ static int syscall_fcntl(struct state *state, struct syscall_spec *syscall,
 	if (actual_arg_count == 2) {
 		begin_syscall(state, syscall);
 
-		result = fcntl(live_fd, command);
+		result = LIVE_SYSCALL(state, syscall, fcntl(live_fd, command));
 	} else if (actual_arg_count == 3) {
 		s32 arg;
 		if (s32_arg(args, 2, &arg, error))
 			return STATUS_ERR;
 		begin_syscall(state, syscall);
 
-		result = fcntl(live_fd, command, arg);
+		result = LIVE_SYSCALL(state, syscall,
+			fcntl(live_fd, command, arg));
 	} else {
 		assert(0);	/* not reached */
 	}
@@ -2732,7 +2788,7 @@ static int syscall_ioctl(struct state *state, struct syscall_spec *syscall,
 	if (actual_arg_count == 2) {
 		begin_syscall(state, syscall);
 
-		result = ioctl(live_fd, command);
+		result = LIVE_SYSCALL(state, syscall, ioctl(live_fd, command));
 
 		return end_syscall(state, syscall, CHECK_EXACT, result, error);
 
@@ -2744,7 +2800,9 @@ static int syscall_ioctl(struct state *state, struct syscall_spec *syscall,
 
 		begin_syscall(state, syscall);
 
-		result = ioctl(live_fd, command, &live_optval);
+		result = LIVE_SYSCALL(state, syscall,
+			ioctl(live_fd, command, &live_optval));
+		live_syscall_output(state, &live_optval, sizeof(live_optval));
 
 		if (end_syscall(state, syscall, CHECK_EXACT, result, error))
 			return STATUS_ERR;
@@ -2777,7 +2835,7 @@ static int syscall_close(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = close(live_fd);
+	result = LIVE_SYSCALL(state, syscall, close(live_fd));
 
 	status = end_syscall(state, syscall, CHECK_EXACT, result, error);
 	if (result == 0) {
@@ -2803,7 +2861,7 @@ static int syscall_shutdown(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = shutdown(live_fd, how);
+	result = LIVE_SYSCALL(state, syscall, shutdown(live_fd, how));
 
 	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
 		return STATUS_ERR;
@@ -2811,6 +2869,63 @@ static int syscall_shutdown(struct state *state, struct syscall_spec *syscall,
 	return STATUS_OK;
 }
 
+#if HAVE_SOCK_DIAG
+/* Check the SK_MEMINFO_* values getsockopt(SO_MEMINFO) returned against
+ * the script's list, in which each value is an exact number, a
+ * [min, max] range, or "..." for any value. Values past the end of the
+ * list are not checked.
+ */
+static int check_so_meminfo(struct expression *expr, const u32 *live,
+			    char **error)
+{
+	struct expression_list *list = expr->value.list;
+	u32 min, max;
+	int i;
+
+	for (i = 0; list != NULL; list = list->next, ++i) {
+		struct expression *value = list->expression;
+
+		if (i == SK_MEMINFO_VARS) {
+			asprintf(error, "SO_MEMINFO has only %d values",
+				 SK_MEMINFO_VARS);
+			return STATUS_ERR;
+		}
+		if (value->type == EXPR_ELLIPSIS)
+			continue;
+		if (value->type == EXPR_LIST) {
+			struct expression_list *range = value->value.list;
+
+			if ((expression_list_length(range) != 2) ||
+			    get_u32(range->expression, &min, error) ||
+			    get_u32(range->next->expression, &max, error)) {
+				if (*error == NULL)
+					asprintf(error, "skmem_%s: expected "
+						 "[min, max]",
+						 sk_meminfo_names[i]);
+				return STATUS_ERR;
+			}
+		} else {
+			if (get_u32(value, &min, error))
+				return STATUS_ERR;
+			max = min;
+		}
+		if ((live[i] < min) || (live[i] > max)) {
+			if (min == max)
+				asprintf(error, "skmem_%s: expected: %u "
+					 "actual: %u", sk_meminfo_names[i],
+					 min, live[i]);
+			else
+				asprintf(error, "skmem_%s: expected: "
+					 "[%u, %u] actual: %u",
+					 sk_meminfo_names[i], min, max,
+					 live[i]);
+			return STATUS_ERR;
+		}
+	}
+	return STATUS_OK;
+}
+#endif  /* HAVE_SOCK_DIAG */
+
 static int check_linger(struct linger_expr *expr,
 			struct linger *linger, char **error)
 {
@@ -3400,7 +3515,7 @@ static int syscall_getsockopt(struct state *state, struct syscall_spec *syscall,
 {
 	int script_fd, live_fd, level, optname, live_result, result = STATUS_OK;
 	s32 script_optval, expected;
-	socklen_t script_optlen, live_optlen;
+	socklen_t script_optlen, live_optlen, live_optcap;
 	bool optlen_provided;
 	void *live_optval;
 	struct expression *val_expression, *len_expression;
@@ -3750,6 +3865,13 @@ static int syscall_getsockopt(struct state *state, struct syscall_spec *syscall,
 	}
 #endif
 	case EXPR_LIST:
+#if HAVE_SOCK_DIAG
+		if ((level == SOL_SOCKET) && (optname == SO_MEMINFO)) {
+			live_optlen = (socklen_t)(SK_MEMINFO_VARS * sizeof(u32));
+			live_optval = calloc(1, live_optlen);
+			break;
+		}
+#endif  /* HAVE_SOCK_DIAG */
 		s32_bracketed_arg(args, 3, &script_optval, error);
 		live_optval = malloc(sizeof(int));
 		live_optlen = (socklen_t)sizeof(int);
@@ -3761,9 +3883,14 @@ static int syscall_getsockopt(struct state *state, struct syscall_spec *syscall,
 		break;
 	}
 
+	live_optcap = live_optlen;
+
 	begin_syscall(state, syscall);
 
-	live_result = getsockopt(live_fd, level, optname, live_optval, &live_optlen);
+	live_result = LIVE_SYSCALL(state, syscall,
+		getsockopt(live_fd, level, optname, live_optval, &live_optlen));
+	live_syscall_output(state, live_optval, live_optcap);
+	live_syscall_output(state, &live_optlen, sizeof(live_optlen));
 
 	if (end_syscall(state, syscall, CHECK_EXACT, live_result, error)) {
 		free(live_optval);
@@ -3917,6 +4044,13 @@ static int syscall_getsockopt(struct state *state, struct syscall_spec *syscall,
 		break;
 #endif
 	case EXPR_LIST:
+#if HAVE_SOCK_DIAG
+		if ((level == SOL_SOCKET) && (optname == SO_MEMINFO)) {
+			result = check_so_meminfo(val_expression, live_optval,
+						  error);
+			break;
+		}
+#endif  /* HAVE_SOCK_DIAG */
 		if (*(int*)live_optval != script_optval) {
 			asprintf(error, "optval: expected: %d actual: %d",
 				(int)script_optval, *(int*)live_optval);
@@ -4768,7 +4902,8 @@ static int syscall_setsockopt(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = setsockopt(live_fd, level, optname, optval, optlen);
+	result = LIVE_SYSCALL(state, syscall,
+		setsockopt(live_fd, level, optname, optval, optlen));
 
 #if defined(SCTP_HMAC_IDENT) && !defined(__SunOS_5_11)
 	free(hmacalgo);
@@ -4815,7 +4950,8 @@ static int syscall_poll(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = poll(fds, nfds, timeout);
+	result = LIVE_SYSCALL(state, syscall, poll(fds, nfds, timeout));
+	live_syscall_output(state, fds, nfds * sizeof(struct pollfd));
 
 	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
 		goto error_out;
@@ -4849,11 +4985,11 @@ static int syscall_open(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = open(name, flags);
+	result = LIVE_SYSCALL(state, syscall, open(name, flags));
 
 	if (end_syscall(state, syscall, CHECK_FD, result, error)) {
 		if (result >= 0) {
-			close(result);
+			close_live_fd(state, result);
 		}
 		return STATUS_ERR;
 	}
@@ -4861,12 +4997,12 @@ static int syscall_open(struct state *state, struct syscall_spec *syscall,
 	if (result >= 0) {
 		live_fd = result;
 		if (get_s32(syscall->result, &script_fd, error)) {
-			close(live_fd);
+			close_live_fd(state, live_fd);
 			return STATUS_ERR;
 		}
 		if (!insert_new_socket(state, 0, 0,
 				       script_fd, live_fd, error)) {
-			close(live_fd);
+			close_live_fd(state, live_fd);
 			return STATUS_ERR;
 		}
 	}
@@ -4904,7 +5040,8 @@ static int syscall_sendfile(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = sendfile(live_outfd, live_infd, &live_offset, count);
+	result = LIVE_SYSCALL(state, syscall,
+		sendfile(live_outfd, live_infd, &live_offset, count));
 
 	status = end_syscall(state, syscall, CHECK_EXACT, result, error);
 
@@ -5029,7 +5166,8 @@ static int syscall_sendfile(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = sendfile(live_fd, live_s, offset, nbytes, sf_hdtr, &live_sbytes, flags);
+	result = LIVE_SYSCALL(state, syscall,
+		sendfile(live_fd, live_s, offset, nbytes, sf_hdtr, &live_sbytes, flags));
 
 	status = end_syscall(state, syscall, CHECK_EXACT, result, error);
 	if ((status == STATUS_OK) &&
@@ -5118,8 +5256,10 @@ static int syscall_sctp_sendmsg(struct state *state, struct syscall_spec *syscal
 	assert(msg != NULL);
 
 	begin_syscall(state, syscall);
-	result = sctp_sendmsg(live_fd, msg, len, (struct sockaddr *) to_ptr,
-			      tolen, ppid, flags, stream_no, timetolive, context);
+	result = LIVE_SYSCALL(state, syscall,
+		sctp_sendmsg(live_fd, msg, len, (struct sockaddr *) to_ptr,
+			     tolen, ppid, flags, stream_no, timetolive,
+			     context));
 
 	free(msg);
 	if (end_syscall(state, syscall, CHECK_EXACT, result, error)) {
@@ -5252,7 +5392,7 @@ static int syscall_sctp_recvmsg(struct state *state, struct syscall_spec *syscal
 	void *msg;
 	u32 len;
 	struct sockaddr_storage live_from;
-	socklen_t live_fromlen;
+	socklen_t live_fromlen = sizeof(live_from);
 	struct sctp_sndrcvinfo live_sinfo;
 	struct expression *len_expr, *script_sinfo_expr, *script_msg_flags_expr;
 	struct expression *script_fromlen_expr, *script_from_expr;
@@ -5274,8 +5414,13 @@ static int syscall_sctp_recvmsg(struct state *state, struct syscall_spec *syscal
 	assert(msg != NULL);
 
 	begin_syscall(state, syscall);
-	result = sctp_recvmsg(live_fd, msg, len, (struct sockaddr*) &live_from,
-			      &live_fromlen, &live_sinfo, &live_msg_flags);
+	result = LIVE_SYSCALL(state, syscall,
+		sctp_recvmsg(live_fd, msg, len, (struct sockaddr*) &live_from,
+			     &live_fromlen, &live_sinfo, &live_msg_flags));
+	live_syscall_output(state, &live_from, sizeof(live_from));
+	live_syscall_output(state, &live_fromlen, sizeof(live_fromlen));
+	live_syscall_output(state, &live_sinfo, sizeof(live_sinfo));
+	live_syscall_output(state, &live_msg_flags, sizeof(live_msg_flags));
 
 	free(msg);
 	if (end_syscall(state, syscall, CHECK_EXACT, result, error)) {
@@ -5615,7 +5760,8 @@ static int syscall_sctp_send(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = sctp_send(live_fd, msg, len, &info, flags);
+	result = LIVE_SYSCALL(state, syscall,
+		sctp_send(live_fd, msg, len, &info, flags));
 	free(msg);
 
 	if (end_syscall(state, syscall, CHECK_EXACT, result, error)) {
@@ -5692,7 +5838,8 @@ static int syscall_sctp_sendx(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = sctp_sendx(live_fd, msg, len, addrs, addrcnt, &info, flags);
+	result = LIVE_SYSCALL(state, syscall,
+		sctp_sendx(live_fd, msg, len, addrs, addrcnt, &info, flags));
 
 	if (end_syscall(state, syscall, CHECK_EXACT, result, error)) {
 		goto error_out;
@@ -5817,7 +5964,8 @@ static int syscall_sctp_sendv(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = sctp_sendv(live_fd, iov, iovcnt, addrs, addrcnt, info, infolen, infotype, flags);
+	result = LIVE_SYSCALL(state, syscall,
+		sctp_sendv(live_fd, iov, iovcnt, addrs, addrcnt, info, infolen, infotype, flags));
 
 	if (end_syscall(state, syscall, CHECK_EXACT, result, error)) {
 		free(addrs);
@@ -6472,8 +6620,9 @@ static int syscall_sctp_recvv(struct state *state, struct syscall_spec *syscall,
 	int flags, iovlen, script_fd, live_fd, result;
 	size_t script_iovec_list_len = 0;
 	unsigned int infotype = 0;
-	socklen_t infolen, fromlen;
+	socklen_t infolen, fromlen, from_capacity;
 	void *info;
+	int info_capacity;
 	struct iovec *iov;
 	struct sockaddr *from = NULL;
 	struct expression *iovec_expr_list, *iovcnt_expr, *addr_expr, *fromlen_expr;
@@ -6508,12 +6657,16 @@ static int syscall_sctp_recvv(struct state *state, struct syscall_spec *syscall,
 		goto error_out;
 	if (info_expr->type == EXPR_NULL) {
 		info = NULL;
+		info_capacity = 0;
 	} else if (info_expr->type == EXPR_SCTP_RCVINFO) {
 		info = &rcvinfo;
+		info_capacity = sizeof(rcvinfo);
 	} else if (info_expr->type == EXPR_SCTP_NXTINFO) {
 		info = &nxtinfo;
+		info_capacity = sizeof(nxtinfo);
 	} else if (info_expr->type == EXPR_SCTP_RECVV_RN) {
 		info = &recvv_rn;
+		info_capacity = sizeof(recvv_rn);
 	} else {
 		goto error_out;
 	}
@@ -6525,13 +6678,22 @@ static int syscall_sctp_recvv(struct state *state, struct syscall_spec *syscall,
 	addr_expr = get_arg(args, 3, error);
 	if (addr_expr == NULL)
 		goto error_out;
+	from_capacity = 0;
 	if (addr_expr->type != EXPR_NULL) {
 		from = malloc(fromlen);
+		from_capacity = fromlen;
 	}
 
 	begin_syscall(state, syscall);
 
-	result = sctp_recvv(live_fd, iov, iovlen, (struct sockaddr *)from, &fromlen, info, &infolen, &infotype, &flags);
+	result = LIVE_SYSCALL(state, syscall,
+		sctp_recvv(live_fd, iov, iovlen, (struct sockaddr *)from, &fromlen, info, &infolen, &infotype, &flags));
+	live_syscall_output(state, from, from_capacity);
+	live_syscall_output(state, &fromlen, sizeof(fromlen));
+	live_syscall_output(state, info, info_capacity);
+	live_syscall_output(state, &infolen, sizeof(infolen));
+	live_syscall_output(state, &infotype, sizeof(infotype));
+	live_syscall_output(state, &flags, sizeof(flags));
 
 	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
 		goto error_out;
@@ -6666,7 +6828,8 @@ static int syscall_sctp_bindx(struct state *state, struct syscall_spec *syscall,
 
 	begin_syscall(state, syscall);
 
-	result = sctp_bindx(live_fd, (struct sockaddr *)&addrs, addrcnt, flags);
+	result = LIVE_SYSCALL(state, syscall,
+		sctp_bindx(live_fd, (struct sockaddr *)&addrs, addrcnt, flags));
 
 	if (end_syscall(state, syscall, CHECK_EXACT, result, error)) {
 		return STATUS_ERR;
@@ -6710,7 +6873,9 @@ static int syscall_sctp_connectx(struct state *state, struct syscall_spec *sysca
 
 	begin_syscall(state, syscall);
 
-	result = sctp_connectx(live_fd, (struct sockaddr *)&live_addr, addrcnt, &live_associd);
+	result = LIVE_SYSCALL(state, syscall,
+		sctp_connectx(live_fd, (struct sockaddr *)&live_addr, addrcnt, &live_associd));
+	live_syscall_output(state, &live_associd, sizeof(live_associd));
 
 	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
 		return STATUS_ERR;
@@ -6755,7 +6920,7 @@ static int syscall_sctp_peeloff(struct state *state, struct syscall_spec *syscal
 
 	begin_syscall(state, syscall);
 
-	result = sctp_peeloff(live_fd, assoc_id);
+	result = LIVE_SYSCALL(state, syscall, sctp_peeloff(live_fd, assoc_id));
 	if (end_syscall(state, syscall, CHECK_FD, result, error))
 		return STATUS_ERR;
 	if (get_s32(syscall->result, &script_new_fd, error))
@@ -6772,12 +6937,51 @@ static int syscall_sctp_peeloff(struct state *state, struct syscall_spec *syscal
 #endif
 }
 
+#if defined(__FreeBSD__) || defined(linux) || (defined(__APPLE__) && defined(HAVE_SCTP)) || defined(__SunOS_5_11)
+/* Save, or with --reverify fill in, the packed array of 'count'
+ * addresses that sctp_getpaddrs() or sctp_getladdrs() returned in
+ * *live_addrs, preceded by its length in bytes. When re-verifying there
+ * is no such array, so *live_addrs becomes a malloc-ed copy of the
+ * recorded one, ended by a zeroed address, which the caller must free()
+ * rather than pass to sctp_freepaddrs() or sctp_freeladdrs().
+ */
+static void live_sctp_addrs_output(struct state *state, void **live_addrs,
+				   int count)
+{
+	int bytes = 0, i;
+
+	if (state->recording == NULL)
+		return;
+	if (!is_reverifying(state)) {
+		for (i = 0; i < count; i++) {
+			const struct sockaddr *addr =
+				(struct sockaddr *)((char *)*live_addrs + bytes);
+
+			if (addr->sa_family == AF_INET)
+				bytes += sizeof(struct sockaddr_in);
+			else if (addr->sa_family == AF_INET6)
+				bytes += sizeof(struct sockaddr_in6);
+			else
+				break;
+		}
+	}
+	live_syscall_output(state, &bytes, sizeof(bytes));
+	if (is_reverifying(state)) {
+		if (bytes < 0)
+			bytes = 0;
+		*live_addrs = calloc(1, bytes + sizeof(struct sockaddr_storage));
+		assert(*live_addrs != NULL);
+	}
+	live_syscall_output(state, *live_addrs, bytes);
+}
+#endif
+
 static int syscall_sctp_getpaddrs(struct state *state, struct syscall_spec *syscall,
 				  struct expression_list *args,
 				  char **error)
 {
 #if defined(__FreeBSD__) || defined(linux) || (defined(__APPLE__) && defined(HAVE_SCTP)) || defined(__SunOS_5_11)
-	int live_fd, script_fd, result;
+	int live_fd, script_fd, result, status = STATUS_ERR;
 	sctp_assoc_t assoc_id;
 	struct expression *assoc_expr, *addrs_list_expr;
 	/*
@@ -6785,9 +6989,9 @@ static int syscall_sctp_getpaddrs(struct state *state, struct syscall_spec *sysc
 	 * in https://tools.ietf.org/html/rfc6458#section-9.3.
 	 */
 #if defined(__SunOS_5_11)
-	void *live_addrs;
+	void *live_addrs = NULL;
 #else
-	struct sockaddr *live_addrs;
+	struct sockaddr *live_addrs = NULL;
 #endif
 
 	if (check_arg_count(args, 3, error))
@@ -6802,10 +7006,12 @@ static int syscall_sctp_getpaddrs(struct state *state, struct syscall_spec *sysc
 
 	begin_syscall(state, syscall);
 
-	result = sctp_getpaddrs(live_fd, assoc_id, &live_addrs);
+	result = LIVE_SYSCALL(state, syscall,
+		sctp_getpaddrs(live_fd, assoc_id, &live_addrs));
+	live_sctp_addrs_output(state, (void **)&live_addrs, result);
 
 	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
-		goto error_out;
+		goto out;
 	addrs_list_expr = get_arg(args, 2, error);
 	if (addrs_list_expr->type != EXPR_ELLIPSIS) {
 		int list_length = 0, i = 0;
@@ -6816,18 +7022,18 @@ static int syscall_sctp_getpaddrs(struct state *state, struct syscall_spec *sysc
 #endif
 
 		if (check_type(addrs_list_expr, EXPR_LIST, error)) {
-			goto error_out;
+			goto out;
 		}
 		list_length = get_arg_count(addrs_list_expr->value.list);
 		if (list_length != result) {
 			asprintf(error, "Bad length of struct sockaddr array. expected: %d, actual %d", list_length, result);
-			goto error_out;
+			goto out;
 		}
 		for (i = 0; i < result; i++) {
 			struct expression *script_addr_expr;
 			script_addr_expr = get_arg(addrs_list_expr->value.list, i, error);
 			if (check_sockaddr(script_addr_expr,  live_addr, error)) {
-				goto error_out;
+				goto out;
 			}
 			if (live_addr->sa_family == AF_INET) {
 				live_addr = (struct sockaddr *)((caddr_t)live_addr + sizeof(struct sockaddr_in));
@@ -6835,14 +7041,17 @@ static int syscall_sctp_getpaddrs(struct state *state, struct syscall_spec *sysc
 				live_addr = (struct sockaddr *)((caddr_t)live_addr + sizeof(struct sockaddr_in6));
 			} else {
 				asprintf(error, "Bad Type of addrs[%d]", i);
-				goto error_out;
+				goto out;
 			}
 		}
 	}
-	return STATUS_OK;
-error_out:
-	sctp_freepaddrs(live_addrs);
-	return STATUS_ERR;
+	status = STATUS_OK;
+out:
+	if (is_reverifying(state))
+		free(live_addrs);
+	else if (live_addrs != NULL)
+		sctp_freepaddrs(live_addrs);
+	return status;
 #else
 	asprintf(error, "sctp_getpaddrs is not supported");
 	return STATUS_ERR;
@@ -6875,7 +7084,7 @@ static int syscall_sctp_getladdrs(struct state *state, struct syscall_spec *sysc
 				  char **error)
 {
 #if defined(__FreeBSD__) || defined(linux) || (defined(__APPLE__) && defined(HAVE_SCTP)) || defined(__SunOS_5_11)
-	int live_fd, script_fd, result;
+	int live_fd, script_fd, result, status = STATUS_ERR;
 	sctp_assoc_t assoc_id;
 	struct expression *assoc_expr, *addrs_list_expr;
 	/*
@@ -6883,9 +7092,9 @@ static int syscall_sctp_getladdrs(struct state *state, struct syscall_spec *sysc
 	 * in https://tools.ietf.org/html/rfc6458#section-9.5.
 	 */
 #if defined(__SunOS_5_11)
-	void *live_addrs;
+	void *live_addrs = NULL;
 #else
-	struct sockaddr *live_addrs;
+	struct sockaddr *live_addrs = NULL;
 #endif
 
 	if (check_arg_count(args, 3, error))
@@ -6900,10 +7109,12 @@ static int syscall_sctp_getladdrs(struct state *state, struct syscall_spec *sysc
 
 	begin_syscall(state, syscall);
 
-	result = sctp_getladdrs(live_fd, assoc_id, &live_addrs);
+	result = LIVE_SYSCALL(state, syscall,
+		sctp_getladdrs(live_fd, assoc_id, &live_addrs));
+	live_sctp_addrs_output(state, (void **)&live_addrs, result);
 
 	if (end_syscall(state, syscall, CHECK_EXACT, result, error))
-		goto error_out;
+		goto out;
 	addrs_list_expr = get_arg(args, 2, error);
 	if (addrs_list_expr->type != EXPR_ELLIPSIS) {
 		int list_length = 0, i = 0;
@@ -6914,18 +7125,18 @@ static int syscall_sctp_getladdrs(struct state *state, struct syscall_spec *sysc
 #endif
 
 		if (check_type(addrs_list_expr, EXPR_LIST, error)) {
-			goto error_out;
+			goto out;
 		}
 		list_length = get_arg_count(addrs_list_expr->value.list);
 		if (list_length != result) {
 			asprintf(error, "Bad length of struct sockaddr array. expected: %d, actual %d", list_length, result);
-			goto error_out;
+			goto out;
 		}
 		for (i = 0; i < result; i++) {
 			struct expression *script_addr_expr;
 			script_addr_expr = get_arg(addrs_list_expr->value.list, i, error);
 			if (check_sockaddr(script_addr_expr,  live_addr, error)) {
-				goto error_out;
+				goto out;
 			}
 			if (live_addr->sa_family == AF_INET) {
 				live_addr = (struct sockaddr *)((caddr_t)live_addr + sizeof(struct sockaddr_in));
@@ -6933,14 +7144,17 @@ static int syscall_sctp_getladdrs(struct state *state, struct syscall_spec *sysc
 				live_addr = (struct sockaddr *)((caddr_t)live_addr + sizeof(struct sockaddr_in6));
 			} else {
 				asprintf(error, "Bad Type of addrs[%d]", i);
-				goto error_out;
+				goto out;
 			}
 		}
 	}
-	return STATUS_OK;
-error_out:
-	sctp_freeladdrs(live_addrs);
-	return STATUS_ERR;
+	status = STATUS_OK;
+out:
+	if (is_reverifying(state))
+		free(live_addrs);
+	else if (live_addrs != NULL)
+		sctp_freeladdrs(live_addrs);
+	return status;
 #else
 	asprintf(error, "sctp_getladdrs is not supported");
 	return STATUS_ERR;
@@ -7028,6 +7242,7 @@ static void invoke_system_call(
 	char *error = NULL, *script_path = NULL;
 	const char *name = syscall->name;
 	struct expression_list *args = NULL;
+	struct perf_values perf_start;
 	int i = 0;
 	int result = 0;
 
@@ -7051,7 +7266,9 @@ static void invoke_system_call(
 		goto error_out;
 
 	/* Run the system call. */
+	perf_event_begin(state->perf, &perf_start);
 	result = system_call_table[i].function(state, syscall, args, &error);
+	perf_event_end(state->perf, event->line_number, &perf_start);
 
 	free_expression_list(args);
 
@@ -7098,6 +7315,10 @@ static int await_idle_thread(struct state *state)
 #endif
 			end_time.tv_sec += MAX_WAIT_SECS;
 		}
+		/* A replayed call ends at its recorded time; jump there. */
+		if (is_reverifying(state))
+			recording_unblock(state->recording,
+					  now_usecs() + MAX_WAIT_SECS * 1000000LL);
 		/* Wait for a signal or our timeout end_time to arrive. */
 		DEBUGP("main thread: awaiting idle syscall thread\n");
 		int err = pthread_cond_timedwait(&state->syscalls->idle,
@@ -7238,6 +7459,8 @@ static void *system_call_thread(void *arg)
 #endif
 	DEBUGP("syscall thread: starting and locking\n");
 	run_lock(state);
+	run_set_context(state->context);
+	perf_thread_start(state->perf);
 
 #if defined(linux)
 	state->syscalls->thread_id = gettid();
@@ -7291,7 +7514,7 @@ static void *system_call_thread(void *arg)
 
 			/* Check end time for the blocking system call. */
 			assert(state->syscalls->live_end_usecs >= 0);
-			if (verify_time(state,
+			if (verify_time(state, TIMING_SYSCALL,
 					event->time_type,
 					syscall->end_usecs, 0,
 					state->syscalls->live_end_usecs,
@@ -7322,6 +7545,7 @@ static void *system_call_thread(void *arg)
 		}
 	}
 	DEBUGP("syscall thread: unlocking and exiting\n");
+	perf_thread_stop(state->perf);
 	run_unlock(state);
 
 	return NULL;
@@ -7334,8 +7558,8 @@ struct syscalls *syscalls_new(struct state *state)
 
 	syscalls->state = SYSCALL_IDLE;
 
-	if ((err = pthread_create(&syscalls->thread, NULL, system_call_thread,
-				  state)) != 0) {
+	if ((err = create_thread(&syscalls->thread, system_call_thread,
+				 state)) != 0) {
 		die_strerror("pthread_create", err);
 	}
 
@@ -88,6 +88,11 @@ void free_script(struct script *script)
 		case CODE_EVENT:
 			free(cur_event->event.code);
 			break;
+		case SYSCTL_EVENT:
+			free(cur_event->event.sysctl->name);
+			free(cur_event->event.sysctl->value);
+			free(cur_event->event.sysctl);
+			break;
 		default:
 			assert(!"bad event type");
 			break;
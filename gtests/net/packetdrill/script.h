@@ -704,6 +704,12 @@ struct command_spec {
 	char *command_line;	/* executed with /bin/sh */
 };
 
+/* A kernel tunable to set, without running a shell command. */
+struct sysctl_spec {
+	char *name;		/* e.g. "net.ipv4.tcp_ecn" */
+	char *value;		/* new value, as written to /proc/sys */
+};
+
 /* An ASCII text snippet of code to insert in the post-processing
  * output. This can be, for example, a snippet of Python to execute.
  */
@@ -718,6 +724,7 @@ enum event_t {
 	SYSCALL_EVENT,
 	COMMAND_EVENT,
 	CODE_EVENT,
+	SYSCTL_EVENT,
 	NUM_EVENT_TYPES,
 };
 
@@ -734,6 +741,7 @@ enum event_time_t {
 /* An event in a script */
 struct event {
 	int line_number;	/* location in test script file */
+	int end_line_number;	/* last line of the event in the file */
 	s64 time_usecs;		/* event time in microseconds */
 	s64 time_usecs_end;	/* event time range end (or NO_TIME_RANGE) */
 	s64 offset_usecs;	/* relative event time offset from script start
@@ -745,6 +753,7 @@ struct event {
 		struct syscall_spec	*syscall;
 		struct command_spec	*command;
 		struct code_spec	*code;
+		struct sysctl_spec	*sysctl;
 	} event;		/* pointer to the event */
 	struct event *next;	/* next in linked list of events */
 };
@@ -774,11 +783,9 @@ struct script {
 	struct command_spec *cleanup_command;  /* untimed cleanup command */
 	char		*buffer;	    /* raw input text of the script */
 	int		length;		    /* number of bytes in the script */
+	s64		parse_usecs;	    /* time it took to parse */
 };
 
-/* Global pointer for final command we always execute at end of script: */
-extern const char *cleanup_cmd;
-
 /* A table entry mapping a bit mask to its human-readable name.
  * A table of such mappings must be terminated with a struct with a
  * NULL name.
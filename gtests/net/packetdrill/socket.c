@@ -40,6 +40,8 @@ struct socket *socket_new(struct state *state)
 void socket_free(struct socket *socket)
 {
 	hash_map_free(socket->ts_val_map);
+	if (socket->mptcp_master == NULL)
+		mptcp_state_free(socket->mptcp);
 	 /* paranoia to help catch bugs */
 	memset(socket->prepared_cookie_echo, 0, socket->prepared_cookie_echo_length);
 	free(socket->prepared_cookie_echo);
@@ -33,6 +33,7 @@
 #include "config.h"
 #include "hash_map.h"
 #include "logging.h"
+#include "mptcp.h"
 #include "packet.h"
 
 /* All possible states for a socket we're tracking. */
@@ -122,6 +123,27 @@ struct socket {
 	u16 last_injected_udp_encaps_src_port;
 	u16 last_injected_udp_encaps_dst_port;
 
+	/* The outer (encapsulation) headers of the last outbound packet
+	 * whose outer layers verified, as expected by the script and as
+	 * sent by the kernel, with per-packet fields zeroed. Later packets
+	 * of the flow whose outer headers match skip re-verifying them.
+	 */
+	u8 outer_script_template[PACKET_MAX_HEADER_BYTES];
+	u8 outer_actual_template[PACKET_MAX_HEADER_BYTES];
+	int outer_template_bytes;	/* 0 if no template yet */
+	enum ip_ecn_t outer_template_ecn;	/* ECN treatment it was for */
+
+	/* CE marks the ECN marking engine applied to our outbound data. */
+	struct ecn_marks ecn_marks;
+
+	/* MPTCP connection state, shared by all subflows. For subflows
+	 * other than the initial one, mptcp_master points to the socket
+	 * of the initial subflow, which owns the state.
+	 */
+	struct mptcp_state *mptcp;
+	struct socket *mptcp_master;
+	u8 mptcp_subflow;		/* subflow id; 0 for initial subflow */
+
 	struct _sctp_cookie_echo_chunk *prepared_cookie_echo;
 	u16 prepared_cookie_echo_length;
 	struct _sctp_heartbeat_ack_chunk *prepared_heartbeat_ack;
@@ -0,0 +1,267 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for taking a snapshot of the state of all the TCP
+ * sockets of a test with a single NETLINK_SOCK_DIAG dump, and for
+ * reading the memory footprint of one socket with SO_MEMINFO.
+ */
+
+#include "socket_diag.h"
+
+#if HAVE_SOCK_DIAG
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <linux/rtnetlink.h>
+#include "hash_map.h"
+
+const char *sk_meminfo_names[SK_MEMINFO_VARS] = {
+	[SK_MEMINFO_RMEM_ALLOC]		= "rmem_alloc",
+	[SK_MEMINFO_RCVBUF]		= "rcvbuf",
+	[SK_MEMINFO_WMEM_ALLOC]		= "wmem_alloc",
+	[SK_MEMINFO_SNDBUF]		= "sndbuf",
+	[SK_MEMINFO_FWD_ALLOC]		= "fwd_alloc",
+	[SK_MEMINFO_WMEM_QUEUED]	= "wmem_queued",
+	[SK_MEMINFO_OPTMEM]		= "optmem",
+	[SK_MEMINFO_BACKLOG]		= "backlog",
+	[SK_MEMINFO_DROPS]		= "drops",
+};
+
+/* Extensions we ask the kernel to append to each inet_diag_msg. The
+ * congestion control module reports DCTCP or BBR state when asked for
+ * INET_DIAG_VEGASINFO.
+ */
+#define SOCK_DIAG_EXTENSIONS				\
+	((1 << (INET_DIAG_INFO - 1)) |			\
+	 (1 << (INET_DIAG_VEGASINFO - 1)) |		\
+	 (1 << (INET_DIAG_CONG - 1)) |			\
+	 (1 << (INET_DIAG_SKMEMINFO - 1)))
+
+/* Copy at most len bytes of the attribute payload into the zeroed
+ * destination, so we tolerate kernels with shorter or longer structs.
+ */
+static void copy_attr(void *dst, int len, const struct rtattr *attr)
+{
+	int attr_len = RTA_PAYLOAD(attr);
+
+	memset(dst, 0, len);
+	memcpy(dst, RTA_DATA(attr), attr_len < len ? attr_len : len);
+}
+
+/* Fill in the entry from a diag message and its attributes. */
+static void parse_inet_diag_msg(const struct nlmsghdr *nlh,
+				struct sock_diag_entry *entry)
+{
+	const struct inet_diag_msg *msg = NLMSG_DATA(nlh);
+	struct rtattr *attr = (struct rtattr *)(msg + 1);
+	int len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*msg));
+
+	entry->state = msg->idiag_state;
+	entry->rqueue = msg->idiag_rqueue;
+	entry->wqueue = msg->idiag_wqueue;
+
+	for (; RTA_OK(attr, len); attr = RTA_NEXT(attr, len)) {
+		switch (attr->rta_type) {
+		case INET_DIAG_INFO:
+			copy_attr(&entry->info, sizeof(entry->info), attr);
+			entry->has_info = true;
+			break;
+		case INET_DIAG_SKMEMINFO:
+			copy_attr(entry->meminfo, sizeof(entry->meminfo), attr);
+			entry->has_meminfo = true;
+			break;
+		case INET_DIAG_CONG:
+			/* Leave room for the terminating NUL. */
+			copy_attr(entry->cong, sizeof(entry->cong) - 1, attr);
+			break;
+		case INET_DIAG_DCTCPINFO:
+			copy_attr(&entry->dctcp, sizeof(entry->dctcp), attr);
+			entry->has_dctcp = true;
+			break;
+		case INET_DIAG_BBRINFO:
+			copy_attr(&entry->bbr, sizeof(entry->bbr), attr);
+			entry->has_bbr = true;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/* Send one dump request for the given family with the given sequence
+ * number and parse the replies to it, filling in the entries whose
+ * socket inode is in the inode map.
+ */
+static int sock_diag_dump(int netlink_fd, u32 seq, int family,
+			  const struct hash_map *inodes,
+			  struct sock_diag_entry *entries,
+			  char **error)
+{
+	struct {
+		struct nlmsghdr nlh;
+		struct inet_diag_req_v2 req;
+	} request;
+	struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+	long buffer[8192 / sizeof(long)];	/* aligned for nlmsghdr */
+	struct nlmsghdr *nlh = NULL;
+	const struct inet_diag_msg *msg = NULL;
+	ssize_t len;
+	u32 index;
+
+	memset(&request, 0, sizeof(request));
+	request.nlh.nlmsg_len = sizeof(request);
+	request.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+	request.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	request.nlh.nlmsg_seq = seq;
+	request.req.sdiag_family = family;
+	request.req.sdiag_protocol = IPPROTO_TCP;
+	request.req.idiag_states = ~0U;
+	request.req.idiag_ext = SOCK_DIAG_EXTENSIONS;
+
+	if (sendto(netlink_fd, &request, sizeof(request), 0,
+		   (struct sockaddr *)&kernel, sizeof(kernel)) < 0) {
+		asprintf(error, "sock_diag request: %s", strerror(errno));
+		return STATUS_ERR;
+	}
+
+	for (;;) {
+		len = recv(netlink_fd, buffer, sizeof(buffer), 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			asprintf(error, "sock_diag reply: %s",
+				 strerror(errno));
+			return STATUS_ERR;
+		}
+		for (nlh = (struct nlmsghdr *)buffer; NLMSG_OK(nlh, len);
+		     nlh = NLMSG_NEXT(nlh, len)) {
+			if (nlh->nlmsg_seq != seq)
+				continue;	/* stale reply */
+			if (nlh->nlmsg_type == NLMSG_DONE)
+				return STATUS_OK;
+			if (nlh->nlmsg_type == NLMSG_ERROR) {
+				const struct nlmsgerr *err = NLMSG_DATA(nlh);
+				asprintf(error, "sock_diag dump: %s",
+					 strerror(-err->error));
+				return STATUS_ERR;
+			}
+			if (nlh->nlmsg_type != SOCK_DIAG_BY_FAMILY)
+				continue;
+			msg = NLMSG_DATA(nlh);
+			if (hash_map_get(inodes, msg->idiag_inode, &index))
+				parse_inet_diag_msg(nlh, &entries[index]);
+		}
+	}
+}
+
+int sock_diag_snapshot(int netlink_fd, u32 *seq, struct socket *sockets,
+		       struct socket *socket_under_test,
+		       struct sock_diag_entry **entries,
+		       int *num_entries, char **error)
+{
+	struct hash_map *inodes = NULL;
+	struct sock_diag_entry *all = NULL;
+	struct socket *socket = NULL;
+	struct stat st;
+	bool has_ipv4 = false, has_ipv6 = false;
+	int result = STATUS_ERR;
+	int num = 0, i, j;
+
+	for (socket = sockets; socket != NULL; socket = socket->next)
+		++num;
+	inodes = hash_map_new(num);
+	all = calloc(num > 0 ? num : 1, sizeof(struct sock_diag_entry));
+
+	/* Find the inode of each open TCP socket, to recognize it in
+	 * the dump.
+	 */
+	num = 0;
+	for (socket = sockets; socket != NULL; socket = socket->next) {
+		if (socket->is_closed || (socket->live.fd < 0) ||
+		    (socket->protocol != IPPROTO_TCP))
+			continue;
+		if (fstat(socket->live.fd, &st) < 0)
+			continue;
+		hash_map_set(inodes, st.st_ino, num);
+		all[num].script_fd = socket->script.fd;
+		all[num].is_socket_under_test = (socket == socket_under_test);
+		all[num].state = 0xff;	/* not found in the dump */
+		if (socket->address_family == AF_INET)
+			has_ipv4 = true;
+		else
+			has_ipv6 = true;
+		++num;
+	}
+
+	if (has_ipv4 &&
+	    sock_diag_dump(netlink_fd, ++*seq, AF_INET, inodes, all, error))
+		goto out;
+	if (has_ipv6 &&
+	    sock_diag_dump(netlink_fd, ++*seq, AF_INET6, inodes, all, error))
+		goto out;
+
+	/* Drop sockets the kernel did not report. */
+	for (i = 0, j = 0; i < num; ++i) {
+		if (all[i].state != 0xff)
+			all[j++] = all[i];
+	}
+	*entries = all;
+	*num_entries = j;
+	all = NULL;
+	result = STATUS_OK;
+
+out:
+	free(all);
+	hash_map_free(inodes);
+	return result;
+}
+
+int sk_meminfo_get(int fd, u32 meminfo[SK_MEMINFO_VARS], char **error)
+{
+	socklen_t len = SK_MEMINFO_VARS * sizeof(u32);
+
+	memset(meminfo, 0, len);
+	if (getsockopt(fd, SOL_SOCKET, SO_MEMINFO, meminfo, &len) < 0) {
+		asprintf(error, "getsockopt(SO_MEMINFO): %s",
+			 strerror(errno));
+		return STATUS_ERR;
+	}
+	return STATUS_OK;
+}
+
+char *sk_meminfo_to_string(const u32 meminfo[SK_MEMINFO_VARS])
+{
+	size_t size = 0;
+	char *buf = NULL;
+	FILE *s = open_memstream(&buf, &size);
+	int i;
+
+	for (i = 0; i < SK_MEMINFO_VARS; ++i) {
+		fprintf(s, "%s%s=%u", (i > 0) ? " " : "",
+			sk_meminfo_names[i], meminfo[i]);
+	}
+	fclose(s);
+	return buf;
+}
+
+#endif  /* HAVE_SOCK_DIAG */
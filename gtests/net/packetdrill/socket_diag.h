@@ -0,0 +1,99 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Interface for taking a snapshot of the state of all the TCP sockets
+ * of a test with a single NETLINK_SOCK_DIAG dump, and for reading the
+ * memory footprint of one socket with SO_MEMINFO.
+ */
+
+#ifndef __SOCKET_DIAG_H__
+#define __SOCKET_DIAG_H__
+
+#include "types.h"
+
+#if HAVE_SOCK_DIAG
+
+#include <linux/inet_diag.h>
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include "socket.h"
+#include "tcp.h"
+
+#define SOCK_DIAG_CONG_NAME_LEN	16	/* TCP_CA_NAME_MAX in the kernel */
+
+#ifndef SO_MEMINFO
+#define SO_MEMINFO		55	/* missing from older libc headers */
+#endif
+
+/* The state of one socket of the test, as reported by sock_diag. */
+struct sock_diag_entry {
+	int script_fd;			/* fd of the socket in the script */
+	bool is_socket_under_test;	/* is this state->socket_under_test? */
+
+	u8 state;			/* TCP state (TCPI_*) */
+	u32 rqueue;			/* receive queue, or accept backlog */
+	u32 wqueue;			/* send queue, or max accept backlog */
+
+	bool has_info;
+	struct _tcp_info info;		/* INET_DIAG_INFO */
+
+	bool has_meminfo;
+	u32 meminfo[SK_MEMINFO_VARS];	/* INET_DIAG_SKMEMINFO */
+
+	char cong[SOCK_DIAG_CONG_NAME_LEN];	/* INET_DIAG_CONG */
+
+	bool has_dctcp;
+	struct tcp_dctcp_info dctcp;	/* INET_DIAG_DCTCPINFO */
+
+	bool has_bbr;
+	struct tcp_bbr_info bbr;	/* INET_DIAG_BBRINFO */
+};
+
+/* Dump the TCP sockets with one SOCK_DIAG_BY_FAMILY request per
+ * address family in use on the given NETLINK_SOCK_DIAG socket, and
+ * return in a malloc-allocated array the entries for the open sockets
+ * in the given list. The requests take their sequence numbers from
+ * *seq, which the caller keeps with the socket, so replies to an
+ * earlier dump are told apart. On success, returns STATUS_OK; on error
+ * returns STATUS_ERR and fills in *error.
+ */
+extern int sock_diag_snapshot(int netlink_fd, u32 *seq,
+			      struct socket *sockets,
+			      struct socket *socket_under_test,
+			      struct sock_diag_entry **entries,
+			      int *num_entries, char **error);
+
+/* Names of the SK_MEMINFO_* values, in the order SO_MEMINFO and
+ * INET_DIAG_SKMEMINFO report them; code events call them skmem_foo.
+ */
+extern const char *sk_meminfo_names[SK_MEMINFO_VARS];
+
+/* Read the SO_MEMINFO values of the socket with the given live fd into
+ * meminfo, zeroing any values the kernel does not report. On success,
+ * returns STATUS_OK; on error returns STATUS_ERR and fills in *error.
+ */
+extern int sk_meminfo_get(int fd, u32 meminfo[SK_MEMINFO_VARS],
+			  char **error);
+
+/* Return a malloc-allocated "rmem_alloc=N rcvbuf=N ..." string. */
+extern char *sk_meminfo_to_string(const u32 meminfo[SK_MEMINFO_VARS]);
+
+#endif  /* HAVE_SOCK_DIAG */
+
+#endif /* __SOCKET_DIAG_H__ */
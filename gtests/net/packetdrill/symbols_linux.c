@@ -42,6 +42,7 @@
 
 #include <linux/sockios.h>
 
+#include "socket_diag.h"
 #include "tcp.h"
 
 /* A table of platform-specific string->int mappings. */
@@ -55,6 +56,10 @@ struct int_symbol platform_symbols_table[] = {
 	{ SOL_UDP,                          "SOL_UDP"                         },
 	{ SOL_UDPLITE,                      "SOL_UDPLITE"                     },
 
+#ifdef IPPROTO_MPTCP
+	{ IPPROTO_MPTCP,                    "IPPROTO_MPTCP"                   },
+#endif
+
 	{ SO_ACCEPTCONN,                    "SO_ACCEPTCONN"                   },
 	{ SO_ATTACH_FILTER,                 "SO_ATTACH_FILTER"                },
 	{ SO_BINDTODEVICE,                  "SO_BINDTODEVICE"                 },
@@ -88,6 +93,21 @@ struct int_symbol platform_symbols_table[] = {
 	{ SO_DOMAIN,                        "SO_DOMAIN"                       },
 	{ SO_TYPE,                          "SO_TYPE"                         },
 	{ SO_PROTOCOL,                      "SO_PROTOCOL"                     },
+#ifdef SO_BUSY_POLL
+	{ SO_BUSY_POLL,                     "SO_BUSY_POLL"                    },
+#endif
+#ifdef SO_INCOMING_NAPI_ID
+	{ SO_INCOMING_NAPI_ID,              "SO_INCOMING_NAPI_ID"             },
+#endif
+#ifdef SO_PREFER_BUSY_POLL
+	{ SO_PREFER_BUSY_POLL,              "SO_PREFER_BUSY_POLL"             },
+#endif
+#ifdef SO_BUSY_POLL_BUDGET
+	{ SO_BUSY_POLL_BUDGET,              "SO_BUSY_POLL_BUDGET"             },
+#endif
+#ifdef SO_MEMINFO
+	{ SO_MEMINFO,                       "SO_MEMINFO"                      },
+#endif
 
 	{ IP_TOS,                           "IP_TOS"                          },
 	{ IP_MTU_DISCOVER,                  "IP_MTU_DISCOVER"                 },
@@ -19,21 +19,132 @@
 /*
  * Author: ncardwell@google.com (Neal Cardwell)
  *
- * A module to execute a system(3) shell command and check the result.
+ * A module to execute a shell command and check the result.
  */
 
 #include "system.h"
 
 #include <errno.h>
+#include <pthread.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
+extern char **environ;
+
+/* As in glibc's system(3), the threads running commands at once share
+ * one saved SIGINT and SIGQUIT disposition: the first to start a
+ * command saves and ignores them, and the last to finish restores
+ * them. Otherwise two overlapping commands on --parallel threads could
+ * leave SIGINT ignored for good, or lose our handler for it.
+ */
+static pthread_mutex_t sigaction_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int sigaction_refcount;
+static struct sigaction saved_int, saved_quit;
+
+/* Take sigaction_mutex with all signals blocked, so a signal handler
+ * that runs a cleanup command cannot deadlock on it.
+ */
+static void sigaction_lock(sigset_t *saved_mask)
+{
+	sigset_t all;
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, saved_mask);
+	pthread_mutex_lock(&sigaction_mutex);
+}
+
+static void sigaction_unlock(const sigset_t *saved_mask)
+{
+	pthread_mutex_unlock(&sigaction_mutex);
+	pthread_sigmask(SIG_SETMASK, saved_mask, NULL);
+}
+
+int spawn_system(const char *command)
+{
+	char *argv[] = { "sh", "-c", (char *)command, NULL };
+	struct sigaction ignore;
+	sigset_t block_chld, saved_mask, lock_mask, default_signals;
+	posix_spawnattr_t attr;
+	pid_t pid;
+	int status = -1, result, saved_errno;
+
+	/* As system(3) does, ignore SIGINT and SIGQUIT and block SIGCHLD
+	 * while we wait, and give the shell back the default handling of
+	 * any signals we did not already ignore.
+	 */
+	memset(&ignore, 0, sizeof(ignore));
+	ignore.sa_handler = SIG_IGN;
+	sigemptyset(&ignore.sa_mask);
+	sigaction_lock(&lock_mask);
+	if (sigaction_refcount++ == 0) {
+		sigaction(SIGINT, &ignore, &saved_int);
+		sigaction(SIGQUIT, &ignore, &saved_quit);
+	}
+	sigemptyset(&default_signals);
+	if (saved_int.sa_handler != SIG_IGN)
+		sigaddset(&default_signals, SIGINT);
+	if (saved_quit.sa_handler != SIG_IGN)
+		sigaddset(&default_signals, SIGQUIT);
+	sigaction_unlock(&lock_mask);
+	sigemptyset(&block_chld);
+	sigaddset(&block_chld, SIGCHLD);
+	pthread_sigmask(SIG_BLOCK, &block_chld, &saved_mask);
+
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setsigdefault(&attr, &default_signals);
+	posix_spawnattr_setsigmask(&attr, &saved_mask);
+	posix_spawnattr_setflags(&attr,
+				 POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+
+	result = posix_spawn(&pid, "/bin/sh", NULL, &attr, argv, environ);
+	posix_spawnattr_destroy(&attr);
+	if (result != 0) {
+		errno = result;
+	} else {
+		while (waitpid(pid, &status, 0) < 0) {
+			if (errno != EINTR) {
+				status = -1;
+				break;
+			}
+		}
+	}
+
+	saved_errno = errno;
+	sigaction_lock(&lock_mask);
+	if (--sigaction_refcount == 0) {
+		sigaction(SIGINT, &saved_int, NULL);
+		sigaction(SIGQUIT, &saved_quit, NULL);
+	}
+	sigaction_unlock(&lock_mask);
+	pthread_sigmask(SIG_SETMASK, &saved_mask, NULL);
+	errno = saved_errno;
+	return status;
+}
+
+int create_thread(pthread_t *thread, void *(*start)(void *), void *arg)
+{
+	sigset_t block, saved_mask;
+	int err;
+
+	/* The new thread inherits our signal mask. */
+	sigemptyset(&block);
+	sigaddset(&block, SIGINT);
+	sigaddset(&block, SIGTERM);
+	sigaddset(&block, SIGHUP);
+	sigaddset(&block, SIGALRM);
+	pthread_sigmask(SIG_BLOCK, &block, &saved_mask);
+	err = pthread_create(thread, NULL, start, arg);
+	pthread_sigmask(SIG_SETMASK, &saved_mask, NULL);
+	return err;
+}
+
 int safe_system(const char *command, char **error)
 {
-	int status = system(command);
+	int status = spawn_system(command);
 	if (status == -1) {
 		asprintf(error, "%s", strerror(errno));
 		return STATUS_ERR;
@@ -27,9 +27,27 @@
 
 #include "types.h"
 
-/* Execute the given command with system(3). On success, returns
+#include <pthread.h>
+
+/* Execute the given command with /bin/sh, like system(3), and return
+ * the same wait status or -1 that system(3) would. Rather than fork the
+ * whole process, which has its memory locked and may have large
+ * buffers, we start the shell with posix_spawn(3), which does not copy
+ * our address space, so the cost of a command is small and does not
+ * grow with the size of the process.
+ */
+extern int spawn_system(const char *command);
+
+/* Execute the given command with spawn_system(). On success, returns
  * STATUS_OK. On error returns STATUS_ERR and fills in *error.
  */
 extern int safe_system(const char *command, char **error);
 
+/* Start a thread like pthread_create(3), but with the signals that end
+ * a run blocked, so that only the process's initial thread handles
+ * them. Returns 0 or an error number, as pthread_create(3) does.
+ */
+extern int create_thread(pthread_t *thread, void *(*start)(void *),
+			 void *arg);
+
 #endif /* __SYSTEM_H__ */
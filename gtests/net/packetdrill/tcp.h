@@ -85,7 +85,10 @@
 #define TCPOPT_SACK		5
 #define TCPOPT_TIMESTAMP	8
 #define TCPOLEN_TIMESTAMP	10
+#define TCPOPT_MPTCP		30	/* Multipath TCP (RFC 8684) */
 #define TCPOPT_FASTOPEN		34
+#define TCPOPT_ACCECN0		172	/* AccECN, counters in EE0B order */
+#define TCPOPT_ACCECN1		174	/* AccECN, counters in EE1B order */
 #define TCPOPT_EXP		254	/* Experimental */
 
 /* A portable TCP header definition (Linux and *BSD use different names). */
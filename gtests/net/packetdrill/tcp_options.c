@@ -68,3 +68,20 @@ int num_sack_blocks(u8 opt_len, int *num_blocks, char **error)
 	*num_blocks = num_bytes / sizeof(struct sack_block);
 	return STATUS_OK;
 }
+
+int num_accecn_counters(u8 opt_len, int *num_counters, char **error)
+{
+	if (opt_len < TCPOLEN_ACCECN_BASE) {
+		asprintf(error, "TCP AccECN option too short");
+		return STATUS_ERR;
+	}
+	const int num_bytes = opt_len - TCPOLEN_ACCECN_BASE;
+	if ((num_bytes % TCPOLEN_ACCECN_COUNTER != 0) ||
+	    (num_bytes / TCPOLEN_ACCECN_COUNTER > MAX_ACCECN_COUNTERS)) {
+		asprintf(error, "TCP AccECN option has bad length: %u",
+			 opt_len);
+		return STATUS_ERR;
+	}
+	*num_counters = num_bytes / TCPOLEN_ACCECN_COUNTER;
+	return STATUS_OK;
+}
@@ -56,6 +56,20 @@
 #define MAX_TCP_FAST_OPEN_COOKIE_BYTES				\
 	(MAX_TCP_OPTION_BYTES - TCPOLEN_FASTOPEN_BASE)
 
+/* AccECN option must have: 1-byte kind, 1-byte length, and then
+ * zero to three 24-bit byte counters (see draft-ietf-tcpm-accurate-ecn).
+ */
+#define TCPOLEN_ACCECN_BASE	2	/* smallest legal AccECN option size */
+#define TCPOLEN_ACCECN_COUNTER	3	/* bytes per AccECN counter */
+#define MAX_ACCECN_COUNTERS	3	/* EE0B, ECEB and EE1B */
+
+/* The AccECN byte counters, in the order of the AccECN0 option. */
+enum accecn_counter_t {
+	ACCECN_E0B = 0,		/* bytes received with ECT(0) */
+	ACCECN_CEB = 1,		/* bytes received with CE */
+	ACCECN_E1B = 2,		/* bytes received with ECT(1) */
+};
+
 /* Represents a list of TCP options in their wire format. */
 struct tcp_options {
 	u8 data[MAX_TCP_OPTION_BYTES];	/* The options data, in wire format */
@@ -107,6 +121,21 @@ struct tcp_option {
 			 */
 			u8 cookie[MAX_TCP_FAST_OPEN_COOKIE_BYTES];
 		} fast_open;
+		struct {
+			/* The upper 4 bits of the first byte are the
+			 * MPTCP subtype; the layout of the rest depends
+			 * on the subtype. See mptcp.h for accessors.
+			 */
+			u8 subtype;
+			u8 bytes[MAX_TCP_OPTION_BYTES - 3];
+		} mptcp;
+		struct {
+			/* 24-bit counters in network order; the
+			 * option kind determines their order.
+			 */
+			u8 counters[MAX_ACCECN_COUNTERS *
+				    TCPOLEN_ACCECN_COUNTER];
+		} accecn;
 	} data;
 } __packed;
 
@@ -129,4 +158,38 @@ extern int tcp_options_append(struct tcp_options *options,
  */
 extern int num_sack_blocks(u8 opt_len, int *num_blocks, char **error);
 
+/* Calculate the number of byte counters in an AccECN option of the
+ * given length and store it in *num_counters. Returns STATUS_OK on
+ * success; on failure returns STATUS_ERR and sets error message.
+ */
+extern int num_accecn_counters(u8 opt_len, int *num_counters, char **error);
+
+/* Return the position of the given counter within an AccECN option of
+ * the given kind (TCPOPT_ACCECN0 or TCPOPT_ACCECN1).
+ */
+static inline int accecn_counter_index(u8 kind, enum accecn_counter_t counter)
+{
+	return (kind == TCPOPT_ACCECN1) ? (2 - counter) : counter;
+}
+
+/* Get and set the 24-bit AccECN counter at the given position. */
+static inline u32 accecn_option_counter(const struct tcp_option *option,
+					int index)
+{
+	const u8 *p = option->data.accecn.counters +
+		      index * TCPOLEN_ACCECN_COUNTER;
+
+	return (p[0] << 16) | (p[1] << 8) | p[2];
+}
+
+static inline void set_accecn_option_counter(struct tcp_option *option,
+					     int index, u32 value)
+{
+	u8 *p = option->data.accecn.counters + index * TCPOLEN_ACCECN_COUNTER;
+
+	p[0] = (value >> 16) & 0xff;
+	p[1] = (value >> 8) & 0xff;
+	p[2] = value & 0xff;
+}
+
 #endif /* __TCP_OPTIONS_H__ */
@@ -62,7 +62,10 @@ static int get_expected_tcp_option_length(u8 kind, u8 *expected_length,
 		break;
 
 	case TCPOPT_SACK:
+	case TCPOPT_MPTCP:
 	case TCPOPT_FASTOPEN:
+	case TCPOPT_ACCECN0:
+	case TCPOPT_ACCECN1:
 	case TCPOPT_EXP:
 		*expected_length = 0;	/* variable-length option */
 		break;
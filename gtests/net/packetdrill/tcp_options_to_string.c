@@ -24,6 +24,7 @@
 
 #include "tcp_options_to_string.h"
 
+#include "mptcp.h"
 #include "tcp_options_iterator.h"
 
 static int tcp_fast_open_option_to_string(FILE *s, struct tcp_option *option)
@@ -128,6 +129,23 @@ int tcp_options_to_string(struct packet *packet,
 				ntohl(option->data.time_stamp.ecr));
 			break;
 
+		case TCPOPT_MPTCP:
+			if (mptcp_option_to_string(s, option, error))
+				goto out;
+			break;
+
+		case TCPOPT_ACCECN0:
+		case TCPOPT_ACCECN1:
+			fprintf(s, "accecn%d",
+				option->kind == TCPOPT_ACCECN1 ? 1 : 0);
+			int num_counters = 0;
+			if (num_accecn_counters(option->length,
+						&num_counters, error))
+				goto out;
+			for (i = 0; i < num_counters; ++i)
+				fprintf(s, " %u", accecn_option_counter(option, i));
+			break;
+
 		case TCPOPT_FASTOPEN:
 			if (tcp_fast_open_option_to_string(s, option)) {
 				asprintf(error, "invalid length: %u",
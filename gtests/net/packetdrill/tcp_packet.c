@@ -75,7 +75,7 @@ static inline int is_tcp_flag_set(char flag, const char *flags)
 	return (strchr(flags, flag) != NULL) ? 1 : 0;
 }
 
-/* Find and return the first numeric flag for ACE */
+/* Find and return the first numeric flag for ACE, or -1 if none */
 static inline int tcp_flag_ace_count(const char *flags)
 {
 	const char *s;
@@ -84,7 +84,7 @@ static inline int tcp_flag_ace_count(const char *flags)
 		if (strchr(ace_tcp_flags, *s))
 			return ((int)*s - (int)'0');
 	}
-	return 0;
+	return -1;
 }
 
 
@@ -215,7 +215,7 @@ struct packet *new_tcp_packet(int address_family,
 	packet->tcp->urg = is_tcp_flag_set('U', flags);
 
 	ace = tcp_flag_ace_count(flags);
-	if (ace != 0) {
+	if (ace >= 0) {
 		/*
 		 * After validity check, ACE value doesn't
 		 * coexist with ECN flags.
@@ -80,6 +80,8 @@
 /* TUNSETIFF ifr flags */
 #define IFF_TUN         0x0001
 #define IFF_TAP         0x0002
+#define IFF_NAPI        0x0010
+#define IFF_NAPI_FRAGS  0x0020
 #define IFF_NO_PI       0x1000
 #define IFF_ONE_QUEUE   0x2000
 #define IFF_VNET_HDR    0x4000
@@ -0,0 +1,288 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for capturing outbound packets by reading them from
+ * the tun device on a reader thread.
+ */
+
+#include "tun_capture.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ethernet.h"
+#include "logging.h"
+#include "system.h"
+
+#ifdef linux
+
+/* A packet the reader thread dequeued from the tun device. */
+struct captured_packet {
+	struct captured_packet *next;	/* next packet in the queue */
+	s64 time_usecs;			/* when we dequeued it */
+	int length;			/* bytes of data */
+	u8 data[];			/* the IP datagram */
+};
+
+struct tun_capture {
+	int tun_fd;			/* tun device we read (not owned) */
+	int wake_fds[2];		/* pipe to stop the reader thread */
+	pthread_t thread;		/* the reader thread */
+	s64 realtime_offset_nsecs;	/* CLOCK_REALTIME - CLOCK_MONOTONIC */
+
+	pthread_mutex_t lock;		/* protects the queue */
+	pthread_cond_t ready;		/* signaled when the queue grows */
+	struct captured_packet *head;	/* oldest queued packet, or NULL */
+	struct captured_packet **tail;	/* where to link the next packet */
+
+	/* Timestamp errors against a packet socket, in microseconds. */
+	int num_compared;		/* packets whose error we measured */
+	int num_mismatched;		/* packets whose copies differed */
+	s64 sum_error_usecs;		/* to compute the mean */
+	s64 sum_abs_error_usecs;	/* to compute the mean magnitude */
+	s64 min_error_usecs;
+	s64 max_error_usecs;
+};
+
+/* Return CLOCK_REALTIME minus CLOCK_MONOTONIC. */
+static s64 clock_offset_nsecs(void)
+{
+	struct timespec realtime, monotonic;
+
+	if ((clock_gettime(CLOCK_MONOTONIC, &monotonic) < 0) ||
+	    (clock_gettime(CLOCK_REALTIME, &realtime) < 0))
+		die_perror("clock_gettime");
+	return ((s64)(realtime.tv_sec - monotonic.tv_sec) * 1000000000LL +
+		(realtime.tv_nsec - monotonic.tv_nsec));
+}
+
+/* Return the current CLOCK_MONOTONIC time, on the now_usecs() clock. */
+static s64 capture_time_usecs(const struct tun_capture *capture)
+{
+	struct timespec monotonic;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &monotonic) < 0)
+		die_perror("clock_gettime");
+	return ((s64)monotonic.tv_sec * 1000000000LL + monotonic.tv_nsec +
+		capture->realtime_offset_nsecs) / 1000;
+}
+
+/* Read packets from the tun device and queue them until told to stop. */
+static void *tun_capture_thread(void *arg)
+{
+	struct tun_capture *capture = arg;
+	u8 *buffer = malloc(PACKET_READ_BYTES);
+	struct pollfd fds[2];
+
+	fds[0].fd = capture->tun_fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = capture->wake_fds[0];
+	fds[1].events = POLLIN;
+
+	while (1) {
+		struct captured_packet *captured;
+		int in_bytes;
+		s64 time_usecs;
+
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			die_perror("tun capture poll()");
+		}
+		if (fds[1].revents != 0)
+			break;
+		if (!(fds[0].revents & POLLIN))
+			continue;
+
+		in_bytes = read(capture->tun_fd, buffer, PACKET_READ_BYTES);
+		time_usecs = capture_time_usecs(capture);
+		if (in_bytes < 0) {
+			if ((errno == EINTR) || (errno == EAGAIN))
+				continue;
+			die_perror("tun capture read()");
+		}
+		if (in_bytes == 0)
+			continue;
+
+		captured = malloc(sizeof(*captured) + in_bytes);
+		captured->next = NULL;
+		captured->time_usecs = time_usecs;
+		captured->length = in_bytes;
+		memcpy(captured->data, buffer, in_bytes);
+
+		pthread_mutex_lock(&capture->lock);
+		*capture->tail = captured;
+		capture->tail = &captured->next;
+		pthread_cond_signal(&capture->ready);
+		pthread_mutex_unlock(&capture->lock);
+	}
+
+	free(buffer);
+	return NULL;
+}
+
+struct tun_capture *tun_capture_new(int tun_fd)
+{
+	struct tun_capture *capture = calloc(1, sizeof(struct tun_capture));
+	int err;
+
+	capture->tun_fd = tun_fd;
+	capture->tail = &capture->head;
+	capture->realtime_offset_nsecs = clock_offset_nsecs();
+	if (pipe(capture->wake_fds) < 0)
+		die_perror("pipe");
+	if ((err = pthread_mutex_init(&capture->lock, NULL)) != 0)
+		die_strerror("pthread_mutex_init", err);
+	if ((err = pthread_cond_init(&capture->ready, NULL)) != 0)
+		die_strerror("pthread_cond_init", err);
+	if ((err = create_thread(&capture->thread,
+				 tun_capture_thread, capture)) != 0)
+		die_strerror("pthread_create", err);
+
+	return capture;
+}
+
+void tun_capture_free(struct tun_capture *capture)
+{
+	struct captured_packet *captured, *next;
+	const char stop = 0;
+	int err;
+
+	if (capture == NULL)
+		return;
+
+	if (write(capture->wake_fds[1], &stop, sizeof(stop)) < 0)
+		die_perror("tun capture write()");
+	if ((err = pthread_join(capture->thread, NULL)) != 0)
+		die_strerror("pthread_join", err);
+	close(capture->wake_fds[0]);
+	close(capture->wake_fds[1]);
+
+	for (captured = capture->head; captured != NULL; captured = next) {
+		next = captured->next;
+		free(captured);
+	}
+	pthread_cond_destroy(&capture->ready);
+	pthread_mutex_destroy(&capture->lock);
+
+	memset(capture, 0, sizeof(*capture));	/* paranoia */
+	free(capture);
+}
+
+void tun_capture_receive(struct tun_capture *capture,
+			 struct packet *packet, u16 *ether_type,
+			 int *in_bytes)
+{
+	struct captured_packet *captured;
+
+	pthread_mutex_lock(&capture->lock);
+	while (capture->head == NULL)
+		pthread_cond_wait(&capture->ready, &capture->lock);
+	captured = capture->head;
+	capture->head = captured->next;
+	if (capture->head == NULL)
+		capture->tail = &capture->head;
+	pthread_mutex_unlock(&capture->lock);
+
+	assert(captured->length <= packet->buffer_bytes);
+	memcpy(packet->buffer, captured->data, captured->length);
+	packet->time_usecs = captured->time_usecs;
+	*in_bytes = captured->length;
+	*ether_type = ((captured->data[0] >> 4) == 6) ?
+		ETHERTYPE_IPV6 : ETHERTYPE_IP;
+
+	free(captured);
+}
+
+void tun_capture_compare(struct tun_capture *capture,
+			 const struct packet *tun_packet, int tun_bytes,
+			 const struct packet *psock_packet, int psock_bytes)
+{
+	s64 error_usecs;
+
+	if ((tun_bytes != psock_bytes) ||
+	    (memcmp(tun_packet->buffer, psock_packet->buffer, tun_bytes) != 0)) {
+		++capture->num_mismatched;
+		return;
+	}
+
+	error_usecs = tun_packet->time_usecs - psock_packet->time_usecs;
+	if ((capture->num_compared == 0) ||
+	    (error_usecs < capture->min_error_usecs))
+		capture->min_error_usecs = error_usecs;
+	if ((capture->num_compared == 0) ||
+	    (error_usecs > capture->max_error_usecs))
+		capture->max_error_usecs = error_usecs;
+	capture->sum_error_usecs += error_usecs;
+	capture->sum_abs_error_usecs += llabs(error_usecs);
+	++capture->num_compared;
+}
+
+void tun_capture_report(const struct tun_capture *capture, FILE *out)
+{
+	if (capture->num_compared == 0) {
+		fprintf(out, "tun capture: no packets compared with the "
+			"packet socket (%d mismatched)\n",
+			capture->num_mismatched);
+		return;
+	}
+	fprintf(out, "tun capture: timestamp error vs packet socket over "
+		"%d packets (%d mismatched): mean %lld usecs, "
+		"mean magnitude %lld usecs, min %lld usecs, max %lld usecs\n",
+		capture->num_compared, capture->num_mismatched,
+		capture->sum_error_usecs / capture->num_compared,
+		capture->sum_abs_error_usecs / capture->num_compared,
+		capture->min_error_usecs, capture->max_error_usecs);
+}
+
+#else  /* !linux */
+
+struct tun_capture *tun_capture_new(int tun_fd)
+{
+	die("--tun_capture requires Linux\n");
+	return NULL;	/* not reached */
+}
+
+void tun_capture_free(struct tun_capture *capture)
+{
+}
+
+void tun_capture_receive(struct tun_capture *capture,
+			 struct packet *packet, u16 *ether_type,
+			 int *in_bytes)
+{
+	assert(!"not reached");
+}
+
+void tun_capture_compare(struct tun_capture *capture,
+			 const struct packet *tun_packet, int tun_bytes,
+			 const struct packet *psock_packet, int psock_bytes)
+{
+}
+
+void tun_capture_report(const struct tun_capture *capture, FILE *out)
+{
+}
+
+#endif  /* linux */
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Interface for capturing the packets a local test's kernel sends by
+ * reading them whole out of the tun device, instead of sniffing a copy
+ * of each with a packet socket and then reading a byte of it from the
+ * tun device to free the kernel's copy.
+ *
+ * A reader thread blocks in read() on the tun device and stamps each
+ * packet with CLOCK_MONOTONIC as it dequeues it, shifted by the offset
+ * between CLOCK_MONOTONIC and CLOCK_REALTIME (the clock now_usecs()
+ * uses) when the capture starts. Since the reader empties the tun
+ * queue as fast as the kernel fills it, packets never wait in host
+ * queues the way they do when the interpreter reads them one by one,
+ * so this mode suits throughput-oriented suites better than ones that
+ * test how TCP reacts to queueing in the host.
+ *
+ * To help choose between the two methods, the netdev can also keep a
+ * packet socket open and pass both copies of each packet to
+ * tun_capture_compare(), which measures how far apart the two
+ * timestamps are.
+ */
+
+#ifndef __TUN_CAPTURE_H__
+#define __TUN_CAPTURE_H__
+
+#include "types.h"
+
+#include <stdio.h>
+#include "packet.h"
+
+struct tun_capture;
+
+/* Start a reader thread capturing the packets read from tun_fd. */
+extern struct tun_capture *tun_capture_new(int tun_fd);
+
+/* Stop the reader thread and free the capture and any packets it has
+ * queued. Does not close tun_fd.
+ */
+extern void tun_capture_free(struct tun_capture *capture);
+
+/* Wait for the next packet the reader thread dequeued, and copy it into
+ * the given packet's buffer, with its capture time in time_usecs. Sets
+ * *ether_type from the IP version and *in_bytes to the packet length.
+ */
+extern void tun_capture_receive(struct tun_capture *capture,
+				struct packet *packet, u16 *ether_type,
+				int *in_bytes);
+
+/* Record the timestamp error of a captured packet against the copy of
+ * it that a packet socket sniffed. Copies whose contents differ are
+ * counted as mismatched and not measured.
+ */
+extern void tun_capture_compare(struct tun_capture *capture,
+				const struct packet *tun_packet, int tun_bytes,
+				const struct packet *psock_packet,
+				int psock_bytes);
+
+/* Print a summary of the timestamp errors measured so far. */
+extern void tun_capture_report(const struct tun_capture *capture,
+			       FILE *out);
+
+#endif /* __TUN_CAPTURE_H__ */
@@ -43,6 +43,40 @@ static inline void __put_unaligned_be32(u32 val, u8 *p)
 	*p++ = val;
 }
 
+static inline u16 __get_unaligned_be16(const u8 *p)
+{
+	return (u16)p[0] << 8 |
+	       (u16)p[1];
+}
+
+static inline void __put_unaligned_be16(u16 val, u8 *p)
+{
+	*p++ = val >> 8;
+	*p++ = val;
+}
+
+static inline u64 __get_unaligned_be64(const u8 *p)
+{
+	return (u64)__get_unaligned_be32(p) << 32 |
+	       (u64)__get_unaligned_be32(p + 4);
+}
+
+static inline void __put_unaligned_be64(u64 val, u8 *p)
+{
+	__put_unaligned_be32(val >> 32, p);
+	__put_unaligned_be32(val, p + 4);
+}
+
+static inline u16 get_unaligned_be16(const void *p)
+{
+	return __get_unaligned_be16((const u8 *)p);
+}
+
+static inline void put_unaligned_be16(u16 val, void *p)
+{
+	__put_unaligned_be16(val, p);
+}
+
 static inline u32 get_unaligned_be32(const void *p)
 {
 	return __get_unaligned_be32((const u8 *)p);
@@ -53,4 +87,14 @@ static inline void put_unaligned_be32(u32 val, void *p)
 	__put_unaligned_be32(val, p);
 }
 
+static inline u64 get_unaligned_be64(const void *p)
+{
+	return __get_unaligned_be64((const u8 *)p);
+}
+
+static inline void put_unaligned_be64(u64 val, void *p)
+{
+	__put_unaligned_be64(val, p);
+}
+
 #endif /* __UNALIGNED_H__ */
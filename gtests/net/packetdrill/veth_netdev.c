@@ -0,0 +1,385 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Implementation for a netdev for local tests that uses a veth pair.
+ */
+
+#include "veth_netdev.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef linux
+#include <linux/bpf.h>
+#include <linux/ethtool.h>
+#include <linux/sockios.h>
+#include <sys/syscall.h>
+#endif
+
+#include "ethernet.h"
+#include "link_layer.h"
+#include "logging.h"
+#include "net_utils.h"
+#include "packet.h"
+#include "packet_socket.h"
+#include "system.h"
+#include "tun.h"
+
+#ifdef linux
+
+/* Internal private state for a veth netdev. */
+struct veth_netdev {
+	struct netdev netdev;		/* "inherit" from netdev */
+
+	char *name;		/* the kernel's end of the pair (owned) */
+	char *peer_name;	/* the end we inject and sniff on (owned) */
+	struct ether_addr ether_addr;		/* of the kernel's end */
+	struct ether_addr peer_ether_addr;	/* of our end */
+
+	struct ether_frame_headers ether_headers;	/* for injecting */
+
+	int control_fd;		/* fd for ioctls on the kernel's end */
+	int xdp_link_fd;	/* BPF link holding our XDP program, or -1 */
+	struct packet_socket *psock;	/* for injecting and sniffing (owned) */
+	struct ip_reassembly *reassembly;	/* for sniffed fragments */
+};
+
+struct netdev_ops veth_netdev_ops;
+
+/* "Downcast" an abstract netdev to our veth flavor. */
+static inline struct veth_netdev *to_veth_netdev(struct netdev *netdev)
+{
+	return (struct veth_netdev *)netdev;
+}
+
+/* Run the given shell command, and die if it fails. */
+static void veth_system(const char *command)
+{
+	int result;
+
+	DEBUGP("running: '%s'\n", command);
+	result = spawn_system(command);
+	if ((result == -1) || !WIFEXITED(result) ||
+	    (WEXITSTATUS(result) != 0))
+		die("error executing command '%s'\n", command);
+}
+
+/* Write the given value to a /proc or /sys file about one of our
+ * devices. If the file does not exist and is optional, do nothing.
+ */
+static void veth_write_file(const char *path, const char *value,
+			    bool optional)
+{
+	const int len = strlen(value);
+	int fd;
+
+	DEBUGP("writing '%s' to %s\n", value, path);
+	fd = open(path, O_WRONLY);
+	if ((fd < 0) && optional && (errno == ENOENT))
+		return;
+	if ((fd < 0) || (write(fd, value, len) != len) || (close(fd) < 0))
+		die("error writing '%s' to %s: %s\n",
+		    value, path, strerror(errno));
+}
+
+/* Create the veth pair, bring both ends up, and make sure the kernel
+ * only handles our packets on its own end. The remote prefix is routed
+ * out the kernel's end, so if our end forwarded the packets it sniffs,
+ * they would loop; with forwarding off the stack drops them quietly.
+ */
+static void create_veth_pair(struct config *config,
+			     struct veth_netdev *netdev)
+{
+	char *command = NULL, *path = NULL;
+
+	/* Include our pid so concurrent packetdrill processes can
+	 * share a network namespace.
+	 */
+	asprintf(&netdev->name, "pdveth%d", getpid());
+	asprintf(&netdev->peer_name, "pdpeer%d", getpid());
+	if (strlen(netdev->name) >= IFNAMSIZ)
+		die("interface name %s too long.\n", netdev->name);
+
+	asprintf(&command,
+		 "ip link del %s > /dev/null 2>&1 ; "
+		 "ip link add %s type veth peer name %s",
+		 netdev->name, netdev->name, netdev->peer_name);
+	veth_system(command);
+	free(command);
+
+	if (config->mtu != TUN_DRIVER_DEFAULT_MTU) {
+		asprintf(&command,
+			 "ip link set dev %s mtu %d && "
+			 "ip link set dev %s mtu %d",
+			 netdev->name, config->mtu,
+			 netdev->peer_name, config->mtu);
+		veth_system(command);
+		free(command);
+	}
+
+	asprintf(&path, "/proc/sys/net/ipv4/conf/%s/forwarding",
+		 netdev->peer_name);
+	veth_write_file(path, "0", false);
+	free(path);
+	asprintf(&path, "/proc/sys/net/ipv6/conf/%s/disable_ipv6",
+		 netdev->peer_name);
+	veth_write_file(path, "1", true);
+	free(path);
+
+	asprintf(&command,
+		 "ip link set dev %s up && ip link set dev %s up",
+		 netdev->peer_name, netdev->name);
+	veth_system(command);
+	free(command);
+
+	get_hw_address(netdev->name, &netdev->ether_addr);
+	get_hw_address(netdev->peer_name, &netdev->peer_ether_addr);
+
+	netdev->control_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+	if (netdev->control_fd < 0)
+		die_perror("opening AF_INET, SOCK_DGRAM, IPPROTO_IP socket");
+}
+
+/* Turn GRO on or off on the kernel's end. We always set it, so that a
+ * test does not depend on the default of the kernel under test. On veth,
+ * GRO also turns on NAPI for the receive path.
+ */
+static void set_gro(struct veth_netdev *netdev, bool enable)
+{
+	struct ethtool_value value;
+	struct ifreq ifr;
+
+	memset(&ifr, 0, sizeof(ifr));
+	strcpy(ifr.ifr_name, netdev->name);
+	value.cmd = ETHTOOL_SGRO;
+	value.data = enable ? 1 : 0;
+	ifr.ifr_data = (void *)&value;
+	if (ioctl(netdev->control_fd, SIOCETHTOOL, &ifr) < 0)
+		die_perror("SIOCETHTOOL ETHTOOL_SGRO");
+}
+
+/* Attach an XDP program that passes every packet up the stack to the
+ * kernel's end, so packets go through the veth XDP receive path. The
+ * program stays attached until we close the BPF link.
+ */
+static void attach_xdp_pass(struct veth_netdev *netdev)
+{
+	struct bpf_insn insns[] = {
+		/* r0 = XDP_PASS; return r0 */
+		{ .code = BPF_ALU64 | BPF_MOV | BPF_K, .dst_reg = BPF_REG_0,
+		  .imm = XDP_PASS },
+		{ .code = BPF_JMP | BPF_EXIT },
+	};
+	union bpf_attr attr;
+	int prog_fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_XDP;
+	attr.insns = (unsigned long)insns;
+	attr.insn_cnt = ARRAY_SIZE(insns);
+	attr.license = (unsigned long)"GPL";
+	prog_fd = syscall(__NR_bpf, BPF_PROG_LOAD, &attr, sizeof(attr));
+	if (prog_fd < 0)
+		die_perror("bpf BPF_PROG_LOAD XDP");
+
+	memset(&attr, 0, sizeof(attr));
+	attr.link_create.prog_fd = prog_fd;
+	attr.link_create.target_ifindex = if_nametoindex(netdev->name);
+	attr.link_create.attach_type = BPF_XDP;
+	netdev->xdp_link_fd = syscall(__NR_bpf, BPF_LINK_CREATE,
+				      &attr, sizeof(attr));
+	if (netdev->xdp_link_fd < 0)
+		die_perror("bpf BPF_LINK_CREATE XDP");
+	close(prog_fd);
+}
+
+/* Set up the receive path on the kernel's end as the config asks. */
+static void set_receive_features(struct config *config,
+				 struct veth_netdev *netdev)
+{
+	char *path = NULL;
+
+	set_gro(netdev, config->veth_gro);
+	if (config->veth_xdp)
+		attach_xdp_pass(netdev);
+	if (config->veth_threaded_napi) {
+		/* sysfs shows the devices of the network namespace that
+		 * mounted it, which may not be ours under --parallel.
+		 */
+		asprintf(&path, "/sys/class/net/%s/threaded", netdev->name);
+		if (access(path, F_OK) < 0)
+			die("cannot find %s; is sysfs mounted for this "
+			    "network namespace?\n", path);
+		veth_write_file(path, "1", false);
+		free(path);
+	}
+}
+
+/* Route traffic destined for our remote IP out the kernel's end, and
+ * add a permanent neighbor entry for the gateway so the kernel sends
+ * to our end without resolving the gateway first.
+ */
+static void route_traffic_to_device(struct config *config,
+				    struct veth_netdev *netdev)
+{
+	const u8 *peer = netdev->peer_ether_addr.ether_addr_octet;
+	char *command = NULL;
+
+	asprintf(&command,
+		 "ip route del %s > /dev/null 2>&1 ; "
+		 "ip route add %s dev %s via %s && "
+		 "ip neigh replace %s lladdr "
+		 "%02x:%02x:%02x:%02x:%02x:%02x dev %s nud permanent",
+		 config->live_remote_prefix_string,
+		 config->live_remote_prefix_string,
+		 netdev->name,
+		 config->live_gateway_ip_string,
+		 config->live_gateway_ip_string,
+		 peer[0], peer[1], peer[2], peer[3], peer[4], peer[5],
+		 netdev->name);
+	veth_system(command);
+	free(command);
+}
+
+struct netdev *veth_netdev_new(struct config *config)
+{
+	struct veth_netdev *netdev = calloc(1, sizeof(struct veth_netdev));
+
+	DEBUGP("veth_netdev_new\n");
+
+	netdev->netdev.ops = &veth_netdev_ops;
+	netdev->control_fd = -1;
+	netdev->xdp_link_fd = -1;
+
+	if (is_ip_local(&config->live_remote_ip)) {
+		die("error: live_remote_ip %s is not remote\n",
+		    config->live_remote_ip_string);
+	}
+
+	create_veth_pair(config, netdev);
+	set_receive_features(config, netdev);
+
+	net_setup_dev_address(netdev->name,
+			      &config->live_local_ip,
+			      config->live_prefix_len,
+			      &config->live_gateway_ip);
+	route_traffic_to_device(config, netdev);
+
+	ether_frame_headers_init(&netdev->ether_headers, &netdev->ether_addr,
+				 &netdev->peer_ether_addr);
+
+	netdev->psock = packet_socket_new(netdev->peer_name);
+
+	/* Make sure we only see packets from the kernel under test. */
+	packet_socket_set_filter(netdev->psock,
+				 &netdev->ether_addr,
+				 &config->live_local_ip);
+	netdev->reassembly = netdev_reassembly_new(config);
+
+	return (struct netdev *)netdev;
+}
+
+static void veth_netdev_free(struct netdev *a_netdev)
+{
+	struct veth_netdev *netdev = to_veth_netdev(a_netdev);
+	char *command = NULL;
+
+	DEBUGP("veth_netdev_free\n");
+
+	if (netdev->psock)
+		packet_socket_free(netdev->psock);
+	ip_reassembly_free(netdev->reassembly);
+	if (netdev->xdp_link_fd >= 0)
+		close(netdev->xdp_link_fd);
+	if (netdev->control_fd >= 0)
+		close(netdev->control_fd);
+
+	/* Deleting one end takes down the peer and the route with it. */
+	asprintf(&command, "ip link del %s > /dev/null 2>&1", netdev->name);
+	spawn_system(command);
+	free(command);
+
+	free(netdev->name);
+	free(netdev->peer_name);
+	memset(netdev, 0, sizeof(*netdev));  /* paranoia to help catch bugs */
+	free(netdev);
+}
+
+static int veth_netdev_send(struct netdev *a_netdev,
+			    struct packet *packet)
+{
+	struct veth_netdev *netdev = to_veth_netdev(a_netdev);
+
+	DEBUGP("veth_netdev_send\n");
+
+	return ether_frame_send(netdev->psock, &netdev->ether_headers, packet);
+}
+
+/* Injecting a burst back to back is what lets GRO coalesce it. */
+static int veth_netdev_send_burst(struct netdev *a_netdev,
+				  struct packet **packets, int num_packets)
+{
+	struct veth_netdev *netdev = to_veth_netdev(a_netdev);
+
+	DEBUGP("veth_netdev_send_burst: %d packets\n", num_packets);
+
+	return ether_frame_send_burst(netdev->psock, &netdev->ether_headers,
+				      packets, num_packets);
+}
+
+static int veth_netdev_receive(struct netdev *a_netdev, u8 udp_encaps,
+			       const struct packet_filter *filter,
+			       struct packet **packet, char **error)
+{
+	struct veth_netdev *netdev = to_veth_netdev(a_netdev);
+	int num_packets = 0;
+
+	DEBUGP("veth_netdev_receive\n");
+
+	/* What the kernel sends out its end arrives inbound on ours. */
+	return netdev_receive_loop(netdev->psock, netdev->reassembly,
+				   DIRECTION_INBOUND, udp_encaps, filter,
+				   packet, &num_packets, error);
+}
+
+struct netdev_ops veth_netdev_ops = {
+	.free = veth_netdev_free,
+	.send = veth_netdev_send,
+	.send_burst = veth_netdev_send_burst,
+	.receive = veth_netdev_receive,
+};
+
+#else  /* !linux */
+
+struct netdev *veth_netdev_new(struct config *config)
+{
+	die("--veth requires Linux\n");
+	return NULL;	/* not reached */
+}
+
+#endif  /* linux */
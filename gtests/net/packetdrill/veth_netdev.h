@@ -0,0 +1,41 @@
+/*
+ * Copyright 2013 Google Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+/*
+ * Interface for a netdev for local tests that uses a veth pair instead
+ * of a tun device.
+ *
+ * The kernel under test owns one end of the pair, with the test's local
+ * IP and a route to the remote prefix. We inject and sniff Ethernet
+ * frames through a packet socket on the other end. Packets we inject
+ * thus arrive the way they do from a real NIC, and can go through
+ * NAPI, GRO, and XDP, which the tun write path skips.
+ */
+
+#ifndef __VETH_NETDEV_H__
+#define __VETH_NETDEV_H__
+
+#include "types.h"
+
+#include "config.h"
+#include "netdev.h"
+
+/* Allocate and return a new veth netdev for purely local tests. */
+extern struct netdev *veth_netdev_new(struct config *config);
+
+#endif /* __VETH_NETDEV_H__ */
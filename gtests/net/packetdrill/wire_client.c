@@ -29,11 +29,24 @@
 #include "script.h"
 #include "run.h"
 
+/* With --wire_session the client outlives each script. Wire mode does
+ * not allow --parallel, so a process runs one script at a time and
+ * needs at most one session.
+ */
+static struct wire_client *wire_session;
+
 struct wire_client *wire_client_new(void)
 {
 	return calloc(1, sizeof(struct wire_client));
 }
 
+struct wire_client *wire_client_session(void)
+{
+	if (wire_session == NULL)
+		wire_session = wire_client_new();
+	return wire_session;
+}
+
 void wire_client_free(struct wire_client *wire_client)
 {
 	if (wire_client->wire_conn != NULL)
@@ -139,6 +152,16 @@ static void wire_client_send_hw_address(struct wire_client *wire_client,
 				"error sending WIRE_HARDWARE_ADDR");
 }
 
+/* Tell the server the session goes on with another script. */
+static void wire_client_send_next_script(struct wire_client *wire_client)
+{
+	if (wire_conn_write(wire_client->wire_conn,
+			    WIRE_NEXT_SCRIPT,
+			    NULL, 0))
+		wire_client_die(wire_client,
+				"error sending WIRE_NEXT_SCRIPT");
+}
+
 /* Receive server's message that the server is ready to execute the script. */
 static void wire_client_receive_server_ready(struct wire_client *wire_client)
 {
@@ -248,6 +271,20 @@ int wire_client_init(struct wire_client *wire_client,
 	DEBUGP("wire_client_init\n");
 	assert(config->is_wire_client);
 
+	wire_client->last_event_type = INVALID_EVENT;
+	wire_client->num_events = 0;
+
+	/* In a session we already told the server everything but the
+	 * script itself.
+	 */
+	if (wire_client->wire_conn != NULL) {
+		wire_client_send_next_script(wire_client);
+		wire_client_send_script_path(wire_client, config);
+		wire_client_send_script(wire_client, script);
+		wire_client_receive_server_ready(wire_client);
+		return STATUS_OK;
+	}
+
 	get_hw_address(config->wire_client_device,
 		       &wire_client->client_ether_addr);
 
@@ -269,6 +306,19 @@ int wire_client_init(struct wire_client *wire_client,
 	return STATUS_OK;
 }
 
+void wire_client_session_end(void)
+{
+	if (wire_session == NULL)
+		return;
+
+	if ((wire_session->wire_conn != NULL) &&
+	    wire_conn_write(wire_session->wire_conn,
+			    WIRE_SESSION_END, NULL, 0))
+		wire_client_die(wire_session,
+				"error sending WIRE_SESSION_END");
+	wire_client_free(wire_session);
+	wire_session = NULL;
+}
 
 /* Tell the wire client that the interpreter has moved on to the next
  * event.  Inform the wire server if need be. The client informs the
@@ -48,7 +48,18 @@ struct wire_client {
 /* Allocate a new wire_client. */
 struct wire_client *wire_client_new(void);
 
-/* Initiate remote on-the-wire testing using a real NIC. */
+/* Return the wire_client for --wire_session, which keeps its connection
+ * to the server from one script to the next. Call wire_client_init()
+ * on it for each script.
+ */
+extern struct wire_client *wire_client_session(void);
+
+/* Tell the server the --wire_session is over, and free its wire_client. */
+extern void wire_client_session_end(void);
+
+/* Initiate remote on-the-wire testing using a real NIC, or start the
+ * next script of a session.
+ */
 extern int wire_client_init(struct wire_client *wire_client,
 			    const struct config *config,
 			    const struct script *script,
@@ -31,6 +31,7 @@
 
 #include "logging.h"
 #include "net_utils.h"
+#include "system.h"
 
 struct wire_client_netdev {
 	struct netdev netdev;		/* "inherit" from netdev */
@@ -99,7 +100,7 @@ static void route_traffic_to_wire_server(struct config *config,
 	 * since they can happen if there is no previously existing
 	 * route.
 	 */
-	system(route_command);
+	spawn_system(route_command);
 
 	free(route_command);
 }
@@ -151,6 +152,7 @@ static int wire_client_netdev_send(struct netdev *a_netdev,
 }
 
 static int wire_client_netdev_receive(struct netdev *a_netdev, u8 udp_encaps,
+				      const struct packet_filter *filter,
 				      struct packet **packet, char **error)
 {
 	DEBUGP("wire_client_netdev_receive\n");
@@ -41,6 +41,8 @@ const char *wire_op_to_string(enum wire_op_t op)
 	case WIRE_PACKETS_START:	return "WIRE_PACKETS_START";
 	case WIRE_PACKETS_WARN:		return "WIRE_PACKETS_WARN";
 	case WIRE_PACKETS_DONE:		return "WIRE_PACKETS_DONE";
+	case WIRE_NEXT_SCRIPT:		return "WIRE_NEXT_SCRIPT";
+	case WIRE_SESSION_END:		return "WIRE_SESSION_END";
 	case WIRE_NUM_OPS:		return "WIRE_NUM_OPS";
 	/* We omit the default case so compiler catches missing values. */
 	}
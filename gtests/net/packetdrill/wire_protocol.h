@@ -39,6 +39,8 @@ enum wire_op_t {
 	WIRE_PACKETS_START,	/* "please start handling packet events" */
 	WIRE_PACKETS_WARN,	/* "here's a warning about fishy packets" */
 	WIRE_PACKETS_DONE,	/* "i'm done handling packet events" */
+	WIRE_NEXT_SCRIPT,	/* "same session; here's the next script" */
+	WIRE_SESSION_END,	/* "no more scripts in this session" */
 	WIRE_NUM_OPS,
 };
 
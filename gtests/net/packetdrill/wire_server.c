@@ -31,6 +31,7 @@
 #include "link_layer.h"
 #include "logging.h"
 #include "run.h"
+#include "system.h"
 #include "wire_conn.h"
 #include "wire_server.h"
 #include "wire_server_netdev.h"
@@ -46,6 +47,7 @@ struct wire_server {
 	struct config config;			/* run-time configuration */
 	struct script script;			/* raw and parsed script */
 	struct state *state;			/* interpreter engine state */
+	struct netdev *netdev;			/* kept across a session */
 
 	char *script_path;			/* path of script (on cli!) */
 	char *script_buffer;			/* contents of script */
@@ -72,6 +74,8 @@ static struct wire_server *wire_server_new(struct wire_conn *accepted_conn,
 
 static void wire_server_free(struct wire_server *wire_server)
 {
+	if (wire_server->netdev != NULL)
+		netdev_free(wire_server->netdev);
 	wire_conn_free(wire_server->wire_conn);
 	free(wire_server->script_path);
 	free(wire_server->script_buffer);
@@ -180,6 +184,40 @@ static int wire_server_receive_script(struct wire_server *wire_server)
 }
 
 
+/* Wait for the client to start the next script of a --wire_session,
+ * and receive it, or to end the session.
+ */
+static int wire_server_receive_next_script(struct wire_server *wire_server,
+					   bool *session_end)
+{
+	enum wire_op_t op = WIRE_INVALID;
+	void *buf = NULL;
+	int buf_len = -1;
+
+	if (wire_conn_read(wire_server->wire_conn, &op, &buf, &buf_len))
+		return STATUS_ERR;
+	if (op == WIRE_SESSION_END) {
+		*session_end = true;
+		return STATUS_OK;
+	}
+	if (op != WIRE_NEXT_SCRIPT) {
+		fprintf(stderr,
+			"bad wire client: expected WIRE_NEXT_SCRIPT "
+			"or WIRE_SESSION_END\n");
+		return STATUS_ERR;
+	}
+	*session_end = false;
+
+	free(wire_server->script_path);
+	wire_server->script_path = NULL;
+	free(wire_server->script_buffer);
+	wire_server->script_buffer = NULL;
+
+	if (wire_server_receive_script_path(wire_server))
+		return STATUS_ERR;
+	return wire_server_receive_script(wire_server);
+}
+
 /* Receive the ethernet address to which the server should send packets. */
 static int wire_server_receive_hw_address(struct wire_server *wire_server)
 {
@@ -339,15 +377,25 @@ static int wire_server_next_event(struct wire_server *wire_server,
 	return STATUS_OK;
 }
 
-/* Run the given packet event; send any error or warning back to the client. */
+/* Run the given packet event, along with any other inbound packets due
+ * at the same time; send any error or warning back to the client.
+ */
 static int wire_server_run_packet_event(
 	struct wire_server *wire_server, struct event *event,
 	struct packet *packet, char **error)
 {
 	int result = STATUS_OK;
+	int num_packets = inbound_burst_length(event);
 
-	result = run_packet_event(wire_server->state,
+	if (num_packets > 1) {
+		result = run_inbound_packet_burst(wire_server->state,
+						  num_packets, error);
+		/* The client counts each packet of the burst as an event. */
+		wire_server->num_events += num_packets - 1;
+	} else {
+		result = run_packet_event(wire_server->state,
 					  event, packet, error);
+	}
 	if (result == STATUS_ERR) {
 		/* When we sniff an incorrect packet, don't exit the
 		 * process (we're a daemon), just return the error
@@ -419,6 +467,9 @@ static int wire_server_run_script(struct wire_server *wire_server,
 		case CODE_EVENT:
 			DEBUGP("CODE_EVENT happens on client side...\n");
 			break;
+		case SYSCTL_EVENT:
+			DEBUGP("SYSCTL_EVENT happens on client side...\n");
+			break;
 		case INVALID_EVENT:
 		case NUM_EVENT_TYPES:
 			assert(!"bogus type");
@@ -435,11 +486,59 @@ static int wire_server_run_script(struct wire_server *wire_server,
 	return STATUS_OK;
 }
 
+/* Parse the script we received, set up to run it, and run it. In a
+ * --wire_session the netdev of the previous script is reused when the
+ * addresses allow.
+ */
+static int wire_server_run_next_script(struct wire_server *wire_server,
+				       char **error)
+{
+	if (parse_script_and_set_config(wire_server->argc,
+						wire_server->argv,
+						&wire_server->config,
+						&wire_server->script,
+						wire_server->script_path,
+						wire_server->script_buffer))
+		return STATUS_ERR;
+
+	set_scheduling_priority();
+	lock_memory();
+
+	if ((wire_server->netdev != NULL) &&
+	    wire_server_netdev_reuse(wire_server->netdev,
+				     &wire_server->config)) {
+		netdev_free(wire_server->netdev);
+		wire_server->netdev = NULL;
+	}
+	if (wire_server->netdev == NULL) {
+		wire_server->netdev =
+		  wire_server_netdev_new(&wire_server->config,
+					 wire_server->wire_server_device,
+					 &wire_server->client_ether_addr,
+					 &wire_server->server_ether_addr);
+	}
+
+	wire_server->state = state_new(&wire_server->config,
+					       &wire_server->script,
+					       wire_server->netdev);
+	wire_server->state->keep_netdev = true;
+	wire_server->last_event_type = INVALID_EVENT;
+	wire_server->num_events = 0;
+
+	if (wire_server_send_server_ready(wire_server))
+		return STATUS_ERR;
+
+	if (wire_server_receive_client_starting(wire_server))
+		return STATUS_ERR;
+
+	return wire_server_run_script(wire_server, error);
+}
+
 /* Handle a wire connection from a client. */
 static void *wire_server_thread(void *arg)
 {
 	struct wire_server *wire_server = (struct wire_server *)arg;
-	struct netdev *netdev = NULL;
+	bool session_end = false;
 	char *error = NULL;
 
 	DEBUGP("wire_server_thread\n");
@@ -458,37 +557,25 @@ static void *wire_server_thread(void *arg)
 	if (wire_server_receive_hw_address(wire_server))
 		goto error_done;
 
-	if (parse_script_and_set_config(wire_server->argc,
-						wire_server->argv,
-						&wire_server->config,
-						&wire_server->script,
-						wire_server->script_path,
-						wire_server->script_buffer))
-		goto error_done;
-
-	set_scheduling_priority();
-	lock_memory();
-
-	netdev =
-	  wire_server_netdev_new(&wire_server->config,
-				 wire_server->wire_server_device,
-				 &wire_server->client_ether_addr,
-				 &wire_server->server_ether_addr);
-
-	wire_server->state = state_new(&wire_server->config,
-					       &wire_server->script,
-					       netdev);
+	while (1) {
+		if (wire_server_run_next_script(wire_server, &error))
+			goto error_done;
 
-	if (wire_server_send_server_ready(wire_server))
-		goto error_done;
+		DEBUGP("wire_server_thread: finished test successfully\n");
 
-	if (wire_server_receive_client_starting(wire_server))
-		goto error_done;
+		if (!wire_server->config.wire_session)
+			break;
 
-	if (wire_server_run_script(wire_server, &error))
-		goto error_done;
+		state_free(wire_server->state, 0);
+		wire_server->state = NULL;
+		free_script(&wire_server->script);
 
-	DEBUGP("wire_server_thread: finished test successfully\n");
+		if (wire_server_receive_next_script(wire_server,
+						    &session_end))
+			goto error_done;
+		if (session_end)
+			break;
+	}
 
 error_done:
 	if (error != NULL)
@@ -508,8 +595,8 @@ static void start_wire_server_thread(struct wire_server *wire_server)
 	int err;
 
 	DEBUGP("start_wire_server_thread\n");
-	if ((err = pthread_create(&thread, NULL, wire_server_thread,
-				  wire_server)) != 0) {
+	if ((err = create_thread(&thread, wire_server_thread,
+				 wire_server)) != 0) {
 		die_strerror("pthread_create", err);
 	}
 }
@@ -30,11 +30,13 @@
 #include <sys/uio.h>
 #include <unistd.h>
 
+#include "link_layer.h"
 #include "logging.h"
 #include "net_utils.h"
 #include "packet.h"
 #include "packet_socket.h"
 #include "packet_parser.h"
+#include "system.h"
 
 struct wire_server_netdev {
 	struct netdev netdev;		/* "inherit" from netdev */
@@ -42,10 +44,20 @@ struct wire_server_netdev {
 	char *name;			/* copy of the interface name (owned) */
 	struct config *config;		/* this test's config (not owned) */
 
+	/* The addresses we set up for, which outlive the config of the
+	 * script that set them up in a --wire_session.
+	 */
+	struct ip_address gateway_ip;	/* address we added to our NIC */
+	int prefix_len;			/* prefix length of gateway_ip */
+	struct ip_address client_ip;	/* address our filter matches */
+
 	struct ether_addr client_ether_addr;
 	struct ether_addr server_ether_addr;
 
+	struct ether_frame_headers ether_headers;	/* for injecting */
+
 	struct packet_socket *psock;	/* for sniffing packets (owned) */
+	struct ip_reassembly *reassembly;	/* for sniffed fragments */
 };
 
 struct netdev_ops wire_server_netdev_ops;
@@ -82,7 +94,7 @@ void wire_server_netdev_init(const char *netdev_name)
 	/* For now, intentionally ignoring errors rather than figuring
 	 * out how many Ethernet interfaces there are. TODO: clean up.
 	 */
-	system(command);
+	spawn_system(command);
 	free(command);
 
 	/* Block outgoing IPv6 "destination unreachable" messages, to
@@ -95,7 +107,7 @@ void wire_server_netdev_init(const char *netdev_name)
 		 "ip6tables -F OUTPUT; "
 		 "ip6tables -A OUTPUT -p icmpv6 --icmpv6-type 1 -j DROP");
 	/* For now, intentionally ignoring. TODO: clean up. */
-	system(command);
+	spawn_system(command);
 	free(command);
 #endif
 }
@@ -114,8 +126,14 @@ struct netdev *wire_server_netdev_new(
 	netdev->netdev.ops = &wire_server_netdev_ops;
 	netdev->name = strdup(wire_server_device);
 	netdev->config = config;
+	netdev->gateway_ip = config->live_gateway_ip;
+	netdev->prefix_len = config->live_prefix_len;
+	netdev->client_ip = config->live_local_ip;
 	ether_copy(&netdev->client_ether_addr, client_ether_addr);
 	ether_copy(&netdev->server_ether_addr, server_ether_addr);
+	ether_frame_headers_init(&netdev->ether_headers,
+				 &netdev->client_ether_addr,
+				 &netdev->server_ether_addr);
 
 	/* Add the gateway IP to our NIC, so it answers ARP or
 	 * neighbor discovery requests, so we can receive packets from
@@ -135,6 +153,7 @@ struct netdev *wire_server_netdev_new(
 	packet_socket_set_filter(netdev->psock,
 				 client_ether_addr,
 				 &config->live_local_ip);  /* client IP */
+	netdev->reassembly = netdev_reassembly_new(config);
 
 	return (struct netdev *)netdev;
 }
@@ -146,46 +165,63 @@ static void wire_server_netdev_free(struct netdev *a_netdev)
 	DEBUGP("wire_server_netdev_free\n");
 
 	net_del_dev_address(netdev->name,
-			    &netdev->config->live_gateway_ip,
-			    netdev->config->live_prefix_len);
+			    &netdev->gateway_ip,
+			    netdev->prefix_len);
 
 	free(netdev->name);
 	if (netdev->psock)
 		packet_socket_free(netdev->psock);
+	ip_reassembly_free(netdev->reassembly);
 
 	memset(netdev, 0, sizeof(*netdev));  /* paranoia */
 	free(netdev);
 }
 
+int wire_server_netdev_reuse(struct netdev *a_netdev, struct config *config)
+{
+	struct wire_server_netdev *netdev = to_server_netdev(a_netdev);
+
+	DEBUGP("wire_server_netdev_reuse\n");
+
+	if (!is_equal_ip(&netdev->gateway_ip, &config->live_gateway_ip) ||
+	    (netdev->prefix_len != config->live_prefix_len) ||
+	    !is_equal_ip(&netdev->client_ip, &config->live_local_ip))
+		return STATUS_ERR;
+
+	netdev->config = config;
+
+	/* Start the next script with no stale fragments or packets. */
+	ip_reassembly_free(netdev->reassembly);
+	netdev->reassembly = netdev_reassembly_new(config);
+	packet_socket_drain(netdev->psock);
+
+	return STATUS_OK;
+}
+
 static int wire_server_netdev_send(struct netdev *a_netdev,
 				   struct packet *packet)
 {
 	struct wire_server_netdev *netdev = to_server_netdev(a_netdev);
-	struct ether_header ether;
-	struct iovec ether_frame[2];
-	int address_family = packet_address_family(packet);
-	int result = STATUS_ERR;
 
 	DEBUGP("wire_server_netdev_send\n");
 
-	/* Prepend an ethernet header. */
-	ether_copy(ether.ether_dhost, &netdev->client_ether_addr);
-	ether_copy(ether.ether_shost, &netdev->server_ether_addr);
-	ether.ether_type = htons(ether_type_for_family(address_family));
-	ether_frame[0].iov_base	= &ether;
-	ether_frame[0].iov_len	= sizeof(ether);
+	return ether_frame_send(netdev->psock, &netdev->ether_headers, packet);
+}
 
-	/* Then after that we have the IP datagram. */
-	ether_frame[1].iov_base	= packet_start(packet);
-	ether_frame[1].iov_len	= packet->ip_bytes;
+static int wire_server_netdev_send_burst(struct netdev *a_netdev,
+					 struct packet **packets,
+					 int num_packets)
+{
+	struct wire_server_netdev *netdev = to_server_netdev(a_netdev);
 
-	result = packet_socket_writev(netdev->psock,
-				      ether_frame, ARRAY_SIZE(ether_frame));
+	DEBUGP("wire_server_netdev_send_burst: %d packets\n", num_packets);
 
-	return result;
+	return ether_frame_send_burst(netdev->psock, &netdev->ether_headers,
+				      packets, num_packets);
 }
 
 static int wire_server_netdev_receive(struct netdev *a_netdev, u8 udp_encaps,
+				      const struct packet_filter *filter,
 				      struct packet **packet, char **error)
 {
 	struct wire_server_netdev *netdev = to_server_netdev(a_netdev);
@@ -193,12 +229,14 @@ static int wire_server_netdev_receive(struct netdev *a_netdev, u8 udp_encaps,
 
 	DEBUGP("wire_server_netdev_receive\n");
 
-	return netdev_receive_loop(netdev->psock, DIRECTION_INBOUND, udp_encaps,
+	return netdev_receive_loop(netdev->psock, netdev->reassembly,
+				   DIRECTION_INBOUND, udp_encaps, filter,
 				   packet, &num_packets, error);
 }
 
 struct netdev_ops wire_server_netdev_ops = {
 	.free = wire_server_netdev_free,
 	.send = wire_server_netdev_send,
+	.send_burst = wire_server_netdev_send_burst,
 	.receive = wire_server_netdev_receive,
 };
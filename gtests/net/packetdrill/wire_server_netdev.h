@@ -44,4 +44,13 @@ extern struct netdev *wire_server_netdev_new(
 	const struct ether_addr *client_ether_addr,
 	const struct ether_addr *server_ether_addr);
 
+/* Ready a netdev that ran the previous script of a --wire_session for
+ * the next script, which has the given config. This skips the address
+ * and packet socket setup of wire_server_netdev_new(). Returns
+ * STATUS_ERR if the script needs different addresses, in which case
+ * the caller should free the netdev and make a new one.
+ */
+extern int wire_server_netdev_reuse(struct netdev *netdev,
+				    struct config *config);
+
 #endif /* __WIRE_SERVER_NETDEV_H__ */